@@ -1,13 +1,21 @@
 // Copyright (c) 2015, Tencent Inc.
 // All rights reserved.
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include "thirdparty/glog/logging.h"
 #include "app/qzap/common/sstable/sstable.h"
 #include "app/qzap/common/utility/file_utility.h"
 #include "thirdparty/leveldb/env.h"
+#include "thirdparty/leveldb/filter_policy.h"
+#include "thirdparty/leveldb/iterator.h"
 #include "thirdparty/leveldb/table.h"
 #include "thirdparty/leveldb/table_builder.h"
 #include "thirdparty/libhdfs/hdfs.h"
+#include "thirdparty/snappy/snappy.h"
 
 namespace leveldb {
 
@@ -27,80 +35,212 @@ class MemoryRandomAccessFile : public RandomAccessFile {
     MemoryRandomAccessFile(const char* input, size_t len)
       : array_data_(input), array_data_size_(len) { }
 
+    // Points into the data without copying, Table handles blocks that are
+    // not in |scratch|.
     virtual Status Read(uint64_t offset, size_t n, Slice* result,
                         char* scratch) const {
       Status s;
-      ssize_t r = 0;
+      size_t r = 0;
       if (offset < array_data_size_) {
-        if (n + offset < array_data_size_) {
-          r = n;
-        } else {
-          r = array_data_size_ - offset;
-        }
-        memcpy(scratch, array_data_ + offset, r);
+        r = std::min<uint64_t>(n, array_data_size_ - offset);
       }
-      *result = Slice(scratch, (r < 0) ? 0 : r);
+      *result = Slice(array_data_ + offset, r);
       return s;
     }
 };
+
+class MmapRandomAccessFile : public MemoryRandomAccessFile {
+ private:
+    void* base_;
+    size_t length_;
+
+ public:
+    MmapRandomAccessFile(void* base, size_t length)
+      : MemoryRandomAccessFile(static_cast<const char*>(base), length),
+        base_(base), length_(length) {
+    }
+
+    virtual ~MmapRandomAccessFile() {
+      munmap(base_, length_);
+    }
+};
 }  // namespace leveldb
 
-SSTable::SSTable() {
+namespace {
+
+// See leveldb table/format.h.
+const size_t kFooterSize = 48;
+const size_t kBlockTrailerSize = 5;
+const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
+const char kNoCompression = 0;
+const char kSnappyCompression = 1;
+const uint32_t kCrcMaskDelta = 0xa282ead8ul;
+
+uint32_t DecodeFixed32(const char* ptr) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(ptr);
+  return static_cast<uint32_t>(p[0]) |
+      (static_cast<uint32_t>(p[1]) << 8) |
+      (static_cast<uint32_t>(p[2]) << 16) |
+      (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// CRC-32C (Castagnoli) as in leveldb util/crc32c.cc. Only the small
+// metaindex and filter blocks go through it, so a byte table is enough.
+struct Crc32cTable {
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; ++j) {
+        crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78u : 0);
+      }
+      table[i] = crc;
+    }
+  }
+  uint32_t table[256];
+};
+
+uint32_t Crc32c(const char* data, size_t n) {
+  static const Crc32cTable crc_table;
+  uint32_t crc = 0xffffffffu;
+  for (size_t i = 0; i < n; ++i) {
+    crc = crc_table.table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^
+        (crc >> 8);
+  }
+  return crc ^ 0xffffffffu;
+}
+
+// See leveldb util/crc32c.h.
+uint32_t UnmaskCrc(uint32_t masked_crc) {
+  uint32_t rot = masked_crc - kCrcMaskDelta;
+  return (rot >> 17) | (rot << 15);
+}
+
+bool GetVarint64(leveldb::Slice* input, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift <= 63 && !input->empty(); shift += 7) {
+    uint64_t byte = static_cast<unsigned char>((*input)[0]);
+    input->remove_prefix(1);
+    *value |= (byte & 127) << shift;
+    if ((byte & 128) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads the block at |handle| into |contents|, uncompressing if needed.
+// The trailer checksum covers the block and its type byte.
+bool ReadBlock(leveldb::RandomAccessFile* file, leveldb::Slice handle,
+               bool verify_checksums, std::string* contents) {
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  if (!GetVarint64(&handle, &offset) || !GetVarint64(&handle, &size)) {
+    return false;
+  }
+  std::string scratch(size + kBlockTrailerSize, '\0');
+  leveldb::Slice block;
+  leveldb::Status status =
+      file->Read(offset, scratch.size(), &block, &scratch[0]);
+  if (!status.ok() || block.size() != scratch.size()) {
+    return false;
+  }
+  if (verify_checksums &&
+      UnmaskCrc(DecodeFixed32(block.data() + size + 1)) !=
+      Crc32c(block.data(), size + 1)) {
+    LOG(ERROR) << "SSTable block checksum mismatch, offset: " << offset;
+    return false;
+  }
+  switch (block[size]) {
+    case kNoCompression:
+      contents->assign(block.data(), size);
+      return true;
+    case kSnappyCompression:
+      return snappy::Uncompress(block.data(), size, contents);
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+SSTable::SSTable() : verify_checksums_(false), filter_policy_(NULL) {
 }
 
 SSTable::~SSTable() {
 }
 
 SSTable *SSTable::Open(const std::string &file) {
-  leveldb::RandomAccessFile *random_access_file;
-  leveldb::Status status = leveldb::Env::Default()->NewRandomAccessFile(
-    file, &random_access_file);
-  if (!status.ok()) {
-    LOG(ERROR) << "SSTable::Open " << file << " NewRandomAccessFile fail: "
-      << status.ToString();
+  return Open(file, SSTableOptions());
+}
+
+SSTable *SSTable::Open(const std::string &file,
+                       const SSTableOptions &options) {
+  off_t file_size = GetFileSize(file);
+  if (file_size < 0) {
+    LOG(ERROR) << "SSTable::Open " << file << " GetFileSize fail";
     return NULL;
   }
-  leveldb::Table *table = NULL;
-  leveldb::Options options;
-  status = leveldb::Table::Open(
-      options, random_access_file, GetFileSize(file), &table);
-  if (!status.ok()) {
-    LOG(ERROR) << "Table::Open fail, status: " << status.ToString();
-    delete random_access_file;
-    return NULL;
+  leveldb::RandomAccessFile *random_access_file = NULL;
+  if (options.use_mmap) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+      PLOG(ERROR) << "SSTable::Open " << file << " open fail";
+      return NULL;
+    }
+    void *base = NULL;
+    if (file_size > 0) {
+      base = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED || base == NULL) {
+      PLOG(ERROR) << "SSTable::Open " << file << " mmap fail";
+      return NULL;
+    }
+    random_access_file = new leveldb::MmapRandomAccessFile(base, file_size);
+  } else {
+    leveldb::Status status = leveldb::Env::Default()->NewRandomAccessFile(
+      file, &random_access_file);
+    if (!status.ok()) {
+      LOG(ERROR) << "SSTable::Open " << file << " NewRandomAccessFile fail: "
+        << status.ToString();
+      return NULL;
+    }
   }
-  SSTable *sstable(new SSTable);
-  sstable->table_.reset(table);
-  sstable->random_access_file_.reset(random_access_file);
-  sstable->filename_ = file;
-  return sstable;
+  return OpenTable(random_access_file, file_size, options, file);
 }
 
 SSTable *SSTable::OpenFromString(const std::string &input) {
+  return OpenFromString(input, SSTableOptions());
+}
+
+SSTable *SSTable::OpenFromString(const std::string &input,
+                                 const SSTableOptions &options) {
   leveldb::RandomAccessFile *random_access_file =
       new leveldb::MemoryRandomAccessFile(input);
-  leveldb::Table *table = NULL;
-  leveldb::Options options;
-  leveldb::Status status =
-      leveldb::Table::Open(options, random_access_file, input.size(), &table);
-  if (!status.ok()) {
-    LOG(ERROR) << "Table::Open fail, status: " << status.ToString();
-    delete random_access_file;
-    return NULL;
-  }
-  SSTable *sstable(new SSTable);
-  sstable->table_.reset(table);
-  sstable->random_access_file_.reset(random_access_file);
-  sstable->filename_ = "memory string";
-  return sstable;
+  return OpenTable(random_access_file, input.size(), options, "memory string");
 }
+
 SSTable *SSTable::OpenFromArray(const char *input, size_t len) {
+  return OpenFromArray(input, len, SSTableOptions());
+}
+
+SSTable *SSTable::OpenFromArray(const char *input, size_t len,
+                                const SSTableOptions &options) {
   leveldb::RandomAccessFile *random_access_file =
       new leveldb::MemoryRandomAccessFile(input, len);
+  return OpenTable(random_access_file, len, options, "memory string");
+}
+
+SSTable *SSTable::OpenTable(leveldb::RandomAccessFile *random_access_file,
+                            uint64_t file_size,
+                            const SSTableOptions &options,
+                            const std::string &filename) {
   leveldb::Table *table = NULL;
-  leveldb::Options options;
-  leveldb::Status status =
-      leveldb::Table::Open(options, random_access_file, len, &table);
+  leveldb::Options table_options;
+  table_options.block_cache = options.block_cache;
+  table_options.paranoid_checks = options.verify_checksums;
+  leveldb::Status status = leveldb::Table::Open(
+      table_options, random_access_file, file_size, &table);
   if (!status.ok()) {
     LOG(ERROR) << "Table::Open fail, status: " << status.ToString();
     delete random_access_file;
@@ -109,12 +249,170 @@ SSTable *SSTable::OpenFromArray(const char *input, size_t len) {
   SSTable *sstable(new SSTable);
   sstable->table_.reset(table);
   sstable->random_access_file_.reset(random_access_file);
-  sstable->filename_ = "memory string";
+  sstable->filename_ = filename;
+  sstable->verify_checksums_ = options.verify_checksums;
+  sstable->filter_policy_ = options.filter_policy;
+  if (options.filter_policy != NULL && !sstable->LoadFilter(file_size)) {
+    LOG(WARNING) << "SSTable " << filename << " has no filter "
+      << options.filter_policy->Name();
+    sstable->filter_.clear();
+  }
   return sstable;
 }
 
+bool SSTable::LoadFilter(uint64_t file_size) {
+  if (file_size < kFooterSize) {
+    return false;
+  }
+  std::string scratch(kFooterSize, '\0');
+  leveldb::Slice footer;
+  leveldb::Status status = random_access_file_->Read(
+      file_size - kFooterSize, kFooterSize, &footer, &scratch[0]);
+  if (!status.ok() || footer.size() != kFooterSize) {
+    return false;
+  }
+  const char *magic = footer.data() + kFooterSize - 8;
+  if ((DecodeFixed32(magic) |
+       (static_cast<uint64_t>(DecodeFixed32(magic + 4)) << 32)) !=
+      kTableMagicNumber) {
+    return false;
+  }
+  // The metaindex handle comes first in the footer.
+  std::string metaindex;
+  if (!ReadBlock(random_access_file_.get(), footer, verify_checksums_,
+                 &metaindex) ||
+      metaindex.size() < sizeof(uint32_t)) {
+    return false;
+  }
+  uint64_t num_restarts =
+      DecodeFixed32(metaindex.data() + metaindex.size() - sizeof(uint32_t));
+  if ((num_restarts + 1) * sizeof(uint32_t) > metaindex.size()) {
+    return false;
+  }
+  leveldb::Slice entries(
+      metaindex.data(),
+      metaindex.size() - (num_restarts + 1) * sizeof(uint32_t));
+  std::string filter_name = "filter.";
+  filter_name += filter_policy_->Name();
+  std::string key;
+  while (!entries.empty()) {
+    uint64_t shared = 0;
+    uint64_t non_shared = 0;
+    uint64_t value_size = 0;
+    if (!GetVarint64(&entries, &shared) ||
+        !GetVarint64(&entries, &non_shared) ||
+        !GetVarint64(&entries, &value_size) ||
+        shared > key.size() || non_shared + value_size > entries.size()) {
+      return false;
+    }
+    key.resize(shared);
+    key.append(entries.data(), non_shared);
+    entries.remove_prefix(non_shared);
+    leveldb::Slice handle(entries.data(), value_size);
+    entries.remove_prefix(value_size);
+    if (key == filter_name) {
+      return ReadBlock(random_access_file_.get(), handle, verify_checksums_,
+                       &filter_) &&
+          filter_.size() >= kBlockTrailerSize;
+    }
+  }
+  return false;
+}
+
+// See leveldb table/filter_block.cc.
+bool SSTable::KeyMayMatch(const leveldb::Slice &key) const {
+  if (filter_.empty()) {
+    return true;
+  }
+  const char *data = filter_.data();
+  size_t size = filter_.size();
+  size_t base_lg = static_cast<unsigned char>(data[size - 1]);
+  uint32_t offsets = DecodeFixed32(data + size - 5);
+  if (offsets > size - 5) {
+    return true;
+  }
+  uint64_t num = (size - 5 - offsets) / 4;
+  uint64_t index = table_->ApproximateOffsetOf(key) >> base_lg;
+  if (index >= num) {
+    return true;
+  }
+  uint32_t start = DecodeFixed32(data + offsets + index * 4);
+  uint32_t limit = DecodeFixed32(data + offsets + index * 4 + 4);
+  if (start <= limit && limit <= offsets) {
+    return filter_policy_->KeyMayMatch(
+        key, leveldb::Slice(data + start, limit - start));
+  }
+  return start != limit;
+}
+
+bool SSTable::Get(const StringPiece &key, Iterator *iterator,
+                  StringPiece *value) const {
+  leveldb::Slice target(key.data(), key.size());
+  if (!KeyMayMatch(target)) {
+    return false;
+  }
+  iterator->iterator_->Seek(target);
+  if (!iterator->Valid() || iterator->iterator_->key() != target) {
+    return false;
+  }
+  *value = iterator->value_piece();
+  return true;
+}
+
+bool SSTable::Get(const StringPiece &key, std::string *value) const {
+  scoped_ptr<Iterator> iterator(NewIterator());
+  StringPiece piece;
+  if (iterator.get() == NULL || !Get(key, iterator.get(), &piece)) {
+    return false;
+  }
+  value->assign(piece.data(), piece.size());
+  return true;
+}
+
+namespace {
+
+struct KeyIndexLess {
+  explicit KeyIndexLess(const std::vector<StringPiece> &keys) : keys_(keys) {}
+  bool operator()(size_t a, size_t b) const {
+    return keys_[a] < keys_[b];
+  }
+  const std::vector<StringPiece> &keys_;
+};
+
+}  // namespace
+
+size_t SSTable::MultiGet(const std::vector<StringPiece> &keys,
+                         std::vector<std::string> *values,
+                         std::vector<bool> *found) const {
+  values->assign(keys.size(), std::string());
+  found->assign(keys.size(), false);
+  scoped_ptr<Iterator> iterator(NewIterator());
+  if (iterator.get() == NULL) {
+    return 0;
+  }
+  // Sorted keys seek forward through the table, and the iterator keeps
+  // the current data block while the next key falls in it.
+  std::vector<size_t> order(keys.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), KeyIndexLess(keys));
+  size_t found_num = 0;
+  StringPiece value;
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (Get(keys[order[i]], iterator.get(), &value)) {
+      (*values)[order[i]].assign(value.data(), value.size());
+      (*found)[order[i]] = true;
+      ++found_num;
+    }
+  }
+  return found_num;
+}
+
 SSTable::Iterator *SSTable::NewIterator() const {
-  leveldb::Iterator *it = table_->NewIterator(leveldb::ReadOptions());
+  leveldb::ReadOptions read_options;
+  read_options.verify_checksums = verify_checksums_;
+  leveldb::Iterator *it = table_->NewIterator(read_options);
   if (!it->status().ok()) {
     LOG(ERROR) << "New leveldb iterator fail: " << it->status().ToString();
     delete it;
@@ -164,6 +462,16 @@ std::string SSTable::Iterator::value() const {
   return std::string(iterator_->value().data(), iterator_->value().size());
 }
 
+StringPiece SSTable::Iterator::key_piece() const {
+  leveldb::Slice key = iterator_->key();
+  return StringPiece(key.data(), key.size());
+}
+
+StringPiece SSTable::Iterator::value_piece() const {
+  leveldb::Slice value = iterator_->value();
+  return StringPiece(value.data(), value.size());
+}
+
 std::string SSTable::Iterator::status_string() const {
   return iterator_->status().ToString();
 }
@@ -183,6 +491,11 @@ SSTableBuilder::SSTableBuilder(
 SSTableBuilder::~SSTableBuilder() {
 }
 
+void SSTableBuilder::EnableBloomFilter(int bits_per_key) {
+  filter_policy_.reset(leveldb::NewBloomFilterPolicy(bits_per_key));
+  options_.filter_policy = filter_policy_.get();
+}
+
 
 bool SSTableBuilder::Init(const leveldb::Options &options) {
   if (table_builder_.get() != NULL) {
@@ -2,17 +2,51 @@
 #define APP_QZAP_COMMON_SSTABLE_SSTABLE_H_
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include "app/qzap/common/base/scoped_ptr.h"
+#include "common/base/string/string_piece.h"
+#include "thirdparty/gtest/gtest_prod.h"
 #include "thirdparty/leveldb/options.h"
 namespace leveldb {
+class Cache;
+class FilterPolicy;
 class Table;
 class TableBuilder;
 class RandomAccessFile;
+class Slice;
 class WritableFile;
 class Iterator;
 class Env;
 }
 
+// Options for opening an SSTable.
+struct SSTableOptions {
+  SSTableOptions()
+    : block_cache(NULL),
+      filter_policy(NULL),
+      use_mmap(false),
+      verify_checksums(false) {
+  }
+
+  // Cache for uncompressed blocks, e.g. leveldb::NewLRUCache(capacity).
+  // Can be shared by many tables. Not owned.
+  // Uncompressed blocks of mmapped or in-memory tables are read in place
+  // and never go through the cache.
+  leveldb::Cache* block_cache;
+
+  // Should be the policy the table was built with, e.g.
+  // leveldb::NewBloomFilterPolicy(10). Get() skips keys rejected by the
+  // filter without reading data blocks. Not owned.
+  const leveldb::FilterPolicy* filter_policy;
+
+  // Map the whole file into memory, blocks are read without copying.
+  bool use_mmap;
+
+  // Also verifies the metaindex and filter blocks read for filter_policy.
+  // A corrupted filter is dropped and Get() falls back to data blocks.
+  bool verify_checksums;
+};
+
 // About SSTable:
 //   http://www.quora.com/What-is-an-SSTable-in-Googles-internal-infrastructure.
 class SSTable {
@@ -59,6 +93,12 @@ class SSTable {
       // REQUIRES: !AtEnd() && !AtStart()
       std::string value() const;
 
+      // Same as key() and value() but without copying. The data is valid
+      // only until the next modification of the iterator.
+      // REQUIRES: Valid()
+      StringPiece key_piece() const;
+      StringPiece value_piece() const;
+
       // status in string format.
       std::string status_string() const;
      private:
@@ -69,16 +109,56 @@ class SSTable {
 
     ~SSTable();
     static SSTable *Open(const std::string &file);
+    static SSTable *Open(const std::string &file, const SSTableOptions &options);
     static SSTable *OpenFromString(const std::string &input);
+    static SSTable *OpenFromString(const std::string &input,
+                                   const SSTableOptions &options);
+    // |input| must outlive the table.
     static SSTable *OpenFromArray(const char *input, size_t len);
+    static SSTable *OpenFromArray(const char *input, size_t len,
+                                  const SSTableOptions &options);
     static SSTable *OpenFromHDFSFile(const std::string &file);
     static SSTable* OpenFromFile(const std::string &file);
     Iterator *NewIterator() const;
+
+    // Point lookup through |iterator|, which must come from NewIterator() of
+    // this table. On success |value| points into the block held by the
+    // iterator and is valid until the iterator is moved or destroyed.
+    // Reusing one iterator for nearby keys avoids reloading the block.
+    bool Get(const StringPiece &key, Iterator *iterator,
+             StringPiece *value) const;
+    // Copying version of the lookup above.
+    bool Get(const StringPiece &key, std::string *value) const;
+    // Looks up all |keys| in sorted order, so keys in the same block load
+    // the block only once. (*values)[i] and (*found)[i] are the result of
+    // keys[i]. Returns the number of keys found.
+    size_t MultiGet(const std::vector<StringPiece> &keys,
+                    std::vector<std::string> *values,
+                    std::vector<bool> *found) const;
+
   private:
+    FRIEND_TEST(SSTableTest, TestFilter);
+    FRIEND_TEST(SSTableTest, TestNoFilter);
+    FRIEND_TEST(SSTableTest, TestFilterChecksum);
+
     SSTable();
+    static SSTable *OpenTable(leveldb::RandomAccessFile *random_access_file,
+                              uint64_t file_size,
+                              const SSTableOptions &options,
+                              const std::string &filename);
+    // Reads the filter block of |filter_policy_| through the footer and the
+    // metaindex block. Returns false if the table has no such filter.
+    bool LoadFilter(uint64_t file_size);
+    // Returns false only if the filter proves |key| is not in the table.
+    bool KeyMayMatch(const leveldb::Slice &key) const;
+
     scoped_ptr<leveldb::Table> table_;
     scoped_ptr<leveldb::RandomAccessFile> random_access_file_;
     std::string filename_;
+    bool verify_checksums_;
+    const leveldb::FilterPolicy *filter_policy_;
+    // Filter block contents, empty when there is no filter.
+    std::string filter_;
 };
 
 class SSTableBuilder {
@@ -86,6 +166,10 @@ class SSTableBuilder {
     explicit SSTableBuilder(const std::string &file);
     SSTableBuilder(const std::string &file, const leveldb::Options &options);
     ~SSTableBuilder();
+    // Builds a bloom filter for each data block, read back by an SSTable
+    // opened with leveldb::NewBloomFilterPolicy(bits_per_key).
+    // Must be called before the first Add().
+    void EnableBloomFilter(int bits_per_key);
     bool Add(const std::string &key, const std::string &value);
     bool Build();
     uint64_t NumEntries() const;
@@ -97,5 +181,6 @@ class SSTableBuilder {
     scoped_ptr<leveldb::WritableFile> writable_file_;
     leveldb::Env *env_;
     leveldb::Options options_;
+    scoped_ptr<const leveldb::FilterPolicy> filter_policy_;
 };
 #endif  // APP_QZAP_COMMON_SSTABLE_SSTABLE_H_
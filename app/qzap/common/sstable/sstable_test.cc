@@ -2,8 +2,10 @@
 // Author: jefftang@tencent.com
 // Date: 2013-3-28
 #include <math.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <algorithm>
 #include <vector>
 #include "app/qzap/common/base/string_utility.h"
 #include "app/qzap/common/sstable/sstable.h"
@@ -11,7 +13,39 @@
 #include "thirdparty/gflags/gflags.h"
 #include "thirdparty/glog/logging.h"
 #include "thirdparty/gtest/gtest.h"
+#include "thirdparty/leveldb/cache.h"
 #include "thirdparty/leveldb/env.h"
+#include "thirdparty/leveldb/filter_policy.h"
+#include "thirdparty/leveldb/slice.h"
+
+// In-memory file counting reads, to tell whether a lookup touched a block.
+class CountingRandomAccessFile : public leveldb::RandomAccessFile {
+ public:
+  explicit CountingRandomAccessFile(const std::string &data)
+    : data_(data), reads_(0) {
+  }
+
+  virtual leveldb::Status Read(uint64_t offset, size_t n,
+                               leveldb::Slice *result, char *scratch) const {
+    ++reads_;
+    size_t r = 0;
+    if (offset < data_.size()) {
+      r = std::min<uint64_t>(n, data_.size() - offset);
+    }
+    memcpy(scratch, data_.data() + offset, r);
+    *result = leveldb::Slice(scratch, r);
+    return leveldb::Status();
+  }
+
+  int reads() const {
+    return reads_;
+  }
+
+ private:
+  std::string data_;
+  mutable int reads_;
+};
+
 class SSTableTest : public testing::Test {
  public:
   void SetUp() {
@@ -28,6 +62,22 @@ class SSTableTest : public testing::Test {
     close(fd);
     *filename = local_filename;
   }
+
+  // Keys are key000000, key000002, ..., odd ones are absent.
+  void BuildEvenKeys(int num, bool bloom_filter, std::string *filename) {
+    CreateTempFileName(filename);
+    SSTableBuilder builder(*filename);
+    unlink(filename->c_str());
+    if (bloom_filter) {
+      builder.EnableBloomFilter(10);
+    }
+    for (int i = 0; i < num; ++i) {
+      ASSERT_TRUE(builder.Add(
+        StringPrintf("key%06d", i * 2),
+        StringPrintf("data%d", i)));
+    }
+    ASSERT_TRUE(builder.Build());
+  }
 };
 
 TEST_F(SSTableTest, Test1) {
@@ -207,3 +257,184 @@ TEST_F(SSTableTest, TestSnappyCompress) {
   ASSERT_EQ(it->key(), "");
   ASSERT_EQ(it->value(), "4");
 }
+
+TEST_F(SSTableTest, TestGet) {
+  static const int kTestNum = 1000;
+  std::string filename;
+  CreateTempFileName(&filename);
+  SSTableBuilder builder(filename);
+  unlink(filename.c_str());
+  builder.EnableBloomFilter(10);
+  for (int i = 0; i < kTestNum; ++i) {
+    ASSERT_TRUE(builder.Add(
+      StringPrintf("key%06d", i * 2),
+      StringPrintf("data%d", i)));
+  }
+  ASSERT_TRUE(builder.Build());
+
+  scoped_ptr<leveldb::Cache> block_cache(leveldb::NewLRUCache(1 << 20));
+  scoped_ptr<const leveldb::FilterPolicy> filter_policy(
+      leveldb::NewBloomFilterPolicy(10));
+  std::string input;
+  ASSERT_TRUE(ReadFileToString(filename, &input));
+  for (int type = 0; type < 3; ++type) {
+    SSTableOptions options;
+    options.block_cache = block_cache.get();
+    options.filter_policy = filter_policy.get();
+    options.use_mmap = type == 1;
+    scoped_ptr<SSTable> table(type == 2 ?
+        SSTable::OpenFromArray(input.data(), input.size(), options) :
+        SSTable::Open(filename, options));
+    ASSERT_TRUE(table != NULL);
+
+    scoped_ptr<SSTable::Iterator> it(table->NewIterator());
+    ASSERT_TRUE(it != NULL);
+    StringPiece value;
+    for (int i = 0; i < kTestNum; ++i) {
+      ASSERT_TRUE(table->Get(StringPrintf("key%06d", i * 2), it.get(), &value));
+      ASSERT_EQ(StringPrintf("data%d", i), value.as_string());
+      ASSERT_EQ(StringPrintf("key%06d", i * 2), it->key_piece().as_string());
+      ASSERT_FALSE(table->Get(StringPrintf("key%06d", i * 2 + 1), it.get(), &value));
+    }
+    std::string copied;
+    ASSERT_TRUE(table->Get("key000010", &copied));
+    ASSERT_EQ("data5", copied);
+    ASSERT_FALSE(table->Get("zzz", &copied));
+    ASSERT_FALSE(table->Get("", &copied));
+
+    // Unsorted, duplicated and missing keys.
+    std::vector<StringPiece> keys;
+    keys.push_back("key000100");
+    keys.push_back("key000001");
+    keys.push_back("key000002");
+    keys.push_back("key000100");
+    keys.push_back("zzz");
+    std::vector<std::string> values;
+    std::vector<bool> found;
+    ASSERT_EQ(3u, table->MultiGet(keys, &values, &found));
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_TRUE(found[0]);
+    ASSERT_EQ("data50", values[0]);
+    ASSERT_FALSE(found[1]);
+    ASSERT_TRUE(found[2]);
+    ASSERT_EQ("data1", values[2]);
+    ASSERT_TRUE(found[3]);
+    ASSERT_EQ("data50", values[3]);
+    ASSERT_FALSE(found[4]);
+    ASSERT_EQ("", values[4]);
+  }
+}
+
+TEST_F(SSTableTest, TestFilter) {
+  static const int kTestNum = 1000;
+  std::string filename;
+  BuildEvenKeys(kTestNum, true, &filename);
+  std::string input;
+  ASSERT_TRUE(ReadFileToString(filename, &input));
+
+  scoped_ptr<const leveldb::FilterPolicy> filter_policy(
+      leveldb::NewBloomFilterPolicy(10));
+  SSTableOptions options;
+  options.filter_policy = filter_policy.get();
+  options.verify_checksums = true;
+  CountingRandomAccessFile *file = new CountingRandomAccessFile(input);
+  scoped_ptr<SSTable> table(
+      SSTable::OpenTable(file, input.size(), options, filename));
+  ASSERT_TRUE(table != NULL);
+  ASSERT_FALSE(table->filter_.empty());
+
+  // There is no block cache, so seeking to another block reads the file.
+  scoped_ptr<SSTable::Iterator> it(table->NewIterator());
+  ASSERT_TRUE(it != NULL);
+  StringPiece value;
+  int reads = file->reads();
+  ASSERT_TRUE(table->Get(StringPrintf("key%06d", (kTestNum - 1) * 2),
+                         it.get(), &value));
+  ASSERT_GT(file->reads(), reads);
+
+  int rejected = 0;
+  for (int i = 0; i < kTestNum; ++i) {
+    std::string key = StringPrintf("key%06d", i * 2);
+    ASSERT_TRUE(table->KeyMayMatch(key)) << key;
+    key = StringPrintf("key%06d", i * 2 + 1);
+    if (table->KeyMayMatch(key)) {
+      continue;
+    }
+    ++rejected;
+    reads = file->reads();
+    ASSERT_FALSE(table->Get(key, it.get(), &value));
+    ASSERT_EQ(reads, file->reads()) << key;
+  }
+  // About 1% false positives with 10 bits per key.
+  EXPECT_GT(rejected, kTestNum * 9 / 10);
+}
+
+TEST_F(SSTableTest, TestNoFilter) {
+  static const int kTestNum = 1000;
+  std::string filename;
+  BuildEvenKeys(kTestNum, false, &filename);
+
+  // The policy is set but the table has no filter, every key goes to the
+  // data blocks.
+  scoped_ptr<const leveldb::FilterPolicy> filter_policy(
+      leveldb::NewBloomFilterPolicy(10));
+  SSTableOptions options;
+  options.filter_policy = filter_policy.get();
+  options.verify_checksums = true;
+  scoped_ptr<SSTable> table(SSTable::Open(filename, options));
+  ASSERT_TRUE(table != NULL);
+  EXPECT_TRUE(table->filter_.empty());
+  scoped_ptr<SSTable::Iterator> it(table->NewIterator());
+  ASSERT_TRUE(it != NULL);
+  StringPiece value;
+  for (int i = 0; i < kTestNum; ++i) {
+    std::string key = StringPrintf("key%06d", i * 2 + 1);
+    ASSERT_TRUE(table->KeyMayMatch(key));
+    ASSERT_FALSE(table->Get(key, it.get(), &value)) << key;
+    ASSERT_TRUE(table->Get(StringPrintf("key%06d", i * 2), it.get(), &value));
+    ASSERT_EQ(StringPrintf("data%d", i), value.as_string());
+  }
+}
+
+TEST_F(SSTableTest, TestFilterChecksum) {
+  static const int kTestNum = 100;
+  std::string filename;
+  BuildEvenKeys(kTestNum, true, &filename);
+  std::string input;
+  ASSERT_TRUE(ReadFileToString(filename, &input));
+
+  // The footer starts with the metaindex handle, flip a byte of the
+  // checksum in the metaindex block trailer.
+  ASSERT_GT(input.size(), 48u);
+  const char *p = input.data() + input.size() - 48;
+  uint64_t handle[2] = {0, 0};
+  for (int i = 0; i < 2; ++i) {
+    for (int shift = 0; ; shift += 7, ++p) {
+      handle[i] |= static_cast<uint64_t>(*p & 127) << shift;
+      if ((*p & 128) == 0) {
+        ++p;
+        break;
+      }
+    }
+  }
+  ASSERT_LT(handle[0] + handle[1] + 1, input.size());
+  input[handle[0] + handle[1] + 1] ^= 1;
+
+  scoped_ptr<const leveldb::FilterPolicy> filter_policy(
+      leveldb::NewBloomFilterPolicy(10));
+  SSTableOptions options;
+  options.filter_policy = filter_policy.get();
+  scoped_ptr<SSTable> table(SSTable::OpenFromString(input, options));
+  ASSERT_TRUE(table != NULL);
+  EXPECT_FALSE(table->filter_.empty());
+
+  // The corrupted filter is dropped, lookups still work.
+  options.verify_checksums = true;
+  table.reset(SSTable::OpenFromString(input, options));
+  ASSERT_TRUE(table != NULL);
+  EXPECT_TRUE(table->filter_.empty());
+  std::string value;
+  ASSERT_TRUE(table->Get("key000010", &value));
+  EXPECT_EQ("data5", value);
+  EXPECT_FALSE(table->Get("key000011", &value));
+}
@@ -3,6 +3,7 @@
 // Date: 2012-11-22
 #ifndef PLATFORM_THREAD_COUNT_BLOCKER_H_
 #define PLATFORM_THREAD_COUNT_BLOCKER_H_
+#include <limits>
 #include "app/qzap/common/thread/mutex.h"
 // A BlockingCounter allows a thread to wait for a pre-specified number of
 // actions to occur.
@@ -5,6 +5,7 @@
 #ifndef COMMON_WRITER_WRITER_H_
 #define COMMON_WRITER_WRITER_H_
 
+#include <stdio.h>
 #include <string>
 #include <set>
 #include <vector>
@@ -14,9 +15,10 @@
 #include "thirdparty/glog/logging.h"
 #include "app/qzap/common/base/string_utility.h"
 #include "app/qzap/common/utility/file_utility.h"
+#include "app/qzap/common/sstable/sstable.h"
 #include "common/proto/config.pb.h"
 #include "data_storer/kv/leveldb/proto_kv.h"
-#include "data_storer/sql/mysql_handler.h"
+#include "data_storer/sql/mysql_pool.h"
 
 namespace gdt {
 namespace Writer {
@@ -31,18 +33,105 @@ namespace Writer {
     for (auto it = data.begin(); it != data.end(); it++) {
       os << *it << std::endl;
     }
-    return true;
+    return os;
+  }
+
+  // 写入mysql, 多个连接并行批量写
+  template <class T>
+  bool WriteToMysql(const IOConfig& config,
+                    const std::vector<T>& data) {
+    MysqlPool mysql_pool;
+    if (!mysql_pool.Open(config.mysql_config())) {
+      LOG(ERROR) << "Open mysql failed";
+      return false;
+    }
+    {
+      ScopedMysqlHandler mysql_handler(&mysql_pool);
+      if (!mysql_handler->BuildTable<T>()) {
+        return false;
+      }
+    }
+    return mysql_pool.ParallelInsert(data);
+  }
+  // 写入leveldb, 按batch_size批量写; bulk_load时排序后顺序写入
+  template <class T>
+  bool WriteToLeveldb(const IOConfig& config,
+                      const std::vector<T>& datas) {
+    const LeveldbConfig& leveldb_config = config.leveldb_config();
+    ProtoKV<T, &T::id> proto_kv;
+    proto_kv.set_batch_size(leveldb_config.batch_size());
+    proto_kv.set_sync(leveldb_config.sync());
+    proto_kv.set_write_buffer_size(leveldb_config.write_buffer_size());
+    if (!proto_kv.Open(leveldb_config.db_name())) {
+      LOG(ERROR) << "Open leveldb failed " << leveldb_config.db_name();
+      return false;
+    }
+    LOG(INFO) << "datas:" << datas.size();
+    if (leveldb_config.bulk_load()) {
+      return proto_kv.BulkLoad(datas);
+    }
+    return proto_kv.Insert(datas);
   }
 
-  // 从文件里读取
+  // SSTable文件不能追加, 流式处理的第batch_sequence批(从0开始)写到加后缀.1, .2, ...的文件,
+  // 非流式处理和第0批写到配置的文件名
+  inline std::string GetSSTableFilename(const IOConfig& config, uint64_t batch_sequence) {
+    std::string filename = GetFormatFilename(config.file_pattern(),
+                                             config.seconds_ago());
+    if (batch_sequence == 0) {
+      return filename;
+    }
+    return filename + "." + std::to_string(batch_sequence);
+  }
+
+  // 写一个有序SSTable文件, 已存在的同名文件(上次运行的结果)被覆盖.
+  // key与ProtoKV相同, 同一key保留最后一条
+  template <class T>
+  bool WriteToSSTable(const IOConfig& config,
+                      const std::vector<T>& datas,
+                      uint64_t batch_sequence = 0) {
+    std::vector<const T*> sorted(datas.size());
+    for (size_t i = 0; i < datas.size(); ++i) {
+      sorted[i] = &datas[i];
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const T* a, const T* b) { return a->id() < b->id(); });
+    std::string filename = GetSSTableFilename(config, batch_sequence);
+    if (FileExisting(filename) && remove(filename.c_str()) != 0) {
+      LOG(ERROR) << "Remove old sstable failed " << filename;
+      return false;
+    }
+    SSTableBuilder builder(filename);
+    std::string value;
+    char key[kUint64KeySize];
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      if (i + 1 < sorted.size() && sorted[i + 1]->id() == sorted[i]->id()) {
+        continue;
+      }
+      value.clear();
+      if (!sorted[i]->AppendToString(&value)) {
+        LOG(ERROR) << "SerializeToString Failed " << sorted[i]->id();
+        continue;
+      }
+      EncodeUint64Key(sorted[i]->id(), key);
+      if (!builder.Add(std::string(key, kUint64KeySize), value)) {
+        return false;
+      }
+    }
+    return builder.Build();
+  }
+
+  // 写入存储, batch_sequence为流式处理的批次序号, 只用于SSTable的文件名
   template <class T>
   bool WriteToIO(const IOConfig& config,
-                 const std::vector<T>& data) {
+                 const std::vector<T>& data,
+                 uint64_t batch_sequence = 0) {
     switch (config.store_method()) {
       case LevelDb:
         return WriteToLeveldb(config, data);
         break;
       case SSTable:
+        return WriteToSSTable(config, data, batch_sequence);
         break;
       case File:
         break;
@@ -55,32 +144,6 @@ namespace Writer {
     return true;
   }
 
-  // 从文件里读取
-  template <class T>
-  bool WriteToMysql(const IOConfig& config,
-                    const std::vector<T>& data) {
-    MysqlHandler mysql_handler;
-    mysql_handler.Open(config.mysql_config());
-    mysql_handler.BuildTable<T>();
-    std::for_each(data.begin(), data.end(),
-        std::bind(&MysqlHandler::Insert, mysql_handler, std::placeholders::_1));
-    return true;
-  }
-  // 从文件里读取
-  template <class T>
-  bool WriteToLeveldb(const IOConfig& config,
-                      const std::vector<T>& datas) {
-    ProtoKV<T, &T::id> proto_kv;
-    proto_kv.Open(config.leveldb_config().db_name());
-    LOG(ERROR) << "datas:" << datas.size();
-    uint64_t success = 0;
-    for (auto data : datas) {
-      success += proto_kv.Insert(data);
-    }
-    LOG(ERROR) << "success:" << success;
-    return true;
-  }
-
 
 
 
@@ -10,10 +10,55 @@
 #include "thirdparty/gtest/gtest.h"
 #include "thirdparty/glog/logging.h"
 #include "common/writer/writer.h"
+#include "data_collector/proto/product.pb.h"
 
 
 using std::string;
 
 TEST(Writer, WriteToOrderedLine) {
 
+}
+
+// 读出SSTable中id对应的title
+static std::string GetTitle(const std::string& filename, uint64_t id) {
+  // 类名被config.proto的枚举值SSTable隐藏
+  scoped_ptr<class SSTable> table(SSTable::Open(filename));
+  if (table.get() == NULL) {
+    return "";
+  }
+  char key[gdt::kUint64KeySize];
+  gdt::EncodeUint64Key(id, key);
+  std::string value;
+  Product product;
+  if (!table->Get(StringPiece(key, gdt::kUint64KeySize), &value) ||
+      !product.ParseFromString(value)) {
+    return "";
+  }
+  return product.title();
+}
+
+TEST(Writer, WriteToSSTableTwice) {
+  system("rm -f writer_test.sstable*");
+  IOConfig config;
+  config.set_store_method(SSTable);
+  config.set_file_pattern("writer_test.sstable");
+  std::vector<Product> products(2);
+  products[0].set_id(2);
+  products[0].set_title("first");
+  products[1].set_id(1);
+  products[1].set_title("first");
+  ASSERT_TRUE(gdt::Writer::WriteToIO(config, products));
+  // 重跑时覆盖原文件
+  products[1].set_title("rerun");
+  ASSERT_TRUE(gdt::Writer::WriteToIO(config, products));
+  EXPECT_EQ("rerun", GetTitle("writer_test.sstable", 1));
+  EXPECT_EQ("first", GetTitle("writer_test.sstable", 2));
+  EXPECT_EQ("", GetTitle("writer_test.sstable.1", 2));
+  // 流式处理的后续批次写到加序号的文件
+  products[0].set_title("second");
+  ASSERT_TRUE(gdt::Writer::WriteToIO(config, products, 1));
+  EXPECT_EQ("first", GetTitle("writer_test.sstable", 2));
+  EXPECT_EQ("second", GetTitle("writer_test.sstable.1", 2));
+  EXPECT_EQ("", GetTitle("writer_test.sstable.2", 2));
+  system("rm -f writer_test.sstable*");
 }
\ No newline at end of file
@@ -57,6 +57,32 @@ class BaseFunctor {
     return kSuccess;
   }
 
+  // 能按输入切分并行处理的functor返回本次输入的条数, 返回0时只调用DoWork
+  virtual size_t PartitionSize(const DataMessageType& data_message) {
+    return 0;
+  }
+
+  // 处理第[begin, end)条输入, 输出写入output. 多个分片在不同线程上同时调用,
+  // 只能读data_message和修改其中第[begin, end)条输入
+  virtual FunctorResult DoWorkRange(DataMessageType* data_message, size_t begin, size_t end,
+                                    DataMessageType* output) {
+    return kSuccess;
+  }
+
+  // 所有分片结束后按分片顺序调用, 把分片的输出合并到data_message
+  virtual void MergeRange(DataMessageType* output, DataMessageType* data_message) {
+  }
+
+  // 输入的条数, 计入运行统计. 默认与PartitionSize相同, 不可切分的functor需要时重载
+  virtual size_t InputSize(const DataMessageType& data_message) {
+    return PartitionSize(data_message);
+  }
+
+  // 输出的条数, 执行前后的差计入运行统计
+  virtual size_t OutputSize(const DataMessageType& data_message) {
+    return 0;
+  }
+
  public:
   bool success_init_;
   // 配置
@@ -5,17 +5,27 @@
 #ifndef FRAMEWORK_BASE_PROCESSOR_H_
 #define FRAMEWORK_BASE_PROCESSOR_H_
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include "app/qzap/common/thread/count_blocker.h"
+#include "common/system/concurrency/threadpool.h"
 #include "data_collector/feeder/framework/base_functor.h"
 #include "data_collector/feeder/framework/data_message.h"
+#include "framework/common/run_stat.h"
+#include "framework/common/stream_pipeline.h"
 
 namespace gdt {
 
 template <class ConfigType, class DataMessageType>
 class BaseProcessor {
+ public:
+  typedef std::tr1::shared_ptr<DataMessageType> DataMessagePtr;
+  typedef typename StreamPipeline<DataMessageType>::Emitter Emitter;
+  typedef BaseFunctor<ConfigType, DataMessageType> Functor;
+
  public:
   BaseProcessor() : success_init_(false) {
   }
@@ -41,6 +51,17 @@ class BaseProcessor {
       delete base_functor_list_[i];
     }
     base_functor_list_.clear();
+    functor_stats_.clear();
+  }
+
+  // 可切分的functor按输入切分到thread_num个线程上并行执行, 不大于1时串行执行
+  virtual bool InitThreadPool(int thread_num) {
+    if (thread_num > 1 && !thread_pool_) {
+      // 调用线程也处理一个分片
+      thread_pool_ = ThreadPool::Create(ProcessorName(), thread_num - 1);
+      thread_pool_->Start();
+    }
+    return true;
   }
 
   virtual bool AddFunctor(BaseFunctor<ConfigType, DataMessageType>* base_functor) {
@@ -49,6 +70,8 @@ class BaseProcessor {
       return false;
     }
     base_functor_list_.push_back(base_functor);
+    functor_stats_.push_back(
+        RunStatRegistry::Instance().Get(ProcessorName() + "." + base_functor->Name()));
     return true;
   }
 
@@ -57,6 +80,8 @@ class BaseProcessor {
       LOG(ERROR) << "Not success init\t" << this->ProcessorName();
       return false;
     }
+    // 堆内存只在processor这一级采样, functor不采样
+    ScopedRunStat scoped_stat(RunStatRegistry::Instance().Get(ProcessorName()), false, true);
     if (!BeginWork()) {
       LOG(ERROR) << "Begin work Failed\t" << this->ProcessorName();
       return false;
@@ -69,16 +94,25 @@ class BaseProcessor {
     return true;
   }
 
+  // 流式处理一批输入, 输出通过emit交给下一个processor
+  // 默认整批DoProcess后向后传递, 能把输出切成更小批次的processor重载
+  virtual bool DoStreamProcess(const DataMessagePtr& data_message, const Emitter& emit) {
+    return DoProcess(data_message.get()) && emit(data_message);
+  }
+
+  // 流式处理时同时处理批次的线程数, functor能被多个线程同时调用时才可以大于1
+  virtual int StreamWorkerNum() {
+    return 1;
+  }
+
   virtual std::string ProcessorName() {
     return "BaseProcessor";
   }
 
   virtual bool DoWork(DataMessageType* data_message) {
-                      LOG(ERROR) << "base_functor_list_\t" <<base_functor_list_.size();
-
     for (int j = 0 ; j < base_functor_list_.size(); j++) {
-      LOG(ERROR) << base_functor_list_[j]->Name() << " do work begin";
-      if (base_functor_list_[j]->DoWork(data_message) != kSuccess) {
+      VLOG(1) << base_functor_list_[j]->Name() << " do work begin";
+      if (DoFunctor(j, data_message) != kSuccess) {
         LOG(ERROR) << base_functor_list_[j]->Name() << " do work failed";
       }
     }
@@ -92,12 +126,97 @@ class BaseProcessor {
   virtual void EndWork() {
   }
 
+  // 执行第index个functor, 墙上时间, CPU时间和输入输出条数计入运行统计.
+  // functor每批都执行, 不采样堆内存
+  FunctorResult DoFunctor(size_t index, DataMessageType* data_message) {
+    Functor* functor = base_functor_list_[index];
+    RunStat* stat = index < functor_stats_.size() ? functor_stats_[index] :
+        RunStatRegistry::Instance().Get(ProcessorName() + "." + functor->Name());
+    ScopedRunStat scoped_stat(stat, false);
+    size_t size = functor->PartitionSize(*data_message);
+    size_t input_size = functor->InputSize(*data_message);
+    size_t output_size = functor->OutputSize(*data_message);
+    FunctorResult result = RunFunctor(functor, size, stat, data_message);
+    scoped_stat.set_items_in(input_size);
+    scoped_stat.set_items_out(
+        std::max(functor->OutputSize(*data_message), output_size) - output_size);
+    return result;
+  }
+
  public:
   bool success_init_;
   // 配置
   const ConfigType* config_;
   // functor列表
   std::vector<BaseFunctor<ConfigType, DataMessageType>* > base_functor_list_;
+
+ private:
+  // functor的一个输入分片
+  struct Partition {
+    size_t begin;
+    size_t end;
+    DataMessageType output;
+    FunctorResult result;
+    // 在线程池上执行时的CPU时间
+    uint64_t cpu_us;
+  };
+
+  // 有线程池且functor可切分时, 输入按顺序连续切分并行处理, 再按分片顺序合并输出,
+  // 结果与串行执行相同
+  FunctorResult RunFunctor(Functor* functor, size_t size, RunStat* stat,
+                           DataMessageType* data_message) {
+    if (!thread_pool_ || size < 2) {
+      return functor->DoWork(data_message);
+    }
+    size_t partition_num = std::min(size, static_cast<size_t>(thread_pool_->size() + 1));
+    std::vector<Partition> partitions(partition_num);
+    CountBlocker blocker(partition_num);
+    for (size_t i = 0; i < partition_num; ++i) {
+      partitions[i].begin = size * i / partition_num;
+      partitions[i].end = size * (i + 1) / partition_num;
+      partitions[i].result = kUnKnown;
+      partitions[i].cpu_us = 0;
+    }
+    for (size_t i = 0; i + 1 < partition_num; ++i) {
+      if (!thread_pool_->PushTask(NewCallback(this, &BaseProcessor::DoPoolPartition, functor,
+                                              data_message, &partitions[i], &blocker))) {
+        DoPartition(functor, data_message, &partitions[i], &blocker);
+      }
+    }
+    DoPartition(functor, data_message, &partitions.back(), &blocker);
+    blocker.Wait();
+    FunctorResult result = kSuccess;
+    for (size_t i = 0; i < partition_num; ++i) {
+      if (result == kSuccess) {
+        result = partitions[i].result;
+      }
+      stat->AddCpu(partitions[i].cpu_us);
+      functor->MergeRange(&partitions[i].output, data_message);
+    }
+    return result;
+  }
+
+  void DoPartition(Functor* functor, DataMessageType* data_message, Partition* partition,
+                   CountBlocker* blocker) {
+    partition->result = functor->DoWorkRange(data_message, partition->begin, partition->end,
+                                             &partition->output);
+    blocker->Dec(1);
+  }
+
+  // 在线程池上执行分片, 调用线程的CPU时间已由ScopedRunStat统计
+  void DoPoolPartition(Functor* functor, DataMessageType* data_message, Partition* partition,
+                       CountBlocker* blocker) {
+    uint64_t start_cpu_us = ThreadCpuMicroseconds();
+    partition->result = functor->DoWorkRange(data_message, partition->begin, partition->end,
+                                             &partition->output);
+    partition->cpu_us = ThreadCpuMicroseconds() - start_cpu_us;
+    blocker->Dec(1);
+  }
+
+  // 并行执行functor的线程池, 为空时串行
+  std::tr1::shared_ptr<ThreadPool> thread_pool_;
+  // 与base_functor_list_一一对应的运行统计
+  std::vector<RunStat*> functor_stats_;
 };
 
 typedef BaseProcessor<FeederConfig, DataMessage> FeederBaseProcessor;
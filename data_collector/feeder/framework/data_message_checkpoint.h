@@ -0,0 +1,27 @@
+// Copyright (c) 2015 Tencent Inc.
+// Author: cernwang (cernwang@tencent.com)
+// DataMessage的检查点读写, 只有用状态机执行DataMessage的目标需要,
+// 依赖//framework/proto:framework_pb和//app/qzap/common/recordio:recordio
+
+#ifndef FRAMEWORK_DATA_MESSAGE_CHECKPOINT_H_
+#define FRAMEWORK_DATA_MESSAGE_CHECKPOINT_H_
+
+#include "data_collector/feeder/framework/data_message.h"
+#include "framework/common/checkpoint.h"
+
+namespace gdt {
+
+// 写入/读取检查点
+inline bool WriteDataMessage(const DataMessage& data_message, RecordWriter* writer) {
+  return WriteMessages(data_message.products, writer) &&
+      WriteMessages(data_message.feeder_files, writer);
+}
+
+inline bool ReadDataMessage(RecordReader* reader, DataMessage* data_message) {
+  return ReadMessages(reader, &data_message->products) &&
+      ReadMessages(reader, &data_message->feeder_files);
+}
+
+}  // namespace gdt
+
+#endif  // FRAMEWORK_DATA_MESSAGE_CHECKPOINT_H_
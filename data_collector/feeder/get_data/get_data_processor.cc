@@ -3,19 +3,50 @@
 
 #include "data_collector/feeder/get_data/get_data_processor.h"
 
+#include <algorithm>
 #include "thirdparty/glog/logging.h"
 #include "thirdparty/gflags/gflags.h"
 #include "common/base/shared_ptr.h"
 #include "data_collector/feeder/get_data/index_info_load_functor.h"
 #include "data_collector/feeder/get_data/raw_data_download_functor.h"
 
+DEFINE_int32(feeder_download_batch_size, 1, "流式处理时每批下载的feeder文件数");
+DEFINE_int32(feeder_download_thread_num, 1, "同时下载feeder文件的线程数");
+
 namespace gdt {
 
 bool GetDataProcessor::Init() {
   INIT_FUNCTOR(index_info_load_functor, IndexInfoLoadFunctor);
   INIT_FUNCTOR(raw_data_download_functor, RawDataDownloadFunctor);
+  PASS_OR_RETURN(InitThreadPool(FLAGS_feeder_download_thread_num));
   success_init_ = true;
   return true;
 }
 
+bool GetDataProcessor::DoStreamProcess(const DataMessagePtr& data_message,
+                                       const Emitter& emit) {
+  PASS_OR_RETURN(success_init_);
+  PASS_OR_RETURN(BeginWork());
+  // 第一个functor生成feeder文件列表, 其余functor按批执行
+  if (!base_functor_list_.empty() &&
+      DoFunctor(0, data_message.get()) != kSuccess) {
+    LOG(ERROR) << base_functor_list_[0]->Name() << " do work failed";
+  }
+  const std::vector<FeederFile>& feeder_files = data_message->feeder_files;
+  size_t batch_size = std::max(FLAGS_feeder_download_batch_size, 1);
+  for (size_t begin = 0; begin < feeder_files.size(); begin += batch_size) {
+    size_t end = std::min(begin + batch_size, feeder_files.size());
+    DataMessagePtr batch(new DataMessage());
+    batch->feeder_files.assign(feeder_files.begin() + begin, feeder_files.begin() + end);
+    for (size_t i = 1; i < base_functor_list_.size(); ++i) {
+      if (DoFunctor(i, batch.get()) != kSuccess) {
+        LOG(ERROR) << base_functor_list_[i]->Name() << " do work failed";
+      }
+    }
+    PASS_OR_RETURN(emit(batch));
+  }
+  EndWork();
+  return true;
+}
+
 }  // namespace gdt
@@ -20,6 +20,10 @@ class GetDataProcessor : public FeederBaseProcessor {
 
   virtual bool Init();
 
+  // 先取得所有feeder文件, 再按--feeder_download_batch_size分批下载,
+  // 每下载完一批就交给下游解析
+  virtual bool DoStreamProcess(const DataMessagePtr& data_message, const Emitter& emit);
+
   std::string ProcessorName() {
     return "GetDataProcessor";
   }
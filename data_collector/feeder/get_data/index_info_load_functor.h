@@ -24,6 +24,14 @@ class IndexInfoLoadFunctor: public FeederBaseFunctor {
 
   virtual ~IndexInfoLoadFunctor() {}
 
+  const std::string Name() {
+    return "IndexInfoLoadFunctor";
+  }
+
+  size_t OutputSize(const DataMessage& data_message) {
+    return data_message.feeder_files.size();
+  }
+
   // 从文件里解析商品数据
   virtual FunctorResult DoWork(DataMessage* data_message);
 
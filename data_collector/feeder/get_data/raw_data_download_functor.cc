@@ -16,21 +16,41 @@ bool RawDataDownloadFunctor::Init() {
 }
 
 FunctorResult RawDataDownloadFunctor::DoWork(DataMessage* data_message) {
-  std::for_each(data_message->feeder_files.begin(),
-                data_message->feeder_files.end(),
+  Download(&downloader_, data_message, 0, data_message->feeder_files.size());
+  return kSuccess;
+}
+
+FunctorResult RawDataDownloadFunctor::DoWorkRange(DataMessage* data_message,
+                                                  size_t begin,
+                                                  size_t end,
+                                                  DataMessage* output) {
+  CurlDownloader downloader;
+  if (!downloader.Init()) {
+    return kFailedContinued;
+  }
+  Download(&downloader, data_message, begin, end);
+  downloader.UnInit();
+  return kSuccess;
+}
+
+void RawDataDownloadFunctor::Download(CurlDownloader* downloader,
+                                      DataMessage* data_message,
+                                      size_t begin,
+                                      size_t end) {
+  std::for_each(data_message->feeder_files.begin() + begin,
+                data_message->feeder_files.begin() + end,
                 [=](FeederFile& feeder_file) {
                   if (!NeedDownload(feeder_file)) {
                     feeder_file.set_downloaded(true);
                     return;
                   }
-                  if (!downloader_.DoDownloadFile(feeder_file.url(), feeder_file.filename())) {
+                  if (!downloader->DoDownloadFile(feeder_file.url(), feeder_file.filename())) {
                     feeder_file.set_downloaded(false);
                     remove(feeder_file.filename().c_str());
                   } else {
                     feeder_file.set_downloaded(true);
                   }
                 });
-  return kSuccess;
 }
 
 // TODO(cernwang) 现在是全量更新
@@ -24,10 +24,27 @@ class RawDataDownloadFunctor: public FeederBaseFunctor {
 
   virtual ~RawDataDownloadFunctor() {}
 
+  const std::string Name() {
+    return "RawDataDownloadFunctor";
+  }
+
   // 从文件里解析商品数据
   FunctorResult DoWork(DataMessage* data_message);
 
+  // 按feeder文件切分并行下载
+  size_t PartitionSize(const DataMessage& data_message) {
+    return data_message.feeder_files.size();
+  }
+
+  // curl句柄不能被多个线程共用, 每个分片使用自己的下载器
+  FunctorResult DoWorkRange(DataMessage* data_message, size_t begin, size_t end,
+                            DataMessage* output);
+
  private:
+  // 下载第[begin, end)个文件, 设置下载结果
+  void Download(CurlDownloader* downloader, DataMessage* data_message,
+                size_t begin, size_t end);
+
   // 是否需要进行下载
   bool NeedDownload(const FeederFile& feeder_file);
 
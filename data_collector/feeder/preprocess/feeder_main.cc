@@ -15,6 +15,8 @@
 #include "data_collector/feeder/preprocess/output_data_processor.h"
 
 DEFINE_string(conf, "../conf/feeder.conf", "配制文件路径");
+DEFINE_bool(stream, false, "流式处理, 下载/解析/写出同时进行");
+DEFINE_int32(stream_queue_size, 4, "流式处理时相邻processor之间最多缓存的批次数");
 
 namespace gdt {
 
@@ -36,7 +38,21 @@ int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
   FeederManager feeder_manager;
   PASS_OR_RETURN(feeder_manager.Init());
-  PASS_OR_RETURN(feeder_manager.DoProcess());
+  if (FLAGS_stream) {
+    if (FLAGS_stream_queue_size < 1) {
+      LOG(ERROR) << "stream_queue_size must be at least 1: " << FLAGS_stream_queue_size;
+      return 1;
+    }
+    // bulk_load每次写入后都整理整个库, 不能按批次写
+    const IOConfig& writer_config = ConfigChecker::Instance().Get().product_writer_config();
+    if (writer_config.store_method() == LevelDb && writer_config.leveldb_config().bulk_load()) {
+      LOG(ERROR) << "leveldb bulk_load does not support --stream";
+      return 1;
+    }
+    PASS_OR_RETURN(feeder_manager.DoStreamProcess(FLAGS_stream_queue_size));
+  } else {
+    PASS_OR_RETURN(feeder_manager.DoProcess());
+  }
   feeder_manager.UnInit();
   return 0;
 }
@@ -8,12 +8,20 @@
 #include "common/base/shared_ptr.h"
 #include "data_collector/feeder/preprocess/read_data_functor.h"
 
+DEFINE_int32(feeder_parse_thread_num, 1, "流式处理时解析商品数据的线程数");
+DEFINE_int32(feeder_read_thread_num, 1, "一批feeder文件按文件切分并行解析的线程数");
+
 namespace gdt {
 
 bool ParseDataProcessor::Init() {
   INIT_FUNCTOR(read_data_functor, ReadDataFunctor);
+  PASS_OR_RETURN(InitThreadPool(FLAGS_feeder_read_thread_num));
   success_init_ = true;
   return true;
 }
 
+int ParseDataProcessor::StreamWorkerNum() {
+  return FLAGS_feeder_parse_thread_num;
+}
+
 }  // namespace gdt
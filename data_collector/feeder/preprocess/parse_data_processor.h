@@ -20,6 +20,9 @@ class ParseDataProcessor : public FeederBaseProcessor {
 
   virtual bool Init();
 
+  // 解析只读配置, 可以多个线程同时解析不同的批次
+  virtual int StreamWorkerNum();
+
   std::string ProcessorName() {
     return "ParseDataProcessor";
   }
@@ -20,14 +20,22 @@ bool ReadDataFunctor::Init() {
 }
 
 FunctorResult ReadDataFunctor::DoWork(DataMessage* data_message) {
-  std::for_each(data_message->feeder_files.begin(),
-                data_message->feeder_files.end(),
+  return DoWorkRange(data_message, 0, data_message->feeder_files.size(), data_message);
+}
+
+FunctorResult ReadDataFunctor::DoWorkRange(DataMessage* data_message,
+                                           size_t begin,
+                                           size_t end,
+                                           DataMessage* output) {
+  size_t product_begin = output->products.size();
+  std::for_each(data_message->feeder_files.begin() + begin,
+                data_message->feeder_files.begin() + end,
   	            std::bind(&ReadDataFunctor::GetProductFromFeedFile,
                           this,
                           std::placeholders::_1,
-                          &(data_message->products)));
-  std::for_each(data_message->products.begin(),
-                data_message->products.end(),
+                          &(output->products)));
+  std::for_each(output->products.begin() + product_begin,
+                output->products.end(),
                 [&](Product& product) {
                   product.set_id(rules::ConvertToProductId(product.outer_id(), 
                                                            product.source_id()));
@@ -35,6 +43,11 @@ FunctorResult ReadDataFunctor::DoWork(DataMessage* data_message) {
   return kSuccess;
 }
 
+void ReadDataFunctor::MergeRange(DataMessage* output, DataMessage* data_message) {
+  std::copy(output->products.begin(), output->products.end(),
+            std::back_inserter(data_message->products));
+}
+
 bool ReadDataFunctor::GetProductFromFeedFile(
     const FeederFile& feeder_file,
     std::vector<Product>* whole_products) {
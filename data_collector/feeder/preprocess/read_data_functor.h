@@ -23,9 +23,28 @@ class ReadDataFunctor: public FeederBaseFunctor {
 
   virtual ~ReadDataFunctor() {}
 
+  const std::string Name() {
+    return "ReadDataFunctor";
+  }
+
+  size_t OutputSize(const DataMessage& data_message) {
+    return data_message.products.size();
+  }
+
   // 从文件里解析商品数据
   FunctorResult DoWork(DataMessage* data_message);
 
+  // 按feeder文件切分并行解析
+  size_t PartitionSize(const DataMessage& data_message) {
+    return data_message.feeder_files.size();
+  }
+
+  // 解析第[begin, end)个文件, 商品追加到output
+  FunctorResult DoWorkRange(DataMessage* data_message, size_t begin, size_t end,
+                            DataMessage* output);
+
+  void MergeRange(DataMessage* output, DataMessage* data_message);
+
  private:
   bool GetProductFromFeedFile(
       const FeederFile& feeder_file,
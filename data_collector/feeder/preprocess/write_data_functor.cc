@@ -15,7 +15,8 @@ bool WriteDataFunctor::Init() {
 }
 
 FunctorResult WriteDataFunctor::DoWork(DataMessage* data_message) {
-  if (!Writer::WriteToIO(config_->product_writer_config(), data_message->products)) {
+  if (!Writer::WriteToIO(config_->product_writer_config(), data_message->products,
+                         batch_num_++)) {
     return kFailedNotContinued;
   }
   return kSuccess;
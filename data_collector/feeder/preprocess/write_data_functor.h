@@ -16,16 +16,27 @@ namespace gdt {
 
 class WriteDataFunctor: public FeederBaseFunctor {
  public:
-  WriteDataFunctor() : FeederBaseFunctor() {
+  WriteDataFunctor() : FeederBaseFunctor(), batch_num_(0) {
   }
 
   virtual bool Init();
 
   virtual ~WriteDataFunctor() {}
 
+  const std::string Name() {
+    return "WriteDataFunctor";
+  }
+
   // 从文件里解析商品数据
   FunctorResult DoWork(DataMessage* data_message);
 
+  size_t InputSize(const DataMessage& data_message) {
+    return data_message.products.size();
+  }
+
+ private:
+  // 已写入的批次数, 流式处理时每批写到不同的文件. 输出processor只有一个线程
+  uint64_t batch_num_;
 };
 
 }  // namespace gdt
@@ -5,11 +5,13 @@
 #define CREATIVE_wavelet_COMMON_LEVELDB_H_
 
 
+#include <stdint.h>
 #include <string>
 #include <list>
 #include "thirdparty/glog/logging.h"
 #include "thirdparty/leveldb/db.h"
 #include "thirdparty/leveldb/comparator.h"
+#include "thirdparty/leveldb/write_batch.h"
 #include "app/qzap/common/base/shared_ptr.h"
 #include "app/qzap/common/utility/file_utility.h"
 
@@ -22,15 +24,9 @@ class NaiveComparator : public ::leveldb::Comparator {
   // if a < b: negative result
   // if a > b: positive result
   // else: zero result
+  // 与std::string的比较顺序相同, 直接memcmp不复制
   int Compare(const ::leveldb::Slice& a, const ::leveldb::Slice& b) const {
-    std::string str_a(a.data(), a.size());
-    std::string str_b(b.data(), b.size());
-    if (str_a > str_b) {
-      return 1;
-    } else if (str_a < str_b) {
-      return -1;
-    }
-    return 0;
+    return a.compare(b);
   }
   
   // Ignore the following methods for now:
@@ -42,6 +38,40 @@ class NaiveComparator : public ::leveldb::Comparator {
   void FindShortSuccessor(std::string*) const {}
 };
 
+// uint64的key编码为定长8字节大端序, memcmp的顺序即数值顺序
+static const size_t kUint64KeySize = 8;
+
+inline void EncodeUint64Key(uint64_t key, char* buffer) {
+  for (int i = kUint64KeySize - 1; i >= 0; --i) {
+    buffer[i] = static_cast<char>(key & 0xff);
+    key >>= 8;
+  }
+}
+
+inline uint64_t DecodeUint64Key(const char* buffer) {
+  uint64_t key = 0;
+  for (size_t i = 0; i < kUint64KeySize; ++i) {
+    key = (key << 8) | static_cast<unsigned char>(buffer[i]);
+  }
+  return key;
+}
+
+// 定长大端序key的比较器.
+// 名字与NaiveComparator不同, leveldb打开旧的十进制key的库时会报错而不是查不到数据
+class Uint64KeyComparator : public ::leveldb::Comparator {
+ public:
+  int Compare(const ::leveldb::Slice& a, const ::leveldb::Slice& b) const {
+    return a.compare(b);
+  }
+
+  const char* Name() const {
+    return "gdt.Uint64KeyComparator";
+  }
+
+  void FindShortestSeparator(std::string*, const ::leveldb::Slice&) const {}
+  void FindShortSuccessor(std::string*) const {}
+};
+
 
 template<typename Comp>
 class Table {
@@ -54,6 +84,7 @@ class Table {
 
   explicit Table(const std::string& file = "")
     : db_(NULL), comp_(), file_(file) {
+    options_.create_if_missing = true;
   }
 
   ~Table() {
@@ -68,8 +99,7 @@ class Table {
   bool Open() {
     //  close first if opened
     Close();
-    ::leveldb::Options options;
-    options.create_if_missing = true;
+    ::leveldb::Options options = options_;
     options.comparator = &comp_;
     ::leveldb::Status status = ::leveldb::DB::Open(options, file_, &db_);
     if (status.ok())
@@ -80,6 +110,11 @@ class Table {
   std::string GetFileName() const {
     return file_;
   }
+
+  // Open前修改, 如批量导入时调大write_buffer_size
+  ::leveldb::Options* mutable_options() {
+    return &options_;
+  }
   void Close() {
     if (db_) {
       CheckHandle_(db_);
@@ -111,6 +146,19 @@ class Table {
     }
     return size;
   }
+  // 整个库在磁盘上的近似字节数, O(1), 不含还在memtable中的数据
+  uint64_t ApproximateBytes() const {
+    if (!CheckHandle_(db_)) {
+      return 0;
+    }
+    // 上界取255个0xff, 覆盖实际使用的key
+    std::string limit(255, '\xff');
+    ::leveldb::Range range("", limit);
+    uint64_t size = 0;
+    db_->GetApproximateSizes(&range, 1, &size);
+    return size;
+  }
+
   /**
    * @deprecated
    */
@@ -168,6 +216,41 @@ class Table {
   bool Update(const std::string& key, const std::string& value) {
     return Insert(key, value);
   }
+
+  bool Put(const ::leveldb::Slice& key, const ::leveldb::Slice& value, bool sync) {
+    ::leveldb::WriteOptions options;
+    options.sync = sync;
+    return CheckHandle_(db_) && db_->Put(options, key, value).ok();
+  }
+
+  /**
+   * @brief Apply a batch of updates atomically, with a single WAL write.
+   *
+   * @param batch Updates, left unchanged
+   * @param sync Whether to fsync the WAL before returning
+   *
+   * @return If successful, the return value is @c true, else, it is @c false.
+   */
+  bool Write(::leveldb::WriteBatch* batch, bool sync) {
+    if (!CheckHandle_(db_)) {
+      return false;
+    }
+    ::leveldb::WriteOptions options;
+    options.sync = sync;
+    ::leveldb::Status status = db_->Write(options, batch);
+    if (!status.ok()) {
+      LOG(ERROR) << "Write batch failed " << file_ << " " << status.ToString();
+      return false;
+    }
+    return true;
+  }
+
+  // 全量压缩, 批量导入后整理为有序的层
+  void CompactAll() {
+    if (CheckHandle_(db_)) {
+      db_->CompactRange(NULL, NULL);
+    }
+  }
   /**
    * @brief Insert new data into database or update the existing record.
    *
@@ -181,9 +264,12 @@ class Table {
     return false;
   }
   bool Get(const std::string& key, std::string* value) const {
+    return Get(::leveldb::Slice(key.data(), key.size()), value);
+  }
+
+  bool Get(const ::leveldb::Slice& key, std::string* value) const {
     if (CheckHandle_(db_)) {
-      ::leveldb::Status s = db_->Get(::leveldb::ReadOptions(),
-          ::leveldb::Slice(key.data(), key.size()), value);
+      ::leveldb::Status s = db_->Get(::leveldb::ReadOptions(), key, value);
       if (s.ok()) {
         return true;
       }
@@ -271,6 +357,7 @@ class Table {
   ::leveldb::DB* db_;
   Comp comp_;
   std::string file_;
+  ::leveldb::Options options_;
 };
 
 }  // namespace gdt
@@ -6,6 +6,8 @@
 #define CREATIVE_wavelet_DATABASE_LOCAL_DB_OPERATOR_H_
 
 #include <stdio.h>
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <map>
@@ -17,21 +19,46 @@
 #include "thirdparty/protobuf/text_format.h"
 #include "app/qzap/common/base/string_utility.h"
 #include "app/qzap/common/utility/file_utility.h"
+#include "common/system/concurrency/thread.h"
 #include "data_storer/kv/leveldb/leveldb.h"
 
 namespace gdt {
 
 typedef shared_ptr< ::leveldb::Iterator> CursorType;
 
-// 对本地数据库的操作的类
+// 对本地数据库的操作的类, key编码为定长大端序
 template <class T, ::google::protobuf::uint64 (T::*GetKey)() const>
 class ProtoKV {
  public:
+  // 遍历的回调, 返回false时停止. proto在遍历中复用, 需要保留时自行复制
+  typedef std::function<bool(const T&)> Visitor;
+  // 并行遍历的回调, 第一个参数是段号, 同一段的记录在同一个线程中按key顺序回调
+  typedef std::function<bool(int, const T&)> ShardVisitor;
+
+  ProtoKV() : batch_size_(10000), sync_(false) {
+  }
+
+  // 批量插入时每个WriteBatch的记录数
+  void set_batch_size(size_t batch_size) {
+    batch_size_ = std::max<size_t>(batch_size, 1);
+  }
+
+  // 写入时是否同步WAL
+  void set_sync(bool sync) {
+    sync_ = sync;
+  }
+
+  // 在Open前设置
+  void set_write_buffer_size(size_t write_buffer_size) {
+    database_.mutable_options()->write_buffer_size = write_buffer_size;
+  }
+
   // 插入
   bool Insert(const T& proto) {
     std::string value;
     if (proto.SerializeToString(&value)) {
-      return database_.Insert(ConvertToString((proto.*GetKey)()), value);   
+      char key[kUint64KeySize];
+      return database_.Put(Key((proto.*GetKey)(), key), value, sync_);
     } else {
       return false;
     }
@@ -40,7 +67,8 @@ class ProtoKV {
   // 是否变化
   bool Changed(const T& proto) {
     std::string value;
-    if (!database_.Get(ConvertToString((proto.*GetKey)()), &value)) {
+    char key[kUint64KeySize];
+    if (!database_.Get(Key((proto.*GetKey)(), key), &value)) {
       return false;
     } else {
       std::string origin_value;
@@ -54,7 +82,8 @@ class ProtoKV {
   // 获取
   bool Get(uint64_t key, T* proto) {
     std::string value;
-    if (!database_.Get(ConvertToString(key), &value)) {
+    char buffer[kUint64KeySize];
+    if (!database_.Get(Key(key, buffer), &value)) {
       return false;
     } else {
       if (proto->ParseFromString(value)) {
@@ -68,7 +97,8 @@ class ProtoKV {
   // 是否存在
   bool Existing(uint64_t key) {
     std::string value;
-    return database_.Get(ConvertToString(key), &value);
+    char buffer[kUint64KeySize];
+    return database_.Get(Key(key, buffer), &value);
   }
 
   // 是否存在
@@ -93,52 +123,213 @@ class ProtoKV {
     return true;
   }
 
-  // 载入全量
+  // 载入全量, 需要常驻内存时才用, 否则用Scan
   bool Load(std::vector<T>* protos) {
+    return Scan([protos](const T& proto) {
+      protos->push_back(proto);
+      return true;
+    });
+  }
+
+  // 按key顺序遍历全量, value直接从leveldb::Slice解析, 不复制key和value
+  bool Scan(const Visitor& visitor) {
+    return ScanRange(0, ~static_cast<uint64_t>(0), visitor);
+  }
+
+  // 遍历key在[begin, last]内的记录, 解析失败的记录跳过
+  bool ScanRange(uint64_t begin, uint64_t last, const Visitor& visitor) {
     if (!database_.IsOpened()) {
       return false;
     }
-    CursorType cursor(database_.Begin());
+    char buffer[kUint64KeySize];
+    EncodeUint64Key(begin, buffer);
+    CursorType cursor(database_.Begin(std::string(buffer, kUint64KeySize)));
     if (!cursor) {
       return false;
     }
-    while (cursor->Valid()) {
-      std::string key, value;
-      if (database_.Fetch(&cursor, &key, &value)) {
-        T proto;
-        if (proto.ParseFromString(value)) {
-          (*protos).push_back(proto);
-        } else {
-          LOG(ERROR) << "ParseFromString Failed ";
-        }
+    T proto;
+    for (; cursor->Valid(); cursor->Next()) {
+      ::leveldb::Slice key = cursor->key();
+      if (key.size() != kUint64KeySize) {
+        LOG(ERROR) << "Bad key size " << key.size();
+        continue;
       }
-      database_.IterNext(&cursor);
-      if (!cursor) {
+      if (DecodeUint64Key(key.data()) > last) {
+        break;
+      }
+      ::leveldb::Slice value = cursor->value();
+      if (!proto.ParseFromArray(value.data(), value.size())) {
+        LOG(ERROR) << "ParseFromArray Failed " << DecodeUint64Key(key.data());
+        continue;
+      }
+      if (!visitor(proto)) {
         break;
       }
     }
-    return true;
+    return cursor->status().ok();
   }
 
-  // 插入全量
+  // 按首尾key把key空间等分为thread_num段, 每段一个线程遍历, 各线程有自己的leveldb迭代器.
+  // key分布不均匀时各段的记录数不同
+  bool ParallelScan(int thread_num, const ShardVisitor& visitor) {
+    if (!database_.IsOpened()) {
+      return false;
+    }
+    CursorType first_cursor(database_.Begin());
+    CursorType last_cursor(database_.RBegin());
+    if (!first_cursor || !last_cursor) {
+      return false;
+    }
+    // 跳过长度不对的key, 与ScanRange一致
+    while (first_cursor->Valid() && first_cursor->key().size() != kUint64KeySize) {
+      LOG(ERROR) << "Bad key size " << first_cursor->key().size();
+      first_cursor->Next();
+    }
+    while (last_cursor->Valid() && last_cursor->key().size() != kUint64KeySize) {
+      last_cursor->Prev();
+    }
+    if (!first_cursor->Valid() || !last_cursor->Valid()) {
+      return first_cursor->status().ok() && last_cursor->status().ok();
+    }
+    uint64_t first = DecodeUint64Key(first_cursor->key().data());
+    uint64_t last = DecodeUint64Key(last_cursor->key().data());
+    uint64_t span = last - first;
+    if (thread_num < 1) {
+      thread_num = 1;
+    }
+    if (span < static_cast<uint64_t>(thread_num - 1)) {
+      thread_num = static_cast<int>(span + 1);
+    }
+    // 第i段从first + i * step + min(i, remainder)开始
+    uint64_t step = span / thread_num;
+    uint64_t remainder = span % thread_num;
+    std::vector<uint64_t> begins(thread_num);
+    for (int i = 0; i < thread_num; ++i) {
+      begins[i] = first + step * i + std::min<uint64_t>(i, remainder);
+    }
+    std::vector<char> results(thread_num, false);
+    std::vector<shared_ptr<Thread> > threads;
+    for (int i = 0; i < thread_num; ++i) {
+      uint64_t shard_last = i + 1 < thread_num ? begins[i + 1] - 1 : last;
+      threads.push_back(shared_ptr<Thread>(new Thread(
+          "ProtoKVScan", gdt::NewCallback(this, &ProtoKV::ScanShard, i, begins[i], shard_last,
+                                          &visitor, &results[i]))));
+      threads.back()->Start();
+    }
+    bool succeed = true;
+    for (int i = 0; i < thread_num; ++i) {
+      threads[i]->Join();
+      succeed = succeed && results[i];
+    }
+    return succeed;
+  }
+
+  // 近似记录数, O(1): 磁盘字节数除以开头若干条记录的平均大小.
+  // 不含memtable中的数据(刚写入的数据需先CompactAll), 压缩率会影响估计值
+  uint64_t ApproximateSize() {
+    uint64_t bytes = database_.ApproximateBytes();
+    CursorType cursor(database_.Begin());
+    if (bytes == 0 || !cursor) {
+      return 0;
+    }
+    uint64_t sample_bytes = 0;
+    uint64_t sample_num = 0;
+    for (; cursor->Valid() && sample_num < kSampleNum; cursor->Next()) {
+      sample_bytes += cursor->key().size() + cursor->value().size();
+      ++sample_num;
+    }
+    return sample_bytes == 0 ? 0 : bytes * sample_num / sample_bytes;
+  }
+
+  // 插入全量, 每batch_size条一个WriteBatch
   bool Insert(const std::vector<T>& protos) {
     if (!database_.IsOpened()) {
       return false;
     }
-    for (typename std::vector<T>::const_iterator iter = protos.begin();
-        iter != protos.end(); iter++) {
-      Insert(*iter);
+    std::vector<const T*> batch(protos.size());
+    for (size_t i = 0; i < protos.size(); ++i) {
+      batch[i] = &protos[i];
     }
-    return true;    
+    return WriteBatches(batch);
+  }
+
+  // 离线批量导入: 按key排序后顺序写入, 再全量压缩.
+  // 有序写入时每次memtable落盘的文件互不重叠, 压缩基本只是移动文件.
+  // 配合set_write_buffer_size调大memtable, 同一key多次出现时保留最后一条
+  bool BulkLoad(const std::vector<T>& protos) {
+    if (!database_.IsOpened()) {
+      return false;
+    }
+    std::vector<const T*> sorted(protos.size());
+    for (size_t i = 0; i < protos.size(); ++i) {
+      sorted[i] = &protos[i];
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), KeyLess);
+    if (!WriteBatches(sorted)) {
+      return false;
+    }
+    database_.CompactAll();
+    return true;
   }
 
+  // 把memtable落盘并全量压缩
+  void CompactAll() {
+    database_.CompactAll();
+  }
+
+  // 精确记录数, 遍历全库
   uint64_t Size() {
     return database_.Size();
   }
 
  private:
+  // 估计记录数时抽样的记录数
+  static const uint64_t kSampleNum = 1000;
+
+  void ScanShard(int shard, uint64_t begin, uint64_t last, const ShardVisitor* visitor,
+                 char* result) {
+    *result = ScanRange(begin, last, [shard, visitor](const T& proto) {
+      return (*visitor)(shard, proto);
+    });
+  }
+
+  static ::leveldb::Slice Key(uint64_t key, char* buffer) {
+    EncodeUint64Key(key, buffer);
+    return ::leveldb::Slice(buffer, kUint64KeySize);
+  }
+
+  static bool KeyLess(const T* a, const T* b) {
+    return (a->*GetKey)() < (b->*GetKey)();
+  }
+
+  // WriteBatch和序列化的缓冲区在批次间复用
+  bool WriteBatches(const std::vector<const T*>& protos) {
+    ::leveldb::WriteBatch batch;
+    std::string value;
+    char key[kUint64KeySize];
+    size_t batch_num = 0;
+    for (size_t i = 0; i < protos.size(); ++i) {
+      value.clear();
+      if (!protos[i]->AppendToString(&value)) {
+        LOG(ERROR) << "SerializeToString Failed " << (protos[i]->*GetKey)();
+        continue;
+      }
+      batch.Put(Key((protos[i]->*GetKey)(), key), value);
+      if (++batch_num >= batch_size_) {
+        if (!database_.Write(&batch, sync_)) {
+          return false;
+        }
+        batch.Clear();
+        batch_num = 0;
+      }
+    }
+    return batch_num == 0 || database_.Write(&batch, sync_);
+  }
+
   // 数据库
-  Table<NaiveComparator> database_;
+  Table<Uint64KeyComparator> database_;
+  size_t batch_size_;
+  bool sync_;
 };
 
 }  //  namespace gdt
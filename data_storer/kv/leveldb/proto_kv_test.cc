@@ -0,0 +1,190 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+
+#include <stdlib.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "common/system/concurrency/mutex.h"
+#include "thirdparty/gtest/gtest.h"
+#include "data_collector/proto/product.pb.h"
+#include "data_storer/kv/leveldb/proto_kv.h"
+
+using namespace gdt;
+
+static Product MakeProduct(uint64_t id, const std::string& title) {
+  Product product;
+  product.set_id(id);
+  product.set_title(title);
+  return product;
+}
+
+TEST(ProtoKV, Uint64Key) {
+  uint64_t keys[] = {0, 1, 255, 256, 65535, 1ULL << 32, (1ULL << 63) + 7, ~0ULL};
+  size_t size = sizeof(keys) / sizeof(keys[0]);
+  Uint64KeyComparator comparator;
+  for (size_t i = 0; i < size; ++i) {
+    char a[kUint64KeySize];
+    EncodeUint64Key(keys[i], a);
+    EXPECT_EQ(keys[i], DecodeUint64Key(a));
+    for (size_t j = 0; j < size; ++j) {
+      char b[kUint64KeySize];
+      EncodeUint64Key(keys[j], b);
+      int compare = comparator.Compare(::leveldb::Slice(a, kUint64KeySize),
+                                       ::leveldb::Slice(b, kUint64KeySize));
+      EXPECT_EQ(i < j, compare < 0);
+      EXPECT_EQ(i == j, compare == 0);
+    }
+  }
+  NaiveComparator naive;
+  EXPECT_LT(naive.Compare("10", "9"), 0);
+  EXPECT_LT(naive.Compare("1", "10"), 0);
+  EXPECT_EQ(0, naive.Compare("abc", "abc"));
+}
+
+TEST(ProtoKV, BatchInsert) {
+  system("rm -rf proto_kv_test.db");
+  ProtoKV<Product, &Product::id> proto_kv;
+  proto_kv.set_batch_size(7);
+  ASSERT_TRUE(proto_kv.Open("proto_kv_test.db"));
+  std::vector<Product> products;
+  for (uint64_t id = 100; id > 0; --id) {
+    products.push_back(MakeProduct(id * 1000, "product"));
+  }
+  ASSERT_TRUE(proto_kv.Insert(products));
+  ASSERT_TRUE(proto_kv.Insert(MakeProduct(1, "single")));
+  EXPECT_EQ(101u, proto_kv.Size());
+  Product product;
+  ASSERT_TRUE(proto_kv.Get(5000, &product));
+  EXPECT_EQ("product", product.title());
+  EXPECT_TRUE(proto_kv.Existing(1));
+  EXPECT_FALSE(proto_kv.Existing(2));
+  EXPECT_FALSE(proto_kv.Changed(MakeProduct(1, "single")));
+  EXPECT_TRUE(proto_kv.Changed(MakeProduct(1, "changed")));
+
+  // 按数值顺序遍历
+  std::vector<Product> loaded;
+  ASSERT_TRUE(proto_kv.Load(&loaded));
+  ASSERT_EQ(101u, loaded.size());
+  EXPECT_EQ(1u, loaded[0].id());
+  for (size_t i = 1; i < loaded.size(); ++i) {
+    EXPECT_LT(loaded[i - 1].id(), loaded[i].id());
+  }
+  proto_kv.Close();
+  system("rm -rf proto_kv_test.db");
+}
+
+TEST(ProtoKV, BulkLoad) {
+  system("rm -rf proto_kv_bulk_test.db");
+  ProtoKV<Product, &Product::id> proto_kv;
+  proto_kv.set_batch_size(3);
+  proto_kv.set_write_buffer_size(64 << 20);
+  std::vector<Product> products;
+  EXPECT_FALSE(proto_kv.BulkLoad(products));
+  ASSERT_TRUE(proto_kv.Open("proto_kv_bulk_test.db"));
+  uint64_t ids[] = {300, 2, 70000, 2, 1, 300};
+  for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); ++i) {
+    products.push_back(MakeProduct(ids[i], std::string(1, 'a' + i)));
+  }
+  ASSERT_TRUE(proto_kv.BulkLoad(products));
+  std::vector<Product> loaded;
+  ASSERT_TRUE(proto_kv.Load(&loaded));
+  ASSERT_EQ(4u, loaded.size());
+  EXPECT_EQ(1u, loaded[0].id());
+  EXPECT_EQ(2u, loaded[1].id());
+  EXPECT_EQ(300u, loaded[2].id());
+  EXPECT_EQ(70000u, loaded[3].id());
+  // 重复的key保留最后一条
+  EXPECT_EQ("d", loaded[1].title());
+  EXPECT_EQ("f", loaded[2].title());
+  proto_kv.Close();
+  system("rm -rf proto_kv_bulk_test.db");
+}
+
+TEST(ProtoKV, Scan) {
+  system("rm -rf proto_kv_scan_test.db");
+  ProtoKV<Product, &Product::id> proto_kv;
+  ASSERT_TRUE(proto_kv.Open("proto_kv_scan_test.db"));
+  std::vector<Product> products;
+  for (uint64_t id = 1; id <= 1000; ++id) {
+    products.push_back(MakeProduct(id * 3, "product"));
+  }
+  ASSERT_TRUE(proto_kv.Insert(products));
+
+  uint64_t previous = 0;
+  uint64_t count = 0;
+  ASSERT_TRUE(proto_kv.Scan([&](const Product& product) {
+    EXPECT_LT(previous, product.id());
+    previous = product.id();
+    ++count;
+    return true;
+  }));
+  EXPECT_EQ(1000u, count);
+
+  // 范围的两端都包含, 回调返回false时停止
+  count = 0;
+  ASSERT_TRUE(proto_kv.ScanRange(30, 60, [&](const Product& product) {
+    ++count;
+    return true;
+  }));
+  EXPECT_EQ(11u, count);
+  count = 0;
+  ASSERT_TRUE(proto_kv.Scan([&](const Product& product) {
+    return ++count < 5;
+  }));
+  EXPECT_EQ(5u, count);
+
+  // 估计值只统计磁盘上的数据
+  proto_kv.CompactAll();
+  EXPECT_GT(proto_kv.ApproximateSize(), 0u);
+  proto_kv.Close();
+  system("rm -rf proto_kv_scan_test.db");
+}
+
+TEST(ProtoKV, ParallelScan) {
+  system("rm -rf proto_kv_parallel_test.db");
+  ProtoKV<Product, &Product::id> proto_kv;
+  ASSERT_TRUE(proto_kv.Open("proto_kv_parallel_test.db"));
+  EXPECT_TRUE(proto_kv.ParallelScan(4, [](int shard, const Product& product) {
+    return true;
+  }));
+  std::vector<Product> products;
+  for (uint64_t id = 0; id < 1000; ++id) {
+    products.push_back(MakeProduct(id * id, "product"));
+  }
+  ASSERT_TRUE(proto_kv.Insert(products));
+
+  Mutex mutex;
+  std::set<uint64_t> ids;
+  std::vector<uint64_t> shard_last(4, 0);
+  ASSERT_TRUE(proto_kv.ParallelScan(4, [&](int shard, const Product& product) {
+    MutexLocker locker(&mutex);
+    EXPECT_TRUE(ids.insert(product.id()).second);
+    // 每段内按key顺序, 段之间不重叠
+    EXPECT_LE(shard_last[shard], product.id());
+    shard_last[shard] = product.id();
+    for (int i = 0; i < shard; ++i) {
+      EXPECT_LT(shard_last[i], product.id());
+    }
+    return true;
+  }));
+  EXPECT_EQ(1000u, ids.size());
+
+  // 记录数少于线程数
+  ProtoKV<Product, &Product::id> small_kv;
+  system("rm -rf proto_kv_small_test.db");
+  ASSERT_TRUE(small_kv.Open("proto_kv_small_test.db"));
+  ASSERT_TRUE(small_kv.Insert(MakeProduct(7, "a")));
+  ASSERT_TRUE(small_kv.Insert(MakeProduct(8, "b")));
+  ids.clear();
+  ASSERT_TRUE(small_kv.ParallelScan(16, [&](int shard, const Product& product) {
+    MutexLocker locker(&mutex);
+    ids.insert(product.id());
+    return true;
+  }));
+  EXPECT_EQ(2u, ids.size());
+  proto_kv.Close();
+  small_kv.Close();
+  system("rm -rf proto_kv_parallel_test.db proto_kv_small_test.db");
+}
@@ -0,0 +1,158 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+//
+// Author: Qian Wang <cernwang@tencent.com>
+
+#include "data_storer/sql/mysql_cursor.h"
+
+#include <string.h>
+#include <google/protobuf/text_format.h>
+#include "common/base/string/string_number.h"
+#include "thirdparty/glog/logging.h"
+
+namespace gdt {
+
+using google::protobuf::Descriptor;
+using google::protobuf::EnumValueDescriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+bool MysqlCursor::Open(MYSQL* mysql, const std::string& sql, const Descriptor* descriptor) {
+  Close();
+  error_ = true;
+  if (mysql == NULL) {
+    LOG(ERROR) << " No available connection!";
+    return false;
+  }
+  if (mysql_real_query(mysql, sql.c_str(), sql.length()) != 0) {
+    LOG(ERROR) << "Mysql Query Failed:" << mysql_error(mysql);
+    LOG(ERROR) << "Sql:" << sql;
+    return false;
+  }
+  result_ = mysql_use_result(mysql);
+  if (result_ == NULL) {
+    LOG(ERROR) << "Mysql use result failed:" << mysql_error(mysql);
+    return false;
+  }
+  mysql_ = mysql;
+  descriptor_ = descriptor;
+  unsigned int num_cols = mysql_num_fields(result_);
+  MYSQL_FIELD* fields = mysql_fetch_fields(result_);
+  columns_.resize(num_cols);
+  for (unsigned int i = 0; i < num_cols; ++i) {
+    const FieldDescriptor* field = descriptor->FindFieldByName(fields[i].name);
+    columns_[i] = field != NULL && !field->is_repeated() ? field : NULL;
+  }
+  error_ = false;
+  return true;
+}
+
+void MysqlCursor::Close() {
+  if (result_ != NULL) {
+    mysql_free_result(result_);
+    result_ = NULL;
+  }
+  mysql_ = NULL;
+}
+
+bool MysqlCursor::Next(Message* record) {
+  if (result_ == NULL) {
+    return false;
+  }
+  if (record->GetDescriptor() != descriptor_) {
+    LOG(ERROR) << "Different record type " << record->GetDescriptor()->full_name();
+    error_ = true;
+    return false;
+  }
+  MYSQL_ROW row = mysql_fetch_row(result_);
+  if (row == NULL) {
+    // use_result模式下读完和出错都返回NULL
+    if (mysql_errno(mysql_) != 0) {
+      LOG(ERROR) << "Mysql fetch row failed:" << mysql_error(mysql_);
+      error_ = true;
+    }
+    Close();
+    return false;
+  }
+  unsigned long* lengths = mysql_fetch_lengths(result_);
+  record->Clear();
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    // NULL值的字段不设置
+    if (columns_[i] == NULL || row[i] == NULL) {
+      continue;
+    }
+    if (!SetField(columns_[i], row[i], lengths[i], record)) {
+      LOG(ERROR) << "Invalid value of " << columns_[i]->name() << ":" << row[i];
+      error_ = true;
+      Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class T>
+static bool ParseColumn(const char* value, T* number) {
+  char* end = NULL;
+  return ParseNumber(value, number, &end) && *end == '\0';
+}
+
+bool MysqlCursor::SetField(const FieldDescriptor* field, const char* value,
+                           unsigned long length, Message* record) {
+  const Reflection* reflection = record->GetReflection();
+  switch (field->cpp_type()) {
+#define CASE_NUMERIC_FIELD(cpptype, method, valuetype) \
+    case FieldDescriptor::CPPTYPE_##cpptype: { \
+      valuetype number; \
+      if (!ParseColumn(value, &number)) { \
+        return false; \
+      } \
+      reflection->Set##method(record, field, number); \
+      break; \
+    }
+
+    CASE_NUMERIC_FIELD(INT32,  Int32,  int);
+    CASE_NUMERIC_FIELD(UINT32, UInt32, unsigned int);
+    CASE_NUMERIC_FIELD(INT64,  Int64,  long long);
+    CASE_NUMERIC_FIELD(UINT64, UInt64, unsigned long long);
+    CASE_NUMERIC_FIELD(FLOAT,  Float,  float);
+    CASE_NUMERIC_FIELD(DOUBLE, Double, double);
+#undef CASE_NUMERIC_FIELD
+
+    case FieldDescriptor::CPPTYPE_BOOL: {
+      int number;
+      if (ParseColumn(value, &number)) {
+        reflection->SetBool(record, field, number != 0);
+      } else {
+        reflection->SetBool(record, field, strcmp(value, "true") == 0);
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_ENUM: {
+      int number;
+      if (!ParseColumn(value, &number)) {
+        return false;
+      }
+      const EnumValueDescriptor* enum_value = field->enum_type()->FindValueByNumber(number);
+      if (enum_value == NULL) {
+        return false;
+      }
+      reflection->SetEnum(record, field, enum_value);
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_STRING:
+      reflection->SetString(record, field, std::string(value, length));
+      break;
+    case FieldDescriptor::CPPTYPE_MESSAGE:
+      // 与写入时的TextFormat对应
+      if (!google::protobuf::TextFormat::ParseFromString(
+          std::string(value, length), reflection->MutableMessage(record, field))) {
+        return false;
+      }
+      break;
+  }
+  return true;
+}
+
+}  // namespace gdt
@@ -0,0 +1,68 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+//
+// Author: Qian Wang <cernwang@tencent.com>
+
+#ifndef DATA_STORER_SQL_MYSQL_CURSOR_H_
+#define DATA_STORER_SQL_MYSQL_CURSOR_H_
+
+#include <string>
+#include <vector>
+#include "thirdparty/mysql/mysql.h"
+#include "thirdparty/protobuf/descriptor.h"
+#include "thirdparty/protobuf/message.h"
+
+namespace gdt {
+
+// 流式读取查询结果: 用mysql_use_result逐行从服务端取, 不在客户端缓存整个结果集,
+// 按列名预先找到对应字段, 每行直接转成proto.
+// 游标打开期间同一连接不能执行其他语句
+class MysqlCursor {
+ public:
+  MysqlCursor() : mysql_(NULL), result_(NULL), descriptor_(NULL), error_(false) {}
+  ~MysqlCursor() {
+    Close();
+  }
+
+  // 执行查询, 按descriptor建立列到字段的映射. 没有对应字段的列被忽略
+  bool Open(MYSQL* mysql, const std::string& sql,
+            const google::protobuf::Descriptor* descriptor);
+  // 释放结果集, 未读完的行被丢弃
+  void Close();
+
+  // 读取下一行, 读完或出错时返回false
+  bool Next(google::protobuf::Message* record);
+  // 读取下一批最多batch_size行, 复用records中已有的消息. 返回读到的行数
+  template <class T>
+  size_t NextBatch(size_t batch_size, std::vector<T>* records) {
+    records->resize(batch_size);
+    size_t size = 0;
+    while (size < batch_size && Next(&(*records)[size])) {
+      ++size;
+    }
+    records->resize(size);
+    return size;
+  }
+
+  // Next返回false时区分读完和出错
+  bool error() const {
+    return error_;
+  }
+
+ private:
+  // 把一列的值写入字段, value以'\0'结尾
+  static bool SetField(const google::protobuf::FieldDescriptor* field,
+                       const char* value, unsigned long length,
+                       google::protobuf::Message* record);
+
+  MYSQL* mysql_;
+  MYSQL_RES* result_;
+  const google::protobuf::Descriptor* descriptor_;
+  // 第i列对应的字段, 没有对应字段时为NULL
+  std::vector<const google::protobuf::FieldDescriptor*> columns_;
+  bool error_;
+};
+
+}  // namespace gdt
+
+#endif  // DATA_STORER_SQL_MYSQL_CURSOR_H_
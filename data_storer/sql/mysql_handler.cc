@@ -6,6 +6,8 @@
 #include "data_storer/sql/mysql_handler.h"
 
 #include <google/protobuf/text_format.h>
+#include <stdio.h>
+#include <algorithm>
 #include <string>
 #include <time.h>
 #include <vector>
@@ -49,7 +51,162 @@ bool MysqlHandler::Insert(const google::protobuf::Message& record) {
   return Exec(sql, &results);
 }
 
+bool MysqlHandler::InsertBatch(const google::protobuf::Message* const* records, size_t size) {
+  if (mysql == NULL) {
+    LOG(ERROR) << " No available connection!";
+    return false;
+  }
+  if (size == 0) {
+    return true;
+  }
+  const Descriptor* descriptor = records[0]->GetDescriptor();
+  std::string head;
+  AppendInsertHead(descriptor, &head);
+  mysql_autocommit(mysql, 0);
+  bool succeed = true;
+  std::string sql;
+  std::vector<std::map<std::string, std::string> > results;
+  size_t row_num = 0;
+  size_t statement_num = 0;
+  for (size_t i = 0; succeed && i < size; ++i) {
+    if (records[i]->GetDescriptor() != descriptor) {
+      LOG(ERROR) << "Different record type " << records[i]->GetDescriptor()->full_name();
+      succeed = false;
+      break;
+    }
+    sql += row_num == 0 ? head : ",";
+    succeed = AppendInsertValues(*records[i], &sql);
+    ++row_num;
+    // 行数或字节数到上限, 或最后一条时执行
+    if (succeed && (row_num >= batch_size_ || sql.size() >= kMaxStatementSize || i + 1 == size)) {
+      succeed = Exec(sql, &results);
+      sql.clear();
+      row_num = 0;
+      // 分多个事务提交, 避免大事务长时间持锁和撑大undo日志
+      if (succeed && commit_interval_ > 0 && ++statement_num >= commit_interval_) {
+        succeed = Commit();
+        statement_num = 0;
+      }
+    }
+  }
+  if (succeed) {
+    succeed = Commit();
+  }
+  if (!succeed) {
+    mysql_rollback(mysql);
+  }
+  mysql_autocommit(mysql, 1);
+  return succeed;
+}
+
+void MysqlHandler::AppendInsertHead(const Descriptor* descriptor, std::string* sql) {
+  *sql += "REPLACE INTO `" + descriptor->name() + "` (";
+  bool first = true;
+  for (int i = 0; i < descriptor->field_count(); ++i) {
+    const FieldDescriptor* field = descriptor->field(i);
+    if (field->is_repeated()) {
+      continue;
+    }
+    if (!first) {
+      *sql += ",";
+    } else {
+      first = false;
+    }
+    *sql += "`" + field->name() + "`";
+  }
+  *sql += ") VALUES ";
+}
+
+// 与ProtoMessageToMap的格式相同
+bool MysqlHandler::AppendInsertValues(const google::protobuf::Message& record,
+                                      std::string* sql) {
+  const Reflection* reflection = record.GetReflection();
+  const Descriptor* descriptor = record.GetDescriptor();
+  char buffer[32];
+  std::string scratch;
+  *sql += "(";
+  bool first = true;
+  for (int i = 0; i < descriptor->field_count(); ++i) {
+    const FieldDescriptor* field = descriptor->field(i);
+    if (field->is_repeated()) {
+      continue;
+    }
+    if (!first) {
+      *sql += ",";
+    } else {
+      first = false;
+    }
+    if (!reflection->HasField(record, field)) {
+      *sql += "NULL";
+      continue;
+    }
+    switch (field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_INT32:
+        AppendIntegerToString(reflection->GetInt32(record, field), sql);
+        break;
+      case FieldDescriptor::CPPTYPE_UINT32:
+        AppendIntegerToString(reflection->GetUInt32(record, field), sql);
+        break;
+      case FieldDescriptor::CPPTYPE_INT64:
+        AppendIntegerToString(static_cast<long long>(reflection->GetInt64(record, field)), sql);
+        break;
+      case FieldDescriptor::CPPTYPE_UINT64:
+        AppendIntegerToString(
+            static_cast<unsigned long long>(reflection->GetUInt64(record, field)), sql);
+        break;
+      case FieldDescriptor::CPPTYPE_BOOL:
+        *sql += reflection->GetBool(record, field) ? "1" : "0";
+        break;
+      case FieldDescriptor::CPPTYPE_ENUM:
+        AppendIntegerToString(reflection->GetEnum(record, field)->number(), sql);
+        break;
+      case FieldDescriptor::CPPTYPE_FLOAT:
+        snprintf(buffer, sizeof(buffer), "%.9g", reflection->GetFloat(record, field));
+        *sql += buffer;
+        break;
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        snprintf(buffer, sizeof(buffer), "%.17g", reflection->GetDouble(record, field));
+        *sql += buffer;
+        break;
+      case FieldDescriptor::CPPTYPE_STRING:
+        AppendQuoted(reflection->GetStringReference(record, field, &scratch), sql);
+        break;
+      case FieldDescriptor::CPPTYPE_MESSAGE:
+        if (!google::protobuf::TextFormat::PrintToString(
+            reflection->GetMessage(record, field), &scratch)) {
+          return false;
+        }
+        AppendQuoted(scratch, sql);
+        break;
+    }
+  }
+  *sql += ")";
+  return true;
+}
+
+void MysqlHandler::AppendQuoted(const std::string& value, std::string* sql) {
+  // 转义后最长为2倍加1
+  size_t offset = sql->size();
+  sql->resize(offset + value.size() * 2 + 3);
+  (*sql)[offset] = '\'';
+  unsigned long length = mysql != NULL ?
+      mysql_real_escape_string(mysql, &(*sql)[offset + 1], value.data(), value.size()) :
+      mysql_escape_string(&(*sql)[offset + 1], value.data(), value.size());
+  (*sql)[offset + 1 + length] = '\'';
+  sql->resize(offset + length + 2);
+}
+
+bool MysqlHandler::Commit() {
+  if (mysql_commit(mysql) != 0) {
+    LOG(ERROR) << "Mysql commit failed:" << mysql_error(mysql);
+    return false;
+  }
+  return true;
+}
+
 bool MysqlHandler::Open(const MysqlConfig& mysql_config) {
+  batch_size_ = std::max<size_t>(mysql_config.batch_size(), 1);
+  commit_interval_ = mysql_config.commit_interval();
   mysql = mysql_init(NULL);
   if (!mysql) {
   LOG(ERROR) << "Mysql init failed";
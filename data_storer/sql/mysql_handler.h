@@ -8,9 +8,13 @@
 
 #include <string>
 #include <list>
+#include <map>
+#include <vector>
 #include "thirdparty/glog/logging.h"
+#include "thirdparty/gtest/gtest_prod.h"
 #include "thirdparty/mysql/mysql.h"
 #include "common/encoding/pb_to_map.h"
+#include "data_storer/sql/mysql_cursor.h"
 #include "data_storer/sql/proto/mysql_config.pb.h"
 
 namespace gdt {
@@ -18,7 +22,7 @@ namespace gdt {
 class MysqlHandler {
  public:
   //
-  MysqlHandler(): mysql(NULL) {}
+  MysqlHandler(): mysql(NULL), batch_size_(500), commit_interval_(10) {}
   // 打开数据库
   bool Open(const MysqlConfig& mysql_config);
   // 关闭数据库
@@ -32,6 +36,19 @@ class MysqlHandler {
   bool BuildTable(const google::protobuf::Message& record);
   // 插入一条记录
   bool Insert(const google::protobuf::Message& record);
+  // 批量插入, 见InsertBatch(records, size)
+  template <class T>
+  bool InsertBatch(const std::vector<T>& records) {
+    std::vector<const google::protobuf::Message*> pointers(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+      pointers[i] = &records[i];
+    }
+    return InsertBatch(pointers.data(), pointers.size());
+  }
+  // 批量插入同一类型的记录: 每batch_size条拼成一条多行REPLACE语句,
+  // 每commit_interval条语句提交一次事务, 失败时回滚未提交的部分.
+  // 列为所有非重复字段, 未设置的字段为NULL
+  bool InsertBatch(const google::protobuf::Message* const* records, size_t size);
   // 删除记录
   template <typename Record>
   bool Delete(const Record& record);
@@ -41,20 +58,27 @@ class MysqlHandler {
   // select记录
   template <typename Record>
   bool Select(const Lambda& lambda, std::vector<Record>* records) {
-    std::string sql = GenerateSelectSql(Record()) + GenerateConditionSql(lambda);
-    LOG(ERROR) << sql;
-    std::vector<std::map<std::string, std::string> > results;
-    if (!Exec(sql, &results)) {
+    MysqlCursor cursor;
+    if (!OpenCursor<Record>(lambda, &cursor)) {
       return false;
     }
-    LOG(ERROR) << records;
-    for (auto result : results) {
-      Record record;
-      if (MapToProtoMessage(result, &record)) {
-        records->push_back(record);
-      }
+    Record record;
+    while (cursor.Next(&record)) {
+      records->push_back(record);
     }
-    return true;
+    return !cursor.error();
+  }
+  // 打开满足lambda的记录的流式游标, 大结果集用cursor.NextBatch分批读取
+  template <typename Record>
+  bool OpenCursor(const Lambda& lambda, MysqlCursor* cursor) {
+    std::string sql = GenerateSelectSql(Record()) + GenerateConditionSql(lambda);
+    VLOG(1) << sql;
+    return OpenCursor(sql, Record::descriptor(), cursor);
+  }
+  // 执行查询并打开流式游标
+  bool OpenCursor(const std::string& sql, const google::protobuf::Descriptor* descriptor,
+                  MysqlCursor* cursor) {
+    return cursor->Open(mysql, sql, descriptor);
   }
 
  public:
@@ -85,8 +109,29 @@ class MysqlHandler {
   std::string GenerateSelectSql(const google::protobuf::Message& record);
 
  private:
+  FRIEND_TEST(MysqlHandlerTest, InsertHead);
+  FRIEND_TEST(MysqlHandlerTest, InsertValues);
+  FRIEND_TEST(MysqlHandlerTest, InsertValuesEscape);
+
+  // 一条语句的最大字节数, 低于max_allowed_packet的默认值
+  static const size_t kMaxStatementSize = 1 << 20;
+
+  // 多行语句的头部: REPLACE INTO `table` (`a`,`b`) VALUES
+  static void AppendInsertHead(const google::protobuf::Descriptor* descriptor,
+                               std::string* sql);
+  // 追加一行的值: ('a',1,NULL)
+  bool AppendInsertValues(const google::protobuf::Message& record, std::string* sql);
+  // 转义后加引号追加, 未连接时按默认字符集转义
+  void AppendQuoted(const std::string& value, std::string* sql);
+  // 提交当前事务
+  bool Commit();
+
   // 数据库句柄
   MYSQL* mysql;
+  // 批量写入时每条语句的行数
+  size_t batch_size_;
+  // 批量写入时每个事务的语句数, 0表示不限
+  size_t commit_interval_;
 };
 
 }  // namespace gdt
@@ -0,0 +1,58 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+//
+// Author: Qian Wang <cernwang@tencent.com>
+
+#include <string>
+#include "thirdparty/gtest/gtest.h"
+#include "data_collector/proto/product.pb.h"
+#include "data_storer/sql/mysql_handler.h"
+
+namespace gdt {
+
+// 只测试SQL的拼接, 不需要连接数据库
+TEST(MysqlHandlerTest, InsertHead) {
+  std::string sql;
+  MysqlHandler::AppendInsertHead(FeederFile::descriptor(), &sql);
+  EXPECT_EQ("REPLACE INTO `FeederFile` (`url`,`last_modify_time`,`filename`,`source`,"
+            "`downloaded`,`source_id`) VALUES ", sql);
+  // 重复字段不作为列
+  sql.clear();
+  MysqlHandler::AppendInsertHead(ProductExt::descriptor(), &sql);
+  EXPECT_EQ("REPLACE INTO `ProductExt` () VALUES ", sql);
+}
+
+TEST(MysqlHandlerTest, InsertValues) {
+  MysqlHandler handler;
+  Attribute attribute;
+  std::string sql;
+  // 未设置的字段为NULL, 默认值不写入
+  ASSERT_TRUE(handler.AppendInsertValues(attribute, &sql));
+  EXPECT_EQ("(NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL)", sql);
+
+  attribute.set_data_type(Attribute::DOUBLE);
+  attribute.set_bool_value(true);
+  attribute.set_int32_value(-3);
+  attribute.set_uint32_value(4000000000u);
+  attribute.set_int64_value(-5);
+  attribute.set_uint64_value(18446744073709551615ULL);
+  attribute.set_float_value(0.5);
+  attribute.set_double_value(0.25);
+  attribute.set_string_value("abc");
+  sql = "REPLACE ";
+  ASSERT_TRUE(handler.AppendInsertValues(attribute, &sql));
+  EXPECT_EQ("REPLACE (7,1,-3,4000000000,-5,18446744073709551615,0.5,0.25,'abc')", sql);
+}
+
+TEST(MysqlHandlerTest, InsertValuesEscape) {
+  MysqlHandler handler;
+  FeederFile file;
+  file.set_url("it's\\");
+  file.set_filename(std::string("a\0b", 3));
+  file.set_source("\"\n");
+  std::string sql;
+  ASSERT_TRUE(handler.AppendInsertValues(file, &sql));
+  EXPECT_EQ("('it\\'s\\\\',NULL,'a\\0b','\\\"\\n',NULL,NULL)", sql);
+}
+
+}  // namespace gdt
@@ -0,0 +1,93 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+//
+// Author: Qian Wang <cernwang@tencent.com>
+
+#include "data_storer/sql/mysql_pool.h"
+
+#include <algorithm>
+#include "common/base/scoped_ptr.h"
+#include "thirdparty/glog/logging.h"
+#include "common/system/concurrency/thread.h"
+
+namespace gdt {
+
+MysqlPool::~MysqlPool() {
+  Close();
+}
+
+bool MysqlPool::Open(const MysqlConfig& mysql_config) {
+  Close();
+  size_t pool_size = std::max<size_t>(mysql_config.pool_size(), 1);
+  for (size_t i = 0; i < pool_size; ++i) {
+    shared_ptr<MysqlHandler> handler(new MysqlHandler());
+    if (!handler->Open(mysql_config)) {
+      LOG(ERROR) << "Open mysql connection failed " << i;
+      Close();
+      return false;
+    }
+    handlers_.push_back(handler);
+    idle_handlers_.PushBack(handler.get());
+  }
+  return true;
+}
+
+void MysqlPool::Close() {
+  MysqlHandler* handler = NULL;
+  while (idle_handlers_.TryPopFront(&handler)) {
+  }
+  for (size_t i = 0; i < handlers_.size(); ++i) {
+    handlers_[i]->Close();
+  }
+  handlers_.clear();
+}
+
+MysqlHandler* MysqlPool::Acquire() {
+  MysqlHandler* handler = NULL;
+  idle_handlers_.PopFront(&handler);
+  return handler;
+}
+
+void MysqlPool::Release(MysqlHandler* handler) {
+  idle_handlers_.PushBack(handler);
+}
+
+bool MysqlPool::ParallelInsert(const std::vector<const google::protobuf::Message*>& records) {
+  if (handlers_.empty()) {
+    LOG(ERROR) << "Mysql pool not opened";
+    return false;
+  }
+  size_t thread_num = std::min(handlers_.size(), records.size());
+  if (thread_num <= 1) {
+    bool result = false;
+    InsertRange(records.data(), records.size(), &result);
+    return result;
+  }
+  size_t step = (records.size() + thread_num - 1) / thread_num;
+  // bool的vector不能取元素地址
+  scoped_array<bool> results(new bool[thread_num]);
+  std::vector<shared_ptr<Thread> > threads;
+  for (size_t i = 0; i < thread_num; ++i) {
+    size_t begin = std::min(i * step, records.size());
+    size_t size = std::min(step, records.size() - begin);
+    results[i] = false;
+    threads.push_back(shared_ptr<Thread>(new Thread(
+        "MysqlWriter", gdt::NewCallback(this, &MysqlPool::InsertRange,
+                                        records.data() + begin, size, &results[i]))));
+    threads.back()->Start();
+  }
+  bool succeed = true;
+  for (size_t i = 0; i < thread_num; ++i) {
+    threads[i]->Join();
+    succeed = succeed && results[i];
+  }
+  return succeed;
+}
+
+void MysqlPool::InsertRange(const google::protobuf::Message* const* records, size_t size,
+                            bool* result) {
+  ScopedMysqlHandler handler(this);
+  *result = handler->InsertBatch(records, size);
+}
+
+}  // namespace gdt
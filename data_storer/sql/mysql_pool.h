@@ -0,0 +1,79 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+//
+// Author: Qian Wang <cernwang@tencent.com>
+
+#ifndef DATA_STORER_SQL_MYSQL_POOL_H_
+#define DATA_STORER_SQL_MYSQL_POOL_H_
+
+#include <vector>
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/blocking_queue.h"
+#include "data_storer/sql/mysql_handler.h"
+#include "data_storer/sql/proto/mysql_config.pb.h"
+
+namespace gdt {
+
+// 固定大小的连接池, 多个写线程各取一个连接并行写入
+class MysqlPool {
+ public:
+  MysqlPool() {}
+  ~MysqlPool();
+
+  // 打开pool_size个连接, 有一个失败即失败
+  bool Open(const MysqlConfig& mysql_config);
+  // 关闭所有连接, 需在所有连接归还后调用
+  void Close();
+
+  // 取一个空闲连接, 没有时阻塞
+  MysqlHandler* Acquire();
+  // 归还连接
+  void Release(MysqlHandler* handler);
+
+  size_t size() const {
+    return handlers_.size();
+  }
+
+  // records按连接数等分, 每段一个线程取一个连接调用InsertBatch.
+  // 每段按commit_interval分多个事务提交, 一段失败时其他段和本段之前的事务已提交
+  template <class T>
+  bool ParallelInsert(const std::vector<T>& records) {
+    std::vector<const google::protobuf::Message*> pointers(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+      pointers[i] = &records[i];
+    }
+    return ParallelInsert(pointers);
+  }
+  bool ParallelInsert(const std::vector<const google::protobuf::Message*>& records);
+
+ private:
+  // 写线程
+  void InsertRange(const google::protobuf::Message* const* records, size_t size,
+                   bool* result);
+
+  std::vector<shared_ptr<MysqlHandler> > handlers_;
+  BlockingQueue<MysqlHandler*> idle_handlers_;
+};
+
+// 在作用域内占用一个连接
+class ScopedMysqlHandler {
+ public:
+  explicit ScopedMysqlHandler(MysqlPool* pool) : pool_(pool), handler_(pool->Acquire()) {}
+  ~ScopedMysqlHandler() {
+    pool_->Release(handler_);
+  }
+  MysqlHandler* operator->() const {
+    return handler_;
+  }
+  MysqlHandler* get() const {
+    return handler_;
+  }
+
+ private:
+  MysqlPool* pool_;
+  MysqlHandler* handler_;
+};
+
+}  // namespace gdt
+
+#endif  // DATA_STORER_SQL_MYSQL_POOL_H_
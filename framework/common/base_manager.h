@@ -40,6 +40,8 @@ class BaseManager {
   }
 
   virtual  bool DoProcess() {
+    RunStatSnapshot snapshot;
+    RunStatRegistry::Instance().Snapshot(&snapshot);
     shared_ptr<DataMessageType> data_message(new DataMessageType());
     for (size_t i = 0; i < base_processor_list_.size(); ++i) {
       if (base_processor_list_[i]) {
@@ -47,9 +49,31 @@ class BaseManager {
         base_processor_list_[i]->DoProcess(data_message.get());
       }
     }
+    LOG(INFO) << Name() << " run stat:\n" << RunStatRegistry::Instance().Summary(snapshot);
     return true;
   }
 
+  // 流式处理: 每个processor是流水线的一个stage, 在自己的线程上处理上游产生的批次,
+  // 相邻stage之间最多缓存queue_size个批次, 内存由队列深度而不是数据总量决定
+  virtual bool DoStreamProcess(size_t queue_size) {
+    typedef BaseProcessor<ConfigType, DataMessageType> Processor;
+    StreamPipeline<DataMessageType> pipeline(queue_size);
+    for (size_t i = 0; i < base_processor_list_.size(); ++i) {
+      if (base_processor_list_[i]) {
+        LOG(INFO) << "Add stream stage " << base_processor_list_[i]->ProcessorName();
+        pipeline.AddStage(base_processor_list_[i]->ProcessorName(),
+                          base_processor_list_[i]->StreamWorkerNum(),
+                          std::bind(&Processor::DoStreamProcess, base_processor_list_[i],
+                                    std::placeholders::_1, std::placeholders::_2));
+      }
+    }
+    RunStatSnapshot snapshot;
+    RunStatRegistry::Instance().Snapshot(&snapshot);
+    bool succeed = pipeline.Run(typename Processor::DataMessagePtr(new DataMessageType()));
+    LOG(INFO) << Name() << " run stat:\n" << RunStatRegistry::Instance().Summary(snapshot);
+    return succeed;
+  }
+
   virtual void UnInit() {
     for (size_t i = 0; i < base_processor_list_.size(); ++i) {
       if (base_processor_list_[i]) {
@@ -0,0 +1,99 @@
+// Copyright (c) 2015, Tencent Inc.
+// Author: cernwang<cernwang@tencent.com>
+// 状态机检查点的读写
+//
+// 检查点是snappy压缩的recordio文件, 第一条记录为Checkpoint, 之后是消息的内容.
+// 消息类型需要在自己的命名空间里提供以下两个函数:
+//   bool WriteDataMessage(const DataMessageType& data_message, RecordWriter* writer);
+//   bool ReadDataMessage(RecordReader* reader, DataMessageType* data_message);
+// 一般由WriteMessages/ReadMessages逐个写入/读取消息中的proto数组
+
+#ifndef FRAMEWORK_COMMON_CHECKPOINT_H_
+#define FRAMEWORK_COMMON_CHECKPOINT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "thirdparty/glog/logging.h"
+#include "app/qzap/common/compress/block_compression_codec.h"
+#include "app/qzap/common/recordio/recordio.h"
+#include "framework/proto/framework.pb.h"
+
+namespace gdt {
+
+// 先写条数, 再每个proto一条记录
+template <class MessageType>
+bool WriteMessages(const std::vector<MessageType>& messages, RecordWriter* writer) {
+  uint64_t num = messages.size();
+  if (!writer->WriteRecord(reinterpret_cast<const char*>(&num), sizeof(num))) {
+    return false;
+  }
+  for (const MessageType& message : messages) {
+    if (!writer->WriteMessage(message)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class MessageType>
+bool ReadMessages(RecordReader* reader, std::vector<MessageType>* messages) {
+  const char* data = NULL;
+  int32_t size = 0;
+  if (!reader->ReadRecord(&data, &size) || size != sizeof(uint64_t)) {
+    return false;
+  }
+  uint64_t num = 0;
+  memcpy(&num, data, sizeof(num));
+  // 条数来自文件, 损坏时可能很大, 逐条读出后再追加, 不按条数预先分配
+  messages->clear();
+  MessageType message;
+  for (uint64_t i = 0; i < num; ++i) {
+    if (!reader->ReadMessage(&message)) {
+      return false;
+    }
+    messages->push_back(message);
+  }
+  return true;
+}
+
+// 先写临时文件再改名, 写到一半退出时保留上一个检查点
+template <class DataMessageType>
+bool SaveCheckpoint(const std::string& filename, const Checkpoint& checkpoint,
+                    const DataMessageType& data_message) {
+  std::string temp_filename = filename + ".tmp";
+  std::ofstream stream(temp_filename.c_str(), std::ios::binary | std::ios::trunc);
+  bool succeed = stream.is_open();
+  if (succeed) {
+    RecordWriter writer(&stream, RecordWriterOptions(
+        RecordWriterOptions::DEFAULT_OPTIONS, ::common::BlockCompressionCodec::SNAPPY));
+    succeed = writer.WriteMessage(checkpoint) &&
+        WriteDataMessage(data_message, &writer) && writer.Flush();
+  }
+  stream.close();
+  if (!succeed || stream.fail() || rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    LOG(ERROR) << "Save checkpoint failed\t" << filename;
+    remove(temp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+template <class DataMessageType>
+bool LoadCheckpoint(const std::string& filename, Checkpoint* checkpoint,
+                    DataMessageType* data_message) {
+  std::ifstream stream(filename.c_str(), std::ios::binary);
+  RecordReader reader(&stream);
+  if (!stream.is_open() || !reader.ReadMessage(checkpoint) ||
+      !ReadDataMessage(&reader, data_message)) {
+    LOG(ERROR) << "Load checkpoint failed\t" << filename;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace gdt
+#endif  // FRAMEWORK_COMMON_CHECKPOINT_H_
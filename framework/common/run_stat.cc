@@ -0,0 +1,166 @@
+// Copyright (c) 2015, Tencent Inc.
+// Author: cernwang<cernwang@tencent.com>
+
+#include "framework/common/run_stat.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace gdt {
+
+static uint64_t ClockMicroseconds(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// 进程已分配的堆内存, 包括mmap分配的大块.
+// mallinfo的int字段超过2G会回绕, glibc 2.33起用mallinfo2; 更早的版本改用常驻内存
+static int64_t HeapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return static_cast<int64_t>(info.uordblks + info.hblkhd);
+#else
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (file == NULL) {
+    return 0;
+  }
+  long long size = 0;
+  long long resident = 0;
+  int count = fscanf(file, "%lld %lld", &size, &resident);
+  fclose(file);
+  return count == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+uint64_t ThreadCpuMicroseconds() {
+  return ClockMicroseconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void RunStat::Add(const RunStatValue& value) {
+  __sync_fetch_and_add(&value_.run_num, value.run_num);
+  __sync_fetch_and_add(&value_.wall_us, value.wall_us);
+  __sync_fetch_and_add(&value_.cpu_us, value.cpu_us);
+  __sync_fetch_and_add(&value_.items_in, value.items_in);
+  __sync_fetch_and_add(&value_.items_out, value.items_out);
+  __sync_fetch_and_add(&value_.heap_bytes, value.heap_bytes);
+}
+
+RunStatValue RunStat::value() const {
+  RunStatValue value;
+  value.run_num = value_.run_num;
+  value.wall_us = value_.wall_us;
+  value.cpu_us = value_.cpu_us;
+  value.items_in = value_.items_in;
+  value.items_out = value_.items_out;
+  value.heap_bytes = value_.heap_bytes;
+  return value;
+}
+
+RunStatRegistry& RunStatRegistry::Instance() {
+  static RunStatRegistry registry;
+  return registry;
+}
+
+RunStatRegistry::RunStatRegistry()
+    : registerer_("framework_stat", this, &RunStatRegistry::Dump) {
+}
+
+RunStat* RunStatRegistry::Get(const std::string& name) {
+  MutexLocker locker(&mutex_);
+  shared_ptr<RunStat>& stat = stats_[name];
+  if (!stat) {
+    stat.reset(new RunStat(name));
+  }
+  return stat.get();
+}
+
+void RunStatRegistry::Snapshot(RunStatSnapshot* snapshot) const {
+  MutexLocker locker(&mutex_);
+  snapshot->clear();
+  for (auto& stat : stats_) {
+    (*snapshot)[stat.first] = stat.second->value();
+  }
+}
+
+std::string RunStatRegistry::Summary(const RunStatSnapshot& since) const {
+  RunStatSnapshot now;
+  Snapshot(&now);
+  std::vector<std::pair<std::string, RunStatValue> > deltas;
+  for (auto& stat : now) {
+    RunStatValue delta = stat.second;
+    auto iter = since.find(stat.first);
+    if (iter != since.end()) {
+      delta.run_num -= iter->second.run_num;
+      delta.wall_us -= iter->second.wall_us;
+      delta.cpu_us -= iter->second.cpu_us;
+      delta.items_in -= iter->second.items_in;
+      delta.items_out -= iter->second.items_out;
+      delta.heap_bytes -= iter->second.heap_bytes;
+    }
+    if (delta.run_num > 0) {
+      deltas.push_back(std::make_pair(stat.first, delta));
+    }
+  }
+  std::stable_sort(deltas.begin(), deltas.end(),
+                   [](const std::pair<std::string, RunStatValue>& left,
+                      const std::pair<std::string, RunStatValue>& right) {
+                     return left.second.wall_us > right.second.wall_us;
+                   });
+  std::ostringstream os;
+  os << "name\truns\twall_ms\tcpu_ms\titems_in\titems_out\theap_kb\n";
+  for (auto& delta : deltas) {
+    os << delta.first << "\t" << delta.second.run_num
+       << "\t" << delta.second.wall_us / 1000
+       << "\t" << delta.second.cpu_us / 1000
+       << "\t" << delta.second.items_in
+       << "\t" << delta.second.items_out
+       << "\t" << delta.second.heap_bytes / 1024 << "\n";
+  }
+  return os.str();
+}
+
+Json::Value RunStatRegistry::Dump() const {
+  RunStatSnapshot snapshot;
+  Snapshot(&snapshot);
+  Json::Value value(Json::objectValue);
+  for (auto& stat : snapshot) {
+    Json::Value& item = value[stat.first];
+    item["run_num"] = static_cast<Json::UInt64>(stat.second.run_num);
+    item["wall_us"] = static_cast<Json::UInt64>(stat.second.wall_us);
+    item["cpu_us"] = static_cast<Json::UInt64>(stat.second.cpu_us);
+    item["items_in"] = static_cast<Json::UInt64>(stat.second.items_in);
+    item["items_out"] = static_cast<Json::UInt64>(stat.second.items_out);
+    item["heap_bytes"] = static_cast<Json::Int64>(stat.second.heap_bytes);
+  }
+  return value;
+}
+
+ScopedRunStat::ScopedRunStat(RunStat* stat, bool process_cpu, bool heap)
+    : stat_(stat), process_cpu_(process_cpu), heap_(heap), start_heap_bytes_(0) {
+  start_wall_us_ = ClockMicroseconds(CLOCK_MONOTONIC);
+  start_cpu_us_ = ClockMicroseconds(process_cpu_ ? CLOCK_PROCESS_CPUTIME_ID
+                                                 : CLOCK_THREAD_CPUTIME_ID);
+  if (heap_) {
+    start_heap_bytes_ = HeapBytes();
+  }
+}
+
+ScopedRunStat::~ScopedRunStat() {
+  value_.run_num = 1;
+  value_.wall_us = ClockMicroseconds(CLOCK_MONOTONIC) - start_wall_us_;
+  value_.cpu_us = ClockMicroseconds(process_cpu_ ? CLOCK_PROCESS_CPUTIME_ID
+                                                 : CLOCK_THREAD_CPUTIME_ID) - start_cpu_us_;
+  if (heap_) {
+    value_.heap_bytes = HeapBytes() - start_heap_bytes_;
+  }
+  stat_->Add(value_);
+}
+
+}  // namespace gdt
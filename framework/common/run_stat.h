@@ -0,0 +1,113 @@
+// Copyright (c) 2015, Tencent Inc.
+// Author: cernwang<cernwang@tencent.com>
+// functor/task/state的运行统计
+
+#ifndef FRAMEWORK_COMMON_RUN_STAT_H_
+#define FRAMEWORK_COMMON_RUN_STAT_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "common/base/export_variable.h"
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/mutex.h"
+#include "thirdparty/jsoncpp/json.h"
+
+namespace gdt {
+
+// 累计值, 时间单位为微秒
+struct RunStatValue {
+  RunStatValue()
+      : run_num(0), wall_us(0), cpu_us(0), items_in(0), items_out(0), heap_bytes(0) {
+  }
+  uint64_t run_num;
+  uint64_t wall_us;
+  uint64_t cpu_us;
+  // 输入/输出的条数, 只有functor统计, 没有重载InputSize/OutputSize的为0
+  uint64_t items_in;
+  uint64_t items_out;
+  // 运行期间进程堆内存的增长, glibc 2.33以前为常驻内存的增长.
+  // 只有state和processor采样
+  int64_t heap_bytes;
+};
+
+// 一个functor/task/state的累计统计, 可以被多个线程同时更新
+class RunStat {
+ public:
+  explicit RunStat(const std::string& name) : name_(name) {
+  }
+
+  void Add(const RunStatValue& value);
+
+  // 在其他线程上的CPU时间, 如并行执行的分片
+  void AddCpu(uint64_t cpu_us) {
+    __sync_fetch_and_add(&value_.cpu_us, cpu_us);
+  }
+
+  RunStatValue value() const;
+
+  const std::string& name() const {
+    return name_;
+  }
+
+ private:
+  std::string name_;
+  RunStatValue value_;
+};
+
+typedef std::map<std::string, RunStatValue> RunStatSnapshot;
+
+// 所有统计, 以framework_stat导出到export_variable
+class RunStatRegistry {
+ public:
+  static RunStatRegistry& Instance();
+
+  // 同名的返回同一个, 指针一直有效
+  RunStat* Get(const std::string& name);
+
+  void Snapshot(RunStatSnapshot* snapshot) const;
+
+  // since之后的增量, 按墙上时间从大到小每行一个
+  std::string Summary(const RunStatSnapshot& since) const;
+
+  Json::Value Dump() const;
+
+ private:
+  RunStatRegistry();
+
+  mutable Mutex mutex_;
+  std::map<std::string, shared_ptr<RunStat> > stats_;
+  VariableRegisterer registerer_;
+};
+
+// 作用域内的墙上时间, CPU时间和堆增长计入stat
+class ScopedRunStat {
+ public:
+  // process_cpu为true时统计整个进程的CPU时间, 否则只统计当前线程.
+  // 采样堆内存要遍历所有arena或读/proc, 只在heap为true时采样
+  ScopedRunStat(RunStat* stat, bool process_cpu, bool heap = false);
+  ~ScopedRunStat();
+
+  void set_items_in(uint64_t items_in) {
+    value_.items_in = items_in;
+  }
+
+  void set_items_out(uint64_t items_out) {
+    value_.items_out = items_out;
+  }
+
+ private:
+  RunStat* stat_;
+  bool process_cpu_;
+  bool heap_;
+  RunStatValue value_;
+  uint64_t start_wall_us_;
+  uint64_t start_cpu_us_;
+  int64_t start_heap_bytes_;
+};
+
+// 当前线程的CPU时间
+uint64_t ThreadCpuMicroseconds();
+
+}  // namespace gdt
+#endif  // FRAMEWORK_COMMON_RUN_STAT_H_
@@ -0,0 +1,68 @@
+// Copyright (c) 2015, Tencent Inc.
+// All rights reserved.
+// Author: cernwang <cernwang@tencent.com>
+
+#include <string>
+#include <vector>
+
+#include "thirdparty/gtest/gtest.h"
+#include "thirdparty/jsoncpp/writer.h"
+#include "framework/common/run_stat.h"
+
+using namespace gdt;
+
+TEST(RunStat, Scoped) {
+  RunStat* stat = RunStatRegistry::Instance().Get("test.scoped");
+  EXPECT_EQ(stat, RunStatRegistry::Instance().Get("test.scoped"));
+  RunStatSnapshot snapshot;
+  RunStatRegistry::Instance().Snapshot(&snapshot);
+  for (int i = 0; i < 2; ++i) {
+    ScopedRunStat scoped_stat(stat, false);
+    scoped_stat.set_items_in(10);
+    scoped_stat.set_items_out(5);
+    // 消耗CPU
+    volatile uint64_t sum = 0;
+    for (int j = 0; j < 10000000; ++j) {
+      sum += j;
+    }
+  }
+  RunStatValue value = stat->value();
+  EXPECT_EQ(2u, value.run_num);
+  EXPECT_EQ(20u, value.items_in);
+  EXPECT_EQ(10u, value.items_out);
+  EXPECT_GT(value.wall_us, 0u);
+  EXPECT_GT(value.cpu_us, 0u);
+  std::string summary = RunStatRegistry::Instance().Summary(snapshot);
+  EXPECT_NE(std::string::npos, summary.find("test.scoped\t2\t"));
+  // 没有增量的不出现在汇总中
+  RunStatRegistry::Instance().Snapshot(&snapshot);
+  summary = RunStatRegistry::Instance().Summary(snapshot);
+  EXPECT_EQ(std::string::npos, summary.find("test.scoped"));
+}
+
+TEST(RunStat, Export) {
+  RunStat* stat = RunStatRegistry::Instance().Get("test.export");
+  {
+    ScopedRunStat scoped_stat(stat, true);
+    std::vector<char> buffer(1 << 20, 1);
+  }
+  Json::Value value;
+  ExportedVariable::Root()->FindByName("framework_stat")->Dump(&value);
+  EXPECT_EQ(1u, value["test.export"]["run_num"].asUInt64());
+}
+
+TEST(RunStat, Heap) {
+  RunStat* stat = RunStatRegistry::Instance().Get("test.heap");
+  std::vector<std::vector<char> > buffers;
+  {
+    // 默认不采样堆内存
+    ScopedRunStat scoped_stat(stat, false);
+    buffers.push_back(std::vector<char>(4 << 20, 1));
+  }
+  EXPECT_EQ(0, stat->value().heap_bytes);
+  {
+    ScopedRunStat scoped_stat(stat, false, true);
+    buffers.push_back(std::vector<char>(4 << 20, 1));
+  }
+  EXPECT_GT(stat->value().heap_bytes, 0);
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2015, Tencent Inc.
+// Author: cernwang<cernwang@tencent.com>
+// 流式处理的流水线
+
+#ifndef FRAMEWORK_COMMON_STREAM_PIPELINE_H_
+#define FRAMEWORK_COMMON_STREAM_PIPELINE_H_
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include "thirdparty/glog/logging.h"
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/blocking_queue.h"
+#include "common/system/concurrency/thread.h"
+
+namespace gdt {
+
+// 由多个stage组成的流水线, 相邻stage之间是有界的阻塞队列.
+// 每个stage在自己的线程上消费上游的批次, 输出通过emit推入下游队列,
+// 下游队列满时emit阻塞, 在内存中的批次数由队列深度决定.
+// 所有stage同时运行, 总耗时取决于最慢的stage
+template <class MessageType>
+class StreamPipeline {
+ public:
+  typedef std::tr1::shared_ptr<MessageType> MessagePtr;
+  // 把一批输出推给下游, 流水线已经失败时返回false, 调用者应尽快结束
+  typedef std::function<bool(const MessagePtr&)> Emitter;
+  // 处理一批输入, 失败返回false
+  typedef std::function<bool(const MessagePtr&, const Emitter&)> StageFunc;
+
+  // 队列深度至少为1
+  explicit StreamPipeline(size_t queue_size)
+      : queue_size_(std::max<size_t>(queue_size, 1)), failed_(0) {
+  }
+
+  // worker_num个线程同时执行该stage, 大于1时输出的顺序与输入不一定相同
+  void AddStage(const std::string& name, int worker_num, const StageFunc& func) {
+    Stage stage;
+    stage.name = name;
+    stage.worker_num = worker_num > 0 ? worker_num : 1;
+    stage.running_num = stage.worker_num;
+    stage.func = func;
+    stages_.push_back(stage);
+  }
+
+  // source作为第一个stage的唯一输入, 运行到所有stage结束, 全部成功才返回true
+  bool Run(const MessagePtr& source) {
+    if (stages_.empty()) {
+      return true;
+    }
+    queues_.clear();
+    for (size_t i = 0; i < stages_.size(); ++i) {
+      stages_[i].running_num = stages_[i].worker_num;
+      queues_.push_back(std::tr1::shared_ptr<Queue>(new Queue(queue_size_)));
+    }
+    failed_ = 0;
+    std::vector<std::tr1::shared_ptr<Thread> > threads;
+    for (size_t i = 0; i < stages_.size(); ++i) {
+      for (int j = 0; j < stages_[i].worker_num; ++j) {
+        threads.push_back(std::tr1::shared_ptr<Thread>(new Thread(
+            stages_[i].name, NewCallback(this, &StreamPipeline::Work, i))));
+        threads.back()->Start();
+      }
+    }
+    // 线程启动后再放入输入, 队列深度为1时也不会阻塞
+    queues_[0]->PushBack(source);
+    queues_[0]->PushBack(MessagePtr());
+    for (auto& thread : threads) {
+      thread->Join();
+    }
+    return failed_ == 0;
+  }
+
+ private:
+  typedef BlockingQueue<MessagePtr> Queue;
+
+  struct Stage {
+    std::string name;
+    int worker_num;
+    // 还在运行的线程数, 最后一个退出的线程通知下游结束
+    int running_num;
+    StageFunc func;
+  };
+
+  void Work(size_t index) {
+    Stage& stage = stages_[index];
+    Queue* input = queues_[index].get();
+    Queue* output = index + 1 < queues_.size() ? queues_[index + 1].get() : NULL;
+    Emitter emit = [this, output](const MessagePtr& message) {
+      if (failed_ != 0) {
+        return false;
+      }
+      if (output != NULL) {
+        output->PushBack(message);
+      }
+      return true;
+    };
+    while (true) {
+      MessagePtr message;
+      input->PopFront(&message);
+      // 空指针表示上游已经结束, 放回去让同一stage的其他线程也能看到
+      if (!message) {
+        input->PushFront(message);
+        break;
+      }
+      // 失败后继续消费, 上游不会阻塞在满的队列上
+      if (failed_ != 0) {
+        continue;
+      }
+      if (!stage.func(message, emit)) {
+        LOG(ERROR) << "Stream stage failed\t" << stage.name;
+        __sync_lock_test_and_set(&failed_, 1);
+      }
+    }
+    if (__sync_sub_and_fetch(&stage.running_num, 1) == 0 && output != NULL) {
+      output->PushBack(MessagePtr());
+    }
+  }
+
+  size_t queue_size_;
+  volatile int failed_;
+  std::vector<Stage> stages_;
+  // 第i个stage的输入队列
+  std::vector<std::tr1::shared_ptr<Queue> > queues_;
+};
+
+}  // namespace gdt
+#endif  // FRAMEWORK_COMMON_STREAM_PIPELINE_H_
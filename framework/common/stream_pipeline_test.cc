@@ -0,0 +1,114 @@
+// Copyright (c) 2015, Tencent Inc.
+// All rights reserved.
+// Author: cernwang <cernwang@tencent.com>
+
+#include <algorithm>
+#include <vector>
+
+#include "thirdparty/gtest/gtest.h"
+#include "common/system/concurrency/mutex.h"
+#include "framework/common/stream_pipeline.h"
+
+using namespace gdt;
+
+// 记录同时存在的批次数
+static int g_alive = 0;
+static int g_max_alive = 0;
+
+struct Batch {
+  std::vector<int> values;
+
+  Batch() {
+    int alive = __sync_add_and_fetch(&g_alive, 1);
+    int max_alive = g_max_alive;
+    while (alive > max_alive &&
+           !__sync_bool_compare_and_swap(&g_max_alive, max_alive, alive)) {
+      max_alive = g_max_alive;
+    }
+  }
+  ~Batch() {
+    __sync_sub_and_fetch(&g_alive, 1);
+  }
+};
+
+typedef StreamPipeline<Batch> Pipeline;
+
+// 产生batch_num个批次, 每批一个数
+static bool Produce(int batch_num, const Pipeline::MessagePtr&, const Pipeline::Emitter& emit) {
+  for (int i = 0; i < batch_num; ++i) {
+    Pipeline::MessagePtr batch(new Batch());
+    batch->values.push_back(i);
+    if (!emit(batch)) return false;
+  }
+  return true;
+}
+
+static bool Square(int fail_value, const Pipeline::MessagePtr& input, const Pipeline::Emitter& emit) {
+  Pipeline::MessagePtr output(new Batch());
+  for (int value : input->values) {
+    if (value == fail_value) return false;
+    output->values.push_back(value * value);
+  }
+  return emit(output);
+}
+
+TEST(StreamPipelineTest, Run) {
+  Mutex mutex;
+  std::vector<int> collected;
+  g_max_alive = 0;
+  Pipeline pipeline(2);
+  pipeline.AddStage("produce", 1, std::bind(&Produce, 1000, std::placeholders::_1,
+                                            std::placeholders::_2));
+  pipeline.AddStage("square", 4, std::bind(&Square, -1, std::placeholders::_1,
+                                           std::placeholders::_2));
+  pipeline.AddStage("collect", 1, [&](const Pipeline::MessagePtr& input, const Pipeline::Emitter&) {
+    MutexLocker locker(&mutex);
+    collected.insert(collected.end(), input->values.begin(), input->values.end());
+    return true;
+  });
+  ASSERT_TRUE(pipeline.Run(Pipeline::MessagePtr(new Batch())));
+  ASSERT_EQ(1000u, collected.size());
+  std::sort(collected.begin(), collected.end());
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(i * i, collected[i]);
+  }
+  // 队列深度2, 另加每个线程手上的输入和输出
+  EXPECT_LE(g_max_alive, 2 * 2 + 2 * 6 + 1);
+  EXPECT_EQ(0, g_alive);
+}
+
+TEST(StreamPipelineTest, Failed) {
+  int collected = 0;
+  Pipeline pipeline(2);
+  pipeline.AddStage("produce", 1, std::bind(&Produce, 1000, std::placeholders::_1,
+                                            std::placeholders::_2));
+  pipeline.AddStage("square", 2, std::bind(&Square, 10, std::placeholders::_1,
+                                           std::placeholders::_2));
+  pipeline.AddStage("collect", 1, [&](const Pipeline::MessagePtr&, const Pipeline::Emitter&) {
+    ++collected;
+    return true;
+  });
+  EXPECT_FALSE(pipeline.Run(Pipeline::MessagePtr(new Batch())));
+  EXPECT_LT(collected, 1000);
+  EXPECT_EQ(0, g_alive);
+}
+
+
+TEST(StreamPipelineTest, SmallQueue) {
+  // 深度为0时按1处理
+  for (size_t queue_size = 0; queue_size <= 1; ++queue_size) {
+    int collected = 0;
+    Pipeline pipeline(queue_size);
+    pipeline.AddStage("produce", 1, std::bind(&Produce, 100, std::placeholders::_1,
+                                              std::placeholders::_2));
+    pipeline.AddStage("square", 2, std::bind(&Square, -1, std::placeholders::_1,
+                                             std::placeholders::_2));
+    pipeline.AddStage("collect", 1, [&](const Pipeline::MessagePtr&, const Pipeline::Emitter&) {
+      ++collected;
+      return true;
+    });
+    EXPECT_TRUE(pipeline.Run(Pipeline::MessagePtr(new Batch())));
+    EXPECT_EQ(100, collected);
+  }
+  EXPECT_EQ(0, g_alive);
+}
\ No newline at end of file
@@ -0,0 +1,295 @@
+// Copyright (c) 2015 Tencent Inc.
+// Author: Wang Qian (cernwang@tencent.com)
+
+#ifndef COMMON_STATE_MACHINE_DAG_H_
+#define COMMON_STATE_MACHINE_DAG_H_
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "thirdparty/glog/logging.h"
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/condition_variable.h"
+#include "common/system/concurrency/mutex.h"
+#include "common/system/concurrency/threadpool.h"
+#include "framework/proto/framework.pb.h"
+#include "framework/state_machine/task.h"
+
+namespace gdt {
+namespace common {
+
+// 一个节点的执行记录, 时间为从Run开始的毫秒数
+struct DagNodeStat {
+  // 名称
+  std::string name;
+  // 依赖全部结束的时间
+  int64_t ready_time;
+  // 开始执行的时间
+  int64_t start_time;
+  // 结束的时间
+  int64_t end_time;
+  // 是否成功
+  bool succeed;
+  // 是否在关键路径上
+  bool critical;
+};
+
+// 按依赖关系调度任务: 节点的依赖全部成功后立即执行, 同一资源组内同时执行的节点数受限,
+// 总耗时取决于关键路径而不是每个状态之间的屏障
+template <class ConfigType, class DataMessageType>
+class Dag {
+ public:
+  typedef Task<ConfigType, DataMessageType> TaskType;
+
+  Dag() : data_message_(NULL), config_(NULL), finished_num_(0) {
+  }
+
+  ~Dag() {
+    if (thread_pool_) {
+      thread_pool_->Stop();
+    }
+  }
+
+  // 同步数据地址和业务配置
+  void Sync(DataMessageType* data_message, ConfigType* config) {
+    data_message_ = data_message;
+    config_ = config;
+  }
+
+  // 初始化, 节点ID重复, 依赖不存在, 有环或资源组并发上限小于1时失败
+  bool Init(const DagConfig& dag_config) {
+    nodes_.clear();
+    nodes_.resize(dag_config.node_config_size());
+    std::map<uint64_t, size_t> node_index;
+    for (int i = 0; i < dag_config.node_config_size(); ++i) {
+      const DagNodeConfig& node_config = dag_config.node_config(i);
+      Node& node = nodes_[i];
+      node.task.Sync(data_message_, config_);
+      CHECK_LOG(node.task.Init(node_config.task_config()), node_config.task_config().name());
+      CHECK_LOG(node_index.insert(std::make_pair(node.task.Id(), i)).second, node.task.Id());
+      node.resource = node_config.resource();
+    }
+    for (int i = 0; i < dag_config.node_config_size(); ++i) {
+      for (uint64_t depend_id : dag_config.node_config(i).depend_id()) {
+        auto iter = node_index.find(depend_id);
+        CHECK_LOG(iter != node_index.end(), depend_id);
+        nodes_[i].depends.push_back(iter->second);
+        nodes_[iter->second].dependents.push_back(i);
+      }
+    }
+    limits_.clear();
+    for (auto resource_config : dag_config.resource_config()) {
+      // 并发上限小于1的资源组永远不会调度
+      CHECK_LOG(resource_config.limit() >= 1, resource_config.name());
+      limits_[resource_config.name()] = resource_config.limit();
+    }
+    CHECK_LOG(Sort(), "dag has cycle");
+    if (!thread_pool_) {
+      int thread_num = dag_config.has_thread_num() ?
+          dag_config.thread_num() : static_cast<int>(nodes_.size());
+      thread_pool_ = ThreadPool::Create("Dag", std::max(thread_num, 1));
+      thread_pool_->Start();
+    }
+    return true;
+  }
+
+  // 执行所有节点, 全部成功返回true
+  bool Run() {
+    start_ = std::chrono::steady_clock::now();
+    MutexLocker locker(&mutex_);
+    stats_.assign(nodes_.size(), DagNodeStat());
+    running_.clear();
+    ready_.clear();
+    finished_num_ = 0;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      nodes_[i].remaining = nodes_[i].depends.size();
+      nodes_[i].depend_failed = false;
+      stats_[i].name = nodes_[i].task.name_;
+      stats_[i].succeed = false;
+      stats_[i].critical = false;
+    }
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      if (nodes_[i].remaining == 0) {
+        stats_[i].ready_time = Now();
+        ready_.push_back(i);
+      }
+    }
+    Dispatch();
+    while (finished_num_ < nodes_.size()) {
+      done_.Wait(&mutex_);
+    }
+    MarkCriticalPath();
+    bool succeed = true;
+    for (const DagNodeStat& stat : stats_) {
+      LOG(INFO) << "Dag node " << stat.name << (stat.succeed ? " succeed" : " failed")
+                << " wait " << stat.start_time - stat.ready_time << "ms"
+                << " run " << stat.end_time - stat.start_time << "ms"
+                << (stat.critical ? " critical" : "");
+      succeed = succeed && stat.succeed;
+    }
+    return succeed;
+  }
+
+  // 最近一次Run的执行记录, 与配置中的节点顺序相同
+  const std::vector<DagNodeStat>& stats() const {
+    return stats_;
+  }
+
+ private:
+  struct Node {
+    TaskType task;
+    // 依赖的节点下标
+    std::vector<size_t> depends;
+    // 依赖此节点的节点下标
+    std::vector<size_t> dependents;
+    std::string resource;
+    // 还没有结束的依赖数
+    size_t remaining;
+    bool depend_failed;
+  };
+
+  int64_t Now() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+  }
+
+  // 拓扑排序, 有环时返回false
+  bool Sort() {
+    order_.clear();
+    std::vector<size_t> remaining(nodes_.size());
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      remaining[i] = nodes_[i].depends.size();
+      if (remaining[i] == 0) {
+        order_.push_back(i);
+      }
+    }
+    for (size_t i = 0; i < order_.size(); ++i) {
+      for (size_t dependent : nodes_[order_[i]].dependents) {
+        if (--remaining[dependent] == 0) {
+          order_.push_back(dependent);
+        }
+      }
+    }
+    return order_.size() == nodes_.size();
+  }
+
+  // 资源组未满的就绪节点按就绪顺序开始执行, 需持有mutex_
+  void Dispatch() {
+    std::vector<size_t> failed;
+    for (auto iter = ready_.begin(); iter != ready_.end();) {
+      size_t index = *iter;
+      const std::string& resource = nodes_[index].resource;
+      auto limit = limits_.find(resource);
+      if (!resource.empty() && limit != limits_.end() && running_[resource] >= limit->second) {
+        ++iter;
+        continue;
+      }
+      iter = ready_.erase(iter);
+      ++running_[resource];
+      stats_[index].start_time = Now();
+      if (!thread_pool_->PushTask(NewCallback(this, &Dag::RunNode, index))) {
+        failed.push_back(index);
+      }
+    }
+    // 线程池已停止
+    for (size_t index : failed) {
+      Finish(index, false);
+    }
+  }
+
+  void RunNode(size_t index) {
+    bool succeed = nodes_[index].task.Run();
+    MutexLocker locker(&mutex_);
+    Finish(index, succeed);
+    Dispatch();
+  }
+
+  // 节点结束, 依赖全部结束的节点变为就绪, 有依赖失败时直接失败, 需持有mutex_
+  void Finish(size_t index, bool succeed) {
+    DagNodeStat& stat = stats_[index];
+    stat.end_time = Now();
+    stat.succeed = succeed;
+    --running_[nodes_[index].resource];
+    ++finished_num_;
+    for (size_t dependent : nodes_[index].dependents) {
+      Node& node = nodes_[dependent];
+      node.depend_failed = node.depend_failed || !succeed;
+      if (--node.remaining > 0) {
+        continue;
+      }
+      stats_[dependent].ready_time = Now();
+      if (node.depend_failed) {
+        stats_[dependent].start_time = stats_[dependent].ready_time;
+        ++running_[node.resource];
+        Finish(dependent, false);
+      } else {
+        ready_.push_back(dependent);
+      }
+    }
+    if (finished_num_ == nodes_.size()) {
+      done_.Broadcast();
+    }
+  }
+
+  // 按执行时间求最长的依赖链
+  void MarkCriticalPath() {
+    if (nodes_.empty()) {
+      return;
+    }
+    std::vector<int64_t> length(nodes_.size(), 0);
+    std::vector<size_t> prev(nodes_.size(), nodes_.size());
+    for (size_t index : order_) {
+      for (size_t depend : nodes_[index].depends) {
+        if (length[depend] > length[index]) {
+          length[index] = length[depend];
+          prev[index] = depend;
+        }
+      }
+      length[index] += stats_[index].end_time - stats_[index].start_time;
+    }
+    // 长度相同时取拓扑序靠后的, 路径包含末尾耗时为0的节点
+    size_t last = order_.front();
+    for (size_t index : order_) {
+      if (length[index] >= length[last]) {
+        last = index;
+      }
+    }
+    for (size_t index = last; index < nodes_.size(); index = prev[index]) {
+      stats_[index].critical = true;
+    }
+  }
+
+ private:
+  // 节点
+  std::vector<Node> nodes_;
+  // 拓扑序
+  std::vector<size_t> order_;
+  // 资源组的并发上限
+  std::map<std::string, int> limits_;
+  // 资源组正在执行的节点数
+  std::map<std::string, int> running_;
+  // 依赖已满足, 等待资源的节点
+  std::deque<size_t> ready_;
+  // 执行记录
+  std::vector<DagNodeStat> stats_;
+  size_t finished_num_;
+  Mutex mutex_;
+  ConditionVariable done_;
+  std::chrono::steady_clock::time_point start_;
+  // 消息
+  DataMessageType* data_message_;
+  // 业务配置
+  ConfigType* config_;
+  // 执行节点的线程池
+  shared_ptr<ThreadPool> thread_pool_;
+};
+
+}  // namespace common
+}  // namespace gdt
+
+#endif  // COMMON_STATE_MACHINE_DAG_H_
@@ -16,6 +16,7 @@
 
 #include "app/qzap/common/base/base.h"
 #include "common/base/class_register.h"
+#include "common/system/concurrency/event.h"
 #include "data_collector/feeder/framework/data_message.h"
 #include "framework/common/base_processor.h"
 
@@ -32,8 +33,49 @@ class TestFunctor : public Functor {
 
 };
 
+class SlowFunctor : public Functor {
+
+  FunctorResult DoWork(DataMessage* data_message) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    return kSuccess;
+  }
+
+};
+
+// 开始时通知started, 等到release后才结束
+class BlockingFunctor : public Functor {
+ public:
+  static ManualResetEvent& started() {
+    static ManualResetEvent event;
+    return event;
+  }
+  static ManualResetEvent& release() {
+    static ManualResetEvent event;
+    return event;
+  }
+  static std::atomic<int>& run_num() {
+    static std::atomic<int> num(0);
+    return num;
+  }
+  static std::atomic<int>& finished_num() {
+    static std::atomic<int> num(0);
+    return num;
+  }
+
+ private:
+  FunctorResult DoWork(DataMessage* data_message) {
+    ++run_num();
+    started().Set();
+    release().Wait();
+    ++finished_num();
+    return kSuccess;
+  }
+};
+
 CLASS_REGISTER_DEFINE_REGISTRY(Functor_register, Functor);
 REGISTER_FUNCTOR(TestFunctor, Functor);
+REGISTER_FUNCTOR(SlowFunctor, Functor);
+REGISTER_FUNCTOR(BlockingFunctor, Functor);
 
 }  // namespace common
 }  // namespace gdt
@@ -13,9 +13,13 @@
 #include <chrono>
 #include <functional>
 #include <atomic>
-#include <future>
 #include "app/qzap/common/base/base.h"
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/condition_variable.h"
+#include "common/system/concurrency/mutex.h"
+#include "common/system/concurrency/threadpool.h"
 #include "framework/common/bitmap.h"
+#include "framework/common/run_stat.h"
 #include "framework/state_machine/task.h"
 
 namespace gdt {
@@ -27,8 +31,13 @@ template <class ConfigType, class DataMessageType>
 class State {
  public:
   typedef Task<ConfigType, DataMessageType> TaskType;
+
+  State() : thread_pool_(NULL) {
+  }
+
   // 初始化
   bool Init(const StateConfig& state_config) {
+    name_ = state_config.state_name();
     for (auto task_config : state_config.task_config()) {
       TaskType task;
       task.Sync(data_message_, config_);
@@ -47,17 +56,27 @@ class State {
     data_message_ = data_message;
     config_ = config;
   }
+  // 任务在thread_pool上执行, 为空时在调用线程上串行执行
+  void SetThreadPool(ThreadPool* thread_pool) {
+    thread_pool_ = thread_pool;
+  }
   // 执行
   FinalStatus Run() {
-    std::vector<std::future<bool> > futures(tasks.size());
+    // 任务在其他线程上执行, 统计整个进程的CPU时间
+    ScopedRunStat scoped_stat(RunStatRegistry::Instance().Get("state." + name_), true, true);
+    status_.Clear();
+    context_.reset(new RunContext(tasks.size()));
+    for (size_t i = 0; i < tasks.size(); i++) {
+      tasks[i].Reset();
+    }
     for (size_t i = 0; i < tasks.size(); i++) {
       // 任务之间异步并行
-      futures[i] = std::async(std::launch::async, 
-                              std::bind(&TaskType::Run, &tasks[i])); 
+      if (thread_pool_ == NULL ||
+          !thread_pool_->PushTask(NewCallback(this, &State::RunTask, i, context_))) {
+        RunTask(i, context_);
+      }
     }
-    do {
-      LOG(ERROR) << "Waiting ...";
-    } while (!Ready(futures));
+    Wait(context_.get());
     return status_;
   }
   // 获取下一个状态 TODO(cernwang)
@@ -71,15 +90,58 @@ class State {
   }
 
  private:
-  // 是否准备好
-  bool Ready(std::vector<std::future<bool> >& futures) {
-    for (size_t i = 0; i < futures.size(); i++) {
-      // 此处逻辑有问题 TODO（cernwang)
-      CHECK(futures[i].wait_for(std::chrono::seconds(timeout_)) == std::future_status::ready);
+  // 一次执行的结果
+  struct RunContext {
+    explicit RunContext(size_t task_num)
+        : running_num(task_num), succeed(task_num, false), finished(task_num, false) {
+    }
+    Mutex mutex;
+    ConditionVariable done;
+    size_t running_num;
+    std::vector<char> succeed;
+    std::vector<char> finished;
+  };
+
+  void RunTask(size_t index, shared_ptr<RunContext> context) {
+    bool succeed = tasks[index].Run();
+    MutexLocker locker(&context->mutex);
+    context->succeed[index] = succeed;
+    context->finished[index] = true;
+    if (--context->running_num == 0) {
+      context->done.Broadcast();
+    }
+  }
+
+  // 所有任务共用一个截止时间, 到期后取消没有结束的任务, 其状态为失败.
+  // 被取消的任务在当前functor结束后退出, 等它们都退出后才返回,
+  // 否则它们会和下一个状态的任务及检查点同时访问data_message_
+  void Wait(RunContext* context) {
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(timeout_);
+    MutexLocker locker(&context->mutex);
+    while (context->running_num > 0) {
+      if (timeout_ == 0) {
+        context->done.Wait(&context->mutex);
+        continue;
+      }
+      int64_t left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now()).count();
+      if (left <= 0) {
+        LOG(WARNING) << "State timeout, cancel " << context->running_num << " tasks";
+        break;
+      }
+      context->done.TimedWait(&context->mutex, left);
+    }
+    for (size_t i = 0; i < tasks.size(); i++) {
       // 成功则设置状态
-      SetBit(tasks[i].Id(), futures[i].get(), &status_);
+      SetBit(tasks[i].Id(), context->succeed[i], &status_);
+      if (!context->finished[i]) {
+        tasks[i].Cancel();
+      }
+    }
+    while (context->running_num > 0) {
+      context->done.Wait(&context->mutex);
     }
-    return true;
   }
 
  private:
@@ -97,6 +159,12 @@ class State {
   ConfigType* config_;
   // 默认跳转ID
   int64_t default_next_state_id_;
+  // StateMachine所有的线程池
+  ThreadPool* thread_pool_;
+  // 名称
+  std::string name_;
+  // 最近一次执行
+  shared_ptr<RunContext> context_;
 };
 
 }  // namespace common
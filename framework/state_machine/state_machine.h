@@ -4,14 +4,21 @@
 #ifndef COMMON_STATE_MACHINE_STATE_MACHINE_H_
 #define COMMON_STATE_MACHINE_STATE_MACHINE_H_
 
+#include <unistd.h>
+#include <algorithm>
 #include <map>
+#include <string>
 #include <utility>
 #include <vector>
 
 
 #include "thirdparty/glog/logging.h"
 #include "app/qzap/common/base/base.h"
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/threadpool.h"
+#include "framework/common/checkpoint.h"
 #include "framework/proto/framework.pb.h"
+#include "framework/state_machine/dag.h"
 #include "framework/state_machine/state.h"
 
 namespace gdt {
@@ -24,40 +31,128 @@ template <class ConfigType, class DataMessageType>
 class StateMachine {
  public:
   typedef State<ConfigType, DataMessageType> StateType;
+  typedef Dag<ConfigType, DataMessageType> DagType;
+
+  StateMachine() : dag_mode_(false) {
+  }
+
+  ~StateMachine() {
+    // 等被取消的任务结束后再析构状态
+    if (thread_pool_) {
+      thread_pool_->Stop();
+    }
+  }
+
   // 初始化
   bool Init(const StateMachineConfig& state_machine_config) {
+    dag_mode_ = state_machine_config.has_dag_config();
+    if (dag_mode_) {
+      dag_.Sync(data_message_, config_);
+      return dag_.Init(state_machine_config.dag_config());
+    }
+    // 所有状态的任务共用一个常驻的线程池, 状态切换时不再创建线程
+    int thread_num = state_machine_config.thread_num();
+    if (!state_machine_config.has_thread_num()) {
+      for (auto state_config : state_machine_config.state_config()) {
+        thread_num = std::max(thread_num, state_config.task_config_size());
+      }
+    }
+    if (!thread_pool_ && thread_num > 0) {
+      thread_pool_ = ThreadPool::Create("StateMachine", thread_num);
+      thread_pool_->Start();
+    }
     for (auto state_config : state_machine_config.state_config()) {
-      StateType state;
+      StateType& state = states_[state_config.state_id()];
       state.Sync(data_message_, config_);
+      state.SetThreadPool(thread_pool_.get());
       state.Init(state_config);
-      states_[state_config.state_id()] = state;
     }
     current_state_ = state_machine_config.start_state_id();
+    checkpoint_file_ = state_machine_config.checkpoint_file();
+    return true;
+  }
+  // 从检查点恢复消息和执行记录, 之后的Run从上次最后完成的状态的下一个状态开始.
+  // 在Init之后调用, 检查点不存在时(包括上次正常结束)从初始状态开始
+  bool Resume() {
+    CHECK_LOG(!dag_mode_ && !checkpoint_file_.empty(), checkpoint_file_);
+    if (access(checkpoint_file_.c_str(), F_OK) != 0) {
+      LOG(WARNING) << "No checkpoint, run from start state\t" << checkpoint_file_;
+      return true;
+    }
+    Checkpoint checkpoint;
+    CHECK_LOG(LoadCheckpoint(checkpoint_file_, &checkpoint, data_message_), checkpoint_file_);
+    history_.clear();
+    for (auto state_history : checkpoint.history()) {
+      history_.push_back(std::make_pair(state_history.state_id(), state_history.status()));
+    }
+    current_state_ = checkpoint.current_state_id();
+    LOG(INFO) << "Resume from state " << current_state_ << " after "
+              << history_.size() << " states";
     return true;
   }
   // 执行
   bool Run() {
+    RunStatSnapshot snapshot;
+    RunStatRegistry::Instance().Snapshot(&snapshot);
+    bool succeed = dag_mode_ ? dag_.Run() : RunStates();
+    LOG(INFO) << "StateMachine run stat:\n" << RunStatRegistry::Instance().Summary(snapshot);
+    return succeed;
+  }
+  // 获取现有状态
+  uint64_t GetCurrentState() const {
+    return current_state_;
+  }
+  // 同步数据地址和业务配置
+  void Sync(DataMessageType* data_message, ConfigType* config) {
+    data_message_ = data_message;
+    config_ = config;
+  }
+
+ private:
+  // 按状态跳转执行
+  bool RunStates() {
     while (current_state_ > kEndStateId) {
       auto iter = states_.find(current_state_);
       CHECK_LOG(iter != states_.end(), current_state_);
       FinalStatus status = iter->second.Run();
       history_.push_back(std::make_pair(current_state_, status));
       current_state_ = iter->second.NextState(status);
+      // 正常结束后删除检查点, 否则下次恢复会直接结束并沿用旧数据
+      if (current_state_ == kEndStateId) {
+        CHECK(RemoveStateCheckpoint());
+      } else {
+        CHECK(SaveStateCheckpoint());
+      }
     }
     // 等于0为正常退出
     return current_state_ == kEndStateId;
   }
-  // 获取现有状态
-  uint64_t GetCurrentState() const {
-    return current_state_;
+
+  // 写入检查点, 没有配置时不写
+  bool SaveStateCheckpoint() const {
+    if (checkpoint_file_.empty()) {
+      return true;
+    }
+    Checkpoint checkpoint;
+    checkpoint.set_current_state_id(current_state_);
+    for (auto& state_history : history_) {
+      StateHistory* history = checkpoint.add_history();
+      history->set_state_id(state_history.first);
+      history->mutable_status()->CopyFrom(state_history.second);
+    }
+    CHECK_LOG(SaveCheckpoint(checkpoint_file_, checkpoint, *data_message_), checkpoint_file_);
+    return true;
   }
-  // 同步数据地址和业务配置
-  void Sync(DataMessageType* data_message, ConfigType* config) {
-    data_message_ = data_message;
-    config_ = config;
+
+  // 删除检查点, 没有配置或不存在时忽略
+  bool RemoveStateCheckpoint() const {
+    if (checkpoint_file_.empty() || access(checkpoint_file_.c_str(), F_OK) != 0) {
+      return true;
+    }
+    CHECK_LOG(remove(checkpoint_file_.c_str()) == 0, checkpoint_file_);
+    return true;
   }
 
- private:
   // 状态ID到状态机
   std::map<uint64_t, StateType> states_;
   // 状态历史记录
@@ -70,6 +165,13 @@ class StateMachine {
   DataMessageType* data_message_;
   // 业务配置
   ConfigType* config_;
+  // 执行任务的线程池
+  shared_ptr<ThreadPool> thread_pool_;
+  // 检查点文件
+  std::string checkpoint_file_;
+  // 按依赖关系调度
+  bool dag_mode_;
+  DagType dag_;
 };
 
 }  // namespace common
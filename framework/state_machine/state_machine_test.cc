@@ -2,6 +2,7 @@
 // Author: Wang Qian (cernwang@tencent.com)
 
 #include "thirdparty/gtest/gtest.h"
+#include "data_collector/feeder/framework/data_message_checkpoint.h"
 #include "framework/state_machine/register_test.h"
 #include "framework/state_machine/task.h"
 #include "framework/state_machine/state_machine.h"
@@ -20,5 +21,186 @@ TEST(StateMachine, StateMachineTest) {
   sm.Run();
 }
 
+TEST(StateMachine, Timeout) {
+  StateMachineConfig config;
+  StateConfig* state_config = config.add_state_config();
+  state_config->set_state_id(1);
+  state_config->set_timeout(1);
+  state_config->set_default_next_state_id(0);
+  TaskConfig* task_config = state_config->add_task_config();
+  task_config->set_task_id(1);
+  task_config->set_name("slow");
+  task_config->add_functor_config()->set_name("BlockingFunctor");
+  task_config->add_functor_config()->set_name("BlockingFunctor");
+  // 成功时跳转到不存在的状态
+  TransitionConfig* transition_config = state_config->add_transition_config();
+  transition_config->mutable_status()->add_bitset(1);
+  transition_config->set_next_state_id(-1);
+  config.set_start_state_id(1);
+  FeederConfig feeder_config;
+  DataMessage dm;
+  StateMachine<FeederConfig, DataMessage> sm;
+  sm.Sync(&dm, &feeder_config);
+  EXPECT_TRUE(sm.Init(config));
+  bool succeed = false;
+  int finished_num = -1;
+  ManualResetEvent returned;
+  std::thread runner([&]() {
+    succeed = sm.Run();
+    finished_num = BlockingFunctor::finished_num();
+    returned.Set();
+  });
+  BlockingFunctor::started().Wait();
+  // 超时后被取消的任务还在执行, Run不能返回
+  EXPECT_FALSE(returned.TimedWait(3000));
+  BlockingFunctor::release().Set();
+  runner.join();
+  // 超时的任务失败, 走默认跳转
+  EXPECT_TRUE(succeed);
+  // Run在被取消的任务退出后才返回, 被取消的任务不再执行第二个functor
+  EXPECT_EQ(1, finished_num);
+  EXPECT_EQ(1, BlockingFunctor::run_num());
+}
+
+static void AddState(uint64_t id, int64_t next_id, StateMachineConfig* config) {
+  StateConfig* state_config = config->add_state_config();
+  state_config->set_state_id(id);
+  state_config->set_default_next_state_id(next_id);
+  TaskConfig* task_config = state_config->add_task_config();
+  task_config->set_task_id(id);
+  task_config->set_name("task" + std::to_string(id));
+  task_config->add_functor_config()->set_name("TestFunctor");
+}
+
+TEST(StateMachine, Checkpoint) {
+  std::string checkpoint_file = "state_machine.checkpoint";
+  remove(checkpoint_file.c_str());
+  // 状态1结束后跳转到不存在的状态2, 模拟中途退出
+  StateMachineConfig config;
+  config.set_checkpoint_file(checkpoint_file);
+  config.set_start_state_id(1);
+  AddState(1, 2, &config);
+  FeederConfig feeder_config;
+  DataMessage dm;
+  dm.products.resize(2);
+  dm.products[1].set_id(10);
+  dm.feeder_files.resize(1);
+  {
+    StateMachine<FeederConfig, DataMessage> sm;
+    sm.Sync(&dm, &feeder_config);
+    EXPECT_TRUE(sm.Init(config));
+    EXPECT_FALSE(sm.Run());
+    EXPECT_EQ(2u, sm.GetCurrentState());
+  }
+  // 恢复后从状态2开始
+  AddState(2, 0, &config);
+  DataMessage resumed_dm;
+  StateMachine<FeederConfig, DataMessage> sm;
+  sm.Sync(&resumed_dm, &feeder_config);
+  EXPECT_TRUE(sm.Init(config));
+  EXPECT_TRUE(sm.Resume());
+  EXPECT_EQ(2u, sm.GetCurrentState());
+  ASSERT_EQ(2u, resumed_dm.products.size());
+  EXPECT_EQ(10u, resumed_dm.products[1].id());
+  EXPECT_EQ(1u, resumed_dm.feeder_files.size());
+  EXPECT_TRUE(sm.Run());
+  // 正常结束后检查点被删除, 再次恢复从初始状态开始
+  EXPECT_NE(0, access(checkpoint_file.c_str(), F_OK));
+  StateMachine<FeederConfig, DataMessage> rerun_sm;
+  DataMessage rerun_dm;
+  rerun_sm.Sync(&rerun_dm, &feeder_config);
+  EXPECT_TRUE(rerun_sm.Init(config));
+  EXPECT_TRUE(rerun_sm.Resume());
+  EXPECT_EQ(1u, rerun_sm.GetCurrentState());
+  EXPECT_TRUE(rerun_dm.products.empty());
+  remove(checkpoint_file.c_str());
+}
+
+TEST(StateMachine, CheckpointBadCount) {
+  // 条数远大于实际记录数时读取失败, 不按条数分配内存
+  std::stringstream stream;
+  {
+    RecordWriter writer(&stream);
+    uint64_t num = 1ULL << 60;
+    ASSERT_TRUE(writer.WriteRecord(reinterpret_cast<const char*>(&num), sizeof(num)));
+    Product product;
+    product.set_id(1);
+    ASSERT_TRUE(writer.WriteMessage(product));
+    ASSERT_TRUE(writer.Flush());
+  }
+  RecordReader reader(&stream);
+  std::vector<Product> products;
+  EXPECT_FALSE(ReadMessages(&reader, &products));
+  EXPECT_EQ(1u, products.size());
+}
+
+static void AddDagNode(uint64_t id, const std::string& functor,
+                       const std::vector<uint64_t>& depend_ids,
+                       const std::string& resource, DagConfig* dag_config) {
+  DagNodeConfig* node_config = dag_config->add_node_config();
+  node_config->mutable_task_config()->set_task_id(id);
+  node_config->mutable_task_config()->set_name("node" + std::to_string(id));
+  node_config->mutable_task_config()->add_functor_config()->set_name(functor);
+  for (uint64_t depend_id : depend_ids) {
+    node_config->add_depend_id(depend_id);
+  }
+  node_config->set_resource(resource);
+}
+
+TEST(StateMachine, Dag) {
+  // 1和2并行, 3依赖1和2, 4依赖1, 1和4属于并发为1的资源组
+  StateMachineConfig config;
+  DagConfig* dag_config = config.mutable_dag_config();
+  AddDagNode(1, "SlowFunctor", {}, "download", dag_config);
+  AddDagNode(2, "SlowFunctor", {}, "", dag_config);
+  AddDagNode(3, "TestFunctor", {1, 2}, "", dag_config);
+  AddDagNode(4, "TestFunctor", {1}, "download", dag_config);
+  ResourceConfig* resource_config = dag_config->add_resource_config();
+  resource_config->set_name("download");
+  resource_config->set_limit(1);
+  FeederConfig feeder_config;
+  DataMessage dm;
+  StateMachine<FeederConfig, DataMessage> sm;
+  sm.Sync(&dm, &feeder_config);
+  EXPECT_TRUE(sm.Init(config));
+  EXPECT_TRUE(sm.Run());
+
+  // 资源组的并发上限必须大于0, 否则节点永远不会调度
+  resource_config->clear_limit();
+  StateMachine<FeederConfig, DataMessage> zero_limit_sm;
+  zero_limit_sm.Sync(&dm, &feeder_config);
+  EXPECT_FALSE(zero_limit_sm.Init(config));
+  resource_config->set_limit(-1);
+  Dag<FeederConfig, DataMessage> dag;
+  dag.Sync(&dm, &feeder_config);
+  EXPECT_FALSE(dag.Init(*dag_config));
+}
+
+TEST(StateMachine, DagStats) {
+  DagConfig dag_config;
+  AddDagNode(1, "SlowFunctor", {}, "", &dag_config);
+  AddDagNode(2, "SlowFunctor", {}, "", &dag_config);
+  AddDagNode(3, "TestFunctor", {1, 2}, "", &dag_config);
+  FeederConfig feeder_config;
+  DataMessage dm;
+  Dag<FeederConfig, DataMessage> dag;
+  dag.Sync(&dm, &feeder_config);
+  ASSERT_TRUE(dag.Init(dag_config));
+  ASSERT_TRUE(dag.Run());
+  const std::vector<DagNodeStat>& stats = dag.stats();
+  ASSERT_EQ(3u, stats.size());
+  // 没有依赖的节点同时执行
+  EXPECT_LT(stats[1].start_time, stats[0].end_time);
+  EXPECT_GE(stats[2].start_time, std::max(stats[0].end_time, stats[1].end_time));
+  EXPECT_LT(stats[2].end_time, 2500);
+  EXPECT_TRUE(stats[2].critical);
+
+  // 环
+  dag_config.mutable_node_config(0)->add_depend_id(3);
+  Dag<FeederConfig, DataMessage> cyclic_dag;
+  cyclic_dag.Sync(&dm, &feeder_config);
+  EXPECT_FALSE(cyclic_dag.Init(dag_config));
+}
+
 }  // namespace common
 }  // namespace gdt
\ No newline at end of file
@@ -30,6 +30,9 @@ class Task: public BaseProcessor<ConfigType, DataMessageType> {
  public:
   typedef  BaseFunctor<ConfigType, DataMessageType> Functor;
 
+  Task() : cancelled_(false) {
+  }
+
   // 初始化
   bool Init(const TaskConfig& task_config) {
     name_ = task_config.name();
@@ -41,6 +44,7 @@ class Task: public BaseProcessor<ConfigType, DataMessageType> {
       LOG(ERROR) << functor_config.name();
       CHECK(AddFunctor(functor));
     }
+    CHECK(this->InitThreadPool(task_config.thread_num()));
     this->success_init_ = true;
     return true;
   }
@@ -51,8 +55,29 @@ class Task: public BaseProcessor<ConfigType, DataMessageType> {
   }
   // 执行
   bool Run() {
-    LOG(ERROR) << "Runing Task" << name_;
-    return DoProcess(data_message_);
+    VLOG(1) << "Runing Task" << name_;
+    return this->DoProcess(data_message_) && !cancelled_;
+  }
+  // 取消正在执行的任务, 当前functor结束后不再执行剩下的functor
+  void Cancel() {
+    cancelled_ = true;
+  }
+  // 再次执行前清除取消标记
+  void Reset() {
+    cancelled_ = false;
+  }
+  // 逐个执行functor, 失败的functor不影响后面的functor
+  bool DoWork(DataMessageType* data_message) {
+    for (size_t i = 0; i < this->base_functor_list_.size() && !cancelled_; ++i) {
+      if (this->DoFunctor(i, data_message) != kSuccess) {
+        LOG(ERROR) << this->base_functor_list_[i]->Name() << " do work failed";
+      }
+    }
+    return true;
+  }
+  // 运行统计中的名称
+  std::string ProcessorName() {
+    return name_;
   }
   // ID
   uint64_t Id() {
@@ -65,6 +90,8 @@ class Task: public BaseProcessor<ConfigType, DataMessageType> {
   std::string name_;
   // ID
   uint64_t id_;
+  // 超过状态的截止时间后被取消
+  volatile bool cancelled_;
 };
 
 }  // namespace common
@@ -0,0 +1,704 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+// 编译后的Lambda: 字段路径在编译时解析为FieldDescriptor, 常量预先转换为比较类型,
+// 逻辑运算展开为带短路跳转的指令序列, 求值时不再查找字段名, 不复制FieldValue.
+// 批量过滤时按列求值: 每批数据中用到的字段先转换为按比较类型存储的列,
+// 表达式对整列比较得到选择位图, 与/或/非是位图的按字运算
+#ifndef LEARNING_CLEANER_COMPILED_LAMBDA_H_
+#define LEARNING_CLEANER_COMPILED_LAMBDA_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "thirdparty/glog/logging.h"
+#include "thirdparty/protobuf/message.h"
+#include "thirdparty/protobuf/descriptor.h"
+#include "common/proto/config.pb.h"
+#include "framework/common/base_functor.h"
+#include "learning/cleaner/condition.h"
+#include "learning/proto/condition.pb.h"
+
+namespace gdt {
+namespace learning {
+
+// 比较时使用的类型
+enum CompareKind {
+  COMPARE_BOOL,
+  COMPARE_INT,
+  COMPARE_UINT,
+  COMPARE_DOUBLE,
+  COMPARE_STRING,
+};
+
+// 表达式的一边, 常量或字段
+struct CompiledOperand {
+  CompiledOperand()
+      : kind(COMPARE_BOOL), column(-1), int_value(0), uint_value(0), double_value(0) {
+  }
+  CompareKind kind;
+  // 列式求值时的列下标, 常量为-1
+  int column;
+  // 字段路径, 为空时是常量
+  std::vector<const google::protobuf::FieldDescriptor*> path;
+  // 路径上每一层消息的Reflection
+  std::vector<const google::protobuf::Reflection*> reflections;
+  // 常量, 编译时已转换为比较类型
+  int64_t int_value;
+  uint64_t uint_value;
+  double double_value;
+  std::string string_value;
+};
+
+// 一个比较表达式
+struct CompiledExpression {
+  MathOperator math_operator;
+  CompareKind kind;
+  CompiledOperand left;
+  CompiledOperand right;
+};
+
+// 选择位图, 第i行对应第i / 64个字的第i % 64位
+typedef std::vector<uint64_t> SelectionBitmap;
+
+template <class T>
+class CompiledLambda {
+ public:
+  // 每批转换为列的行数
+  static const size_t kBatchSize = 4096;
+
+  CompiledLambda() : root_(-1) {
+  }
+
+  // 字段不存在, 是重复字段, 或字符串与数值比较时失败
+  bool Compile(const Lambda& lambda) {
+    expressions_.clear();
+    instructions_.clear();
+    nodes_.clear();
+    columns_.clear();
+    return CompileLambda(lambda, &root_);
+  }
+
+  bool Satisfy(const T& t) const {
+    bool result = true;
+    for (size_t pc = 0; pc < instructions_.size(); ++pc) {
+      const Instruction& instruction = instructions_[pc];
+      switch (instruction.op) {
+        case OP_EXPRESSION:
+          result = Evaluate(t, expressions_[instruction.arg]);
+          break;
+        case OP_CONST:
+          result = instruction.arg != 0;
+          break;
+        case OP_JUMP_IF_FALSE:
+          if (!result) {
+            pc = instruction.arg - 1;
+          }
+          break;
+        case OP_JUMP_IF_TRUE:
+          if (result) {
+            pc = instruction.arg - 1;
+          }
+          break;
+        case OP_NOT:
+          result = !result;
+          break;
+      }
+    }
+    return result;
+  }
+
+  // 批量求值, results与items一一对应
+  void Filter(const std::vector<T>& items, std::vector<bool>* results) const {
+    results->resize(items.size());
+    std::vector<Column> columns(columns_.size());
+    SelectionBitmap selection;
+    for (size_t begin = 0; begin < items.size(); begin += kBatchSize) {
+      size_t size = std::min(kBatchSize, items.size() - begin);
+      for (size_t i = 0; i < columns_.size(); ++i) {
+        ReadColumn(items, begin, size, columns_[i], &columns[i]);
+      }
+      EvaluateNode(root_, columns, size, &selection);
+      for (size_t i = 0; i < size; ++i) {
+        (*results)[begin + i] = (selection[i / 64] >> (i % 64)) & 1;
+      }
+    }
+  }
+
+ private:
+  enum OpCode {
+    OP_EXPRESSION,
+    OP_CONST,
+    OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE,
+    OP_NOT,
+  };
+
+  struct Instruction {
+    OpCode op;
+    // 表达式下标, 常量值或跳转目标
+    size_t arg;
+  };
+
+  // 列式求值的逻辑树
+  struct Node {
+    // 表达式下标, 为-1时是逻辑运算
+    int expression;
+    bool is_and;
+    bool not_operator;
+    std::vector<int> children;
+  };
+
+  // 一批数据的一列, 只使用与比较类型对应的数组
+  struct Column {
+    std::vector<int64_t> int_values;
+    std::vector<uint64_t> uint_values;
+    std::vector<double> double_values;
+    std::vector<const std::string*> string_values;
+    // GetStringReference没有返回字段本身时的副本
+    std::deque<std::string> strings;
+  };
+
+  int AddNode(int expression, bool is_and) {
+    Node node;
+    node.expression = expression;
+    node.is_and = is_and;
+    node.not_operator = false;
+    nodes_.push_back(node);
+    return static_cast<int>(nodes_.size()) - 1;
+  }
+
+  void Emit(OpCode op, size_t arg) {
+    Instruction instruction;
+    instruction.op = op;
+    instruction.arg = arg;
+    instructions_.push_back(instruction);
+  }
+
+  // 与LambdaParser::Parse的语义相同: 只有一个表达式时忽略逻辑运算符, 先子Lambda后表达式
+  bool CompileLambda(const Lambda& lambda, int* node) {
+    if (lambda.expression_size() == 1 && lambda.lambda().empty()) {
+      CHECK_LOG(CompileExpression(lambda.expression(0), node),
+                lambda.expression(0).Utf8DebugString());
+    } else {
+      CHECK_LOG(lambda.logical_operator() == LOGICAL_OPERATOR_AND ||
+                lambda.logical_operator() == LOGICAL_OPERATOR_OR,
+                lambda.Utf8DebugString());
+      bool is_and = lambda.logical_operator() == LOGICAL_OPERATOR_AND;
+      *node = AddNode(-1, is_and);
+      int child_num = lambda.lambda_size() + lambda.expression_size();
+      if (child_num == 0) {
+        // 空的与为真, 空的或为假
+        Emit(OP_CONST, is_and ? 1 : 0);
+      }
+      // 短路: 与遇到假, 或遇到真时跳到末尾
+      std::vector<size_t> jumps;
+      for (int i = 0; i < child_num; ++i) {
+        int child = -1;
+        if (i < lambda.lambda_size()) {
+          CHECK_LOG(CompileLambda(lambda.lambda(i), &child), lambda.lambda(i).Utf8DebugString());
+        } else {
+          const Expression& expression = lambda.expression(i - lambda.lambda_size());
+          CHECK_LOG(CompileExpression(expression, &child), expression.Utf8DebugString());
+        }
+        nodes_[*node].children.push_back(child);
+        if (i + 1 < child_num) {
+          jumps.push_back(instructions_.size());
+          Emit(is_and ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE, 0);
+        }
+      }
+      for (size_t jump : jumps) {
+        instructions_[jump].arg = instructions_.size();
+      }
+    }
+    if (lambda.not_operator()) {
+      Emit(OP_NOT, 0);
+      nodes_[*node].not_operator = !nodes_[*node].not_operator;
+    }
+    return true;
+  }
+
+  bool CompileExpression(const Expression& expression, int* node) {
+    CompiledExpression compiled;
+    compiled.math_operator = expression.math_operator();
+    PASS_OR_RETURN(CompileOperand(expression.left_field(), &compiled.left));
+    PASS_OR_RETURN(CompileOperand(expression.right_field(), &compiled.right));
+    PASS_OR_RETURN(Promote(compiled.left.kind, compiled.right.kind, &compiled.kind));
+    // 常量转换为比较类型, 求值时只转换字段
+    PASS_OR_RETURN(ConvertConstant(compiled.kind, &compiled.left));
+    PASS_OR_RETURN(ConvertConstant(compiled.kind, &compiled.right));
+    AddColumn(compiled.kind, &compiled.left);
+    AddColumn(compiled.kind, &compiled.right);
+    *node = AddNode(static_cast<int>(expressions_.size()), false);
+    Emit(OP_EXPRESSION, expressions_.size());
+    expressions_.push_back(compiled);
+    return true;
+  }
+
+  // 字段按比较类型存为一列, 同一字段同一类型共用一列
+  void AddColumn(CompareKind kind, CompiledOperand* operand) {
+    if (operand->path.empty()) {
+      return;
+    }
+    for (size_t i = 0; i < columns_.size(); ++i) {
+      if (columns_[i].path == operand->path && columns_[i].kind == kind) {
+        operand->column = static_cast<int>(i);
+        return;
+      }
+    }
+    operand->column = static_cast<int>(columns_.size());
+    columns_.push_back(*operand);
+    columns_.back().kind = kind;
+  }
+
+  static bool CompileOperand(const FieldValueConfig& config, CompiledOperand* operand) {
+    using google::protobuf::FieldDescriptor;
+    if (config.has_field_value()) {
+      const FieldValue& value = config.field_value();
+      switch (value.data_type()) {
+        case FieldValue::BOOL:
+          operand->kind = COMPARE_BOOL;
+          operand->uint_value = value.bool_value();
+          break;
+        case FieldValue::INT32:
+          operand->kind = COMPARE_INT;
+          operand->int_value = value.int32_value();
+          break;
+        case FieldValue::INT64:
+          operand->kind = COMPARE_INT;
+          operand->int_value = value.int64_value();
+          break;
+        case FieldValue::UINT32:
+          operand->kind = COMPARE_UINT;
+          operand->uint_value = value.uint32_value();
+          break;
+        case FieldValue::UINT64:
+          operand->kind = COMPARE_UINT;
+          operand->uint_value = value.uint64_value();
+          break;
+        case FieldValue::FLOAT:
+          operand->kind = COMPARE_DOUBLE;
+          operand->double_value = value.float_value();
+          break;
+        case FieldValue::DOUBLE:
+          operand->kind = COMPARE_DOUBLE;
+          operand->double_value = value.double_value();
+          break;
+        case FieldValue::STRING:
+          operand->kind = COMPARE_STRING;
+          operand->string_value = value.string_value();
+          break;
+        default:
+          LOG(ERROR) << "Unknown data type\t" << value.data_type();
+          return false;
+      }
+      return true;
+    }
+    CHECK_LOG(config.field_name_size() > 0, config.Utf8DebugString());
+    const google::protobuf::Message* prototype = &T::default_instance();
+    for (int i = 0; i < config.field_name_size(); ++i) {
+      CHECK_LOG(prototype != NULL, config.Utf8DebugString());
+      const FieldDescriptor* field =
+          prototype->GetDescriptor()->FindFieldByName(config.field_name(i));
+      CHECK_LOG(field != NULL && !field->is_repeated(), config.field_name(i));
+      operand->path.push_back(field);
+      operand->reflections.push_back(prototype->GetReflection());
+      prototype = field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE ?
+          &prototype->GetReflection()->GetMessage(*prototype, field) : NULL;
+    }
+    // 路径的最后必须是标量
+    CHECK_LOG(prototype == NULL, config.Utf8DebugString());
+    switch (operand->path.back()->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_BOOL:
+        operand->kind = COMPARE_BOOL;
+        break;
+      case FieldDescriptor::CPPTYPE_INT32:
+      case FieldDescriptor::CPPTYPE_INT64:
+        operand->kind = COMPARE_INT;
+        break;
+      case FieldDescriptor::CPPTYPE_UINT32:
+      case FieldDescriptor::CPPTYPE_UINT64:
+      case FieldDescriptor::CPPTYPE_ENUM:
+        operand->kind = COMPARE_UINT;
+        break;
+      case FieldDescriptor::CPPTYPE_FLOAT:
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        operand->kind = COMPARE_DOUBLE;
+        break;
+      case FieldDescriptor::CPPTYPE_STRING:
+        operand->kind = COMPARE_STRING;
+        break;
+      default:
+        return false;
+    }
+    return true;
+  }
+
+  // 两边类型不同时: 有浮点数按浮点数, 有符号和无符号混合按有符号, 布尔值按无符号
+  static bool Promote(CompareKind left, CompareKind right, CompareKind* kind) {
+    if (left == right) {
+      *kind = left;
+      return true;
+    }
+    CHECK_LOG(left != COMPARE_STRING && right != COMPARE_STRING, "string compared with number");
+    if (left == COMPARE_DOUBLE || right == COMPARE_DOUBLE) {
+      *kind = COMPARE_DOUBLE;
+    } else if (left == COMPARE_INT || right == COMPARE_INT) {
+      *kind = COMPARE_INT;
+    } else {
+      *kind = COMPARE_UINT;
+    }
+    return true;
+  }
+
+  static bool ConvertConstant(CompareKind kind, CompiledOperand* operand) {
+    if (!operand->path.empty() || operand->kind == kind) {
+      return true;
+    }
+    switch (kind) {
+      case COMPARE_INT:
+        operand->int_value = static_cast<int64_t>(operand->uint_value);
+        break;
+      case COMPARE_UINT:
+        operand->uint_value = operand->kind == COMPARE_INT ?
+            static_cast<uint64_t>(operand->int_value) : operand->uint_value;
+        break;
+      case COMPARE_DOUBLE:
+        operand->double_value = operand->kind == COMPARE_INT ?
+            static_cast<double>(operand->int_value) :
+            static_cast<double>(operand->uint_value);
+        break;
+      default:
+        return false;
+    }
+    operand->kind = kind;
+    return true;
+  }
+
+  // 沿路径取到最后一层消息
+  static const google::protobuf::Message* Leaf(const T& t, const CompiledOperand& operand) {
+    const google::protobuf::Message* message = &t;
+    for (size_t i = 0; i + 1 < operand.path.size(); ++i) {
+      message = &operand.reflections[i]->GetMessage(*message, operand.path[i]);
+    }
+    return message;
+  }
+
+  template <class Value>
+  static Value ReadNumber(const T& t, const CompiledOperand& operand) {
+    using google::protobuf::FieldDescriptor;
+    const google::protobuf::Message* message = Leaf(t, operand);
+    const google::protobuf::Reflection* reflection = operand.reflections.back();
+    const FieldDescriptor* field = operand.path.back();
+    switch (field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_BOOL:
+        return static_cast<Value>(reflection->GetBool(*message, field));
+      case FieldDescriptor::CPPTYPE_INT32:
+        return static_cast<Value>(reflection->GetInt32(*message, field));
+      case FieldDescriptor::CPPTYPE_INT64:
+        return static_cast<Value>(reflection->GetInt64(*message, field));
+      case FieldDescriptor::CPPTYPE_UINT32:
+        return static_cast<Value>(reflection->GetUInt32(*message, field));
+      case FieldDescriptor::CPPTYPE_UINT64:
+        return static_cast<Value>(reflection->GetUInt64(*message, field));
+      case FieldDescriptor::CPPTYPE_ENUM:
+        return static_cast<Value>(reflection->GetEnum(*message, field)->number());
+      case FieldDescriptor::CPPTYPE_FLOAT:
+        return static_cast<Value>(reflection->GetFloat(*message, field));
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        return static_cast<Value>(reflection->GetDouble(*message, field));
+      default:
+        return Value();
+    }
+  }
+
+  template <class Value>
+  static bool Compare(MathOperator math_operator, const Value& left, const Value& right) {
+    switch (math_operator) {
+      case MATH_OPERATOR_EQUAL:
+        return left == right;
+      case MATH_OPERATOR_LESS_THAN:
+        return left < right;
+      case MATH_OPERATOR_BIGGER_THAN:
+        return right < left;
+    }
+    return false;
+  }
+
+  static bool Evaluate(const T& t, const CompiledExpression& expression) {
+    const CompiledOperand& left = expression.left;
+    const CompiledOperand& right = expression.right;
+    switch (expression.kind) {
+      case COMPARE_BOOL:
+      case COMPARE_UINT:
+        return Compare(expression.math_operator,
+                       left.path.empty() ? left.uint_value : ReadNumber<uint64_t>(t, left),
+                       right.path.empty() ? right.uint_value : ReadNumber<uint64_t>(t, right));
+      case COMPARE_INT:
+        return Compare(expression.math_operator,
+                       left.path.empty() ? left.int_value : ReadNumber<int64_t>(t, left),
+                       right.path.empty() ? right.int_value : ReadNumber<int64_t>(t, right));
+      case COMPARE_DOUBLE:
+        return Compare(expression.math_operator,
+                       left.path.empty() ? left.double_value : ReadNumber<double>(t, left),
+                       right.path.empty() ? right.double_value : ReadNumber<double>(t, right));
+      case COMPARE_STRING: {
+        // 字段的字符串只取引用
+        std::string left_scratch, right_scratch;
+        const std::string& left_value = left.path.empty() ? left.string_value :
+            ReadString(t, left, &left_scratch);
+        const std::string& right_value = right.path.empty() ? right.string_value :
+            ReadString(t, right, &right_scratch);
+        return Compare(expression.math_operator, left_value, right_value);
+      }
+    }
+    return false;
+  }
+
+  static const std::string& ReadString(const T& t, const CompiledOperand& operand,
+                                       std::string* scratch) {
+    const google::protobuf::Message* message = Leaf(t, operand);
+    return operand.reflections.back()->GetStringReference(*message, operand.path.back(), scratch);
+  }
+
+  // 按比较类型读取一批数据的一列, 字段类型的分支在循环外
+  static void ReadColumn(const std::vector<T>& items, size_t begin, size_t size,
+                         const CompiledOperand& operand, Column* column) {
+    switch (operand.kind) {
+      case COMPARE_BOOL:
+      case COMPARE_UINT:
+        ReadNumbers(items, begin, size, operand, &column->uint_values);
+        break;
+      case COMPARE_INT:
+        ReadNumbers(items, begin, size, operand, &column->int_values);
+        break;
+      case COMPARE_DOUBLE:
+        ReadNumbers(items, begin, size, operand, &column->double_values);
+        break;
+      case COMPARE_STRING: {
+        column->string_values.resize(size);
+        column->strings.clear();
+        std::string scratch;
+        for (size_t i = 0; i < size; ++i) {
+          const std::string& value = ReadString(items[begin + i], operand, &scratch);
+          if (&value == &scratch) {
+            column->strings.push_back(scratch);
+            column->string_values[i] = &column->strings.back();
+          } else {
+            column->string_values[i] = &value;
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  template <class Value>
+  static void ReadNumbers(const std::vector<T>& items, size_t begin, size_t size,
+                          const CompiledOperand& operand, std::vector<Value>* values) {
+    using google::protobuf::FieldDescriptor;
+    values->resize(size);
+    const google::protobuf::Reflection* reflection = operand.reflections.back();
+    const FieldDescriptor* field = operand.path.back();
+    switch (field->cpp_type()) {
+#define READ_NUMBERS(cpptype, method) \
+      case FieldDescriptor::CPPTYPE_##cpptype: \
+        for (size_t i = 0; i < size; ++i) { \
+          (*values)[i] = static_cast<Value>( \
+              reflection->Get##method(*Leaf(items[begin + i], operand), field)); \
+        } \
+        break;
+
+      READ_NUMBERS(BOOL, Bool);
+      READ_NUMBERS(INT32, Int32);
+      READ_NUMBERS(INT64, Int64);
+      READ_NUMBERS(UINT32, UInt32);
+      READ_NUMBERS(UINT64, UInt64);
+      READ_NUMBERS(FLOAT, Float);
+      READ_NUMBERS(DOUBLE, Double);
+#undef READ_NUMBERS
+
+      case FieldDescriptor::CPPTYPE_ENUM:
+        for (size_t i = 0; i < size; ++i) {
+          (*values)[i] = static_cast<Value>(
+              reflection->GetEnum(*Leaf(items[begin + i], operand), field)->number());
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  // 逐行比较, 每64行打包成一个字. 步长为0的一边是常量, 步长是模板参数, 内层循环可以向量化
+  template <size_t kLeftStep, size_t kRightStep, class Value, class Comparator>
+  static void CompareValues(const Value* left, const Value* right, size_t size,
+                            Comparator comparator, SelectionBitmap* selection) {
+    selection->resize((size + 63) / 64);
+    for (size_t word = 0; word < selection->size(); ++word) {
+      size_t base = word * 64;
+      size_t num = std::min<size_t>(64, size - base);
+      const Value* left_base = left + base * kLeftStep;
+      const Value* right_base = right + base * kRightStep;
+      uint64_t bits = 0;
+      for (size_t i = 0; i < num; ++i) {
+        bits |= static_cast<uint64_t>(
+            comparator(left_base[i * kLeftStep], right_base[i * kRightStep])) << i;
+      }
+      (*selection)[word] = bits;
+    }
+  }
+
+  template <class Value, class Comparator>
+  static void CompareSteps(const Value* left, size_t left_step,
+                           const Value* right, size_t right_step,
+                           size_t size, Comparator comparator, SelectionBitmap* selection) {
+    if (left_step != 0 && right_step != 0) {
+      CompareValues<1, 1>(left, right, size, comparator, selection);
+    } else if (left_step != 0) {
+      CompareValues<1, 0>(left, right, size, comparator, selection);
+    } else if (right_step != 0) {
+      CompareValues<0, 1>(left, right, size, comparator, selection);
+    } else {
+      CompareValues<0, 0>(left, right, size, comparator, selection);
+    }
+  }
+
+  template <class Value, class Less, class Equal>
+  static void CompareColumns(MathOperator math_operator,
+                             const Value* left, size_t left_step,
+                             const Value* right, size_t right_step,
+                             size_t size, Less less, Equal equal, SelectionBitmap* selection) {
+    switch (math_operator) {
+      case MATH_OPERATOR_EQUAL:
+        CompareSteps(left, left_step, right, right_step, size, equal, selection);
+        break;
+      case MATH_OPERATOR_LESS_THAN:
+        CompareSteps(left, left_step, right, right_step, size, less, selection);
+        break;
+      case MATH_OPERATOR_BIGGER_THAN:
+        CompareSteps(right, right_step, left, left_step, size, less, selection);
+        break;
+      default:
+        selection->assign((size + 63) / 64, 0);
+        break;
+    }
+  }
+
+  template <class Value>
+  static const Value* ColumnData(const CompiledOperand& operand, const Value& constant,
+                                 const std::vector<Value>& values, size_t* step) {
+    *step = operand.column < 0 ? 0 : 1;
+    return operand.column < 0 ? &constant : values.data();
+  }
+
+  void EvaluateExpression(const CompiledExpression& expression,
+                          const std::vector<Column>& columns, size_t size,
+                          SelectionBitmap* selection) const {
+    static const Column kEmptyColumn = Column();
+    const CompiledOperand& left = expression.left;
+    const CompiledOperand& right = expression.right;
+    const Column& left_column = left.column < 0 ? kEmptyColumn : columns[left.column];
+    const Column& right_column = right.column < 0 ? kEmptyColumn : columns[right.column];
+    size_t left_step = 0;
+    size_t right_step = 0;
+    switch (expression.kind) {
+#define COMPARE_COLUMNS(values, constant, type) \
+      { \
+        const type* left_data = ColumnData(left, left.constant, left_column.values, &left_step); \
+        const type* right_data = \
+            ColumnData(right, right.constant, right_column.values, &right_step); \
+        CompareColumns(expression.math_operator, left_data, left_step, right_data, right_step, \
+                       size, std::less<type>(), std::equal_to<type>(), selection); \
+        break; \
+      }
+
+      case COMPARE_BOOL:
+      case COMPARE_UINT:
+        COMPARE_COLUMNS(uint_values, uint_value, uint64_t);
+      case COMPARE_INT:
+        COMPARE_COLUMNS(int_values, int_value, int64_t);
+      case COMPARE_DOUBLE:
+        COMPARE_COLUMNS(double_values, double_value, double);
+#undef COMPARE_COLUMNS
+
+      case COMPARE_STRING: {
+        const std::string* left_constant = &left.string_value;
+        const std::string* right_constant = &right.string_value;
+        const std::string* const* left_data =
+            ColumnData(left, left_constant, left_column.string_values, &left_step);
+        const std::string* const* right_data =
+            ColumnData(right, right_constant, right_column.string_values, &right_step);
+        CompareColumns(expression.math_operator, left_data, left_step, right_data, right_step,
+                       size, [](const std::string* l, const std::string* r) { return *l < *r; },
+                       [](const std::string* l, const std::string* r) { return *l == *r; },
+                       selection);
+        break;
+      }
+    }
+  }
+
+  void EvaluateNode(int index, const std::vector<Column>& columns, size_t size,
+                    SelectionBitmap* selection) const {
+    const Node& node = nodes_[index];
+    if (node.expression >= 0) {
+      EvaluateExpression(expressions_[node.expression], columns, size, selection);
+    } else if (node.children.empty()) {
+      // 空的与为真, 空的或为假
+      selection->assign((size + 63) / 64, node.is_and ? ~0ULL : 0);
+    } else {
+      EvaluateNode(node.children[0], columns, size, selection);
+      SelectionBitmap child_selection;
+      for (size_t i = 1; i < node.children.size(); ++i) {
+        EvaluateNode(node.children[i], columns, size, &child_selection);
+        for (size_t word = 0; word < selection->size(); ++word) {
+          if (node.is_and) {
+            (*selection)[word] &= child_selection[word];
+          } else {
+            (*selection)[word] |= child_selection[word];
+          }
+        }
+      }
+    }
+    if (node.not_operator) {
+      for (size_t word = 0; word < selection->size(); ++word) {
+        (*selection)[word] = ~(*selection)[word];
+      }
+    }
+  }
+
+  std::vector<CompiledExpression> expressions_;
+  std::vector<Instruction> instructions_;
+  // 列式求值的逻辑树和根
+  std::vector<Node> nodes_;
+  int root_;
+  // 用到的字段, 每个一列
+  std::vector<CompiledOperand> columns_;
+};
+
+// 以Condition接口使用编译后的Lambda
+template <class T>
+class CompiledCondition : public Condition<T> {
+ public:
+  bool Compile(const Lambda& lambda) {
+    return lambda_.Compile(lambda);
+  }
+  //
+  bool Satisfy(const T& t) {
+    return lambda_.Satisfy(t);
+  }
+  //
+  void Filter(const std::vector<T>& items, std::vector<bool>* results) {
+    lambda_.Filter(items, results);
+  }
+
+ private:
+  CompiledLambda<T> lambda_;
+};
+
+}  // namespace learning
+}  // namespace gdt
+
+#endif  // LEARNING_CLEANER_COMPILED_LAMBDA_H_
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
 
 #include "app/qzap/common/base/shared_ptr.h"
 #include "thirdparty/glog/logging.h"
@@ -25,6 +26,13 @@ class Condition {
   virtual bool Satisfy(const T& t) {
     return true;
   };
+  // 批量判断, results与items一一对应
+  virtual void Filter(const std::vector<T>& items, std::vector<bool>* results) {
+    results->resize(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+      (*results)[i] = Satisfy(items[i]);
+    }
+  }
   // 析构
   virtual ~Condition() {};
 };
@@ -13,6 +13,7 @@
 #include <functional>
 #include "common/proto/config.pb.h"
 #include "common/encoding/proto_converter.h"
+#include "learning/cleaner/compiled_lambda.h"
 #include "learning/cleaner/condition.h"
 #include "learning/proto/condition.pb.h"
 #include "framework/common/base_functor.h"
@@ -152,6 +153,14 @@ class LambdaParser {
     }
     return true;
   }
+
+  // 与Parse结果相同, 字段在编译时解析, 用于大批量数据的过滤
+  bool Compile(const Lambda& lambda, shared_ptr<Condition<T> >& condition) {
+    shared_ptr<CompiledCondition<T> > compiled_condition(new CompiledCondition<T>());
+    CHECK_LOG(compiled_condition->Compile(lambda), lambda.Utf8DebugString());
+    condition = compiled_condition;
+    return true;
+  }
 };
 
 }  // namespace learning
@@ -82,4 +82,126 @@ TEST(Condition, AndConditionTest) {
   commodity4.set_commodity_id(10);
   commodity4.set_source_id(8);
   EXPECT_EQ(condition->Satisfy(commodity4), true);
-}
\ No newline at end of file
+}
+
+static void AddExpression(gdt::learning::MathOperator math_operator, const std::string& left_name,
+                          const std::string& right_name, gdt::learning::Lambda* lambda) {
+  gdt::learning::Expression* expression = lambda->add_expression();
+  expression->set_math_operator(math_operator);
+  expression->mutable_left_field()->add_field_name(left_name);
+  expression->mutable_right_field()->add_field_name(right_name);
+}
+
+TEST(LambdaParser, CompileTest) {
+  // not (commodity_id == 10 or (commodity_id > source_id and commodity_name < "b"))
+  gdt::learning::Lambda lambda;
+  lambda.set_not_operator(true);
+  lambda.set_logical_operator(gdt::learning::LOGICAL_OPERATOR_OR);
+  gdt::learning::Expression* expression = lambda.add_expression();
+  expression->set_math_operator(gdt::learning::MATH_OPERATOR_EQUAL);
+  expression->mutable_left_field()->add_field_name("commodity_id");
+  expression->mutable_right_field()->mutable_field_value()->set_data_type(FieldValue::UINT64);
+  expression->mutable_right_field()->mutable_field_value()->set_uint64_value(10);
+  gdt::learning::Lambda* child = lambda.add_lambda();
+  child->set_logical_operator(gdt::learning::LOGICAL_OPERATOR_AND);
+  AddExpression(gdt::learning::MATH_OPERATOR_BIGGER_THAN, "commodity_id", "source_id", child);
+  expression = child->add_expression();
+  expression->set_math_operator(gdt::learning::MATH_OPERATOR_LESS_THAN);
+  expression->mutable_left_field()->add_field_name("commodity_name");
+  expression->mutable_right_field()->mutable_field_value()->set_data_type(FieldValue::STRING);
+  expression->mutable_right_field()->mutable_field_value()->set_string_value("b");
+
+  LambdaParser<Commodity> lambda_parser;
+  shared_ptr<Condition<Commodity> > condition;
+  ASSERT_TRUE(lambda_parser.Parse(lambda, condition));
+  shared_ptr<Condition<Commodity> > compiled_condition;
+  ASSERT_TRUE(lambda_parser.Compile(lambda, compiled_condition));
+
+  std::vector<Commodity> commodities;
+  for (uint64_t commodity_id = 8; commodity_id <= 12; ++commodity_id) {
+    for (uint64_t source_id = 9; source_id <= 11; ++source_id) {
+      for (const char* name : {"a", "c"}) {
+        Commodity commodity;
+        commodity.set_commodity_id(commodity_id);
+        commodity.set_source_id(source_id);
+        commodity.set_commodity_name(name);
+        commodities.push_back(commodity);
+      }
+    }
+  }
+  std::vector<bool> results;
+  compiled_condition->Filter(commodities, &results);
+  ASSERT_EQ(commodities.size(), results.size());
+  for (size_t i = 0; i < commodities.size(); ++i) {
+    const Commodity& commodity = commodities[i];
+    bool expected = !(commodity.commodity_id() == 10 ||
+                      (commodity.commodity_id() > commodity.source_id() &&
+                       commodity.commodity_name() < "b"));
+    EXPECT_EQ(expected, condition->Satisfy(commodity)) << commodity.ShortDebugString();
+    EXPECT_EQ(expected, results[i]) << commodity.ShortDebugString();
+  }
+}
+
+TEST(LambdaParser, CompileErrorTest) {
+  LambdaParser<Commodity> lambda_parser;
+  shared_ptr<Condition<Commodity> > condition;
+  gdt::learning::Lambda lambda;
+  AddExpression(gdt::learning::MATH_OPERATOR_EQUAL, "commodity_id", "unknown_field", &lambda);
+  EXPECT_FALSE(lambda_parser.Compile(lambda, condition));
+  lambda.Clear();
+  AddExpression(gdt::learning::MATH_OPERATOR_EQUAL, "commodity_id", "commodity_name", &lambda);
+  EXPECT_FALSE(lambda_parser.Compile(lambda, condition));
+}
+
+TEST(LambdaParser, ColumnarFilterTest) {
+  // (pctr > 0.5 and not (pos_id == 3)) or id < "1" or fix_pctr < click
+  gdt::learning::Lambda lambda;
+  lambda.set_logical_operator(gdt::learning::LOGICAL_OPERATOR_OR);
+  gdt::learning::Lambda* child = lambda.add_lambda();
+  child->set_logical_operator(gdt::learning::LOGICAL_OPERATOR_AND);
+  gdt::learning::Expression* expression = child->add_expression();
+  expression->set_math_operator(gdt::learning::MATH_OPERATOR_BIGGER_THAN);
+  expression->mutable_left_field()->add_field_name("pctr");
+  expression->mutable_right_field()->mutable_field_value()->set_data_type(FieldValue::DOUBLE);
+  expression->mutable_right_field()->mutable_field_value()->set_double_value(0.5);
+  gdt::learning::Lambda* grandchild = child->add_lambda();
+  grandchild->set_not_operator(true);
+  expression = grandchild->add_expression();
+  expression->set_math_operator(gdt::learning::MATH_OPERATOR_EQUAL);
+  expression->mutable_left_field()->add_field_name("pos_id");
+  expression->mutable_right_field()->mutable_field_value()->set_data_type(FieldValue::UINT32);
+  expression->mutable_right_field()->mutable_field_value()->set_uint32_value(3);
+  expression = lambda.add_expression();
+  expression->set_math_operator(gdt::learning::MATH_OPERATOR_LESS_THAN);
+  expression->mutable_left_field()->add_field_name("id");
+  expression->mutable_right_field()->mutable_field_value()->set_data_type(FieldValue::STRING);
+  expression->mutable_right_field()->mutable_field_value()->set_string_value("1");
+  AddExpression(gdt::learning::MATH_OPERATOR_LESS_THAN, "fix_pctr", "click", &lambda);
+
+  CompiledLambda<Exposure> compiled_lambda;
+  ASSERT_TRUE(compiled_lambda.Compile(lambda));
+  // 超过一批, 最后一批不满64的整数倍
+  std::vector<Exposure> exposures(CompiledLambda<Exposure>::kBatchSize * 2 + 100);
+  for (size_t i = 0; i < exposures.size(); ++i) {
+    Exposure& exposure = exposures[i];
+    exposure.set_pctr((i % 10) / 10.0);
+    exposure.set_pos_id(i % 5);
+    exposure.set_id(std::to_string(i % 13));
+    exposure.set_fix_pctr((i % 7) / 2.0);
+    exposure.set_click(i % 3);
+  }
+  std::vector<bool> results;
+  compiled_lambda.Filter(exposures, &results);
+  ASSERT_EQ(exposures.size(), results.size());
+  size_t selected = 0;
+  for (size_t i = 0; i < exposures.size(); ++i) {
+    const Exposure& exposure = exposures[i];
+    bool expected = (exposure.pctr() > 0.5 && !(exposure.pos_id() == 3)) ||
+                    exposure.id() < "1" || exposure.fix_pctr() < exposure.click();
+    ASSERT_EQ(expected, results[i]) << i;
+    ASSERT_EQ(expected, compiled_lambda.Satisfy(exposure)) << i;
+    selected += expected;
+  }
+  EXPECT_GT(selected, 0u);
+  EXPECT_LT(selected, exposures.size());
+}
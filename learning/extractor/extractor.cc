@@ -3,31 +3,400 @@
 
 
 #include "learning/extractor/extractor.h"
+
+#include <stdlib.h>
+#include <string.h>
 #include <algorithm>
+#include "thirdparty/glog/logging.h"
+#include "app/qzap/common/utility/hash.h"
+#include "framework/common/base_functor.h"
 
 namespace gdt {
 namespace learning {
 
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+typedef FeatureConfig::DataTransformConfig DataTransformConfig;
+
+// 数值列的key与列号组合, 与类别值区分
+static const uint64_t kNumericSeed = 0x5bd1e9955bd1e995ULL;
+static const uint64_t kBucketSeed = 0xc6a4a7935bd1e995ULL;
+
+static inline uint64_t HashCombine(uint64_t seed, uint64_t value) {
+  uint64_t key = seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+static inline uint64_t DoubleBits(double number) {
+  uint64_t bits = 0;
+  memcpy(&bits, &number, sizeof(bits));
+  return bits;
+}
+
+static bool IsNumeric(const FieldDescriptor* field) {
+  return field->cpp_type() != FieldDescriptor::CPPTYPE_STRING;
+}
+
+template <bool kRepeated>
+static inline bool ReadNumber(const Message& message, const Reflection* reflection,
+                              const FieldDescriptor* field, int index, uint64_t* hash,
+                              double* number) {
+  switch (field->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_BOOL: {
+      bool value = kRepeated ? reflection->GetRepeatedBool(message, field, index) :
+          reflection->GetBool(message, field);
+      *hash = value;
+      *number = value;
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_INT32: {
+      int32_t value = kRepeated ? reflection->GetRepeatedInt32(message, field, index) :
+          reflection->GetInt32(message, field);
+      *hash = static_cast<uint64_t>(static_cast<int64_t>(value));
+      *number = value;
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_INT64: {
+      int64_t value = kRepeated ? reflection->GetRepeatedInt64(message, field, index) :
+          reflection->GetInt64(message, field);
+      *hash = static_cast<uint64_t>(value);
+      *number = static_cast<double>(value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_UINT32: {
+      uint32_t value = kRepeated ? reflection->GetRepeatedUInt32(message, field, index) :
+          reflection->GetUInt32(message, field);
+      *hash = value;
+      *number = value;
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_UINT64: {
+      uint64_t value = kRepeated ? reflection->GetRepeatedUInt64(message, field, index) :
+          reflection->GetUInt64(message, field);
+      *hash = value;
+      *number = static_cast<double>(value);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_ENUM: {
+      int value = kRepeated ? reflection->GetRepeatedEnum(message, field, index)->number() :
+          reflection->GetEnum(message, field)->number();
+      *hash = static_cast<uint64_t>(static_cast<int64_t>(value));
+      *number = value;
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_FLOAT: {
+      float value = kRepeated ? reflection->GetRepeatedFloat(message, field, index) :
+          reflection->GetFloat(message, field);
+      *number = value;
+      *hash = DoubleBits(*number);
+      return true;
+    }
+    case FieldDescriptor::CPPTYPE_DOUBLE: {
+      double value = kRepeated ? reflection->GetRepeatedDouble(message, field, index) :
+          reflection->GetDouble(message, field);
+      *number = value;
+      *hash = DoubleBits(value);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
 
-bool Extractor::Init(const ExtractorConfig& extractor_config) {
-  extractor_config_.CopyFrom(extractor_config);
+bool Extractor::Init(const ExtractorConfig& extractor_config, const Descriptor* descriptor) {
+  CHECK_LOG(descriptor != NULL, "NULL descriptor");
+  descriptor_ = descriptor;
+  features_.clear();
+  features_.resize(extractor_config.feature_config_size());
+  for (int i = 0; i < extractor_config.feature_config_size(); ++i) {
+    CHECK_LOG(CompileFeature(extractor_config.feature_config(i), &features_[i]),
+              extractor_config.feature_config(i).Utf8DebugString());
+  }
   return true;
 }
 
-bool Extractor::Extract(const google::protobuf::Message& message,
-                        std::map<std::string, FieldValue>* features) {
-  std::for_each(extractor_config_.feature_config().begin(),
-  	            extractor_config_.feature_config().end(),
-  	            std::bind(&Extractor::ExtractFeature, this, &message,
-  	            	      std::placeholders::_1, features));
+bool Extractor::CompileFeature(const FeatureConfig& feature_config, CompiledFeature* feature) {
+  feature->feature_name = feature_config.feature_name();
+  feature->operations.clear();
+  // 编译时跟踪每一列的类型
+  std::vector<bool> numeric;
+  for (int i = 0; i < feature_config.transform_config_size(); ++i) {
+    const DataTransformConfig& config = feature_config.transform_config(i);
+    Operation operation;
+    switch (config.process_config_case()) {
+      case DataTransformConfig::kGetValueConfig: {
+        const DataTransformConfig::GetValueConfig& get_value = config.get_value_config();
+        CHECK_LOG(get_value.filed_name_size() > 0, config.Utf8DebugString());
+        for (int j = 0; j < get_value.filed_name_size(); ++j) {
+          PASS_OR_RETURN(CompileGetValue(
+              get_value.filed_name(j),
+              get_value.has_miss_value() ? &get_value.miss_value() : NULL,
+              feature));
+          numeric.push_back(feature->operations.back().numeric);
+        }
+        break;
+      }
+      case DataTransformConfig::kCrossFeatureConfig: {
+        const DataTransformConfig::CrossFeatureConfig& cross = config.cross_feature_config();
+        for (int j = 0; j < cross.feature_name_size(); ++j) {
+          PASS_OR_RETURN(CompileGetValue(cross.feature_name(j), NULL, feature));
+        }
+        CHECK_LOG(numeric.size() + cross.feature_name_size() > 0, config.Utf8DebugString());
+        operation.op = OP_CROSS;
+        feature->operations.push_back(operation);
+        numeric.assign(1, false);
+        break;
+      }
+      case DataTransformConfig::kNormalizationConfig: {
+        const DataTransformConfig::NormalizationConfig& normalization =
+            config.normalization_config();
+        if (normalization.normalization_type() ==
+            DataTransformConfig::NormalizationConfig::HASH) {
+          // 类别列不变
+          operation.op = OP_HASH;
+          numeric.assign(numeric.size(), false);
+        } else {
+          CHECK_LOG(std::find(numeric.begin(), numeric.end(), false) == numeric.end(),
+                    "zscore on string column");
+          CHECK_LOG(normalization.stddev() > 0, config.Utf8DebugString());
+          operation.op = OP_ZSCORE;
+          operation.offset = normalization.mean();
+          operation.scale = 1.0 / normalization.stddev();
+        }
+        feature->operations.push_back(operation);
+        break;
+      }
+      case DataTransformConfig::kDiscretizationConfig: {
+        const DataTransformConfig::DiscretizationConfig& discretization =
+            config.discretization_config();
+        CHECK_LOG(std::find(numeric.begin(), numeric.end(), false) == numeric.end(),
+                  "discretize string column");
+        CHECK_LOG(discretization.bucket_num() > 0 &&
+                  discretization.max_value() > discretization.min_value(),
+                  config.Utf8DebugString());
+        operation.op = OP_DISCRETIZE;
+        operation.offset = discretization.min_value();
+        operation.scale = discretization.bucket_num() /
+            (discretization.max_value() - discretization.min_value());
+        operation.bucket_num = discretization.bucket_num();
+        feature->operations.push_back(operation);
+        numeric.assign(numeric.size(), false);
+        break;
+      }
+      default:
+        LOG(ERROR) << "Empty transform config\t" << feature_config.Utf8DebugString();
+        return false;
+    }
+  }
   return true;
 }
 
-bool Extractor::ExtractFeature(const google::protobuf::Message* message,
-                               const FeatureConfig& feature_config,
-                               std::map<std::string, FieldValue>* feature) {
+bool Extractor::CompileGetValue(const std::string& field_name, const std::string* miss_value,
+                                CompiledFeature* feature) {
+  Operation operation;
+  const Descriptor* descriptor = descriptor_;
+  size_t begin = 0;
+  while (true) {
+    CHECK_LOG(descriptor != NULL, field_name);
+    size_t end = field_name.find('.', begin);
+    const FieldDescriptor* field = descriptor->FindFieldByName(
+        field_name.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+    CHECK_LOG(field != NULL, field_name);
+    operation.path.push_back(field);
+    if (end == std::string::npos) {
+      break;
+    }
+    // 中间的字段必须是非重复的消息
+    CHECK_LOG(field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE && !field->is_repeated(),
+              field_name);
+    descriptor = field->message_type();
+    begin = end + 1;
+  }
+  const FieldDescriptor* leaf = operation.path.back();
+  CHECK_LOG(leaf->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE, field_name);
+  operation.numeric = IsNumeric(leaf);
+  operation.has_miss_value = miss_value != NULL;
+  if (miss_value != NULL) {
+    if (operation.numeric) {
+      char* end = NULL;
+      operation.miss_value.number = strtod(miss_value->c_str(), &end);
+      CHECK_LOG(!miss_value->empty() && *end == '\0', *miss_value);
+      operation.miss_value.hash = DoubleBits(operation.miss_value.number);
+      if (leaf->cpp_type() != FieldDescriptor::CPPTYPE_FLOAT &&
+          leaf->cpp_type() != FieldDescriptor::CPPTYPE_DOUBLE) {
+        operation.miss_value.hash = static_cast<uint64_t>(
+            static_cast<int64_t>(operation.miss_value.number));
+      }
+    } else {
+      operation.miss_value.hash = hash_string(*miss_value);
+    }
+  }
+  feature->operations.push_back(operation);
   return true;
 }
 
+bool Extractor::Extract(const Message& message, std::vector<SparseFeature>* features) {
+  CHECK_LOG(message.GetDescriptor() == descriptor_, message.GetDescriptor()->full_name());
+  features->clear();
+  for (size_t i = 0; i < features_.size(); ++i) {
+    ExtractFeature(message, features_[i], features);
+  }
+  return true;
+}
+
+void Extractor::ExtractFeature(const Message& message, const CompiledFeature& feature,
+                               std::vector<SparseFeature>* features) {
+  columns_.clear();
+  values_.clear();
+  for (size_t i = 0; i < feature.operations.size(); ++i) {
+    const Operation& operation = feature.operations[i];
+    switch (operation.op) {
+      case OP_GET_VALUE:
+        GetValue(message, operation);
+        break;
+      case OP_CROSS:
+        Cross();
+        break;
+      case OP_HASH:
+        for (size_t j = 0; j < columns_.size(); ++j) {
+          columns_[j].numeric = false;
+        }
+        break;
+      case OP_ZSCORE:
+        for (size_t j = 0; j < values_.size(); ++j) {
+          Value& value = values_[j];
+          value.number = (value.number - operation.offset) * operation.scale;
+          value.hash = DoubleBits(value.number);
+        }
+        break;
+      case OP_DISCRETIZE:
+        for (size_t j = 0; j < values_.size(); ++j) {
+          Value& value = values_[j];
+          double bucket = (value.number - operation.offset) * operation.scale;
+          bucket = std::max(std::min(bucket, operation.bucket_num - 1.0), 0.0);
+          value.hash = HashCombine(kBucketSeed, static_cast<uint64_t>(bucket));
+          value.number = 1;
+        }
+        for (size_t j = 0; j < columns_.size(); ++j) {
+          columns_[j].numeric = false;
+        }
+        break;
+    }
+  }
+  uint64_t seed = HashCombine(0, feature.feature_name);
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    const Column& column = columns_[i];
+    uint64_t numeric_key = HashCombine(HashCombine(seed, kNumericSeed), i);
+    // 类别值也与列号组合, 否则不同列的相同值(或相同的桶)会冲突
+    uint64_t categorical_seed = HashCombine(seed, i);
+    for (size_t j = column.begin; j < column.end; ++j) {
+      SparseFeature sparse_feature;
+      if (column.numeric) {
+        sparse_feature.key = numeric_key;
+        sparse_feature.value = static_cast<float>(values_[j].number);
+      } else {
+        sparse_feature.key = HashCombine(categorical_seed, values_[j].hash);
+        sparse_feature.value = 1;
+      }
+      features->push_back(sparse_feature);
+    }
+  }
+}
+
+void Extractor::GetValue(const Message& message, const Operation& operation) {
+  Column column;
+  column.numeric = operation.numeric;
+  column.begin = values_.size();
+  const Message* leaf = &message;
+  bool exist = true;
+  for (size_t i = 0; exist && i + 1 < operation.path.size(); ++i) {
+    const Reflection* reflection = leaf->GetReflection();
+    exist = reflection->HasField(*leaf, operation.path[i]);
+    leaf = &reflection->GetMessage(*leaf, operation.path[i]);
+  }
+  const Reflection* reflection = leaf->GetReflection();
+  const FieldDescriptor* field = operation.path.back();
+  Value value;
+  if (!exist) {
+    // 中间的消息不存在
+  } else if (field->is_repeated()) {
+    int size = reflection->FieldSize(*leaf, field);
+    for (int i = 0; i < size; ++i) {
+      if (operation.numeric) {
+        ReadNumber<true>(*leaf, reflection, field, i, &value.hash, &value.number);
+      } else {
+        const std::string& string_value =
+            reflection->GetRepeatedStringReference(*leaf, field, i, &string_buffer_);
+        value.hash = hash_string(string_value);
+        value.number = 1;
+      }
+      values_.push_back(value);
+    }
+  } else if (reflection->HasField(*leaf, field)) {
+    if (operation.numeric) {
+      ReadNumber<false>(*leaf, reflection, field, 0, &value.hash, &value.number);
+    } else {
+      const std::string& string_value =
+          reflection->GetStringReference(*leaf, field, &string_buffer_);
+      value.hash = hash_string(string_value);
+      value.number = 1;
+    }
+    values_.push_back(value);
+  }
+  if (values_.size() == column.begin && operation.has_miss_value) {
+    values_.push_back(operation.miss_value);
+  }
+  column.end = values_.size();
+  columns_.push_back(column);
+}
+
+void Extractor::Cross() {
+  cross_values_.clear();
+  cursors_.clear();
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    if (columns_[i].begin == columns_[i].end) {
+      // 有一列为空时积为空
+      columns_.clear();
+      values_.clear();
+      return;
+    }
+    cursors_.push_back(columns_[i].begin);
+  }
+  while (true) {
+    Value value;
+    value.hash = 0;
+    value.number = 1;
+    for (size_t i = 0; i < columns_.size(); ++i) {
+      value.hash = HashCombine(value.hash, values_[cursors_[i]].hash);
+    }
+    cross_values_.push_back(value);
+    // 按最后一列最快变化的顺序枚举
+    size_t i = columns_.size();
+    for (; i > 0; --i) {
+      if (++cursors_[i - 1] < columns_[i - 1].end) {
+        break;
+      }
+      cursors_[i - 1] = columns_[i - 1].begin;
+    }
+    if (i == 0) {
+      break;
+    }
+  }
+  values_.swap(cross_values_);
+  Column column;
+  column.numeric = false;
+  column.begin = 0;
+  column.end = values_.size();
+  columns_.assign(1, column);
+}
+
 }  // namespace learning
-}  // namespace gdt
\ No newline at end of file
+}  // namespace gdt
@@ -1,41 +1,119 @@
 // Copyright (c) 2014, Tencent Inc.
 // Author: Wang Qian<cernwang@tencent.com>
 
-// 对商品数据库的操作的类
-#ifndef LEARNING_CLEANER_LAMBDA_PARSER_H_
-#define LEARNING_CLEANER_LAMBDA_PARSER_H_
+// 按ExtractorConfig从消息中抽取稀疏特征.
+// 字段路径在Init时解析为FieldDescriptor, 每个特征的变换编译为操作序列;
+// 抽取时只写调用方的缓冲区和复用的成员缓冲区, 不分配内存
+#ifndef LEARNING_EXTRACTOR_EXTRACTOR_H_
+#define LEARNING_EXTRACTOR_EXTRACTOR_H_
 
-
-#include <cstdlib>
-#include <iostream>
+#include <stdint.h>
 #include <string>
-#include <map>
-#include <functional>
-#include "common/proto/config.pb.h"
-#include "common/encoding/proto_converter.h"
-#include "framework/common/base_functor.h"
-#include "learning/cleaner/condition.h"
-#include "learning/proto/condition.pb.h"
-#include "learning/cleaner/lambda_parser.h"
-#include "learning/proto/test.pb.h"
+#include <vector>
+#include "thirdparty/protobuf/descriptor.h"
+#include "thirdparty/protobuf/message.h"
 #include "learning/proto/extractor.pb.h"
 
 namespace gdt {
 namespace learning {
 
+// 一个稀疏特征, key是特征名与特征值的哈希
+struct SparseFeature {
+  uint64_t key;
+  float value;
+};
+
+// 一个特征的值先按列保存: GetValue每个字段一列, 重复字段一列有多个值.
+// 数值列输出为(特征名和列号的哈希, 数值), 类别列输出为(特征名、列号和值的哈希, 1).
+// 同一个Extractor不能被多个线程同时使用
 class Extractor {
  public:
-  bool Init(const ExtractorConfig& extractor_config);
+  Extractor() : descriptor_(NULL) {}
+
+  // descriptor为要抽取的消息类型
+  bool Init(const ExtractorConfig& extractor_config,
+            const google::protobuf::Descriptor* descriptor);
+
+  // 清空features后写入所有特征, features的容量在多次调用间复用
   bool Extract(const google::protobuf::Message& message,
-               std::map<std::string, FieldValue>* features);
-  bool ExtractFeature(const google::protobuf::Message* message,
-                      const FeatureConfig& feature_config,
-                      std::map<std::string, FieldValue>* feature);
+               std::vector<SparseFeature>* features);
+
  private:
-  ExtractorConfig extractor_config_;
+  enum OpCode {
+    // 取一个字段, 追加一列
+    OP_GET_VALUE,
+    // 所有列做笛卡尔积, 合并为一个类别列
+    OP_CROSS,
+    // 数值列转为类别列
+    OP_HASH,
+    OP_ZSCORE,
+    // 数值列等距分桶, 转为类别列
+    OP_DISCRETIZE,
+  };
+
+  // 列中的一个值. 数值的hash是整数值或浮点数的位, 类别的hash是字符串的哈希
+  struct Value {
+    uint64_t hash;
+    double number;
+  };
+
+  struct Operation {
+    Operation()
+        : op(OP_GET_VALUE), numeric(false), has_miss_value(false),
+          offset(0), scale(1), bucket_num(0) {
+      miss_value.hash = 0;
+      miss_value.number = 0;
+    }
+    OpCode op;
+    // OP_GET_VALUE: 字段路径, 中间是非重复的消息字段
+    std::vector<const google::protobuf::FieldDescriptor*> path;
+    bool numeric;
+    bool has_miss_value;
+    Value miss_value;
+    // OP_ZSCORE: mean, 1 / stddev; OP_DISCRETIZE: min_value, bucket_num / (max - min)
+    double offset;
+    double scale;
+    uint32_t bucket_num;
+  };
+
+  struct CompiledFeature {
+    uint32_t feature_name;
+    std::vector<Operation> operations;
+  };
+
+  // 抽取时的一列, 值在values_的[begin, end)
+  struct Column {
+    bool numeric;
+    size_t begin;
+    size_t end;
+  };
+
+  bool CompileFeature(const FeatureConfig& feature_config, CompiledFeature* feature);
+
+  // 解析字段路径, 追加一个OP_GET_VALUE
+  bool CompileGetValue(const std::string& field_name, const std::string* miss_value,
+                       CompiledFeature* feature);
+
+  void ExtractFeature(const google::protobuf::Message& message,
+                      const CompiledFeature& feature,
+                      std::vector<SparseFeature>* features);
+
+  // 把字段的值追加到values_, 字段不存在时用miss_value
+  void GetValue(const google::protobuf::Message& message, const Operation& operation);
+
+  void Cross();
+
+  const google::protobuf::Descriptor* descriptor_;
+  std::vector<CompiledFeature> features_;
+  // 抽取时复用的缓冲区
+  std::vector<Column> columns_;
+  std::vector<Value> values_;
+  std::vector<Value> cross_values_;
+  std::vector<size_t> cursors_;
+  std::string string_buffer_;
 };
 
 }  // namespace learning
 }  // namespace gdt
 
-#endif  // LEARNING_CLEANER_LAMBDA_PARSER_H_
+#endif  // LEARNING_EXTRACTOR_EXTRACTOR_H_
@@ -0,0 +1,224 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+
+#include <string>
+#include <vector>
+#include "thirdparty/gtest/gtest.h"
+#include "thirdparty/protobuf/text_format.h"
+#include "learning/extractor/extractor.h"
+#include "learning/proto/condition.pb.h"
+#include "learning/proto/test.pb.h"
+
+using gdt::learning::Extractor;
+using gdt::learning::SparseFeature;
+
+static bool InitExtractor(const std::string& text, const google::protobuf::Descriptor* descriptor,
+                          Extractor* extractor) {
+  ExtractorConfig config;
+  EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(text, &config)) << text;
+  return extractor->Init(config, descriptor);
+}
+
+static Exposure MakeExposure(uint32_t ad_id, uint32_t pos_id, double pctr) {
+  Exposure exposure;
+  exposure.set_ad_id(ad_id);
+  exposure.set_pos_id(pos_id);
+  exposure.set_pctr(pctr);
+  exposure.set_id("exposure");
+  return exposure;
+}
+
+TEST(Extractor, GetValue) {
+  Extractor extractor;
+  ASSERT_TRUE(InitExtractor(
+      "feature_config { feature_name: 1 transform_config {"
+      "  get_value_config { filed_name: 'pctr' } } }"
+      "feature_config { feature_name: 2 transform_config {"
+      "  get_value_config { filed_name: 'id' } } }"
+      "feature_config { feature_name: 3 transform_config {"
+      "  get_value_config { filed_name: 'bid' miss_value: '7' } } }"
+      "feature_config { feature_name: 4 transform_config {"
+      "  get_value_config { filed_name: 'click' } } }",
+      Exposure::descriptor(), &extractor));
+  std::vector<SparseFeature> features;
+  Exposure exposure = MakeExposure(1, 2, 0.25);
+  ASSERT_TRUE(extractor.Extract(exposure, &features));
+  // click不存在且没有miss_value, 不输出
+  ASSERT_EQ(3u, features.size());
+  EXPECT_FLOAT_EQ(0.25, features[0].value);
+  EXPECT_FLOAT_EQ(1, features[1].value);
+  EXPECT_FLOAT_EQ(7, features[2].value);
+
+  // 数值特征的key与值无关, 类别特征的key与值有关
+  std::vector<SparseFeature> other_features;
+  exposure.set_pctr(0.5);
+  exposure.set_id("other");
+  exposure.set_bid(9);
+  ASSERT_TRUE(extractor.Extract(exposure, &other_features));
+  ASSERT_EQ(3u, other_features.size());
+  EXPECT_EQ(features[0].key, other_features[0].key);
+  EXPECT_FLOAT_EQ(0.5, other_features[0].value);
+  EXPECT_NE(features[1].key, other_features[1].key);
+  EXPECT_EQ(features[2].key, other_features[2].key);
+  EXPECT_FLOAT_EQ(9, other_features[2].value);
+
+  // 消息类型不同时失败
+  Commodity commodity;
+  EXPECT_FALSE(extractor.Extract(commodity, &features));
+}
+
+TEST(Extractor, Cross) {
+  Extractor extractor;
+  ASSERT_TRUE(InitExtractor(
+      "feature_config { feature_name: 1"
+      "  transform_config { get_value_config { filed_name: 'ad_id' } }"
+      "  transform_config { cross_feature_config { feature_name: 'pos_id' } } }"
+      "feature_config { feature_name: 2"
+      "  transform_config { cross_feature_config {"
+      "    feature_name: 'ad_id' feature_name: 'pos_id' } } }",
+      Exposure::descriptor(), &extractor));
+  std::vector<SparseFeature> features;
+  ASSERT_TRUE(extractor.Extract(MakeExposure(1, 2, 0), &features));
+  ASSERT_EQ(2u, features.size());
+  // 特征名不同key不同
+  EXPECT_NE(features[0].key, features[1].key);
+  std::vector<SparseFeature> other_features;
+  ASSERT_TRUE(extractor.Extract(MakeExposure(2, 1, 0), &other_features));
+  ASSERT_EQ(2u, other_features.size());
+  EXPECT_NE(features[0].key, other_features[0].key);
+  ASSERT_TRUE(extractor.Extract(MakeExposure(1, 2, 0.5), &other_features));
+  EXPECT_EQ(features[0].key, other_features[0].key);
+
+  // 有一个字段不存在时不输出
+  Exposure exposure;
+  exposure.set_ad_id(1);
+  ASSERT_TRUE(extractor.Extract(exposure, &features));
+  EXPECT_TRUE(features.empty());
+}
+
+TEST(Extractor, NestedAndRepeated) {
+  Extractor extractor;
+  ASSERT_TRUE(InitExtractor(
+      "feature_config { feature_name: 1"
+      "  transform_config { get_value_config { filed_name: 'math_operator' } }"
+      "  transform_config { cross_feature_config { feature_name: 'left_field.field_name' } } }"
+      "feature_config { feature_name: 2 transform_config {"
+      "  get_value_config { filed_name: 'left_field.field_value.uint64_value' } } }",
+      gdt::learning::Expression::descriptor(), &extractor));
+  gdt::learning::Expression expression;
+  expression.set_math_operator(gdt::learning::MATH_OPERATOR_EQUAL);
+  expression.mutable_left_field()->add_field_name("a");
+  expression.mutable_left_field()->add_field_name("b");
+  std::vector<SparseFeature> features;
+  ASSERT_TRUE(extractor.Extract(expression, &features));
+  // 重复字段的每个值与math_operator交叉, field_value不存在
+  ASSERT_EQ(2u, features.size());
+  EXPECT_NE(features[0].key, features[1].key);
+
+  expression.mutable_left_field()->mutable_field_value()->set_uint64_value(100);
+  ASSERT_TRUE(extractor.Extract(expression, &features));
+  ASSERT_EQ(3u, features.size());
+  EXPECT_FLOAT_EQ(100, features[2].value);
+}
+
+TEST(Extractor, Transform) {
+  Extractor extractor;
+  ASSERT_TRUE(InitExtractor(
+      "feature_config { feature_name: 1"
+      "  transform_config { get_value_config { filed_name: 'pctr' } }"
+      "  transform_config { normalization_config {"
+      "    normalization_type: ZSCORE mean: 0.5 stddev: 0.25 } } }"
+      "feature_config { feature_name: 2"
+      "  transform_config { get_value_config { filed_name: 'ad_id' } }"
+      "  transform_config { normalization_config { normalization_type: HASH } } }"
+      "feature_config { feature_name: 3"
+      "  transform_config { get_value_config { filed_name: 'pctr' } }"
+      "  transform_config { discretization_config {"
+      "    min_value: 0 max_value: 1 bucket_num: 10 } } }",
+      Exposure::descriptor(), &extractor));
+  std::vector<SparseFeature> features;
+  ASSERT_TRUE(extractor.Extract(MakeExposure(1, 2, 0.25), &features));
+  ASSERT_EQ(3u, features.size());
+  EXPECT_FLOAT_EQ(-1, features[0].value);
+  EXPECT_FLOAT_EQ(1, features[1].value);
+  EXPECT_FLOAT_EQ(1, features[2].value);
+
+  std::vector<SparseFeature> same_bucket;
+  ASSERT_TRUE(extractor.Extract(MakeExposure(2, 2, 0.29), &same_bucket));
+  EXPECT_NE(features[1].key, same_bucket[1].key);
+  EXPECT_EQ(features[2].key, same_bucket[2].key);
+  std::vector<SparseFeature> other_bucket;
+  ASSERT_TRUE(extractor.Extract(MakeExposure(1, 2, 0.31), &other_bucket));
+  EXPECT_EQ(features[1].key, other_bucket[1].key);
+  EXPECT_NE(features[2].key, other_bucket[2].key);
+
+  // 范围外的值归入两端的桶
+  std::vector<SparseFeature> low;
+  std::vector<SparseFeature> lowest;
+  ASSERT_TRUE(extractor.Extract(MakeExposure(1, 2, 0.05), &low));
+  ASSERT_TRUE(extractor.Extract(MakeExposure(1, 2, -3), &lowest));
+  EXPECT_EQ(low[2].key, lowest[2].key);
+}
+
+TEST(Extractor, SameValueInDifferentColumns) {
+  Extractor extractor;
+  ASSERT_TRUE(InitExtractor(
+      "feature_config { feature_name: 1"
+      "  transform_config { get_value_config { filed_name: 'ad_id' filed_name: 'pos_id' } }"
+      "  transform_config { normalization_config { normalization_type: HASH } } }"
+      "feature_config { feature_name: 2"
+      "  transform_config { get_value_config { filed_name: 'pctr' filed_name: 'quality' } }"
+      "  transform_config { discretization_config {"
+      "    min_value: 0 max_value: 1 bucket_num: 10 } } }",
+      Exposure::descriptor(), &extractor));
+  Exposure exposure = MakeExposure(3, 3, 0.25);
+  exposure.set_quality(0.25);
+  std::vector<SparseFeature> features;
+  ASSERT_TRUE(extractor.Extract(exposure, &features));
+  // 值相同(或落在同一个桶)的不同列key不同
+  ASSERT_EQ(4u, features.size());
+  EXPECT_NE(features[0].key, features[1].key);
+  EXPECT_NE(features[2].key, features[3].key);
+}
+
+TEST(Extractor, ReuseBuffer) {
+  Extractor extractor;
+  ASSERT_TRUE(InitExtractor(
+      "feature_config { feature_name: 1 transform_config {"
+      "  get_value_config { filed_name: 'ad_id' filed_name: 'pos_id' } } }",
+      Exposure::descriptor(), &extractor));
+  std::vector<SparseFeature> features;
+  features.reserve(16);
+  const SparseFeature* buffer = features.data();
+  for (uint32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(extractor.Extract(MakeExposure(i, i, 0), &features));
+    ASSERT_EQ(2u, features.size());
+    EXPECT_EQ(buffer, features.data());
+  }
+}
+
+TEST(Extractor, InitError) {
+  Extractor extractor;
+  // 字段不存在
+  EXPECT_FALSE(InitExtractor(
+      "feature_config { feature_name: 1 transform_config {"
+      "  get_value_config { filed_name: 'not_exist' } } }",
+      Exposure::descriptor(), &extractor));
+  // 字符串不能做zscore
+  EXPECT_FALSE(InitExtractor(
+      "feature_config { feature_name: 1"
+      "  transform_config { get_value_config { filed_name: 'id' } }"
+      "  transform_config { normalization_config { normalization_type: ZSCORE } } }",
+      Exposure::descriptor(), &extractor));
+  // 数值型的miss_value
+  EXPECT_FALSE(InitExtractor(
+      "feature_config { feature_name: 1 transform_config {"
+      "  get_value_config { filed_name: 'bid' miss_value: 'abc' } } }",
+      Exposure::descriptor(), &extractor));
+  // 路径中间不能是重复字段
+  EXPECT_FALSE(InitExtractor(
+      "feature_config { feature_name: 1 transform_config {"
+      "  get_value_config { filed_name: 'expression.math_operator' } } }",
+      gdt::learning::Lambda::descriptor(), &extractor));
+}
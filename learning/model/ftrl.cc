@@ -0,0 +1,344 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "learning/model/ftrl.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include "thirdparty/glog/logging.h"
+#include "app/qzap/common/recordio/recordio.h"
+#include "common/system/concurrency/thread.h"
+
+namespace gdt {
+namespace learning {
+
+// 打散特征ID, 相邻的ID落到不同的cache line
+static inline uint64_t HashFeature(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+static inline double SampleValue(const Sample& sample, int index) {
+  return index < sample.value_size() ? sample.value(index) : 1.0;
+}
+
+static inline double LogLoss(double prediction, double label) {
+  prediction = std::max(std::min(prediction, 1.0 - 1e-15), 1e-15);
+  return label > 0 ? -log(prediction) : -log(1.0 - prediction);
+}
+
+bool ParseSample(const std::string& line, Sample* sample) {
+  sample->Clear();
+  std::istringstream stream(line);
+  float label = 0;
+  if (!(stream >> label)) {
+    return false;
+  }
+  sample->set_label(label);
+  std::string token;
+  bool has_value = false;
+  while (stream >> token) {
+    char* end = NULL;
+    uint64_t feature = strtoull(token.c_str(), &end, 10);
+    if (end == token.c_str() || (*end != '\0' && *end != ':')) {
+      return false;
+    }
+    float value = 1.0;
+    if (*end == ':') {
+      value = strtof(end + 1, &end);
+      has_value = true;
+    }
+    sample->add_feature(feature);
+    sample->add_value(value);
+  }
+  // 特征值都为1时不保存
+  if (!has_value) {
+    sample->clear_value();
+  }
+  return true;
+}
+
+FtrlTrainer::FtrlTrainer() : table_(NULL), mask_(0), dropped_num_(0) {
+  memset(&zero_slot_, 0, sizeof(zero_slot_));
+}
+
+FtrlTrainer::~FtrlTrainer() {
+  free(table_);
+}
+
+bool FtrlTrainer::Init(const FtrlConfig& config) {
+  config_.CopyFrom(config);
+  uint64_t size = 64;
+  while (size < config_.table_size()) {
+    size <<= 1;
+  }
+  free(table_);
+  table_ = NULL;
+  void* table = NULL;
+  if (posix_memalign(&table, 64, size * sizeof(FtrlSlot)) != 0) {
+    LOG(ERROR) << "Alloc ftrl table failed\t" << size;
+    return false;
+  }
+  memset(table, 0, size * sizeof(FtrlSlot));
+  table_ = static_cast<FtrlSlot*>(table);
+  mask_ = size - 1;
+  memset(&zero_slot_, 0, sizeof(zero_slot_));
+  dropped_num_ = 0;
+  return true;
+}
+
+FtrlSlot* FtrlTrainer::FindSlot(uint64_t feature, bool insert) const {
+  if (feature == 0) {
+    if (insert) {
+      zero_slot_.key = 1;
+    }
+    return zero_slot_.key != 0 ? &zero_slot_ : NULL;
+  }
+  uint64_t key = feature;
+  uint64_t index = HashFeature(key);
+  for (uint64_t probe = 0; probe < kMaxProbe; ++probe) {
+    FtrlSlot* slot = &table_[(index + probe) & mask_];
+    uint64_t slot_key = slot->key;
+    if (slot_key == key) {
+      return slot;
+    }
+    if (slot_key != 0) {
+      continue;
+    }
+    if (!insert) {
+      return NULL;
+    }
+    // 其他线程可能同时插入
+    slot_key = __sync_val_compare_and_swap(&slot->key, 0, key);
+    if (slot_key == 0 || slot_key == key) {
+      return slot;
+    }
+  }
+  if (insert) {
+    __sync_fetch_and_add(&dropped_num_, 1);
+  }
+  return NULL;
+}
+
+float FtrlTrainer::Weight(const FtrlSlot& slot) const {
+  double z = slot.z;
+  if (fabs(z) <= config_.l1()) {
+    return 0;
+  }
+  double sign = z < 0 ? -1.0 : 1.0;
+  return -(z - sign * config_.l1()) /
+      ((config_.beta() + sqrt(slot.n)) / config_.alpha() + config_.l2());
+}
+
+double FtrlTrainer::Train(const Sample& sample) {
+  if (sample.feature_size() <= kStackFeatureNum) {
+    FtrlSlot* slots[kStackFeatureNum];
+    float weights[kStackFeatureNum];
+    return Train(sample, slots, weights);
+  }
+  std::vector<FtrlSlot*> slots(sample.feature_size());
+  std::vector<float> weights(sample.feature_size());
+  return Train(sample, slots.data(), weights.data());
+}
+
+double FtrlTrainer::Train(const Sample& sample, FtrlSlot** slots, float* weights) {
+  int size = sample.feature_size();
+  double sum = 0;
+  for (int i = 0; i < size; ++i) {
+    slots[i] = FindSlot(sample.feature(i), true);
+    weights[i] = slots[i] == NULL ? 0 : Weight(*slots[i]);
+    sum += weights[i] * SampleValue(sample, i);
+  }
+  double prediction = Sigmoid(sum);
+  double gradient = prediction - (sample.label() > 0 ? 1.0 : 0.0);
+  for (int i = 0; i < size; ++i) {
+    FtrlSlot* slot = slots[i];
+    if (slot == NULL) {
+      continue;
+    }
+    double g = gradient * SampleValue(sample, i);
+    double n = slot->n;
+    double sigma = (sqrt(n + g * g) - sqrt(n)) / config_.alpha();
+    slot->z += g - sigma * weights[i];
+    slot->n = n + g * g;
+  }
+  return prediction;
+}
+
+double FtrlTrainer::Predict(const Sample& sample) const {
+  double sum = 0;
+  for (int i = 0; i < sample.feature_size(); ++i) {
+    const FtrlSlot* slot = FindSlot(sample.feature(i), false);
+    if (slot != NULL) {
+      sum += Weight(*slot) * SampleValue(sample, i);
+    }
+  }
+  return Sigmoid(sum);
+}
+
+void FtrlTrainer::TrainRange(const std::vector<Sample>* samples, int index, FtrlStat* stat) {
+  size_t thread_num = std::max(config_.thread_num(), 1);
+  // 先累加到局部变量, 各线程的stat相邻, 逐样本写会伪共享
+  FtrlStat local;
+  for (int epoch = 0; epoch < config_.epoch_num(); ++epoch) {
+    for (size_t i = index; i < samples->size(); i += thread_num) {
+      const Sample& sample = (*samples)[i];
+      local.log_loss += LogLoss(Train(sample), sample.label());
+      ++local.sample_num;
+    }
+  }
+  *stat = local;
+}
+
+void FtrlTrainer::TrainWorker(SampleQueue* queue, FtrlStat* stat) {
+  FtrlStat local;
+  while (true) {
+    shared_ptr<std::vector<Sample> > samples;
+    queue->PopFront(&samples);
+    if (!samples) {
+      break;
+    }
+    for (const Sample& sample : *samples) {
+      local.log_loss += LogLoss(Train(sample), sample.label());
+      ++local.sample_num;
+    }
+  }
+  *stat = local;
+}
+
+FtrlStat FtrlTrainer::TrainSamples(const std::vector<Sample>& samples) {
+  int thread_num = std::max(config_.thread_num(), 1);
+  std::vector<FtrlStat> stats(thread_num);
+  std::vector<shared_ptr<Thread> > threads;
+  for (int i = 0; i < thread_num; ++i) {
+    threads.push_back(shared_ptr<Thread>(new Thread(
+        "FtrlTrainer", gdt::NewCallback(this, &FtrlTrainer::TrainRange, &samples, i, &stats[i]))));
+    threads.back()->Start();
+  }
+  FtrlStat stat;
+  for (int i = 0; i < thread_num; ++i) {
+    threads[i]->Join();
+    stat.sample_num += stats[i].sample_num;
+    stat.log_loss += stats[i].log_loss;
+  }
+  return stat;
+}
+
+bool FtrlTrainer::ReadFile(const std::string& file, SampleQueue* queue) {
+  std::ifstream stream(file.c_str(), std::ios::binary);
+  if (!stream.is_open()) {
+    LOG(ERROR) << "Open sample file failed\t" << file;
+    return false;
+  }
+  size_t batch_size = std::max(config_.batch_size(), 1);
+  shared_ptr<std::vector<Sample> > samples(new std::vector<Sample>());
+  samples->reserve(batch_size);
+  uint64_t bad_num = 0;
+  if (config_.input_format() == FtrlConfig::RECORDIO) {
+    RecordReader reader(&stream);
+    Sample sample;
+    while (reader.ReadMessage(&sample)) {
+      samples->push_back(sample);
+      if (samples->size() >= batch_size) {
+        queue->PushBack(samples);
+        samples.reset(new std::vector<Sample>());
+        samples->reserve(batch_size);
+      }
+    }
+  } else {
+    std::string line;
+    Sample sample;
+    while (std::getline(stream, line)) {
+      if (line.empty()) {
+        continue;
+      }
+      if (!ParseSample(line, &sample)) {
+        ++bad_num;
+        continue;
+      }
+      samples->push_back(sample);
+      if (samples->size() >= batch_size) {
+        queue->PushBack(samples);
+        samples.reset(new std::vector<Sample>());
+        samples->reserve(batch_size);
+      }
+    }
+  }
+  if (!samples->empty()) {
+    queue->PushBack(samples);
+  }
+  if (bad_num > 0) {
+    LOG(WARNING) << "Skip bad samples\t" << file << "\t" << bad_num;
+  }
+  return true;
+}
+
+bool FtrlTrainer::TrainFiles(const std::vector<std::string>& files, FtrlStat* stat) {
+  int thread_num = std::max(config_.thread_num(), 1);
+  // 队列有界, 读取快于训练时阻塞读取线程
+  SampleQueue queue(thread_num * 2);
+  std::vector<FtrlStat> stats(thread_num);
+  std::vector<shared_ptr<Thread> > threads;
+  for (int i = 0; i < thread_num; ++i) {
+    threads.push_back(shared_ptr<Thread>(new Thread(
+        "FtrlTrainer", gdt::NewCallback(this, &FtrlTrainer::TrainWorker, &queue, &stats[i]))));
+    threads.back()->Start();
+  }
+  bool succeed = true;
+  for (int epoch = 0; succeed && epoch < config_.epoch_num(); ++epoch) {
+    for (size_t i = 0; succeed && i < files.size(); ++i) {
+      succeed = ReadFile(files[i], &queue);
+    }
+  }
+  // 每个训练线程一个结束标记
+  for (int i = 0; i < thread_num; ++i) {
+    queue.PushBack(shared_ptr<std::vector<Sample> >());
+  }
+  *stat = FtrlStat();
+  for (int i = 0; i < thread_num; ++i) {
+    threads[i]->Join();
+    stat->sample_num += stats[i].sample_num;
+    stat->log_loss += stats[i].log_loss;
+  }
+  if (dropped_num_ > 0) {
+    LOG(WARNING) << "Ftrl table full, dropped features\t" << dropped_num_;
+  }
+  return succeed;
+}
+
+bool FtrlTrainer::Dump(const std::string& filename) const {
+  std::vector<std::pair<uint64_t, float> > weights;
+  if (zero_slot_.key != 0 && Weight(zero_slot_) != 0) {
+    weights.push_back(std::make_pair(0, Weight(zero_slot_)));
+  }
+  for (uint64_t i = 0; i <= mask_; ++i) {
+    const FtrlSlot& slot = table_[i];
+    if (slot.key == 0) {
+      continue;
+    }
+    float weight = Weight(slot);
+    if (weight != 0) {
+      weights.push_back(std::make_pair(slot.key, weight));
+    }
+  }
+  std::sort(weights.begin(), weights.end());
+  std::vector<uint64_t> features(weights.size());
+  std::vector<float> values(weights.size());
+  for (size_t i = 0; i < weights.size(); ++i) {
+    features[i] = weights[i].first;
+    values[i] = weights[i].second;
+  }
+  return LogisticRegression::Save(filename, features, values);
+}
+
+}  // namespace learning
+}  // namespace gdt
@@ -0,0 +1,103 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+// FTRL-Proximal逻辑回归训练
+// Reference: Ad Click Prediction: a View from the Trenches, KDD 2013
+#ifndef LEARNING_MODEL_FTRL_H_
+#define LEARNING_MODEL_FTRL_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/blocking_queue.h"
+#include "learning/model/logistic_regression.h"
+#include "learning/proto/model.pb.h"
+
+namespace gdt {
+namespace learning {
+
+// 权重表的一个槽, 4个槽占一个cache line
+struct FtrlSlot {
+  // 特征ID, 0表示空槽
+  uint64_t key;
+  float z;
+  float n;
+};
+
+// 训练统计
+struct FtrlStat {
+  FtrlStat() : sample_num(0), log_loss(0) {
+  }
+  uint64_t sample_num;
+  // 更新前预估的对数损失之和
+  double log_loss;
+};
+
+// 权重表用开放寻址, 特征只存z和n, 权重在用到时计算.
+// 多个线程不加锁地同时更新同一张表(Hogwild), 稀疏特征之间冲突很少
+class FtrlTrainer {
+ public:
+  FtrlTrainer();
+  ~FtrlTrainer();
+
+  bool Init(const FtrlConfig& config);
+
+  // 用一个样本更新, 返回更新前的预估值, 可以被多个线程同时调用
+  double Train(const Sample& sample);
+
+  // 多线程训练内存中的样本, 按config的epoch_num和thread_num
+  FtrlStat TrainSamples(const std::vector<Sample>& samples);
+
+  // 一个线程流式读取文件, thread_num个线程训练, 文件格式由input_format决定
+  bool TrainFiles(const std::vector<std::string>& files, FtrlStat* stat);
+
+  double Predict(const Sample& sample) const;
+
+  // 非零权重按特征排序写成LogisticRegression的模型文件
+  bool Dump(const std::string& filename) const;
+
+  // 表满时没有学习的特征次数
+  uint64_t dropped_num() const {
+    return dropped_num_;
+  }
+
+ private:
+  // 每个样本在栈上缓存的特征数, 更多时用堆
+  static const int kStackFeatureNum = 256;
+  // 最多探测的槽数
+  static const uint64_t kMaxProbe = 64;
+
+  // 查找特征的槽, insert时不存在则插入, 表满或不存在时返回NULL
+  FtrlSlot* FindSlot(uint64_t feature, bool insert) const;
+
+  float Weight(const FtrlSlot& slot) const;
+
+  double Train(const Sample& sample, FtrlSlot** slots, float* weights);
+
+  typedef BlockingQueue<shared_ptr<std::vector<Sample> > > SampleQueue;
+
+  // 训练线程: 从队列取样本直到遇到空指针
+  void TrainWorker(SampleQueue* queue, FtrlStat* stat);
+
+  // 训练线程: 训练下标除以线程数余index的样本
+  void TrainRange(const std::vector<Sample>* samples, int index, FtrlStat* stat);
+
+  // 把一个文件的样本分批推入队列
+  bool ReadFile(const std::string& file, SampleQueue* queue);
+
+  FtrlConfig config_;
+  FtrlSlot* table_;
+  uint64_t mask_;
+  // 特征0与表中的空槽标记冲突, 单独存放, key非0表示已插入
+  mutable FtrlSlot zero_slot_;
+  mutable volatile uint64_t dropped_num_;
+};
+
+// 解析一行文本样本: label feature[:value] feature[:value] ...
+bool ParseSample(const std::string& line, Sample* sample);
+
+}  // namespace learning
+}  // namespace gdt
+
+#endif  // LEARNING_MODEL_FTRL_H_
@@ -0,0 +1,234 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+//
+// $build64_release/learning/model/ftrl_test --benchmarks=all --ftrl_benchmark_threads=8
+// BM_FtrlTrain为单线程, BM_FtrlTrainParallel的每核样本数为总样本数除以线程数
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "app/qzap/common/base/benchmark.h"
+#include "app/qzap/common/recordio/recordio.h"
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/glog/logging.h"
+#include "thirdparty/gtest/gtest.h"
+#include "learning/model/ftrl.h"
+#include "learning/model/logistic_regression.h"
+
+DEFINE_int32(ftrl_benchmark_threads, 4, "benchmark训练线程数");
+DEFINE_int32(ftrl_benchmark_features, 1000000, "benchmark特征空间大小");
+DEFINE_int32(ftrl_benchmark_sample_features, 40, "benchmark每个样本的特征数");
+
+using namespace gdt::learning;
+
+// 特征1~10决定点击, 其他是噪声
+static void BuildSamples(int sample_num, int feature_num, int sample_feature_num,
+                         std::vector<Sample>* samples) {
+  samples->resize(sample_num);
+  for (int i = 0; i < sample_num; ++i) {
+    Sample& sample = (*samples)[i];
+    sample.Clear();
+    int signal = rand() % 10 + 1;
+    sample.add_feature(signal);
+    for (int j = 1; j < sample_feature_num; ++j) {
+      sample.add_feature(11 + rand() % feature_num);
+    }
+    double ctr = signal <= 5 ? 0.9 : 0.1;
+    sample.set_label(rand() < ctr * RAND_MAX ? 1 : 0);
+  }
+}
+
+static Sample SingleFeature(uint64_t feature) {
+  Sample sample;
+  sample.add_feature(feature);
+  return sample;
+}
+
+TEST(Ftrl, ParseSample) {
+  Sample sample;
+  ASSERT_TRUE(ParseSample("1 3 5 7", &sample));
+  EXPECT_EQ(1, sample.label());
+  ASSERT_EQ(3, sample.feature_size());
+  EXPECT_EQ(7u, sample.feature(2));
+  EXPECT_EQ(0, sample.value_size());
+  ASSERT_TRUE(ParseSample("0 3:0.5 5", &sample));
+  EXPECT_EQ(0, sample.label());
+  ASSERT_EQ(2, sample.value_size());
+  EXPECT_FLOAT_EQ(0.5, sample.value(0));
+  EXPECT_FLOAT_EQ(1.0, sample.value(1));
+  EXPECT_FALSE(ParseSample("1 abc", &sample));
+}
+
+TEST(Ftrl, TrainSamples) {
+  FtrlConfig config;
+  config.set_table_size(1 << 16);
+  config.set_thread_num(4);
+  config.set_epoch_num(2);
+  config.set_l1(0.1);
+  FtrlTrainer trainer;
+  ASSERT_TRUE(trainer.Init(config));
+  std::vector<Sample> samples;
+  BuildSamples(20000, 1000, 10, &samples);
+  FtrlStat stat = trainer.TrainSamples(samples);
+  EXPECT_EQ(40000u, stat.sample_num);
+  EXPECT_LT(stat.log_loss / stat.sample_num, 0.6);
+  EXPECT_GT(trainer.Predict(SingleFeature(1)), 0.7);
+  EXPECT_LT(trainer.Predict(SingleFeature(8)), 0.3);
+  EXPECT_EQ(0u, trainer.dropped_num());
+
+  // 导出的模型与训练器的预估相同
+  ASSERT_TRUE(trainer.Dump("ftrl_test.model"));
+  LogisticRegression model;
+  ASSERT_TRUE(model.Load("ftrl_test.model"));
+  EXPECT_GT(model.size(), 10u);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_NEAR(trainer.Predict(samples[i]), model.Predict(samples[i]), 1e-6);
+  }
+  remove("ftrl_test.model");
+}
+
+TEST(Ftrl, TableFull) {
+  FtrlConfig config;
+  config.set_table_size(64);
+  FtrlTrainer trainer;
+  ASSERT_TRUE(trainer.Init(config));
+  Sample sample;
+  sample.set_label(1);
+  for (uint64_t feature = 0; feature < 100; ++feature) {
+    sample.add_feature(feature);
+  }
+  trainer.Train(sample);
+  // 特征0不占表中的槽
+  EXPECT_EQ(35u, trainer.dropped_num());
+}
+
+TEST(Ftrl, ZeroFeature) {
+  FtrlConfig config;
+  config.set_table_size(64);
+  FtrlTrainer trainer;
+  ASSERT_TRUE(trainer.Init(config));
+  // 特征0与任何特征ID都不共享槽
+  const uint64_t kFeature = 0x9e3779b97f4a7c15ULL;
+  Sample sample = SingleFeature(0);
+  sample.set_label(1);
+  for (int i = 0; i < 100; ++i) {
+    trainer.Train(sample);
+  }
+  EXPECT_GT(trainer.Predict(SingleFeature(0)), 0.6);
+  EXPECT_DOUBLE_EQ(0.5, trainer.Predict(SingleFeature(kFeature)));
+  sample = SingleFeature(kFeature);
+  sample.set_label(0);
+  for (int i = 0; i < 100; ++i) {
+    trainer.Train(sample);
+  }
+  EXPECT_GT(trainer.Predict(SingleFeature(0)), 0.6);
+  EXPECT_LT(trainer.Predict(SingleFeature(kFeature)), 0.4);
+
+  ASSERT_TRUE(trainer.Dump("ftrl_test_zero.model"));
+  LogisticRegression model;
+  ASSERT_TRUE(model.Load("ftrl_test_zero.model"));
+  EXPECT_EQ(2u, model.size());
+  EXPECT_NEAR(trainer.Predict(SingleFeature(0)), model.Predict(SingleFeature(0)), 1e-6);
+  remove("ftrl_test_zero.model");
+}
+
+TEST(Ftrl, TrainFiles) {
+  std::vector<Sample> samples;
+  BuildSamples(5000, 1000, 10, &samples);
+  {
+    std::ofstream text("ftrl_test.txt");
+    for (const Sample& sample : samples) {
+      text << sample.label();
+      for (uint64_t feature : sample.feature()) {
+        text << " " << feature;
+      }
+      text << "\n";
+    }
+    std::ofstream stream("ftrl_test.recordio", std::ios::binary);
+    RecordWriter writer(&stream);
+    for (const Sample& sample : samples) {
+      ASSERT_TRUE(writer.WriteMessage(sample));
+    }
+    ASSERT_TRUE(writer.Flush());
+  }
+  FtrlConfig config;
+  config.set_table_size(1 << 16);
+  config.set_thread_num(3);
+  config.set_batch_size(100);
+  FtrlTrainer text_trainer;
+  ASSERT_TRUE(text_trainer.Init(config));
+  FtrlStat stat;
+  ASSERT_TRUE(text_trainer.TrainFiles(std::vector<std::string>(1, "ftrl_test.txt"), &stat));
+  EXPECT_EQ(5000u, stat.sample_num);
+  EXPECT_GT(text_trainer.Predict(SingleFeature(1)), 0.5);
+
+  config.set_input_format(FtrlConfig::RECORDIO);
+  FtrlTrainer recordio_trainer;
+  ASSERT_TRUE(recordio_trainer.Init(config));
+  ASSERT_TRUE(recordio_trainer.TrainFiles(
+      std::vector<std::string>(2, "ftrl_test.recordio"), &stat));
+  EXPECT_EQ(10000u, stat.sample_num);
+  EXPECT_GT(recordio_trainer.Predict(SingleFeature(1)), 0.5);
+
+  EXPECT_FALSE(recordio_trainer.TrainFiles(
+      std::vector<std::string>(1, "not_exist.recordio"), &stat));
+  remove("ftrl_test.txt");
+  remove("ftrl_test.recordio");
+}
+
+static const std::vector<Sample>& BenchmarkSamples() {
+  static std::vector<Sample>* samples = NULL;
+  if (samples == NULL) {
+    samples = new std::vector<Sample>();
+    BuildSamples(200000, FLAGS_ftrl_benchmark_features,
+                 FLAGS_ftrl_benchmark_sample_features, samples);
+  }
+  return *samples;
+}
+
+static void BM_FtrlTrain(int iters) {
+  StopBenchmarkTiming();
+  const std::vector<Sample>& samples = BenchmarkSamples();
+  static FtrlTrainer* trainer = NULL;
+  if (trainer == NULL) {
+    trainer = new FtrlTrainer();
+    FtrlConfig config;
+    config.set_table_size(1 << 22);
+    trainer->Init(config);
+  }
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    trainer->Train(samples[i % samples.size()]);
+  }
+  SetBenchmarkItemsProcessed(iters);
+}
+BENCHMARK(BM_FtrlTrain);
+
+static void BM_FtrlTrainParallel(int iters) {
+  StopBenchmarkTiming();
+  const std::vector<Sample>& samples = BenchmarkSamples();
+  std::vector<Sample> batch(samples.begin(),
+                            samples.begin() + std::min<size_t>(iters, samples.size()));
+  FtrlConfig config;
+  config.set_table_size(1 << 22);
+  config.set_thread_num(FLAGS_ftrl_benchmark_threads);
+  FtrlTrainer trainer;
+  trainer.Init(config);
+  StartBenchmarkTiming();
+  FtrlStat stat = trainer.TrainSamples(batch);
+  SetBenchmarkItemsProcessed(stat.sample_num / FLAGS_ftrl_benchmark_threads);
+  SetBenchmarkLabel("per core");
+}
+BENCHMARK(BM_FtrlTrainParallel);
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  RunSpecifiedBenchmarks();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "learning/model/logistic_regression.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include "thirdparty/glog/logging.h"
+
+namespace gdt {
+namespace learning {
+
+const uint32_t LogisticRegression::kMagic;
+const uint32_t LogisticRegression::kVersion;
+
+double Sigmoid(double x) {
+  x = std::max(std::min(x, 35.0), -35.0);
+  return 1.0 / (1.0 + exp(-x));
+}
+
+bool LogisticRegression::Load(const std::string& filename) {
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == NULL) {
+    LOG(ERROR) << "Open model failed\t" << filename;
+    return false;
+  }
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint64_t size = 0;
+  bool succeed = fread(&magic, sizeof(magic), 1, file) == 1 && magic == kMagic &&
+      fread(&version, sizeof(version), 1, file) == 1 && version == kVersion &&
+      fread(&size, sizeof(size), 1, file) == 1;
+  if (succeed) {
+    features_.resize(size);
+    weights_.resize(size);
+    succeed = fread(features_.data(), sizeof(uint64_t), size, file) == size &&
+        fread(weights_.data(), sizeof(float), size, file) == size;
+  }
+  fclose(file);
+  if (!succeed) {
+    LOG(ERROR) << "Bad model file\t" << filename;
+    features_.clear();
+    weights_.clear();
+  }
+  return succeed;
+}
+
+bool LogisticRegression::Save(const std::string& filename,
+                              const std::vector<uint64_t>& features,
+                              const std::vector<float>& weights) {
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (file == NULL) {
+    LOG(ERROR) << "Open model failed\t" << filename;
+    return false;
+  }
+  uint64_t size = features.size();
+  bool succeed = fwrite(&kMagic, sizeof(kMagic), 1, file) == 1 &&
+      fwrite(&kVersion, sizeof(kVersion), 1, file) == 1 &&
+      fwrite(&size, sizeof(size), 1, file) == 1 &&
+      fwrite(features.data(), sizeof(uint64_t), size, file) == size &&
+      fwrite(weights.data(), sizeof(float), size, file) == size;
+  succeed = fclose(file) == 0 && succeed;
+  if (!succeed) {
+    LOG(ERROR) << "Write model failed\t" << filename;
+  }
+  return succeed;
+}
+
+double LogisticRegression::Predict(const Sample& sample) const {
+  double sum = 0;
+  for (int i = 0; i < sample.feature_size(); ++i) {
+    double value = sample.value_size() > i ? sample.value(i) : 1.0;
+    sum += Weight(sample.feature(i)) * value;
+  }
+  return Sigmoid(sum);
+}
+
+float LogisticRegression::Weight(uint64_t feature) const {
+  auto iter = std::lower_bound(features_.begin(), features_.end(), feature);
+  if (iter == features_.end() || *iter != feature) {
+    return 0;
+  }
+  return weights_[iter - features_.begin()];
+}
+
+}  // namespace learning
+}  // namespace gdt
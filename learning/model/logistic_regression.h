@@ -0,0 +1,51 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+// 在线预估用的逻辑回归模型, 只保存非零权重
+#ifndef LEARNING_MODEL_LOGISTIC_REGRESSION_H_
+#define LEARNING_MODEL_LOGISTIC_REGRESSION_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "learning/proto/model.pb.h"
+
+namespace gdt {
+namespace learning {
+
+// 输入截断在[-35, 35], 避免exp溢出
+double Sigmoid(double x);
+
+// 模型文件: magic, 版本, 权重数, 按特征排序的特征数组, 权重数组
+class LogisticRegression {
+ public:
+  static const uint32_t kMagic = 0x4c524d44;  // "LRMD"
+  static const uint32_t kVersion = 1;
+
+  bool Load(const std::string& filename);
+
+  // features需按特征ID排序, weights与features一一对应
+  static bool Save(const std::string& filename,
+                   const std::vector<uint64_t>& features,
+                   const std::vector<float>& weights);
+
+  // 点击率
+  double Predict(const Sample& sample) const;
+
+  // 特征的权重, 不存在时为0
+  float Weight(uint64_t feature) const;
+
+  // 非零权重数
+  size_t size() const {
+    return features_.size();
+  }
+
+ private:
+  std::vector<uint64_t> features_;
+  std::vector<float> weights_;
+};
+
+}  // namespace learning
+}  // namespace gdt
+
+#endif  // LEARNING_MODEL_LOGISTIC_REGRESSION_H_
@@ -0,0 +1,173 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "retrieval/base/delta_segment.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace gdt {
+
+void DeltaSegment::Add(const Document& document) {
+  Remove(document.id());
+  uint32_t slot = documents_.size();
+  documents_.push_back(document);
+  alive_.push_back(true);
+  slots_[document.id()] = slot;
+  for (auto& field : document.field()) {
+    if (field.field_type() == TYPE_NUM) {
+      num_postings_[field.field_id()].insert(std::make_pair(field.num(), slot));
+      continue;
+    }
+    TokenPostings& token_postings = postings_[field.field_id()];
+    auto add = [&](uint64_t token) {
+      std::vector<uint32_t>& posting = token_postings[token];
+      // 同一文档重复的词项只计一次, 与基础索引一致
+      if (posting.empty() || posting.back() != slot) {
+        posting.push_back(slot);
+      }
+    };
+    std::for_each(field.id().begin(), field.id().end(), add);
+  }
+}
+
+bool DeltaSegment::Remove(uint64_t document_id) {
+  auto iter = slots_.find(document_id);
+  if (iter == slots_.end()) {
+    return false;
+  }
+  alive_[iter->second] = false;
+  documents_[iter->second].Clear();
+  slots_.erase(iter);
+  return true;
+}
+
+void DeltaSegment::MatchField(
+    const FieldQuery& field_query,
+    std::unordered_map<uint32_t, double>* matched) const {
+  if (field_query.field_query_type() == FIELD_QUERY_RANGE) {
+    auto num_iter = num_postings_.find(field_query.field_id());
+    if (num_iter == num_postings_.end()) {
+      return;
+    }
+    // 与基础索引分桶后精确过滤的结果一致
+    const RangeQuery& range_query = field_query.range_query();
+    double lower = -std::numeric_limits<double>::infinity();
+    double upper = std::numeric_limits<double>::infinity();
+    if (range_query.has_lower_bound()) {
+      lower = range_query.lower_bound();
+    }
+    if (range_query.has_upper_bound()) {
+      upper = range_query.upper_bound();
+    }
+    if (!(lower <= upper)) return;
+    auto end = num_iter->second.upper_bound(upper);
+    for (auto iter = num_iter->second.lower_bound(lower); iter != end; ++iter) {
+      if (alive_[iter->second]) {
+        (*matched)[iter->second] = 1;
+      }
+    }
+    return;
+  }
+  auto field_iter = postings_.find(field_query.field_id());
+  if (field_iter == postings_.end()) {
+    return;
+  }
+  const TokenPostings& token_postings = field_iter->second;
+  for (auto& token : field_query.id_query().token()) {
+    auto iter = token_postings.find(token.id());
+    if (iter == token_postings.end()) {
+      continue;
+    }
+    for (uint32_t slot : iter->second) {
+      if (alive_[slot]) {
+        (*matched)[slot] += token.weight();
+      }
+    }
+  }
+}
+
+bool DeltaSegment::Retrieval(const Query& query, uint64_t index_offset,
+                             std::vector<Result>* results) const {
+  if (slots_.empty()) {
+    return true;
+  }
+  size_t field_num = query.field_query_size();
+  std::vector<std::unordered_map<uint32_t, double> > matched(field_num);
+  std::vector<double> thres(field_num);
+  // 阈值为正的字段必须有命中, 取命中文档最少的字段作为候选
+  const std::unordered_map<uint32_t, double>* candidate_field = NULL;
+  for (size_t i = 0; i < field_num; ++i) {
+    const FieldQuery& field_query = query.field_query(i);
+    MatchField(field_query, &matched[i]);
+    thres[i] = field_query.field_query_type() == FIELD_QUERY_RANGE ?
+        1 : field_query.id_query().thres();
+    if (thres[i] > 0 && (candidate_field == NULL ||
+                         matched[i].size() < candidate_field->size())) {
+      candidate_field = &matched[i];
+    }
+  }
+
+  std::vector<uint32_t> candidates;
+  if (candidate_field != NULL) {
+    for (auto& slot_weight : *candidate_field) {
+      candidates.push_back(slot_weight.first);
+    }
+  } else if (query.top_k() > 0) {
+    // top_k只返回至少命中一个词项的文档
+    for (auto& field_matched : matched) {
+      for (auto& slot_weight : field_matched) {
+        candidates.push_back(slot_weight.first);
+      }
+    }
+  } else {
+    for (auto& id_slot : slots_) {
+      candidates.push_back(id_slot.second);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+  size_t result_begin = results->size();
+  for (uint32_t slot : candidates) {
+    double score = 0;
+    bool satisfied = true;
+    for (size_t i = 0; i < field_num && satisfied; ++i) {
+      auto iter = matched[i].find(slot);
+      double weight = iter == matched[i].end() ? 0 : iter->second;
+      satisfied = weight >= thres[i];
+      score += weight;
+    }
+    if (!satisfied) {
+      continue;
+    }
+    Result result;
+    result.set_index(index_offset + slot);
+    result.set_document_id(documents_[slot].id());
+    if (query.top_k() > 0) {
+      result.set_score(score);
+    }
+    results->push_back(std::move(result));
+  }
+
+  if (query.top_k() > 0 && results->size() - result_begin > query.top_k()) {
+    auto begin = results->begin() + result_begin;
+    std::partial_sort(begin, begin + query.top_k(), results->end(),
+                      [](const Result& a, const Result& b) {
+                        return a.score() > b.score();
+                      });
+    results->resize(result_begin + query.top_k());
+  }
+  return true;
+}
+
+void DeltaSegment::Dump(std::vector<Document>* documents) const {
+  documents->reserve(documents->size() + slots_.size());
+  for (size_t slot = 0; slot < documents_.size(); ++slot) {
+    if (alive_[slot]) {
+      documents->push_back(documents_[slot]);
+    }
+  }
+}
+
+}  // namespace gdt
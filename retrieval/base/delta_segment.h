@@ -0,0 +1,64 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#ifndef RETRIEVAL_BASE_DELTA_SEGMENT_H_
+#define RETRIEVAL_BASE_DELTA_SEGMENT_H_
+
+#include <stdint.h>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "retrieval/proto/document.pb.h"
+#include "retrieval/proto/query.pb.h"
+
+namespace gdt {
+
+// 增量段, 存放基础索引建好之后新增或更新的文档
+// 直接用倒排链表, 文档数不多, 检索时逐个打分
+// 阈值和得分的语义与SimilarityRetrievaler一致: 每个字段命中词项的权重和
+// 不低于阈值才召回, 得分为所有字段命中权重之和
+class DeltaSegment {
+ public:
+  // 新增文档, 同一Document::id的旧版本被覆盖
+  void Add(const Document& document);
+
+  // 删除文档, 不存在时返回false
+  bool Remove(uint64_t document_id);
+
+  // 检索, 结果的index为index_offset加上文档在增量段中的位置
+  bool Retrieval(const Query& query, uint64_t index_offset,
+                 std::vector<Result>* results) const;
+
+  // 导出所有有效文档
+  void Dump(std::vector<Document>* documents) const;
+
+  bool Contains(uint64_t document_id) const {
+    return slots_.count(document_id) > 0;
+  }
+
+  // 有效文档数
+  size_t size() const { return slots_.size(); }
+
+ private:
+  typedef std::map<uint64_t, std::vector<uint32_t> > TokenPostings;
+  // 数值 -> 位置, 范围检索直接比较原始值
+  typedef std::multimap<double, uint32_t> NumPostings;
+
+  // 单个字段的命中权重
+  void MatchField(const FieldQuery& field_query,
+                  std::unordered_map<uint32_t, double>* matched) const;
+
+  // 位置 -> 文档, 被覆盖或删除的位置不再有效, 倒排中的引用在合并时清理
+  std::vector<Document> documents_;
+  std::vector<bool> alive_;
+  // Document::id -> 位置
+  std::unordered_map<uint64_t, uint32_t> slots_;
+  // ID字段 -> 词项 -> 位置
+  std::unordered_map<uint64_t, TokenPostings> postings_;
+  // 数值字段 -> 数值 -> 位置
+  std::unordered_map<uint64_t, NumPostings> num_postings_;
+};
+
+}  // namespace gdt
+
+#endif  // RETRIEVAL_BASE_DELTA_SEGMENT_H_
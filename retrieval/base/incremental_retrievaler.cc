@@ -0,0 +1,241 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "retrieval/base/incremental_retrievaler.h"
+
+#include <algorithm>
+#include <iterator>
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/glog/logging.h"
+#include "framework/common/base_functor.h"
+
+DEFINE_string(incremental_base_retrievaler, "SimilarityRetrievaler",
+              "增量检索器的基础索引使用的检索器");
+
+namespace gdt {
+
+REGISTER_RETRIEVALER(IncrementalRetrievaler);
+
+IncrementalRetrievaler::IncrementalRetrievaler()
+    : base_fields_known_(false), base_index_num_(0), deleted_num_(0), compacting_(false) {
+}
+
+bool IncrementalRetrievaler::Init() {
+  shared_ptr<Retrievaler> base(CREATE_RETRIEVALER(FLAGS_incremental_base_retrievaler));
+  CHECK_LOG(base, FLAGS_incremental_base_retrievaler);
+  CHECK(base->Init());
+  RWLock::WriterLocker locker(&lock_);
+  return ResetBase(base);
+}
+
+bool IncrementalRetrievaler::Build(const std::vector<Document>& documents) {
+  shared_ptr<Retrievaler> base(CREATE_RETRIEVALER(FLAGS_incremental_base_retrievaler));
+  CHECK_LOG(base, FLAGS_incremental_base_retrievaler);
+  CHECK(base->Init() && base->Build(documents));
+  RWLock::WriterLocker locker(&lock_);
+  return ResetBase(base);
+}
+
+bool IncrementalRetrievaler::Load(const std::string& filename) {
+  shared_ptr<Retrievaler> base(CREATE_RETRIEVALER(FLAGS_incremental_base_retrievaler));
+  CHECK_LOG(base, FLAGS_incremental_base_retrievaler);
+  CHECK(base->Init() && base->Load(filename));
+  RWLock::WriterLocker locker(&lock_);
+  return ResetBase(base);
+}
+
+bool IncrementalRetrievaler::Save(const std::string& filename) const {
+  RWLock::ReaderLocker locker(&lock_);
+  return base_->Save(filename);
+}
+
+bool IncrementalRetrievaler::ResetBase(shared_ptr<Retrievaler> base) {
+  std::vector<uint64_t> document_ids;
+  CHECK_LOG(base->DocumentIds(&document_ids), FLAGS_incremental_base_retrievaler);
+  base_ = base;
+  base_indexes_.clear();
+  base_indexes_.reserve(document_ids.size());
+  for (uint64_t index = 0; index < document_ids.size(); ++index) {
+    base_indexes_[document_ids[index]] = index;
+  }
+  std::vector<uint64_t> field_ids;
+  base_fields_.clear();
+  base_fields_known_ = base->FieldIds(&field_ids);
+  base_fields_.insert(field_ids.begin(), field_ids.end());
+  tombstones_.assign(document_ids.size(), false);
+  base_index_num_ = document_ids.size();
+  deleted_num_ = 0;
+  delta_ = DeltaSegment();
+  return true;
+}
+
+bool IncrementalRetrievaler::Retrieval(const Query& query, std::vector<Result>* results) {
+  RWLock::ReaderLocker locker(&lock_);
+  size_t result_begin = results->size();
+  Query base_query;
+  if (base_index_num_ > 0 && BuildBaseQuery(query, &base_query)) {
+    if (query.top_k() > 0 && deleted_num_ > 0) {
+      // 基础索引的结果可能被墓碑过滤掉, 多取一些
+      base_query.set_top_k(query.top_k() + deleted_num_);
+    }
+    CHECK(base_->Retrieval(base_query, results));
+    if (deleted_num_ > 0) {
+      results->erase(std::remove_if(results->begin() + result_begin, results->end(),
+                                    [this](const Result& result) {
+                                      return result.index() < tombstones_.size() &&
+                                             tombstones_[result.index()];
+                                    }),
+                     results->end());
+    }
+  }
+  CHECK(delta_.Retrieval(query, base_index_num_, results));
+  if (query.top_k() > 0) {
+    std::stable_sort(results->begin() + result_begin, results->end(),
+                     [](const Result& a, const Result& b) {
+                       return a.score() > b.score();
+                     });
+    if (results->size() - result_begin > query.top_k()) {
+      results->resize(result_begin + query.top_k());
+    }
+  }
+  return true;
+}
+
+bool IncrementalRetrievaler::BuildBaseQuery(const Query& query, Query* base_query) const {
+  *base_query = query;
+  if (!base_fields_known_) {
+    return true;
+  }
+  base_query->clear_field_query();
+  for (auto& field_query : query.field_query()) {
+    if (base_fields_.count(field_query.field_id()) > 0) {
+      *base_query->add_field_query() = field_query;
+      continue;
+    }
+    // 范围检索的阈值为1, 与DeltaSegment一致
+    double thres = field_query.field_query_type() == FIELD_QUERY_RANGE ?
+        1 : field_query.id_query().thres();
+    if (thres > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IncrementalRetrievaler::Dump(std::vector<Document>* documents) const {
+  RWLock::ReaderLocker locker(&lock_);
+  documents->clear();
+  CHECK(base_index_num_ == 0 || base_->Dump(documents));
+  documents->erase(std::remove_if(documents->begin(), documents->end(),
+                                  [this](const Document& document) {
+                                    return document.index() < tombstones_.size() &&
+                                           tombstones_[document.index()];
+                                  }),
+                   documents->end());
+  delta_.Dump(documents);
+  return true;
+}
+
+bool IncrementalRetrievaler::Update(const Document& document) {
+  RWLock::WriterLocker locker(&lock_);
+  UpdateLocked(document);
+  if (compacting_) {
+    pending_.push_back(std::make_pair(document, true));
+  }
+  return true;
+}
+
+bool IncrementalRetrievaler::Delete(uint64_t document_id) {
+  RWLock::WriterLocker locker(&lock_);
+  bool found = DeleteLocked(document_id);
+  if (compacting_) {
+    Document document;
+    document.set_id(document_id);
+    pending_.push_back(std::make_pair(document, false));
+  }
+  return found;
+}
+
+void IncrementalRetrievaler::UpdateLocked(const Document& document) {
+  auto iter = base_indexes_.find(document.id());
+  if (iter != base_indexes_.end() && !tombstones_[iter->second]) {
+    tombstones_[iter->second] = true;
+    ++deleted_num_;
+  }
+  delta_.Add(document);
+}
+
+bool IncrementalRetrievaler::DeleteLocked(uint64_t document_id) {
+  bool found = delta_.Remove(document_id);
+  auto iter = base_indexes_.find(document_id);
+  if (iter != base_indexes_.end() && !tombstones_[iter->second]) {
+    tombstones_[iter->second] = true;
+    ++deleted_num_;
+    found = true;
+  }
+  return found;
+}
+
+bool IncrementalRetrievaler::Compact() {
+  MutexLocker compact_locker(&compact_mutex_);
+  shared_ptr<Retrievaler> base;
+  std::vector<bool> tombstones;
+  std::vector<Document> delta_documents;
+  {
+    RWLock::WriterLocker locker(&lock_);
+    base = base_;
+    tombstones = tombstones_;
+    delta_.Dump(&delta_documents);
+    pending_.clear();
+    compacting_ = true;
+  }
+
+  // 基础索引只读, 导出和重建都不持锁, 不阻塞检索和更新
+  std::vector<Document> documents;
+  bool succeed = tombstones.empty() || base->Dump(&documents);
+  if (succeed) {
+    documents.erase(std::remove_if(documents.begin(), documents.end(),
+                                   [&tombstones](const Document& document) {
+                                     return document.index() < tombstones.size() &&
+                                            tombstones[document.index()];
+                                   }),
+                    documents.end());
+    std::move(delta_documents.begin(), delta_documents.end(),
+              std::back_inserter(documents));
+    for (size_t index = 0; index < documents.size(); ++index) {
+      documents[index].set_index(index);
+    }
+  }
+  shared_ptr<Retrievaler> compacted;
+  if (succeed) {
+    compacted.reset(CREATE_RETRIEVALER(FLAGS_incremental_base_retrievaler));
+    succeed = compacted && compacted->Init() && compacted->Build(documents);
+  }
+
+  RWLock::WriterLocker locker(&lock_);
+  compacting_ = false;
+  if (!succeed || !ResetBase(compacted)) {
+    // 增量段和墓碑一直在更新, 失败时保持原状即可
+    LOG(ERROR) << "Compact failed, delta size: " << delta_.size();
+    pending_.clear();
+    return false;
+  }
+  for (auto& update : pending_) {
+    if (update.second) {
+      UpdateLocked(update.first);
+    } else {
+      DeleteLocked(update.first.id());
+    }
+  }
+  LOG(INFO) << "Compact " << documents.size() << " documents, replay "
+            << pending_.size() << " updates";
+  pending_.clear();
+  return true;
+}
+
+size_t IncrementalRetrievaler::delta_size() const {
+  RWLock::ReaderLocker locker(&lock_);
+  return delta_.size();
+}
+
+}  // namespace gdt
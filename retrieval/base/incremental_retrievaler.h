@@ -0,0 +1,79 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#ifndef RETRIEVAL_BASE_INCREMENTAL_RETRIEVALER_H_
+#define RETRIEVAL_BASE_INCREMENTAL_RETRIEVALER_H_
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/mutex.h"
+#include "common/system/concurrency/rwlock.h"
+#include "retrieval/base/delta_segment.h"
+#include "retrieval/base/retrievaler.h"
+
+namespace gdt {
+
+// 支持增量更新的检索器
+// 基础索引由--incremental_base_retrievaler指定的检索器构建, 只读;
+// 新增/更新的文档进入增量段, 删除和被更新的基础文档记在墓碑位图中,
+// 检索时合并两部分结果. Compact在后台重建基础索引后原子替换
+class IncrementalRetrievaler : public Retrievaler {
+ public:
+  IncrementalRetrievaler();
+
+  bool Init();
+  bool Build(const std::vector<Document>& documents);
+  bool Retrieval(const Query& query, std::vector<Result>* results);
+  // 只保存基础索引, 增量需要先Compact
+  bool Save(const std::string& filename) const;
+  bool Load(const std::string& filename);
+  bool Dump(std::vector<Document>* documents) const;
+  bool Update(const Document& document);
+  bool Delete(uint64_t document_id);
+  // 重建期间的更新先写入增量段并记录下来, 替换后在新索引上重放
+  bool Compact();
+
+  // 增量段的文档数
+  size_t delta_size() const;
+
+ private:
+  // 换上新的基础索引, 调用方持有写锁
+  bool ResetBase(shared_ptr<Retrievaler> base);
+
+  // 去掉基础索引中不存在的字段, 必须命中的字段不存在时返回false, 不用检索基础索引
+  bool BuildBaseQuery(const Query& query, Query* base_query) const;
+
+  // 调用方持有写锁
+  void UpdateLocked(const Document& document);
+  bool DeleteLocked(uint64_t document_id);
+
+  // 基础索引, 替换时其他线程仍可以持有旧索引完成检索
+  shared_ptr<Retrievaler> base_;
+  // 基础索引中Document::id -> 索引位置
+  std::unordered_map<uint64_t, uint64_t> base_indexes_;
+  // 基础索引中已删除或被更新的位置
+  std::vector<bool> tombstones_;
+  // 基础索引中的字段, 只在增量段出现的新字段不查基础索引.
+  // 基础检索器不支持FieldIds时base_fields_known_为false, 所有字段都查基础索引
+  std::unordered_set<uint64_t> base_fields_;
+  bool base_fields_known_;
+  // 基础索引的位置数, 增量段的结果排在其后
+  uint64_t base_index_num_;
+  // 墓碑数, top_k检索时基础索引多取这么多个
+  uint64_t deleted_num_;
+  DeltaSegment delta_;
+  bool compacting_;
+  // 重建期间的更新, false表示删除
+  std::vector<std::pair<Document, bool> > pending_;
+  mutable RWLock lock_;
+  // 同一时间只有一个Compact
+  Mutex compact_mutex_;
+};
+
+}  // namespace gdt
+
+#endif  // RETRIEVAL_BASE_INCREMENTAL_RETRIEVALER_H_
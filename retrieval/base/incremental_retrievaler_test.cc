@@ -0,0 +1,174 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "thirdparty/gtest/gtest.h"
+#include "thirdparty/glog/logging.h"
+#include "retrieval/base/incremental_retrievaler.h"
+
+using namespace gdt;
+
+static Document MakeDocument(uint64_t id, const std::vector<uint64_t>& ids, double price) {
+  Document document;
+  document.set_id(id);
+  Field* field = document.add_field();
+  field->set_field_type(TYPE_ID);
+  field->set_field_id(1);
+  for (auto token : ids) {
+    field->add_id(token);
+  }
+  field = document.add_field();
+  field->set_field_type(TYPE_NUM);
+  field->set_field_id(2);
+  field->set_num(price);
+  return document;
+}
+
+static std::vector<Document> BaseDocuments() {
+  std::vector<Document> documents;
+  documents.push_back(MakeDocument(100, {1, 2, 3}, 10));
+  documents.push_back(MakeDocument(101, {2, 3}, 20));
+  documents.push_back(MakeDocument(102, {3, 4}, 30));
+  documents.push_back(MakeDocument(103, {1, 4}, 40));
+  for (size_t i = 0; i < documents.size(); ++i) {
+    documents[i].set_index(i);
+  }
+  return documents;
+}
+
+static Query IdQuery(double thres, uint32_t top_k) {
+  Query query;
+  FieldQuery* field_query = query.add_field_query();
+  field_query->set_field_id(1);
+  field_query->set_field_query_type(FIELD_QUERY_ID);
+  field_query->mutable_id_query()->set_thres(thres);
+  for (uint64_t id = 1; id <= 3; ++id) {
+    Token* token = field_query->mutable_id_query()->add_token();
+    token->set_id(id);
+    token->set_weight(id);
+  }
+  query.set_top_k(top_k);
+  return query;
+}
+
+static Query RangeQuery(double lower, double upper) {
+  Query query;
+  FieldQuery* field_query = query.add_field_query();
+  field_query->set_field_id(2);
+  field_query->set_field_query_type(FIELD_QUERY_RANGE);
+  field_query->mutable_range_query()->set_lower_bound(lower);
+  field_query->mutable_range_query()->set_upper_bound(upper);
+  return query;
+}
+
+static std::vector<uint64_t> Ids(Retrievaler* retrievaler, const Query& query) {
+  std::vector<Result> results;
+  EXPECT_TRUE(retrievaler->Retrieval(query, &results));
+  std::vector<uint64_t> ids;
+  for (auto& result : results) {
+    ids.push_back(result.document_id());
+  }
+  if (query.top_k() == 0) {
+    std::sort(ids.begin(), ids.end());
+  }
+  return ids;
+}
+
+TEST(IncrementalRetrievalerTest, UpdateAndDelete) {
+  IncrementalRetrievaler retrievaler;
+  ASSERT_TRUE(retrievaler.Init());
+  ASSERT_TRUE(retrievaler.Build(BaseDocuments()));
+  EXPECT_EQ(std::vector<uint64_t>({100, 101, 102}), Ids(&retrievaler, IdQuery(3, 0)));
+
+  // 更新基础文档, 新增文档, 删除基础文档
+  ASSERT_TRUE(retrievaler.Update(MakeDocument(101, {4}, 25)));
+  ASSERT_TRUE(retrievaler.Update(MakeDocument(200, {1, 2, 3}, 50)));
+  ASSERT_TRUE(retrievaler.Delete(102));
+  EXPECT_FALSE(retrievaler.Delete(999));
+  EXPECT_EQ(2u, retrievaler.delta_size());
+  EXPECT_EQ(std::vector<uint64_t>({100, 200}), Ids(&retrievaler, IdQuery(3, 0)));
+  EXPECT_EQ(std::vector<uint64_t>({101, 103, 200}), Ids(&retrievaler, RangeQuery(25, 50)));
+
+  // top_k合并两部分结果, 被删除的基础文档不占名额
+  std::vector<uint64_t> top = Ids(&retrievaler, IdQuery(1, 3));
+  ASSERT_EQ(3u, top.size());
+  std::sort(top.begin(), top.begin() + 2);
+  EXPECT_EQ(std::vector<uint64_t>({100, 200, 103}), top);
+
+  // 删除增量中的文档
+  ASSERT_TRUE(retrievaler.Delete(200));
+  EXPECT_EQ(std::vector<uint64_t>({100}), Ids(&retrievaler, IdQuery(3, 0)));
+}
+
+TEST(IncrementalRetrievalerTest, Compact) {
+  IncrementalRetrievaler retrievaler;
+  ASSERT_TRUE(retrievaler.Init());
+  ASSERT_TRUE(retrievaler.Build(BaseDocuments()));
+  ASSERT_TRUE(retrievaler.Update(MakeDocument(101, {4}, 25)));
+  ASSERT_TRUE(retrievaler.Update(MakeDocument(200, {1, 2, 3}, 50)));
+  ASSERT_TRUE(retrievaler.Delete(102));
+
+  std::vector<Query> queries = {IdQuery(3, 0), IdQuery(1, 0), IdQuery(0.5, 2),
+                                RangeQuery(0, 100), RangeQuery(21, 45)};
+  std::vector<std::vector<uint64_t> > expected;
+  for (auto& query : queries) {
+    expected.push_back(Ids(&retrievaler, query));
+  }
+  ASSERT_TRUE(retrievaler.Compact());
+  EXPECT_EQ(0u, retrievaler.delta_size());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    EXPECT_EQ(expected[i], Ids(&retrievaler, queries[i])) << i;
+  }
+
+  std::vector<Document> documents;
+  ASSERT_TRUE(retrievaler.Dump(&documents));
+  EXPECT_EQ(4u, documents.size());
+
+  // 合并后的更新照常生效
+  ASSERT_TRUE(retrievaler.Delete(200));
+  EXPECT_EQ(std::vector<uint64_t>({100}), Ids(&retrievaler, IdQuery(3, 0)));
+}
+
+static FieldQuery* AddTagQuery(double thres, Query* query) {
+  FieldQuery* field_query = query->add_field_query();
+  field_query->set_field_id(3);
+  field_query->set_field_query_type(FIELD_QUERY_ID);
+  field_query->mutable_id_query()->set_thres(thres);
+  Token* token = field_query->mutable_id_query()->add_token();
+  token->set_id(7);
+  token->set_weight(1);
+  return field_query;
+}
+
+TEST(IncrementalRetrievalerTest, NewField) {
+  IncrementalRetrievaler retrievaler;
+  ASSERT_TRUE(retrievaler.Init());
+  ASSERT_TRUE(retrievaler.Build(BaseDocuments()));
+  // 字段3只在增量段中出现
+  Document document = MakeDocument(300, {1, 2, 3}, 60);
+  Field* field = document.add_field();
+  field->set_field_type(TYPE_ID);
+  field->set_field_id(3);
+  field->add_id(7);
+  ASSERT_TRUE(retrievaler.Update(document));
+
+  Query tag_query;
+  AddTagQuery(1, &tag_query);
+  EXPECT_EQ(std::vector<uint64_t>({300}), Ids(&retrievaler, tag_query));
+  tag_query.set_top_k(2);
+  EXPECT_EQ(std::vector<uint64_t>({300}), Ids(&retrievaler, tag_query));
+
+  // 阈值为0的新字段不影响基础索引的结果
+  Query query = IdQuery(3, 0);
+  AddTagQuery(0, &query);
+  EXPECT_EQ(std::vector<uint64_t>({100, 101, 102, 300}), Ids(&retrievaler, query));
+
+  ASSERT_TRUE(retrievaler.Compact());
+  tag_query.set_top_k(0);
+  EXPECT_EQ(std::vector<uint64_t>({300}), Ids(&retrievaler, tag_query));
+  EXPECT_EQ(std::vector<uint64_t>({100, 101, 102, 300}), Ids(&retrievaler, query));
+}
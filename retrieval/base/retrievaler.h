@@ -20,11 +20,58 @@ namespace gdt {
 // 类余弦检索
 class Retrievaler {
  public:
-  bool Init() {
+  virtual ~Retrievaler() {}
+  // 初始化
+  virtual bool Init() {
     return true;
   }
-  bool Build(const std::vector<Document>& documents);
-  bool Retrieval(const Query& query, std::vector<Result>* results);
+  // 从文档构建索引
+  virtual bool Build(const std::vector<Document>& documents) = 0;
+  // 检索
+  virtual bool Retrieval(const Query& query, std::vector<Result>* results) = 0;
+  // 批量检索, (*results)[i]为queries[i]的结果, 默认逐个检索
+  virtual bool RetrievalBatch(const std::vector<Query>& queries,
+                              std::vector<std::vector<Result> >* results) {
+    results->assign(queries.size(), std::vector<Result>());
+    for (size_t i = 0; i < queries.size(); ++i) {
+      if (!Retrieval(queries[i], &(*results)[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  // 将构建好的索引保存到文件
+  virtual bool Save(const std::string& filename) const {
+    return false;
+  }
+  // 从文件载入构建好的索引
+  virtual bool Load(const std::string& filename) {
+    return false;
+  }
+  // 索引位置 -> Document::id
+  virtual bool DocumentIds(std::vector<uint64_t>* document_ids) const {
+    return false;
+  }
+  // 索引中出现过的字段id
+  virtual bool FieldIds(std::vector<uint64_t>* field_ids) const {
+    return false;
+  }
+  // 导出索引中的文档, 用于合并增量后重建索引
+  virtual bool Dump(std::vector<Document>* documents) const {
+    return false;
+  }
+  // 新增或更新文档, 以Document::id为准
+  virtual bool Update(const Document& document) {
+    return false;
+  }
+  // 删除文档
+  virtual bool Delete(uint64_t document_id) {
+    return false;
+  }
+  // 把增量合并进基础索引
+  virtual bool Compact() {
+    return false;
+  }
 };
 
 CLASS_REGISTER_DEFINE_REGISTRY(Retrievaler_register, Retrievaler);
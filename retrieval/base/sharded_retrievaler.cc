@@ -0,0 +1,240 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "retrieval/base/sharded_retrievaler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/glog/logging.h"
+#include "framework/common/base_functor.h"
+
+DEFINE_int32(shard_num, 4, "分片检索器的分片数");
+DEFINE_int32(shard_thread_num, 0, "分片检索器的线程数, 0表示与分片数相同");
+DEFINE_string(sharded_base_retrievaler, "SimilarityRetrievaler",
+              "分片检索器每个分片使用的检索器");
+
+namespace gdt {
+
+REGISTER_RETRIEVALER(ShardedRetrievaler);
+
+// 分片元信息文件格式, 全部为uint64:
+//   magic, shard_num, shard_num * (document_num, document_num * 全局位置)
+static const uint64_t kShardMagic = 0x3130445241485357LLU;  // "WSHARD01"
+
+static std::string ShardFilename(const std::string& filename, size_t shard) {
+  return filename + "." + std::to_string(shard);
+}
+
+ShardedRetrievaler::ShardedRetrievaler() {
+}
+
+ShardedRetrievaler::~ShardedRetrievaler() {
+  if (thread_pool_) {
+    thread_pool_->Stop();
+  }
+}
+
+bool ShardedRetrievaler::Init() {
+  CHECK_LOG(FLAGS_shard_num > 0, FLAGS_shard_num);
+  if (!thread_pool_) {
+    int thread_num = FLAGS_shard_thread_num > 0 ? FLAGS_shard_thread_num : FLAGS_shard_num;
+    thread_pool_ = ThreadPool::Create("ShardedRetrievaler", thread_num);
+    thread_pool_->Start();
+  }
+  return CreateShards(FLAGS_shard_num);
+}
+
+bool ShardedRetrievaler::CreateShards(size_t shard_num) {
+  shards_.clear();
+  global_indexes_.assign(shard_num, std::vector<uint64_t>());
+  for (size_t i = 0; i < shard_num; ++i) {
+    shared_ptr<Retrievaler> shard(CREATE_RETRIEVALER(FLAGS_sharded_base_retrievaler));
+    CHECK_LOG(shard, FLAGS_sharded_base_retrievaler);
+    CHECK(shard->Init());
+    shards_.push_back(shard);
+  }
+  return true;
+}
+
+void ShardedRetrievaler::RunShard(const ShardTask* task, size_t shard, char* succeed,
+                                  CountBlocker* blocker) const {
+  *succeed = (*task)(shard);
+  blocker->Dec(1);
+}
+
+bool ShardedRetrievaler::RunShards(const ShardTask& task) const {
+  if (shards_.empty()) return true;
+  size_t last = shards_.size() - 1;
+  // vector<bool>不能被多个线程同时写
+  std::vector<char> succeed(shards_.size(), false);
+  CountBlocker blocker(last);
+  for (size_t shard = 0; shard < last; ++shard) {
+    if (!thread_pool_->PushTask(NewCallback(this, &ShardedRetrievaler::RunShard,
+                                            &task, shard, &succeed[shard], &blocker))) {
+      // 线程池已停止时在当前线程完成这个分片, 否则整个检索失败
+      RunShard(&task, shard, &succeed[shard], &blocker);
+    }
+  }
+  succeed[last] = task(last);
+  blocker.Wait();
+  return std::find(succeed.begin(), succeed.end(), false) == succeed.end();
+}
+
+bool ShardedRetrievaler::Build(const std::vector<Document>& documents) {
+  CHECK_LOG(!shards_.empty(), "Init first");
+  size_t shard_num = shards_.size();
+  for (size_t shard = 0; shard < shard_num; ++shard) {
+    global_indexes_[shard].clear();
+  }
+  // 按顺序连续切分, 分片内位置从0开始
+  return RunShards([&](size_t shard) {
+    size_t begin = documents.size() * shard / shard_num;
+    size_t end = documents.size() * (shard + 1) / shard_num;
+    std::vector<Document> shard_documents(documents.begin() + begin,
+                                          documents.begin() + end);
+    std::vector<uint64_t>& global_indexes = global_indexes_[shard];
+    global_indexes.reserve(shard_documents.size());
+    for (size_t i = 0; i < shard_documents.size(); ++i) {
+      global_indexes.push_back(shard_documents[i].index());
+      shard_documents[i].set_index(i);
+    }
+    return shards_[shard]->Build(shard_documents);
+  });
+}
+
+bool ShardedRetrievaler::Retrieval(const Query& query, std::vector<Result>* results) {
+  std::vector<std::vector<Result> > shard_results(shards_.size());
+  CHECK(RunShards([&](size_t shard) {
+    if (global_indexes_[shard].empty()) return true;
+    std::vector<Result>& shard_result = shard_results[shard];
+    CHECK(shards_[shard]->Retrieval(query, &shard_result));
+    // 阈值为0时可能返回字母表中没有文档的位置, 直接丢弃
+    const std::vector<uint64_t>& global_indexes = global_indexes_[shard];
+    shard_result.erase(std::remove_if(shard_result.begin(), shard_result.end(),
+                                      [&](const Result& result) {
+                                        return result.index() >= global_indexes.size();
+                                      }),
+                       shard_result.end());
+    for (auto& result : shard_result) {
+      result.set_index(global_indexes[result.index()]);
+    }
+    return true;
+  }));
+  size_t result_begin = results->size();
+  size_t result_num = 0;
+  for (auto& shard_result : shard_results) {
+    result_num += shard_result.size();
+  }
+  results->reserve(result_begin + result_num);
+  for (auto& shard_result : shard_results) {
+    for (auto& result : shard_result) {
+      results->push_back(Result());
+      results->back().Swap(&result);
+    }
+  }
+  if (query.top_k() > 0) {
+    // 每个分片各自的top_k, 合并后再取一次
+    auto by_score = [](const Result& a, const Result& b) {
+      return a.score() > b.score();
+    };
+    if (results->size() - result_begin > query.top_k()) {
+      std::partial_sort(results->begin() + result_begin,
+                        results->begin() + result_begin + query.top_k(),
+                        results->end(), by_score);
+      results->resize(result_begin + query.top_k());
+    } else {
+      std::sort(results->begin() + result_begin, results->end(), by_score);
+    }
+  }
+  return true;
+}
+
+bool ShardedRetrievaler::Save(const std::string& filename) const {
+  std::ofstream ofs(filename.c_str(), std::ios::binary | std::ios::trunc);
+  CHECK_LOG(ofs.good(), filename);
+  auto write = [&](uint64_t value) {
+    ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  write(kShardMagic);
+  write(shards_.size());
+  for (auto& global_indexes : global_indexes_) {
+    write(global_indexes.size());
+    ofs.write(reinterpret_cast<const char*>(global_indexes.data()),
+              sizeof(uint64_t) * global_indexes.size());
+  }
+  ofs.close();
+  CHECK_LOG(!ofs.fail(), filename);
+  return RunShards([&](size_t shard) {
+    return shards_[shard]->Save(ShardFilename(filename, shard));
+  });
+}
+
+bool ShardedRetrievaler::Load(const std::string& filename) {
+  std::ifstream ifs(filename.c_str(), std::ios::binary);
+  CHECK_LOG(ifs.good(), filename);
+  auto read = [&]() {
+    uint64_t value = 0;
+    ifs.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+  };
+  CHECK_LOG(read() == kShardMagic, filename);
+  uint64_t shard_num = read();
+  CHECK_LOG(ifs.good() && shard_num > 0, filename);
+  CHECK(CreateShards(shard_num));
+  for (auto& global_indexes : global_indexes_) {
+    global_indexes.resize(read());
+    ifs.read(reinterpret_cast<char*>(global_indexes.data()),
+             sizeof(uint64_t) * global_indexes.size());
+    CHECK_LOG(ifs.good(), filename);
+  }
+  // 分片数以索引文件为准
+  if (shard_num != static_cast<uint64_t>(FLAGS_shard_num)) {
+    LOG(WARNING) << "Index " << filename << " has " << shard_num
+                 << " shards, --shard_num=" << FLAGS_shard_num;
+  }
+  return RunShards([&](size_t shard) {
+    return global_indexes_[shard].empty() ||
+           shards_[shard]->Load(ShardFilename(filename, shard));
+  });
+}
+
+bool ShardedRetrievaler::DocumentIds(std::vector<uint64_t>* document_ids) const {
+  document_ids->clear();
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    const std::vector<uint64_t>& global_indexes = global_indexes_[shard];
+    if (global_indexes.empty()) continue;
+    std::vector<uint64_t> shard_ids;
+    CHECK(shards_[shard]->DocumentIds(&shard_ids));
+    for (size_t i = 0; i < shard_ids.size() && i < global_indexes.size(); ++i) {
+      if (document_ids->size() <= global_indexes[i]) {
+        document_ids->resize(global_indexes[i] + 1, 0);
+      }
+      (*document_ids)[global_indexes[i]] = shard_ids[i];
+    }
+  }
+  return true;
+}
+
+bool ShardedRetrievaler::Dump(std::vector<Document>* documents) const {
+  std::vector<std::vector<Document> > shard_documents(shards_.size());
+  CHECK(RunShards([&](size_t shard) {
+    const std::vector<uint64_t>& global_indexes = global_indexes_[shard];
+    if (global_indexes.empty()) return true;
+    CHECK(shards_[shard]->Dump(&shard_documents[shard]));
+    for (auto& document : shard_documents[shard]) {
+      CHECK_LOG(document.index() < global_indexes.size(), document.index());
+      document.set_index(global_indexes[document.index()]);
+    }
+    return true;
+  }));
+  documents->clear();
+  for (auto& shard_document : shard_documents) {
+    std::move(shard_document.begin(), shard_document.end(),
+              std::back_inserter(*documents));
+  }
+  return true;
+}
+
+}  // namespace gdt
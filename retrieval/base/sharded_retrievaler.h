@@ -0,0 +1,60 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#ifndef RETRIEVAL_BASE_SHARDED_RETRIEVALER_H_
+#define RETRIEVAL_BASE_SHARDED_RETRIEVALER_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "app/qzap/common/thread/count_blocker.h"
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/threadpool.h"
+#include "retrieval/base/retrievaler.h"
+
+namespace gdt {
+
+// 分片检索器
+// 文档按顺序切成--shard_num段, 每段由--sharded_base_retrievaler指定的检索器
+// 单独建索引, 分片内使用从0开始的局部位置, 字母表更小, 小波树更浅.
+// 构建/载入在线程池上并行, 检索时并行查询各分片后合并结果
+class ShardedRetrievaler : public Retrievaler {
+ public:
+  ShardedRetrievaler();
+  ~ShardedRetrievaler();
+
+  bool Init();
+  bool Build(const std::vector<Document>& documents);
+  bool Retrieval(const Query& query, std::vector<Result>* results);
+  // filename保存分片数和局部位置 -> 全局位置, 第i个分片保存在filename.i
+  bool Save(const std::string& filename) const;
+  bool Load(const std::string& filename);
+  bool DocumentIds(std::vector<uint64_t>* document_ids) const;
+  bool Dump(std::vector<Document>* documents) const;
+
+  size_t shard_num() const {
+    return shards_.size();
+  }
+
+ private:
+  typedef std::function<bool(size_t)> ShardTask;
+
+  // 在线程池上执行task(0..shard_num-1), 当前线程执行最后一个分片,
+  // 全部成功才返回true
+  bool RunShards(const ShardTask& task) const;
+
+  void RunShard(const ShardTask* task, size_t shard, char* succeed,
+                CountBlocker* blocker) const;
+
+  // 创建shard_num个空分片
+  bool CreateShards(size_t shard_num);
+
+  std::vector<shared_ptr<Retrievaler> > shards_;
+  // 各分片局部位置 -> 全局位置(Document::index)
+  std::vector<std::vector<uint64_t> > global_indexes_;
+  shared_ptr<ThreadPool> thread_pool_;
+};
+
+}  // namespace gdt
+
+#endif  // RETRIEVAL_BASE_SHARDED_RETRIEVALER_H_
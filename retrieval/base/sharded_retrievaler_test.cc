@@ -0,0 +1,142 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/gtest/gtest.h"
+#include "thirdparty/glog/logging.h"
+#include "app/qzap/common/base/scoped_ptr.h"
+#include "retrieval/base/sharded_retrievaler.h"
+
+DECLARE_int32(shard_num);
+
+using namespace gdt;
+
+static std::vector<Document> RandomDocuments(size_t document_num) {
+  srand(1);
+  std::vector<Document> documents(document_num);
+  for (size_t i = 0; i < document_num; ++i) {
+    documents[i].set_index(i);
+    documents[i].set_id(i + 1000);
+    Field* field = documents[i].add_field();
+    field->set_field_type(TYPE_ID);
+    field->set_field_id(1);
+    for (uint64_t id = 1; id <= 8; ++id) {
+      if (id == 8 || rand() % 3 == 0) field->add_id(id);
+    }
+    field = documents[i].add_field();
+    field->set_field_type(TYPE_NUM);
+    field->set_field_id(2);
+    field->set_num(rand() % 100);
+  }
+  return documents;
+}
+
+static Query IdQuery(double thres, uint32_t top_k) {
+  Query query;
+  FieldQuery* field_query = query.add_field_query();
+  field_query->set_field_id(1);
+  field_query->set_field_query_type(FIELD_QUERY_ID);
+  field_query->mutable_id_query()->set_thres(thres);
+  for (uint64_t id = 1; id <= 6; ++id) {
+    Token* token = field_query->mutable_id_query()->add_token();
+    token->set_id(id);
+    token->set_weight(id);
+  }
+  query.set_top_k(top_k);
+  return query;
+}
+
+static std::vector<uint64_t> Indexes(const std::vector<Result>& results) {
+  std::vector<uint64_t> indexes;
+  for (auto& result : results) {
+    indexes.push_back(result.index());
+    EXPECT_EQ(result.index() + 1000, result.document_id());
+  }
+  std::sort(indexes.begin(), indexes.end());
+  return indexes;
+}
+
+static std::vector<double> Scores(const std::vector<Result>& results) {
+  std::vector<double> scores;
+  for (auto& result : results) {
+    scores.push_back(result.score());
+  }
+  return scores;
+}
+
+// 分片的结果与不分片时一致
+static void CheckRetrieval(Retrievaler* sharded, Retrievaler* single) {
+  for (double thres = 1; thres <= 13; thres += 3) {
+    std::vector<Result> expected, results;
+    ASSERT_TRUE(single->Retrieval(IdQuery(thres, 0), &expected));
+    ASSERT_TRUE(sharded->Retrieval(IdQuery(thres, 0), &results));
+    EXPECT_EQ(Indexes(expected), Indexes(results)) << thres;
+  }
+  for (uint32_t top_k = 1; top_k <= 64; top_k *= 4) {
+    std::vector<Result> expected, results;
+    ASSERT_TRUE(single->Retrieval(IdQuery(1, top_k), &expected));
+    ASSERT_TRUE(sharded->Retrieval(IdQuery(1, top_k), &results));
+    EXPECT_EQ(Scores(expected), Scores(results)) << top_k;
+  }
+}
+
+TEST(ShardedRetrievalerTest, Retrieval) {
+  std::vector<Document> documents = RandomDocuments(500);
+  scoped_ptr<Retrievaler> single(CREATE_RETRIEVALER("SimilarityRetrievaler"));
+  ASSERT_TRUE(single->Init() && single->Build(documents));
+
+  FLAGS_shard_num = 3;
+  ShardedRetrievaler sharded;
+  ASSERT_TRUE(sharded.Init());
+  ASSERT_TRUE(sharded.Build(documents));
+  EXPECT_EQ(3u, sharded.shard_num());
+  CheckRetrieval(&sharded, single.get());
+
+  std::vector<uint64_t> expected_ids, document_ids;
+  ASSERT_TRUE(single->DocumentIds(&expected_ids));
+  ASSERT_TRUE(sharded.DocumentIds(&document_ids));
+  EXPECT_EQ(expected_ids, document_ids);
+
+  std::vector<Document> dumped;
+  ASSERT_TRUE(sharded.Dump(&dumped));
+  ASSERT_EQ(documents.size(), dumped.size());
+  for (auto& document : dumped) {
+    EXPECT_EQ(documents[document.index()].DebugString(), document.DebugString());
+  }
+}
+
+TEST(ShardedRetrievalerTest, SaveAndLoad) {
+  std::vector<Document> documents = RandomDocuments(100);
+  FLAGS_shard_num = 4;
+  ShardedRetrievaler sharded;
+  ASSERT_TRUE(sharded.Init());
+  ASSERT_TRUE(sharded.Build(documents));
+  ASSERT_TRUE(sharded.Save("sharded_retrievaler_test.index"));
+
+  // 分片数以索引文件为准
+  FLAGS_shard_num = 2;
+  ShardedRetrievaler loaded;
+  ASSERT_TRUE(loaded.Init());
+  ASSERT_TRUE(loaded.Load("sharded_retrievaler_test.index"));
+  EXPECT_EQ(4u, loaded.shard_num());
+  CheckRetrieval(&loaded, &sharded);
+  EXPECT_FALSE(loaded.Load("not_exist.index"));
+}
+
+TEST(ShardedRetrievalerTest, FewDocuments) {
+  // 文档数少于分片数时部分分片为空
+  std::vector<Document> documents = RandomDocuments(2);
+  FLAGS_shard_num = 4;
+  ShardedRetrievaler sharded;
+  ASSERT_TRUE(sharded.Init());
+  ASSERT_TRUE(sharded.Build(documents));
+  std::vector<Result> results;
+  ASSERT_TRUE(sharded.Retrieval(IdQuery(0, 0), &results));
+  EXPECT_EQ(std::vector<uint64_t>({0, 1}), Indexes(results));
+}
@@ -13,6 +13,7 @@
 #include <functional>
 #include "retrieval/proto/extract.pb.h"
 #include "retrieval/proto/document.pb.h"
+#include "framework/common/checkpoint.h"
 #include "framework/common/base_processor.h"
 
 namespace gdt {
@@ -24,6 +25,17 @@ struct ExtratorDataMessage {
   std::vector<Document> documents;
 };
 
+// 写入/读取检查点
+inline bool WriteDataMessage(const ExtratorDataMessage& data_message, RecordWriter* writer) {
+  return WriteMessages(data_message.products, writer) &&
+      WriteMessages(data_message.documents, writer);
+}
+
+inline bool ReadDataMessage(RecordReader* reader, ExtratorDataMessage* data_message) {
+  return ReadMessages(reader, &data_message->products) &&
+      ReadMessages(reader, &data_message->documents);
+}
+
 typedef  BaseFunctor<ExtractorConfig, ExtratorDataMessage> ExtractorBaseFunctor;
 
 }  // namespace gdt
@@ -35,17 +35,43 @@ class ExtractFunctor: public ExtractorBaseFunctor {
 
   // 从文件里解析商品数据
   FunctorResult DoWork(ExtratorDataMessage* data_message) {
-    std::for_each(data_message->products.begin(),
-                  data_message->products.end(),
-                  [=](const Product& product) {
-                    Document document;
-                    Convert(product, &document);
-                    document.set_index(data_message->documents.size());
-                    data_message->documents.push_back(document);
-                  });
+    ExtratorDataMessage output;
+    DoWorkRange(data_message, 0, data_message->products.size(), &output);
+    MergeRange(&output, data_message);
     return kSuccess;
   }
 
+  const std::string Name() {
+    return "ExtractFunctor";
+  }
+
+  size_t OutputSize(const ExtratorDataMessage& data_message) {
+    return data_message.documents.size();
+  }
+
+  // 分词是CPU密集的, 按商品切分并行抽取
+  size_t PartitionSize(const ExtratorDataMessage& data_message) {
+    return data_message.products.size();
+  }
+
+  // 分词器是线程安全的, 其余只读配置
+  FunctorResult DoWorkRange(ExtratorDataMessage* data_message, size_t begin, size_t end,
+                            ExtratorDataMessage* output) {
+    output->documents.resize(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      Convert(data_message->products[i], &output->documents[i - begin]);
+    }
+    return kSuccess;
+  }
+
+  // 文档的index是在所有文档中的位置
+  void MergeRange(ExtratorDataMessage* output, ExtratorDataMessage* data_message) {
+    for (auto& document : output->documents) {
+      document.set_index(data_message->documents.size());
+      data_message->documents.push_back(document);
+    }
+  }
+
  private:
   // 讲消息转换成文档
   bool Convert(const Product& product, Document* document) {
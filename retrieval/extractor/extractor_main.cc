@@ -14,6 +14,7 @@ using namespace gdt::common;
 
 DEFINE_string(framework_conf, "../conf/extract_framework.conf", "状态机配置路径");
 DEFINE_string(extractor_conf, "../conf/extractor.conf", "配制文件路径");
+DEFINE_bool(resume, false, "从检查点恢复, 跳过上次已经完成的状态");
 
 int main(int argc, char** argv) {
   ::google::ParseCommandLineFlags(&argc, &argv, true);
@@ -24,5 +25,8 @@ int main(int argc, char** argv) {
   ExtratorDataMessage data_message;
   state_machine.Sync(&data_message, &BaseConfigManager<ExtractorConfig>::Instance().Get());
   CHECK_LOG(state_machine.Init(BaseConfigManager<StateMachineConfig>::Instance().Get()), FLAGS_framework_conf);
+  if (FLAGS_resume) {
+    CHECK_LOG(state_machine.Resume(), FLAGS_framework_conf);
+  }
   return state_machine.Run();
 }
@@ -16,6 +16,14 @@ namespace gdt {
 
 class ReadDataFunctor: public ExtractorBaseFunctor {
  public:
+  const std::string Name() {
+    return "ReadDataFunctor";
+  }
+
+  size_t OutputSize(const ExtratorDataMessage& data_message) {
+    return data_message.products.size();
+  }
+
   // 从文件里解析商品数据
   FunctorResult DoWork(ExtratorDataMessage* data_message) {
     if (!Reader::ReadFromIO(config_->product_reader_config(),
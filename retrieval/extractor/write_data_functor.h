@@ -17,6 +17,10 @@ namespace gdt {
 
 class WriteDataFunctor: public ExtractorBaseFunctor {
  public:
+  const std::string Name() {
+    return "WriteDataFunctor";
+  }
+
   // 从文件里解析商品数据
   FunctorResult DoWork(ExtratorDataMessage* data_message) {
     if (!Writer::WriteToIO(config_->document_writer_config(),
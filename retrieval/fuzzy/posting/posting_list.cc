@@ -0,0 +1,269 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "retrieval/fuzzy/posting/posting_list.h"
+
+#include <string.h>
+#include <algorithm>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <tmmintrin.h>
+#endif
+
+namespace gdt {
+namespace posting {
+
+static_assert(sizeof(BlockSkip) == 2 * sizeof(uint64_t), "BlockSkip is saved");
+
+namespace {
+
+typedef void (*DecodeFunc)(const uint8_t*, uint32_t, uint32_t, uint32_t*);
+
+inline uint32_t EncodedLength(uint32_t value) {
+  if (value < (1U << 8)) return 1;
+  if (value < (1U << 16)) return 2;
+  if (value < (1U << 24)) return 3;
+  return 4;
+}
+
+void DecodeDeltaGeneric(const uint8_t* data, uint32_t num, uint32_t base,
+                        uint32_t* out) {
+  const uint8_t* control = data;
+  const uint8_t* p = data + (num + 3) / 4;
+  for (uint32_t i = 0; i < num; ++i) {
+    uint32_t length = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+    uint32_t value = 0;
+    memcpy(&value, p, length);
+    p += length;
+    base += value;
+    out[i] = base;
+  }
+}
+
+#if defined(__x86_64__)
+// 控制字节 -> 4个值的pshufb掩码和总字节数
+struct ShuffleTable {
+  uint8_t masks[256][16];
+  uint8_t lengths[256];
+
+  ShuffleTable() {
+    for (int control = 0; control < 256; ++control) {
+      uint8_t offset = 0;
+      for (int i = 0; i < 4; ++i) {
+        int length = ((control >> (2 * i)) & 3) + 1;
+        for (int j = 0; j < 4; ++j) {
+          masks[control][4 * i + j] = j < length ? offset + j : 0x80;
+        }
+        offset += length;
+      }
+      lengths[control] = offset;
+    }
+  }
+};
+
+const ShuffleTable& GetShuffleTable() {
+  static const ShuffleTable table;
+  return table;
+}
+
+__attribute__((target("ssse3")))
+void DecodeDeltaSsse3(const uint8_t* data, uint32_t num, uint32_t base,
+                      uint32_t* out) {
+  const ShuffleTable& table = GetShuffleTable();
+  const uint8_t* control = data;
+  const uint8_t* p = data + (num + 3) / 4;
+  __m128i prev = _mm_set1_epi32(base);
+  uint32_t i = 0;
+  for (; i + 4 <= num; i += 4) {
+    uint8_t c = control[i / 4];
+    __m128i values = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.masks[c])));
+    p += table.lengths[c];
+    // 4个差分值的前缀和
+    values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+    values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+    values = _mm_add_epi32(values, prev);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), values);
+    prev = _mm_shuffle_epi32(values, 0xff);
+  }
+  if (i < num) {
+    // 剩余不足4个的值, 控制字节从该组开始
+    base = i > 0 ? out[i - 1] : base;
+    uint32_t c = control[i / 4];
+    for (; i < num; ++i, c >>= 2) {
+      uint32_t length = (c & 3) + 1;
+      uint32_t value = 0;
+      memcpy(&value, p, length);
+      p += length;
+      base += value;
+      out[i] = base;
+    }
+  }
+}
+
+bool HasCpuFeature(unsigned int leaf, int reg, unsigned int mask) {
+  unsigned int regs[4] = {0, 0, 0, 0};
+  if (__get_cpuid_max(0, NULL) < leaf) return false;
+  __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+  return (regs[reg] & mask) != 0;
+}
+#endif
+
+// 按运行时的cpu选择解码函数
+DecodeFunc GetDecodeDelta() {
+#if defined(__x86_64__)
+  static const DecodeFunc func = HasCpuFeature(1, 2, bit_SSSE3) ?
+      &DecodeDeltaSsse3 : &DecodeDeltaGeneric;
+  return func;
+#else
+  return &DecodeDeltaGeneric;
+#endif
+}
+
+}  // namespace
+
+void StreamVByteEncode(const uint32_t* values, uint32_t num, std::vector<uint8_t>* data) {
+  size_t control = data->size();
+  data->resize(control + (num + 3) / 4, 0);
+  for (uint32_t i = 0; i < num; ++i) {
+    uint32_t length = EncodedLength(values[i]);
+    (*data)[control + i / 4] |= (length - 1) << (2 * (i % 4));
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&values[i]);
+    data->insert(data->end(), bytes, bytes + length);
+  }
+}
+
+void StreamVByteDecodeDelta(const uint8_t* data, uint32_t num, uint32_t base, uint32_t* out) {
+  GetDecodeDelta()(data, num, base, out);
+}
+
+PostingLists::PostingLists() {
+  Clear();
+}
+
+void PostingLists::Clear() {
+  list_blocks_.assign(1, 0);
+  skips_.clear();
+  data_.assign(kDecodePadding, 0);
+}
+
+void PostingLists::Add(const uint32_t* docids, uint32_t num) {
+  // 去掉末尾的补齐, 追加完再补回
+  data_.resize(data_.size() - kDecodePadding);
+  uint32_t deltas[kBlockSize];
+  uint32_t prev = 0;
+  for (uint32_t begin = 0; begin < num; begin += kBlockSize) {
+    uint32_t block_num = std::min(kBlockSize, num - begin);
+    for (uint32_t i = 0; i < block_num; ++i) {
+      deltas[i] = docids[begin + i] - prev;
+      prev = docids[begin + i];
+    }
+    BlockSkip skip = {prev, block_num, data_.size()};
+    skips_.push_back(skip);
+    StreamVByteEncode(deltas, block_num, &data_);
+  }
+  list_blocks_.push_back(skips_.size());
+  data_.resize(data_.size() + kDecodePadding, 0);
+}
+
+uint64_t PostingLists::doc_num(uint64_t list) const {
+  uint64_t begin = list_blocks_[list];
+  uint64_t end = list_blocks_[list + 1];
+  if (begin == end) return 0;
+  return (end - begin - 1) * kBlockSize + skips_[end - 1].doc_num;
+}
+
+uint32_t PostingLists::DecodeBlock(uint64_t list, uint64_t block, uint32_t* docids) const {
+  const BlockSkip& skip = skips_[block];
+  uint32_t base = block > list_blocks_[list] ? skips_[block - 1].last_docid : 0;
+  StreamVByteDecodeDelta(data_.data() + skip.offset, skip.doc_num, base, docids);
+  return skip.doc_num;
+}
+
+void PostingLists::Save(std::ostream& os) const {
+  auto write = [&](uint64_t value) {
+    os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  write(list_num());
+  write(skips_.size());
+  write(data_.size());
+  os.write(reinterpret_cast<const char*>(list_blocks_.data()),
+           sizeof(uint64_t) * list_blocks_.size());
+  os.write(reinterpret_cast<const char*>(skips_.data()),
+           sizeof(BlockSkip) * skips_.size());
+  os.write(reinterpret_cast<const char*>(data_.data()), data_.size());
+  static const char kZeros[8] = {0};
+  os.write(kZeros, (8 - data_.size() % 8) % 8);
+}
+
+bool PostingLists::Load(std::istream& is) {
+  Clear();
+  uint64_t list_num = 0, block_num = 0, data_size = 0;
+  is.read(reinterpret_cast<char*>(&list_num), sizeof(list_num));
+  is.read(reinterpret_cast<char*>(&block_num), sizeof(block_num));
+  is.read(reinterpret_cast<char*>(&data_size), sizeof(data_size));
+  if (!is.good() || data_size < kDecodePadding) return false;
+  list_blocks_.resize(list_num + 1);
+  skips_.resize(block_num);
+  data_.resize(data_size);
+  is.read(reinterpret_cast<char*>(list_blocks_.data()),
+          sizeof(uint64_t) * list_blocks_.size());
+  is.read(reinterpret_cast<char*>(skips_.data()), sizeof(BlockSkip) * skips_.size());
+  is.read(reinterpret_cast<char*>(data_.data()), data_.size());
+  char zeros[8];
+  is.read(zeros, (8 - data_.size() % 8) % 8);
+  if (!is.good() || list_blocks_.back() != block_num) {
+    Clear();
+    return false;
+  }
+  return true;
+}
+
+PostingCursor::PostingCursor(const PostingLists* lists, uint64_t list)
+    : lists_(lists), list_(list), block_(lists->block_begin(list)),
+      block_end_(lists->block_end(list)), pos_(0), num_(0), docid_(kEndDocid) {
+  if (block_ < block_end_) {
+    LoadBlock(block_);
+  }
+}
+
+void PostingCursor::LoadBlock(uint64_t block) {
+  block_ = block;
+  num_ = lists_->DecodeBlock(list_, block, buffer_);
+  pos_ = 0;
+  docid_ = buffer_[0];
+}
+
+void PostingCursor::Next() {
+  if (docid_ == kEndDocid) return;
+  if (++pos_ < num_) {
+    docid_ = buffer_[pos_];
+  } else if (block_ + 1 < block_end_) {
+    LoadBlock(block_ + 1);
+  } else {
+    docid_ = kEndDocid;
+  }
+}
+
+void PostingCursor::Seek(uint32_t target) {
+  if (docid_ >= target) return;
+  if (lists_->skip(block_).last_docid < target) {
+    // 跳过最大文档号小于target的块
+    uint64_t block = block_ + 1;
+    while (block < block_end_ && lists_->skip(block).last_docid < target) {
+      ++block;
+    }
+    if (block == block_end_) {
+      docid_ = kEndDocid;
+      return;
+    }
+    LoadBlock(block);
+  }
+  const uint32_t* iter = std::lower_bound(buffer_ + pos_, buffer_ + num_, target);
+  pos_ = iter - buffer_;
+  docid_ = *iter;
+}
+
+}  // namespace posting
+}  // namespace gdt
@@ -0,0 +1,113 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#ifndef RETRIEVAL_FUZZY_POSTING_POSTING_LIST_H_
+#define RETRIEVAL_FUZZY_POSTING_POSTING_LIST_H_
+
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+
+namespace gdt {
+namespace posting {
+
+// 每块的文档数
+static const uint32_t kBlockSize = 128;
+
+// 游标到达链尾时的文档号
+static const uint32_t kEndDocid = 0xffffffffU;
+
+// 块的跳表项
+struct BlockSkip {
+  // 块内最大的文档号, 也是下一块差分的起点
+  uint32_t last_docid;
+  uint32_t doc_num;
+  // 块数据在data中的偏移
+  uint64_t offset;
+};
+
+// Stream VByte编码n个uint32, 追加到data
+// 格式: (n + 3) / 4个控制字节, 每个值2位表示字节数-1, 之后是每个值1~4字节的数据
+void StreamVByteEncode(const uint32_t* values, uint32_t num, std::vector<uint8_t>* data);
+
+// 解码num个差分值并求前缀和, out[i] = base + values[0] + ... + values[i]
+// data之后至少要有kDecodePadding个字节可读
+void StreamVByteDecodeDelta(const uint8_t* data, uint32_t num, uint32_t base, uint32_t* out);
+
+// 解码时一次读取16字节, 数据末尾需要留出的空间
+static const uint32_t kDecodePadding = 16;
+
+// 多条压缩倒排链共用的存储
+// 每条链按kBlockSize切块, 块内文档号差分后用Stream VByte编码,
+// 每块一个跳表项, 游标跳转时只解码目标所在的块
+class PostingLists {
+ public:
+  PostingLists();
+
+  // 追加一条升序无重复的倒排链, 链的编号为追加的顺序
+  void Add(const uint32_t* docids, uint32_t num);
+
+  uint64_t list_num() const { return list_blocks_.size() - 1; }
+
+  // 链的文档数
+  uint64_t doc_num(uint64_t list) const;
+
+  // 第list条链的块区间[begin, end)
+  uint64_t block_begin(uint64_t list) const { return list_blocks_[list]; }
+  uint64_t block_end(uint64_t list) const { return list_blocks_[list + 1]; }
+
+  const BlockSkip& skip(uint64_t block) const { return skips_[block]; }
+
+  // 解码一块, 返回文档数
+  uint32_t DecodeBlock(uint64_t list, uint64_t block, uint32_t* docids) const;
+
+  // 格式: list_num, block_num, data_size, (list_num + 1) * uint64,
+  //       block_num * BlockSkip, data按8字节补齐
+  void Save(std::ostream& os) const;
+  bool Load(std::istream& is);
+
+  void Clear();
+
+  // 压缩后的字节数
+  uint64_t data_size() const { return data_.size() - kDecodePadding; }
+
+ private:
+  // 每条链的起始块, 最后一项为总块数
+  std::vector<uint64_t> list_blocks_;
+  std::vector<BlockSkip> skips_;
+  // 末尾保留kDecodePadding个字节
+  std::vector<uint8_t> data_;
+};
+
+// 一条链上的游标, 初始位于第一个文档
+class PostingCursor {
+ public:
+  PostingCursor(const PostingLists* lists, uint64_t list);
+
+  // 当前文档号, 链尾为kEndDocid
+  uint32_t docid() const { return docid_; }
+
+  void Next();
+
+  // 移动到第一个>=target的文档, 先按跳表跳过整块
+  void Seek(uint32_t target);
+
+  uint64_t doc_num() const { return lists_->doc_num(list_); }
+
+ private:
+  void LoadBlock(uint64_t block);
+
+  const PostingLists* lists_;
+  uint64_t list_;
+  uint64_t block_;
+  uint64_t block_end_;
+  uint32_t pos_;
+  uint32_t num_;
+  uint32_t docid_;
+  uint32_t buffer_[kBlockSize];
+};
+
+}  // namespace posting
+}  // namespace gdt
+
+#endif  // RETRIEVAL_FUZZY_POSTING_POSTING_LIST_H_
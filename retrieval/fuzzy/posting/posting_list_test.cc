@@ -0,0 +1,104 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+
+#include <stdlib.h>
+#include <sstream>
+#include <vector>
+
+#include "thirdparty/gtest/gtest.h"
+#include "retrieval/fuzzy/posting/posting_list.h"
+
+using namespace gdt::posting;
+
+// 升序无重复, 间隔的字节数随机, 覆盖1~4字节的编码
+static std::vector<uint32_t> RandomDocids(uint32_t num) {
+  std::vector<uint32_t> docids;
+  uint32_t docid = rand() % 3;
+  for (uint32_t i = 0; i < num; ++i) {
+    docids.push_back(docid);
+    static const uint32_t kGaps[] = {1, 200, 60000, 1 << 20};
+    docid += 1 + rand() % kGaps[rand() % 4];
+  }
+  return docids;
+}
+
+TEST(PostingListTest, StreamVByte) {
+  srand(1);
+  for (uint32_t num = 0; num <= 130; ++num) {
+    std::vector<uint32_t> values(num);
+    for (auto& value : values) {
+      value = rand() >> (rand() % 32);
+    }
+    std::vector<uint8_t> data;
+    StreamVByteEncode(values.data(), num, &data);
+    data.resize(data.size() + kDecodePadding);
+    std::vector<uint32_t> decoded(num + 1, 0);
+    StreamVByteDecodeDelta(data.data(), num, 7, decoded.data());
+    uint32_t sum = 7;
+    for (uint32_t i = 0; i < num; ++i) {
+      sum += values[i];
+      ASSERT_EQ(sum, decoded[i]) << num << " " << i;
+    }
+  }
+}
+
+TEST(PostingListTest, Cursor) {
+  srand(2);
+  uint32_t nums[] = {0, 1, 127, 128, 129, 1000};
+  PostingLists lists;
+  std::vector<std::vector<uint32_t> > expected;
+  for (auto num : nums) {
+    expected.push_back(RandomDocids(num));
+    lists.Add(expected.back().data(), num);
+  }
+  ASSERT_EQ(expected.size(), lists.list_num());
+  for (uint64_t list = 0; list < lists.list_num(); ++list) {
+    EXPECT_EQ(expected[list].size(), lists.doc_num(list));
+    PostingCursor cursor(&lists, list);
+    for (auto docid : expected[list]) {
+      ASSERT_EQ(docid, cursor.docid());
+      cursor.Next();
+    }
+    EXPECT_EQ(kEndDocid, cursor.docid());
+  }
+
+  // 随机递增的Seek与线性查找一致
+  const std::vector<uint32_t>& docids = expected.back();
+  for (int round = 0; round < 20; ++round) {
+    PostingCursor cursor(&lists, lists.list_num() - 1);
+    uint32_t target = 0;
+    size_t pos = 0;
+    while (true) {
+      target += rand() % (1 << (rand() % 24));
+      cursor.Seek(target);
+      while (pos < docids.size() && docids[pos] < target) ++pos;
+      if (pos == docids.size()) {
+        EXPECT_EQ(kEndDocid, cursor.docid());
+        break;
+      }
+      ASSERT_EQ(docids[pos], cursor.docid());
+    }
+  }
+}
+
+TEST(PostingListTest, SaveAndLoad) {
+  srand(3);
+  PostingLists lists;
+  std::vector<uint32_t> docids = RandomDocids(300);
+  lists.Add(docids.data(), docids.size());
+  lists.Add(docids.data(), 5);
+  std::stringstream ss;
+  lists.Save(ss);
+  PostingLists loaded;
+  ASSERT_TRUE(loaded.Load(ss));
+  ASSERT_EQ(2u, loaded.list_num());
+  EXPECT_EQ(lists.data_size(), loaded.data_size());
+  PostingCursor cursor(&loaded, 0);
+  for (auto docid : docids) {
+    ASSERT_EQ(docid, cursor.docid());
+    cursor.Next();
+  }
+  std::stringstream empty;
+  EXPECT_FALSE(loaded.Load(empty));
+}
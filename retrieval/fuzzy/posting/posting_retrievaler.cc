@@ -0,0 +1,471 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "retrieval/fuzzy/posting/posting_retrievaler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <utility>
+#include "thirdparty/glog/logging.h"
+#include "framework/common/base_functor.h"
+
+namespace gdt {
+namespace posting {
+
+REGISTER_RETRIEVALER(PostingRetrievaler);
+
+using wavelet::FieldOffset;
+using wavelet::NumField;
+using wavelet::NumRange;
+using wavelet::PostingEntry;
+using wavelet::TokenOffset;
+
+// 索引文件格式:
+//   magic, OffsetTable(字段表和词项表, 区间为词项在原始倒排中的位置)
+//   document_num, document_num * document_id
+//   数值字段表, 见NumFieldTable::Save
+//   PostingLists
+static const uint64_t kIndexMagic = 0x3230584449545350LLU;  // "PSTIDX02"
+
+struct PostingRetrievaler::Context {
+  std::vector<Term> terms;
+  // 每个字段的阈值和得分
+  std::vector<double> thres;
+  std::vector<double> field_scores;
+  // 每个字段得分的上限, 范围检索每个文档最多命中一个桶, 上限为1
+  std::vector<double> field_caps;
+  // 每个字段非逐个遍历的词项的正权重和
+  std::vector<double> lazy_weights;
+  // 候选文档来源的词项, 按正权重从小到大排列
+  std::vector<size_t> drivers;
+  // 候选文档来源的词项中, 仍需逐个遍历的起始下标, 之前的只在候选处跳转
+  size_t essential_begin;
+  // 词项是否仍需逐个遍历
+  std::vector<char> essential;
+  // 非逐个遍历的词项能贡献的得分上界
+  double lazy_bound;
+  // 范围检索按原始值精确过滤
+  std::vector<NumRange> ranges;
+
+  void UpdateLazyBound() {
+    lazy_bound = 0;
+    for (size_t field = 0; field < lazy_weights.size(); ++field) {
+      lazy_bound += std::min(lazy_weights[field], field_caps[field]);
+    }
+  }
+};
+
+static double PositiveWeight(double weight) {
+  return weight > 0 ? weight : 0;
+}
+
+bool PostingRetrievaler::Build(const std::vector<Document>& documents) {
+  offset_table_.Clear();
+  posting_lists_.Clear();
+  index_data_.clear();
+  document_ids_.clear();
+  num_fields_.Clear();
+  entries_.clear();
+  for (auto& document : documents) {
+    CHECK(BuildDocument(document));
+  }
+  num_fields_.Finish();
+  for (auto& entry : entries_) {
+    if (entry.field_type == TYPE_NUM) {
+      const NumField* num_field = num_fields_.Find(entry.field_id);
+      entry.token_id = num_field->Bucket(num_field->value(entry.docid));
+    }
+  }
+  std::vector<uint64_t> posting;
+  offset_table_.Build(&entries_, &posting);
+  std::vector<PostingEntry>().swap(entries_);
+  std::vector<uint32_t> docids;
+  for (uint64_t i = 0; i < offset_table_.field_num(); ++i) {
+    const FieldOffset& field = offset_table_.field(i);
+    for (uint64_t j = 0; j < field.token_num; ++j) {
+      const TokenOffset& token = offset_table_.token(field, j);
+      CHECK(offset_table_.token_index(token) == posting_lists_.list_num());
+      // 同一文档重复的词项只保留一个
+      docids.assign(posting.begin() + token.begin, posting.begin() + token.end);
+      docids.erase(std::unique(docids.begin(), docids.end()), docids.end());
+      posting_lists_.Add(docids.data(), docids.size());
+    }
+  }
+  LOG(INFO) << "Build posting lists, documents:" << document_ids_.size()
+            << " postings:" << posting.size()
+            << " bytes:" << posting_lists_.data_size();
+  return true;
+}
+
+bool PostingRetrievaler::BuildDocument(const Document& document) {
+  // 文档号压缩为uint32, kEndDocid保留给链尾
+  CHECK_LOG(document.index() < kEndDocid, document.index());
+  if (document_ids_.size() <= document.index()) {
+    document_ids_.resize(document.index() + 1, 0);
+  }
+  document_ids_[document.index()] = document.id();
+  for (auto& field : document.field()) {
+    switch (field.field_type()) {
+      case TYPE_ID:
+        for (auto id : field.id()) {
+          entries_.push_back({field.field_id(), id, document.index(), TYPE_ID});
+        }
+        break;
+      case TYPE_NUM:
+        // 与SimilarityRetrievaler相同, 桶号在所有文档加入后确定
+        num_fields_.Get(field.field_id())->Add(document.index(), field.num());
+        entries_.push_back({field.field_id(), 0, document.index(), TYPE_NUM});
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool PostingRetrievaler::BuildTerms(const Query& query, Context* context) const {
+  for (auto& field_query : query.field_query()) {
+    const FieldOffset* field = offset_table_.FindField(field_query.field_id());
+    CHECK_LOG(field != NULL, field_query.field_id());
+    size_t field_index = context->thres.size();
+    switch (field_query.field_query_type()) {
+      case FIELD_QUERY_ID:
+        context->thres.push_back(field_query.id_query().thres());
+        context->field_caps.push_back(std::numeric_limits<double>::infinity());
+        for (auto& token : field_query.id_query().token()) {
+          const TokenOffset* token_offset = offset_table_.FindToken(*field, token.id());
+          CHECK_CONTINUE(token_offset != NULL);
+          context->terms.push_back(
+              {PostingCursor(&posting_lists_, offset_table_.token_index(*token_offset)),
+               field_index, token.weight()});
+        }
+        break;
+      case FIELD_QUERY_RANGE: {
+        // 桶区间内的词项都参与检索, 两端桶中的文档在Score中按原始值过滤
+        const RangeQuery& range_query = field_query.range_query();
+        const NumField* num_field = num_fields_.Find(field->field_id);
+        CHECK_LOG(num_field != NULL, field->field_id);
+        NumRange num_range = {num_field, -std::numeric_limits<double>::infinity(),
+                              std::numeric_limits<double>::infinity()};
+        if (range_query.has_lower_bound()) {
+          num_range.lower = range_query.lower_bound();
+        }
+        if (range_query.has_upper_bound()) {
+          num_range.upper = range_query.upper_bound();
+        }
+        context->thres.push_back(1);
+        context->field_caps.push_back(1);
+        std::pair<uint64_t, uint64_t> buckets;
+        if (!num_field->BucketRange(num_range.lower, num_range.upper, &buckets)) break;
+        context->ranges.push_back(num_range);
+        auto tokens = offset_table_.FindTokens(*field, buckets.first, buckets.second);
+        for (const TokenOffset* token = tokens.first; token < tokens.second; ++token) {
+          context->terms.push_back(
+              {PostingCursor(&posting_lists_, offset_table_.token_index(*token)),
+               field_index, 1});
+        }
+        break;
+      }
+      default:
+        context->thres.push_back(0);
+        context->field_caps.push_back(0);
+        break;
+    }
+  }
+  context->field_scores.resize(context->thres.size());
+  context->lazy_weights.resize(context->thres.size());
+  return true;
+}
+
+bool PostingRetrievaler::ChooseDrivers(Context* context) const {
+  // 阈值为正的字段必须命中其中正权重的词项, 选倒排最短的字段
+  std::vector<uint64_t> field_doc_nums(context->thres.size(), 0);
+  std::vector<double> field_bounds(context->thres.size(), 0);
+  for (auto& term : context->terms) {
+    if (term.weight > 0) {
+      field_doc_nums[term.field] += term.cursor.doc_num();
+      field_bounds[term.field] += term.weight;
+    }
+  }
+  context->essential.assign(context->terms.size(), false);
+  context->essential_begin = 0;
+  context->lazy_bound = 0;
+  std::fill(context->lazy_weights.begin(), context->lazy_weights.end(), 0);
+  size_t driver_field = context->thres.size();
+  for (size_t field = 0; field < context->thres.size(); ++field) {
+    if (context->thres[field] <= 0) continue;
+    // 阈值超过正权重和的字段不可能满足, 没有候选
+    if (context->thres[field] > field_bounds[field]) return true;
+    if (driver_field == context->thres.size() ||
+        field_doc_nums[field] < field_doc_nums[driver_field]) {
+      driver_field = field;
+    }
+  }
+  for (size_t i = 0; i < context->terms.size(); ++i) {
+    const Term& term = context->terms[i];
+    if (driver_field == context->thres.size() ||
+        (term.field == driver_field && term.weight > 0)) {
+      context->drivers.push_back(i);
+      context->essential[i] = true;
+    } else {
+      context->lazy_weights[term.field] += PositiveWeight(term.weight);
+    }
+  }
+  context->UpdateLazyBound();
+  std::sort(context->drivers.begin(), context->drivers.end(),
+            [context](size_t a, size_t b) {
+              return PositiveWeight(context->terms[a].weight) <
+                     PositiveWeight(context->terms[b].weight);
+            });
+  return driver_field != context->thres.size();
+}
+
+bool PostingRetrievaler::Score(uint32_t docid, Context* context, double* score) const {
+  std::fill(context->field_scores.begin(), context->field_scores.end(), 0);
+  for (size_t i = 0; i < context->terms.size(); ++i) {
+    Term& term = context->terms[i];
+    // 字段得分已到上限, 其余词项留到下次用到时再跳转
+    if (context->field_scores[term.field] >= context->field_caps[term.field]) continue;
+    if (!context->essential[i]) {
+      term.cursor.Seek(docid);
+    }
+    if (term.cursor.docid() == docid) {
+      context->field_scores[term.field] += term.weight;
+    }
+  }
+  *score = 0;
+  for (size_t field = 0; field < context->thres.size(); ++field) {
+    if (context->field_scores[field] < context->thres[field]) return false;
+    *score += context->field_scores[field];
+  }
+  for (auto& range : context->ranges) {
+    if (!range.Contains(docid)) return false;
+  }
+  return true;
+}
+
+Result* PostingRetrievaler::AddResult(uint32_t docid, std::vector<Result>* results) const {
+  results->push_back(Result());
+  Result* result = &results->back();
+  result->set_index(docid);
+  if (docid < document_ids_.size()) {
+    result->set_document_id(document_ids_[docid]);
+  }
+  return result;
+}
+
+void PostingRetrievaler::RetrievalAll(Context* context, std::vector<Result>* results) const {
+  // 所有词项都只在候选处跳转
+  context->essential.assign(context->terms.size(), false);
+  double score = 0;
+  for (uint32_t docid = 0; docid < document_ids_.size(); ++docid) {
+    if (Score(docid, context, &score)) {
+      AddResult(docid, results);
+    }
+  }
+}
+
+void PostingRetrievaler::RetrievalThres(Context* context, std::vector<Result>* results) const {
+  double score = 0;
+  while (true) {
+    uint32_t docid = kEndDocid;
+    for (auto i : context->drivers) {
+      docid = std::min(docid, context->terms[i].cursor.docid());
+    }
+    if (docid == kEndDocid) break;
+    if (Score(docid, context, &score)) {
+      AddResult(docid, results);
+    }
+    for (auto i : context->drivers) {
+      if (context->terms[i].cursor.docid() == docid) {
+        context->terms[i].cursor.Next();
+      }
+    }
+  }
+}
+
+void PostingRetrievaler::RetrievalTopK(size_t top_k, Context* context,
+                                       std::vector<Result>* results) const {
+  typedef std::pair<double, uint32_t> ScoredDoc;
+  // 堆顶为当前top_k中最差的文档, 同分时文档号大的更差
+  auto better = [](const ScoredDoc& a, const ScoredDoc& b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  };
+  std::vector<ScoredDoc> heap;
+  heap.reserve(top_k + 1);
+  double threshold = -std::numeric_limits<double>::infinity();
+  std::vector<size_t>& drivers = context->drivers;
+  double score = 0;
+  while (context->essential_begin < drivers.size()) {
+    uint32_t docid = kEndDocid;
+    double bound = context->lazy_bound;
+    for (size_t i = context->essential_begin; i < drivers.size(); ++i) {
+      docid = std::min(docid, context->terms[drivers[i]].cursor.docid());
+    }
+    if (docid == kEndDocid) break;
+    for (size_t i = context->essential_begin; i < drivers.size(); ++i) {
+      const Term& term = context->terms[drivers[i]];
+      if (term.cursor.docid() == docid) {
+        bound += PositiveWeight(term.weight);
+      }
+    }
+    // 得分上界进不了top_k时不用计算其余词项
+    if (bound > threshold && Score(docid, context, &score) &&
+        (heap.size() < top_k || score > threshold)) {
+      heap.push_back(std::make_pair(score, docid));
+      std::push_heap(heap.begin(), heap.end(), better);
+      if (heap.size() > top_k) {
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.pop_back();
+      }
+      if (heap.size() == top_k) {
+        threshold = heap.front().first;
+        // MaxScore: 只命中权重最小的几个词项的文档进不了top_k,
+        // 这些词项不再产生候选
+        while (context->essential_begin < drivers.size()) {
+          const Term& term = context->terms[drivers[context->essential_begin]];
+          context->lazy_weights[term.field] += PositiveWeight(term.weight);
+          double lazy_bound = context->lazy_bound;
+          context->UpdateLazyBound();
+          if (context->lazy_bound > threshold) {
+            context->lazy_weights[term.field] -= PositiveWeight(term.weight);
+            context->lazy_bound = lazy_bound;
+            break;
+          }
+          context->essential[drivers[context->essential_begin]] = false;
+          ++context->essential_begin;
+        }
+      }
+    }
+    for (size_t i = context->essential_begin; i < drivers.size(); ++i) {
+      PostingCursor& cursor = context->terms[drivers[i]].cursor;
+      if (cursor.docid() == docid) {
+        cursor.Next();
+      }
+    }
+  }
+  std::sort(heap.begin(), heap.end(), better);
+  for (auto& scored_doc : heap) {
+    AddResult(scored_doc.second, results)->set_score(scored_doc.first);
+  }
+}
+
+bool PostingRetrievaler::Retrieval(const Query& query, std::vector<Result>* results) {
+  Context context;
+  CHECK(BuildTerms(query, &context));
+  bool has_driver = ChooseDrivers(&context);
+  if (query.top_k() > 0) {
+    RetrievalTopK(query.top_k(), &context, results);
+  } else if (has_driver) {
+    RetrievalThres(&context, results);
+  } else {
+    RetrievalAll(&context, results);
+  }
+  return true;
+}
+
+bool PostingRetrievaler::FieldIds(std::vector<uint64_t>* field_ids) const {
+  field_ids->clear();
+  for (uint64_t i = 0; i < offset_table_.field_num(); ++i) {
+    field_ids->push_back(offset_table_.field(i).field_id);
+  }
+  return true;
+}
+
+bool PostingRetrievaler::Dump(std::vector<Document>* documents) const {
+  std::vector<Document> dumped(document_ids_.size());
+  for (size_t i = 0; i < dumped.size(); ++i) {
+    dumped[i].set_index(i);
+    dumped[i].set_id(document_ids_[i]);
+  }
+  for (uint64_t i = 0; i < offset_table_.field_num(); ++i) {
+    const FieldOffset& field_offset = offset_table_.field(i);
+    const NumField* num_field = num_fields_.Find(field_offset.field_id);
+    std::vector<Field*> fields(dumped.size(), NULL);
+    for (uint64_t j = 0; j < field_offset.token_num; ++j) {
+      const TokenOffset& token = offset_table_.token(field_offset, j);
+      PostingCursor cursor(&posting_lists_, offset_table_.token_index(token));
+      for (; cursor.docid() != kEndDocid; cursor.Next()) {
+        CHECK_LOG(cursor.docid() < dumped.size(), cursor.docid());
+        Field*& field = fields[cursor.docid()];
+        if (field == NULL) {
+          field = dumped[cursor.docid()].add_field();
+          field->set_field_id(field_offset.field_id);
+          field->set_field_type(FieldType(field_offset.field_type));
+        }
+        if (field->field_type() == TYPE_NUM) {
+          CHECK_LOG(num_field != NULL, field_offset.field_id);
+          field->set_num(num_field->value(cursor.docid()));
+        } else {
+          field->add_id(token.token_id);
+        }
+      }
+    }
+  }
+  documents->clear();
+  documents->reserve(dumped.size());
+  for (auto& document : dumped) {
+    // 跳过没有用到的索引位置
+    if (document.id() != 0 || document.field_size() > 0) {
+      documents->push_back(std::move(document));
+    }
+  }
+  return true;
+}
+
+bool PostingRetrievaler::Save(const std::string& filename) const {
+  std::ofstream ofs(filename.c_str(), std::ios::binary | std::ios::trunc);
+  CHECK_LOG(ofs.good(), filename);
+  auto write = [&](uint64_t value) {
+    ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  write(kIndexMagic);
+  offset_table_.Save(ofs);
+  write(document_ids_.size());
+  ofs.write(reinterpret_cast<const char*>(document_ids_.data()),
+            sizeof(uint64_t) * document_ids_.size());
+  num_fields_.Save(ofs);
+  posting_lists_.Save(ofs);
+  ofs.close();
+  CHECK_LOG(!ofs.fail(), filename);
+  return true;
+}
+
+bool PostingRetrievaler::Load(const std::string& filename) {
+  std::ifstream ifs(filename.c_str(), std::ios::binary);
+  CHECK_LOG(ifs.good(), filename);
+  offset_table_.Clear();
+  posting_lists_.Clear();
+  document_ids_.clear();
+  num_fields_.Clear();
+  index_data_.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(index_data_.data());
+  uint64_t word_num = index_data_.size() / sizeof(uint64_t);
+  CHECK_LOG(word_num >= 1 && words[0] == kIndexMagic, filename);
+  uint64_t used = offset_table_.Map(index_data_.data() + sizeof(uint64_t),
+                                    index_data_.size() - sizeof(uint64_t));
+  CHECK_LOG(used > 0, filename);
+  uint64_t pos = 1 + used / sizeof(uint64_t);
+  CHECK_LOG(word_num > pos && word_num >= pos + 1 + words[pos], filename);
+  document_ids_.assign(words + pos + 1, words + pos + 1 + words[pos]);
+  pos += 1 + words[pos];
+  // 原始值列直接引用index_data_
+  used = num_fields_.Map(index_data_.data() + pos * sizeof(uint64_t),
+                         index_data_.size() - pos * sizeof(uint64_t));
+  CHECK_LOG(used > 0 && used % sizeof(uint64_t) == 0, filename);
+  pos += used / sizeof(uint64_t);
+  std::istringstream iss(index_data_.substr(pos * sizeof(uint64_t)));
+  CHECK_LOG(posting_lists_.Load(iss), filename);
+  CHECK_LOG(posting_lists_.list_num() == offset_table_.token_num(), filename);
+  LOG(INFO) << "Load index " << filename << " fields:" << offset_table_.field_num()
+            << " tokens:" << offset_table_.token_num()
+            << " bytes:" << posting_lists_.data_size();
+  return true;
+}
+
+}  // namespace posting
+}  // namespace gdt
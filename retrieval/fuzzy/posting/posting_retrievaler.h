@@ -0,0 +1,83 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#ifndef RETRIEVAL_FUZZY_POSTING_POSTING_RETRIEVALER_H_
+#define RETRIEVAL_FUZZY_POSTING_POSTING_RETRIEVALER_H_
+
+#include <string>
+#include <vector>
+#include "retrieval/base/retrievaler.h"
+#include "retrieval/fuzzy/posting/posting_list.h"
+#include "retrieval/fuzzy/wavelet/num_field.h"
+#include "retrieval/fuzzy/wavelet/offset_table.h"
+
+namespace gdt {
+namespace posting {
+
+// 基于压缩倒排链的检索器, 与SimilarityRetrievaler的检索语义相同:
+// 每个字段命中词项的权重和不低于阈值, 范围检索的阈值为1, 得分为所有命中词项的权重和.
+// 候选文档只从一个必须命中的字段的倒排链中产生, 其余链用跳表跳到候选处,
+// top_k检索按MaxScore剪枝, 短而选择性强的查询只需解码很少的块
+class PostingRetrievaler : public Retrievaler {
+ public:
+  bool Build(const std::vector<Document>& documents);
+  bool Retrieval(const Query& query, std::vector<Result>* results);
+  bool Save(const std::string& filename) const;
+  bool Load(const std::string& filename);
+  bool DocumentIds(std::vector<uint64_t>* document_ids) const {
+    *document_ids = document_ids_;
+    return true;
+  }
+  bool FieldIds(std::vector<uint64_t>* field_ids) const;
+  // 从倒排链还原文档, 数值字段从原始值列还原
+  bool Dump(std::vector<Document>* documents) const;
+
+  // 压缩后倒排链的字节数
+  uint64_t posting_size() const { return posting_lists_.data_size(); }
+
+ private:
+  // 检索中的一个词项
+  struct Term {
+    PostingCursor cursor;
+    // 在query中的字段下标
+    size_t field;
+    double weight;
+  };
+
+  // 一次检索的状态
+  struct Context;
+
+  bool BuildDocument(const Document& document);
+
+  bool BuildTerms(const Query& query, Context* context) const;
+
+  // 选出候选文档来源的词项, 没有必须命中的字段时返回false
+  bool ChooseDrivers(Context* context) const;
+
+  // 计算候选文档docid的得分, 不满足阈值时返回false
+  bool Score(uint32_t docid, Context* context, double* score) const;
+
+  // 没有必须命中的字段时逐个文档检查
+  void RetrievalAll(Context* context, std::vector<Result>* results) const;
+
+  void RetrievalThres(Context* context, std::vector<Result>* results) const;
+
+  void RetrievalTopK(size_t top_k, Context* context, std::vector<Result>* results) const;
+
+  Result* AddResult(uint32_t docid, std::vector<Result>* results) const;
+
+  wavelet::OffsetTable offset_table_;
+  // 第i条链对应词项表中的第i个词项
+  PostingLists posting_lists_;
+  std::vector<uint64_t> document_ids_;
+  // 数值字段的分桶和原始值
+  wavelet::NumFieldTable num_fields_;
+  std::vector<wavelet::PostingEntry> entries_;
+  // 载入的索引文件, offset_table_直接引用其中的字段表和词项表
+  std::string index_data_;
+};
+
+}  // namespace posting
+}  // namespace gdt
+
+#endif  // RETRIEVAL_FUZZY_POSTING_POSTING_RETRIEVALER_H_
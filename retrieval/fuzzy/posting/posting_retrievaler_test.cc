@@ -0,0 +1,324 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+//
+// $build64_release/retrieval/fuzzy/posting/posting_retrievaler_test --benchmarks=all
+//     --posting_benchmark_documents=1000000
+// BM_Wavelet*和BM_Posting*在同一份文档上对比两种检索器
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "app/qzap/common/base/benchmark.h"
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/glog/logging.h"
+#include "thirdparty/gtest/gtest.h"
+#include "retrieval/fuzzy/posting/posting_retrievaler.h"
+#include "retrieval/fuzzy/wavelet/similarity_retrievaler.h"
+
+DEFINE_int32(posting_benchmark_documents, 1000000, "benchmark文档数");
+DECLARE_string(num_field_buckets);
+
+using namespace gdt;
+using gdt::posting::PostingRetrievaler;
+using gdt::wavelet::SimilarityRetrievaler;
+
+static const uint64_t kVocabulary = 100000;
+
+// 词项ID越小越常见, 两个字段: 1为ID, 2为0~100的两位小数
+static std::vector<Document> RandomDocuments(size_t document_num, int max_token_num) {
+  std::vector<Document> documents(document_num);
+  for (size_t i = 0; i < document_num; ++i) {
+    documents[i].set_index(i);
+    documents[i].set_id(i + 1000);
+    Field* field = documents[i].add_field();
+    field->set_field_type(TYPE_ID);
+    field->set_field_id(1);
+    int token_num = 1 + rand() % max_token_num;
+    for (int j = 0; j < token_num; ++j) {
+      double u = rand() / (RAND_MAX + 1.0);
+      field->add_id(uint64_t(kVocabulary * u * u * u));
+    }
+    std::sort(field->mutable_id()->begin(), field->mutable_id()->end());
+    field->mutable_id()->erase(
+        std::unique(field->mutable_id()->begin(), field->mutable_id()->end()),
+        field->mutable_id()->end());
+    field = documents[i].add_field();
+    field->set_field_type(TYPE_NUM);
+    field->set_field_id(2);
+    field->set_num((rand() % 10000) / 100.0);
+  }
+  return documents;
+}
+
+static Query IdQuery(const std::vector<uint64_t>& ids, const std::vector<double>& weights,
+                     double thres, uint32_t top_k) {
+  Query query;
+  FieldQuery* field_query = query.add_field_query();
+  field_query->set_field_id(1);
+  field_query->set_field_query_type(FIELD_QUERY_ID);
+  field_query->mutable_id_query()->set_thres(thres);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    Token* token = field_query->mutable_id_query()->add_token();
+    token->set_id(ids[i]);
+    token->set_weight(weights[i]);
+  }
+  query.set_top_k(top_k);
+  return query;
+}
+
+static void AddRangeQuery(double lower, double upper, Query* query) {
+  FieldQuery* field_query = query->add_field_query();
+  field_query->set_field_id(2);
+  field_query->set_field_query_type(FIELD_QUERY_RANGE);
+  field_query->mutable_range_query()->set_lower_bound(lower);
+  field_query->mutable_range_query()->set_upper_bound(upper);
+}
+
+static std::vector<uint64_t> Indexes(const std::vector<Result>& results) {
+  std::vector<uint64_t> indexes;
+  for (auto& result : results) {
+    indexes.push_back(result.index());
+  }
+  std::sort(indexes.begin(), indexes.end());
+  return indexes;
+}
+
+static std::vector<double> Scores(const std::vector<Result>& results) {
+  std::vector<double> scores;
+  for (auto& result : results) {
+    scores.push_back(result.score());
+  }
+  return scores;
+}
+
+// 两种检索器对同一查询的结果一致
+static void ExpectSameResults(Retrievaler* expected, Retrievaler* actual, const Query& query) {
+  std::vector<Result> expected_results, results;
+  ASSERT_TRUE(expected->Retrieval(query, &expected_results));
+  ASSERT_TRUE(actual->Retrieval(query, &results));
+  if (query.top_k() > 0) {
+    EXPECT_EQ(Scores(expected_results), Scores(results)) << query.ShortDebugString();
+  } else {
+    EXPECT_EQ(Indexes(expected_results), Indexes(results)) << query.ShortDebugString();
+  }
+  for (auto& result : results) {
+    EXPECT_EQ(result.index() + 1000, result.document_id());
+  }
+}
+
+TEST(PostingRetrievalerTest, SameAsWavelet) {
+  srand(1);
+  std::vector<Document> documents = RandomDocuments(3000, 20);
+  SimilarityRetrievaler wavelet;
+  PostingRetrievaler posting;
+  ASSERT_TRUE(wavelet.Build(documents));
+  ASSERT_TRUE(posting.Build(documents));
+  std::vector<uint64_t> ids = {0, 1, 5, 30, 200, 3000};
+  std::vector<double> weights = {1, 2, 3, 1, 4, 2};
+  for (double thres = 1; thres <= 8; thres += 1) {
+    ExpectSameResults(&wavelet, &posting, IdQuery(ids, weights, thres, 0));
+    Query query = IdQuery(ids, weights, thres, 0);
+    AddRangeQuery(20, 60, &query);
+    ExpectSameResults(&wavelet, &posting, query);
+  }
+  for (uint32_t top_k = 1; top_k <= 1000; top_k *= 10) {
+    ExpectSameResults(&wavelet, &posting, IdQuery(ids, weights, 1, top_k));
+    ExpectSameResults(&wavelet, &posting, IdQuery(ids, weights, 4, top_k));
+    Query query = IdQuery(ids, weights, 1, top_k);
+    AddRangeQuery(10, 30.5, &query);
+    ExpectSameResults(&wavelet, &posting, query);
+  }
+  Query query;
+  AddRangeQuery(15, 17, &query);
+  ExpectSameResults(&wavelet, &posting, query);
+}
+
+// 与逐个文档计算的结果比较, 包括负权重和非正阈值
+TEST(PostingRetrievalerTest, BruteForce) {
+  srand(2);
+  std::vector<Document> documents = RandomDocuments(500, 10);
+  PostingRetrievaler posting;
+  ASSERT_TRUE(posting.Build(documents));
+  std::vector<uint64_t> ids = {0, 2, 7, 40, 900};
+  std::vector<double> weights = {1, -2, 3, 2.5, -1};
+  for (double thres = -2; thres <= 6; thres += 1) {
+    std::vector<uint64_t> expected;
+    std::vector<double> expected_scores;
+    for (auto& document : documents) {
+      double score = 0;
+      for (size_t i = 0; i < ids.size(); ++i) {
+        const auto& doc_ids = document.field(0).id();
+        if (std::find(doc_ids.begin(), doc_ids.end(), ids[i]) != doc_ids.end()) {
+          score += weights[i];
+        }
+      }
+      if (score >= thres) {
+        expected.push_back(document.index());
+        expected_scores.push_back(score);
+      }
+    }
+    std::vector<Result> results;
+    ASSERT_TRUE(posting.Retrieval(IdQuery(ids, weights, thres, 0), &results));
+    EXPECT_EQ(expected, Indexes(results)) << thres;
+
+    // top_k按得分从高到低
+    if (thres <= 0) continue;
+    std::sort(expected_scores.rbegin(), expected_scores.rend());
+    expected_scores.resize(std::min<size_t>(expected_scores.size(), 10));
+    results.clear();
+    ASSERT_TRUE(posting.Retrieval(IdQuery(ids, weights, thres, 10), &results));
+    EXPECT_EQ(expected_scores, Scores(results)) << thres;
+  }
+}
+
+// 各种分桶方式下范围检索都与按原始值逐个比较的结果一致
+TEST(PostingRetrievalerTest, RangeBuckets) {
+  srand(5);
+  std::vector<Document> documents = RandomDocuments(1000, 10);
+  std::vector<std::pair<double, double> > ranges = {
+    {9.01, 9.99}, {20.5, 60.25}, {0, 0.5}, {99.5, 1000}, {-1, 3}, {50, 40},
+  };
+  for (const char* buckets : {"", "2:linear:7.5", "2:log:1.3", "2:quantile:16"}) {
+    FLAGS_num_field_buckets = buckets;
+    SimilarityRetrievaler wavelet;
+    PostingRetrievaler posting;
+    ASSERT_TRUE(wavelet.Build(documents));
+    ASSERT_TRUE(posting.Build(documents));
+    for (auto& range : ranges) {
+      std::vector<uint64_t> expected;
+      for (auto& document : documents) {
+        double num = document.field(1).num();
+        if (num >= range.first && num <= range.second) {
+          expected.push_back(document.index());
+        }
+      }
+      Query query;
+      AddRangeQuery(range.first, range.second, &query);
+      std::vector<Result> results;
+      ASSERT_TRUE(wavelet.Retrieval(query, &results));
+      EXPECT_EQ(expected, Indexes(results)) << buckets << " " << range.first;
+      results.clear();
+      ASSERT_TRUE(posting.Retrieval(query, &results));
+      EXPECT_EQ(expected, Indexes(results)) << buckets << " " << range.first;
+
+      // top_k时被过滤掉的候选由后面的文档补上
+      query = IdQuery({0, 1, 2}, {1, 1, 1}, 1, 20);
+      AddRangeQuery(range.first, range.second, &query);
+      ExpectSameResults(&wavelet, &posting, query);
+    }
+  }
+  FLAGS_num_field_buckets = "";
+}
+
+TEST(PostingRetrievalerTest, SaveAndLoad) {
+  srand(3);
+  std::vector<Document> documents = RandomDocuments(1000, 10);
+  PostingRetrievaler posting;
+  ASSERT_TRUE(posting.Build(documents));
+  ASSERT_TRUE(posting.Save("posting_retrievaler_test.index"));
+  PostingRetrievaler loaded;
+  ASSERT_TRUE(loaded.Load("posting_retrievaler_test.index"));
+  std::vector<uint64_t> ids = {0, 3, 10, 100};
+  std::vector<double> weights = {1, 1, 1, 1};
+  for (double thres = 1; thres <= 3; thres += 1) {
+    ExpectSameResults(&posting, &loaded, IdQuery(ids, weights, thres, 0));
+    ExpectSameResults(&posting, &loaded, IdQuery(ids, weights, thres, 5));
+  }
+  EXPECT_FALSE(loaded.Load("not_exist.index"));
+
+  std::vector<Document> dumped;
+  ASSERT_TRUE(posting.Dump(&dumped));
+  ASSERT_EQ(documents.size(), dumped.size());
+  for (size_t i = 0; i < documents.size(); ++i) {
+    EXPECT_EQ(documents[i].DebugString(), dumped[i].DebugString());
+  }
+}
+
+static const std::vector<Document>& BenchmarkDocuments() {
+  static std::vector<Document>* documents = NULL;
+  if (documents == NULL) {
+    srand(4);
+    documents = new std::vector<Document>(
+        RandomDocuments(FLAGS_posting_benchmark_documents, 30));
+  }
+  return *documents;
+}
+
+template <typename T>
+static T* BenchmarkRetrievaler() {
+  static T* retrievaler = NULL;
+  if (retrievaler == NULL) {
+    retrievaler = new T();
+    CHECK(retrievaler->Build(BenchmarkDocuments()));
+  }
+  return retrievaler;
+}
+
+// 短而选择性强的查询: 3个较少见的词项, 命中任意一个即可
+static std::vector<Query> ShortQueries(int num, uint32_t top_k) {
+  std::vector<Query> queries;
+  for (int i = 0; i < num; ++i) {
+    std::vector<uint64_t> ids;
+    for (int j = 0; j < 3; ++j) {
+      ids.push_back(kVocabulary / 10 + rand() % (kVocabulary * 9 / 10));
+    }
+    queries.push_back(IdQuery(ids, {1, 2, 3}, 1, top_k));
+  }
+  return queries;
+}
+
+// 包含常见词项的查询, 要求命中两个以上并限定数值范围
+static std::vector<Query> BroadQueries(int num, uint32_t top_k) {
+  std::vector<Query> queries;
+  for (int i = 0; i < num; ++i) {
+    std::vector<uint64_t> ids;
+    for (int j = 0; j < 5; ++j) {
+      ids.push_back(rand() % 100);
+    }
+    Query query = IdQuery(ids, {1, 1, 1, 1, 1}, 2, top_k);
+    AddRangeQuery(20, 60, &query);
+    queries.push_back(query);
+  }
+  return queries;
+}
+
+static void RunQueries(Retrievaler* retrievaler, const std::vector<Query>& queries,
+                       int iters) {
+  std::vector<Result> results;
+  size_t result_num = 0;
+  for (int i = 0; i < iters; ++i) {
+    results.clear();
+    retrievaler->Retrieval(queries[i % queries.size()], &results);
+    result_num += results.size();
+  }
+  VLOG(1) << "results per query: " << result_num / std::max(iters, 1);
+}
+
+#define RETRIEVAL_BENCHMARK(name, engine, queries, top_k) \
+  static void BM_##name(int iters) { \
+    StopBenchmarkTiming(); \
+    Retrievaler* retrievaler = BenchmarkRetrievaler<engine>(); \
+    std::vector<Query> query_list = queries(100, top_k); \
+    StartBenchmarkTiming(); \
+    RunQueries(retrievaler, query_list, iters); \
+  } \
+  BENCHMARK(BM_##name)
+
+RETRIEVAL_BENCHMARK(WaveletShort, SimilarityRetrievaler, ShortQueries, 0);
+RETRIEVAL_BENCHMARK(PostingShort, PostingRetrievaler, ShortQueries, 0);
+RETRIEVAL_BENCHMARK(WaveletShortTopK, SimilarityRetrievaler, ShortQueries, 10);
+RETRIEVAL_BENCHMARK(PostingShortTopK, PostingRetrievaler, ShortQueries, 10);
+RETRIEVAL_BENCHMARK(WaveletBroadTopK, SimilarityRetrievaler, BroadQueries, 10);
+RETRIEVAL_BENCHMARK(PostingBroadTopK, PostingRetrievaler, BroadQueries, 10);
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  RunSpecifiedBenchmarks();
+  return RUN_ALL_TESTS();
+}
@@ -20,19 +20,180 @@
 #include "retrieval/fuzzy/wavelet/bit_array.h"
 
 #include <cassert>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 namespace wat_array {
 
-BitArray::BitArray() : length_(0), one_num_(0) {
+namespace {
+
+typedef void (*RankBatchFunc)(const uint64_t* words, const uint64_t* positions,
+                              size_t num, uint64_t* ranks);
+typedef uint64_t (*SelectInBlockFunc)(uint64_t x, uint64_t rank);
+
+const uint64_t kSuperBlockBitNum = 512;
+const uint64_t kSuperBlockWordNum = 10;
+const size_t kPrefetchNum = 8;
+
+// rank9: words[0] is the absolute rank, words[1] packs the ranks of
+// blocks 1..7 relative to the superblock in 9 bits each
+inline uint64_t RankOneIn(const uint64_t* words, uint64_t pos) {
+  const uint64_t* super_block = words + (pos / kSuperBlockBitNum) * kSuperBlockWordNum;
+  uint64_t block = (pos / 64) % 8;
+  uint64_t t = block - 1;
+  uint64_t rank = super_block[0] +
+      ((super_block[1] >> ((t + ((t >> 60) & 8)) * 9)) & 0x1FF);
+  return rank + __builtin_popcountll(super_block[2 + block] &
+                                     ((1LLU << (pos % 64)) - 1));
 }
 
-BitArray::BitArray(uint64_t length) {
+inline void RankBatchIn(const uint64_t* words, const uint64_t* positions,
+                        size_t num, uint64_t* ranks) {
+  for (size_t begin = 0; begin < num; begin += kPrefetchNum) {
+    size_t end = begin + kPrefetchNum < num ? begin + kPrefetchNum : num;
+    for (size_t i = begin; i < end; ++i) {
+      const uint64_t* super_block =
+          words + (positions[i] / kSuperBlockBitNum) * kSuperBlockWordNum;
+      __builtin_prefetch(super_block);
+      __builtin_prefetch(super_block + 2 + (positions[i] / 64) % 8);
+    }
+    for (size_t i = begin; i < end; ++i) {
+      ranks[i] = RankOneIn(words, positions[i]);
+    }
+  }
+}
+
+void RankBatchGeneric(const uint64_t* words, const uint64_t* positions,
+                      size_t num, uint64_t* ranks) {
+  RankBatchIn(words, positions, num, ranks);
+}
+
+uint64_t SelectInBlockGeneric(uint64_t x, uint64_t rank) {
+  uint64_t x1 = x - ((x >> 1) & 0x5555555555555555LLU);
+  uint64_t x2 = (x1 & 0x3333333333333333LLU) + ((x1 >> 2) &
+                                                0x3333333333333333LLU);
+  uint64_t x3 = (x2 + (x2 >> 4)) & 0x0F0F0F0F0F0F0F0FLLU;
+
+  uint64_t pos = 0;
+  for (;;  pos += 8) {
+    uint64_t rank_next = (x3 >> pos) & 0xFFLLU;
+    if (rank <= rank_next) break;
+    rank -= rank_next;
+  }
+
+  uint64_t v2 = (x2 >> pos) & 0xFLLU;
+  if (rank > v2) {
+    rank -= v2;
+    pos += 4;
+  }
+
+  uint64_t v1 = (x1 >> pos) & 0x3LLU;
+  if (rank > v1) {
+    rank -= v1;
+    pos += 2;
+  }
+
+  uint64_t v0  = (x >> pos) & 0x1LLU;
+  if (v0 < rank) {
+    pos += 1;
+  }
+
+  return pos;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("popcnt")))
+void RankBatchPopcnt(const uint64_t* words, const uint64_t* positions,
+                     size_t num, uint64_t* ranks) {
+  RankBatchIn(words, positions, num, ranks);
+}
+
+__attribute__((target("bmi2")))
+uint64_t SelectInBlockBmi2(uint64_t x, uint64_t rank) {
+  if (rank == 0) return 0;
+  uint64_t bit = _pdep_u64(1LLU << (rank - 1), x);
+  return bit ? __builtin_ctzll(bit) : 64;
+}
+
+bool HasCpuFeature(unsigned int leaf, int reg, unsigned int mask) {
+  unsigned int regs[4] = {0, 0, 0, 0};
+  if (__get_cpuid_max(0, NULL) < leaf) return false;
+  __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+  return (regs[reg] & mask) != 0;
+}
+#endif
+
+// kernels are chosen once from the running cpu, not the build machine
+RankBatchFunc GetRankBatch() {
+#if defined(__x86_64__)
+  static const RankBatchFunc func = HasCpuFeature(1, 2, bit_POPCNT) ?
+      &RankBatchPopcnt : &RankBatchGeneric;
+  return func;
+#else
+  return &RankBatchGeneric;
+#endif
+}
+
+SelectInBlockFunc GetSelectInBlock() {
+#if defined(__x86_64__)
+  static const SelectInBlockFunc func = HasCpuFeature(7, 1, bit_BMI2) ?
+      &SelectInBlockBmi2 : &SelectInBlockGeneric;
+  return func;
+#else
+  return &SelectInBlockGeneric;
+#endif
+}
+
+}  // namespace
+
+BitArray::BitArray() : words_(NULL), word_num_(0), mapped_(false),
+  length_(0), one_num_(0) {
+}
+
+BitArray::BitArray(uint64_t length) : words_(NULL), word_num_(0),
+  mapped_(false) {
   Init(length);
 }
 
+BitArray::BitArray(const BitArray& other) {
+  CopyFrom(other);
+}
+
+BitArray& BitArray::operator=(const BitArray& other) {
+  if (this != &other) {
+    CopyFrom(other);
+  }
+  return *this;
+}
+
 BitArray::~BitArray() {
 }
 
+void BitArray::CopyFrom(const BitArray& other) {
+  super_blocks_ = other.super_blocks_;
+  length_       = other.length_;
+  one_num_      = other.one_num_;
+  mapped_       = other.mapped_;
+  if (mapped_) {
+    words_    = other.words_;
+    word_num_ = other.word_num_;
+  } else {
+    Bind();
+  }
+}
+
+void BitArray::Bind() {
+  mapped_   = false;
+  words_    = super_blocks_.empty() ? NULL : &super_blocks_[0];
+  word_num_ = super_blocks_.size();
+}
+
+bool BitArray::mapped() const {
+  return mapped_;
+}
+
 uint64_t BitArray::length() const {
   return length_;
 }
@@ -41,37 +202,58 @@ uint64_t BitArray::one_num() const {
   return one_num_;
 }
 
+uint64_t BitArray::SuperBlockNum(uint64_t length) {
+  // one more superblock so that Rank(length) is always inside the array
+  return length / SUPERBLOCK_BITNUM + 1;
+}
+
+uint64_t BitArray::BlockNum() const {
+  return (length_ + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
+}
+
+uint64_t BitArray::Block(uint64_t block_ind) const {
+  return words_[(block_ind / SUPERBLOCK_BLOCKNUM) * SUPERBLOCK_WORDNUM + 2 +
+                block_ind % SUPERBLOCK_BLOCKNUM];
+}
+
 void BitArray::Init(uint64_t length) {
   length_  = length;
   one_num_ = 0;
-  uint64_t block_num = (length + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
-  bit_blocks_.resize(block_num);
+  super_blocks_.assign(SuperBlockNum(length) * SUPERBLOCK_WORDNUM, 0);
+  Bind();
 }
 
 void BitArray::Clear() {
-  std::vector<uint64_t>().swap(bit_blocks_);
-  std::vector<uint64_t>().swap(rank_tables_);
+  std::vector<uint64_t>().swap(super_blocks_);
   length_ = 0;
   one_num_ = 0;
+  Bind();
 }
 
 void BitArray::Build() {
   one_num_ = 0;
-  uint64_t table_num = ((bit_blocks_.size() + TABLE_INTERVAL - 1) /
-                        TABLE_INTERVAL) + 1;
-  rank_tables_.resize(table_num);
-  for (size_t i = 0; i < bit_blocks_.size(); ++i) {
-    if ((i % TABLE_INTERVAL) == 0) {
-      rank_tables_[i / TABLE_INTERVAL] = one_num_;
+  for (size_t i = 0; i < super_blocks_.size(); i += SUPERBLOCK_WORDNUM) {
+    uint64_t* super_block = &super_blocks_[i];
+    uint64_t relative = 0;
+    uint64_t count = 0;
+    for (uint64_t j = 0; j < SUPERBLOCK_BLOCKNUM; ++j) {
+      if (j > 0) {
+        relative |= count << (9 * (j - 1));
+      }
+      count += PopCount(super_block[2 + j]);
     }
-    one_num_ += PopCount(bit_blocks_[i]);
+    super_block[0] = one_num_;
+    super_block[1] = relative;
+    one_num_ += count;
   }
-  rank_tables_.back() = one_num_;
+  Bind();
 }
 
 void BitArray::SetBit(uint64_t bit, uint64_t pos) {
   if (!bit) return;
-  bit_blocks_[pos / BLOCK_BITNUM] |= (1LLU << (pos % BLOCK_BITNUM));
+  super_blocks_[(pos / SUPERBLOCK_BITNUM) * SUPERBLOCK_WORDNUM + 2 +
+                (pos / BLOCK_BITNUM) % SUPERBLOCK_BLOCKNUM] |=
+      (1LLU << (pos % BLOCK_BITNUM));
 }
 
 uint64_t BitArray::Rank(uint64_t bit, uint64_t pos) const {
@@ -80,95 +262,78 @@ uint64_t BitArray::Rank(uint64_t bit, uint64_t pos) const {
   else return pos - RankOne(pos);
 }
 
+void BitArray::RankBatch(uint64_t bit, const uint64_t* positions, size_t num,
+                         uint64_t* ranks) const {
+  if (word_num_ == 0) {
+    for (size_t i = 0; i < num; ++i) ranks[i] = 0;
+    return;
+  }
+  GetRankBatch()(words_, positions, num, ranks);
+  if (!bit) {
+    for (size_t i = 0; i < num; ++i) {
+      ranks[i] = positions[i] - ranks[i];
+    }
+  }
+}
+
 uint64_t BitArray::Select(uint64_t bit, uint64_t rank) const {
   if (bit) {
     if (rank > one_num_) return NOTFOUND;
   } else {
     if (rank > length_ - one_num_) return NOTFOUND;
   }
+  if (rank == 0) return 0;
 
   uint64_t block_pos = SelectOutBlock(bit, rank);
-  uint64_t block = bit ? bit_blocks_[block_pos] : ~bit_blocks_[block_pos];
+  uint64_t block = bit ? Block(block_pos) : ~Block(block_pos);
   return block_pos * BLOCK_BITNUM + SelectInBlock(block, rank);
 }
 
 uint64_t BitArray::SelectOutBlock(uint64_t bit, uint64_t& rank) const {
-  // binary search over tables
+  // binary search over superblocks
   uint64_t left = 0;
-  uint64_t right = rank_tables_.size();
+  uint64_t right = word_num_ / SUPERBLOCK_WORDNUM;
   while (left < right) {
     uint64_t mid = (left + right) / 2;
-    uint64_t length = BLOCK_BITNUM * TABLE_INTERVAL * mid;
-    if (GetBitNum(rank_tables_[mid], length, bit) < rank) {
+    uint64_t length = SUPERBLOCK_BITNUM * mid;
+    if (GetBitNum(words_[mid * SUPERBLOCK_WORDNUM], length, bit) < rank) {
       left = mid + 1;
     } else {
       right = mid;
     }
   }
 
-  uint64_t table_ind = (left != 0) ? left - 1 : 0;
-  uint64_t block_pos = table_ind * TABLE_INTERVAL;
-  rank -= GetBitNum(rank_tables_[table_ind], block_pos * BLOCK_BITNUM, bit);
-
-  // sequential search over blocks
-  for (; block_pos < bit_blocks_.size(); ++block_pos) {
-    uint64_t rank_next = GetBitNum(PopCount(bit_blocks_[block_pos]), BLOCK_BITNUM,
-                                   bit);
-    if (rank <= rank_next) {
+  uint64_t super_ind = (left != 0) ? left - 1 : 0;
+  const uint64_t* super_block = words_ + super_ind * SUPERBLOCK_WORDNUM;
+  rank -= GetBitNum(super_block[0], super_ind * SUPERBLOCK_BITNUM, bit);
+
+  // sequential search over the relative ranks
+  uint64_t block = 1;
+  uint64_t prev = 0;
+  for (; block < SUPERBLOCK_BLOCKNUM; ++block) {
+    uint64_t relative = GetBitNum((super_block[1] >> (9 * (block - 1))) & 0x1FF,
+                                  block * BLOCK_BITNUM, bit);
+    if (relative >= rank) {
       break;
     }
-    rank -= rank_next;
+    prev = relative;
   }
-  return block_pos;
+  rank -= prev;
+  return super_ind * SUPERBLOCK_BLOCKNUM + block - 1;
 }
 
 uint64_t BitArray::SelectInBlock(uint64_t x, uint64_t rank) {
-  uint64_t x1 = x - ((x >> 1) & 0x5555555555555555LLU);
-  uint64_t x2 = (x1 & 0x3333333333333333LLU) + ((x1 >> 2) &
-                                                0x3333333333333333LLU);
-  uint64_t x3 = (x2 + (x2 >> 4)) & 0x0F0F0F0F0F0F0F0FLLU;
-
-  uint64_t pos = 0;
-  for (;;  pos += 8) {
-    uint64_t rank_next = (x3 >> pos) & 0xFFLLU;
-    if (rank <= rank_next) break;
-    rank -= rank_next;
-  }
-
-  uint64_t v2 = (x2 >> pos) & 0xFLLU;
-  if (rank > v2) {
-    rank -= v2;
-    pos += 4;
-  }
-
-  uint64_t v1 = (x1 >> pos) & 0x3LLU;
-  if (rank > v1) {
-    rank -= v1;
-    pos += 2;
-  }
-
-  uint64_t v0  = (x >> pos) & 0x1LLU;
-  if (v0 < rank) {
-    pos += 1;
-  }
-
-  return pos;
+  return GetSelectInBlock()(x, rank);
 }
 
 uint64_t BitArray::Lookup(uint64_t pos) const {
-  return (bit_blocks_[pos / BLOCK_BITNUM] >> (pos % BLOCK_BITNUM)) & 1LLU;
+  return (Block(pos / BLOCK_BITNUM) >> (pos % BLOCK_BITNUM)) & 1LLU;
 }
 
 uint64_t BitArray::RankOne(uint64_t pos) const {
-  uint64_t block_ind = pos / BLOCK_BITNUM;
-  uint64_t table_ind = block_ind / TABLE_INTERVAL;
-  assert(table_ind < rank_tables_.size());
-
-  uint64_t rank = rank_tables_[table_ind];
-  for (uint64_t i = table_ind * TABLE_INTERVAL; i < block_ind; ++i) {
-    rank += PopCount(bit_blocks_[i]);
-  }
-  rank += PopCountMask(bit_blocks_[block_ind], pos % BLOCK_BITNUM);
+  assert(pos / SUPERBLOCK_BITNUM < word_num_ / SUPERBLOCK_WORDNUM);
+  uint64_t rank = 0;
+  GetRankBatch()(words_, &pos, 1, &rank);
   return rank;
 }
 
@@ -198,15 +363,47 @@ void BitArray::PrintForDebug(std::ostream& os) const {
 
 void BitArray::Save(std::ostream& os) const {
   os.write((const char*)(&length_), sizeof(length_));
-  os.write((const char*)(&bit_blocks_[0]),
-           sizeof(bit_blocks_[0]) * bit_blocks_.size());
+  for (uint64_t i = 0; i < BlockNum(); ++i) {
+    uint64_t block = Block(i);
+    os.write((const char*)(&block), sizeof(block));
+  }
+}
+
+void BitArray::SaveMapped(std::ostream& os) const {
+  os.write((const char*)(&length_), sizeof(length_));
+  os.write((const char*)(&one_num_), sizeof(one_num_));
+  os.write((const char*)(&word_num_), sizeof(word_num_));
+  os.write((const char*)(words_), sizeof(uint64_t) * word_num_);
+}
+
+uint64_t BitArray::Map(const char* data, uint64_t size) {
+  const uint64_t header_size = 3 * sizeof(uint64_t);
+  if (size < header_size) return 0;
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(data);
+  uint64_t word_num = words[2];
+  if (word_num != SuperBlockNum(words[0]) * SUPERBLOCK_WORDNUM) return 0;
+  uint64_t total = header_size + sizeof(uint64_t) * word_num;
+  if (size < total) return 0;
+
+  Clear();
+  length_   = words[0];
+  one_num_  = words[1];
+  words_    = words + 3;
+  word_num_ = word_num;
+  mapped_   = true;
+  return total;
 }
 
 void BitArray::Load(std::istream& is) {
   Clear();
   is.read((char*)(&length_), sizeof(length_));
   Init(length_);
-  is.read((char*)(&bit_blocks_[0]), sizeof(bit_blocks_[0]) * bit_blocks_.size());
+  for (uint64_t i = 0; i < BlockNum(); ++i) {
+    is.read((char*)(&super_blocks_[(i / SUPERBLOCK_BLOCKNUM) * SUPERBLOCK_WORDNUM +
+                                   2 + i % SUPERBLOCK_BLOCKNUM]),
+            sizeof(uint64_t));
+  }
+  // 文件中只有位块, rank目录需要重建
   Build();
 }
 
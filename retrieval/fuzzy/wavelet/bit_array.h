@@ -21,6 +21,7 @@
 #define CREATIVE_wavelet_CANDIDATE_SIMILARITY_BIT_ARRAY_H_
 
 #include <stdint.h>
+#include <stddef.h>
 #include <vector>
 #include <iostream>
 
@@ -31,18 +32,27 @@ enum {
   NOTFOUND = 0xFFFFFFFFFFFFFFFFLLU
 };
 
+/**
+ Bits are stored rank9-style: every 512 bits form a superblock of
+ SUPERBLOCK_WORDNUM words, an absolute rank, seven 9-bit relative ranks
+ and the eight bit blocks, so a rank touches a single superblock.
+ */
 class BitArray {
 
  private:
   enum {
     BLOCK_BITNUM = 64,
-    TABLE_INTERVAL = 4,
+    SUPERBLOCK_BLOCKNUM = 8,
+    SUPERBLOCK_BITNUM = BLOCK_BITNUM * SUPERBLOCK_BLOCKNUM,
+    SUPERBLOCK_WORDNUM = SUPERBLOCK_BLOCKNUM + 2,
   };
 
  public:
   BitArray();
   ~BitArray();
   BitArray(uint64_t size);
+  BitArray(const BitArray& other);
+  BitArray& operator=(const BitArray& other);
   uint64_t length() const;
   uint64_t one_num() const;
 
@@ -52,6 +62,13 @@ class BitArray {
 
   void Build();
   uint64_t Rank(uint64_t bit, uint64_t pos) const;
+  /**
+   * ranks[i] = Rank(bit, positions[i]) for i < num, every position must
+   * be <= length(). Superblocks are prefetched ahead so that the cache
+   * misses of the whole batch overlap.
+   */
+  void RankBatch(uint64_t bit, const uint64_t* positions, size_t num,
+                 uint64_t* ranks) const;
   uint64_t Select(uint64_t bit, uint64_t rank) const;
   uint64_t Lookup(uint64_t pos) const;
 
@@ -64,13 +81,30 @@ class BitArray {
   void Save(std::ostream& os) const;
   void Load(std::istream& is);
 
+  // Save superblocks as 8-byte aligned words, readable by Map()
+  void SaveMapped(std::ostream& os) const;
+  // Refer to the words written by SaveMapped() without copying them.
+  // The memory must outlive this array. Return the bytes consumed, 0 if
+  // the data is truncated.
+  uint64_t Map(const char* data, uint64_t size);
+  // Whether the bits refer to external memory
+  bool mapped() const;
+
  private:
   uint64_t RankOne(uint64_t pos) const;
   uint64_t SelectOutBlock(uint64_t bit, uint64_t& rank) const;
+  uint64_t Block(uint64_t block_ind) const;
+  uint64_t BlockNum() const;
+  static uint64_t SuperBlockNum(uint64_t length);
+  void Bind();
+  void CopyFrom(const BitArray& other);
 
  private:
-  std::vector<uint64_t> bit_blocks_;
-  std::vector<uint64_t> rank_tables_;
+  std::vector<uint64_t> super_blocks_;
+  // view used by queries, either into the vector above or into a mapping
+  const uint64_t* words_;
+  uint64_t word_num_;
+  bool mapped_;
   uint64_t length_;
   uint64_t one_num_;
 };
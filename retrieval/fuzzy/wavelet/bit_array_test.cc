@@ -0,0 +1,234 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+//
+// $build64_release/retrieval/fuzzy/wavelet/bit_array_test --benchmarks=all
+//     --bit_array_benchmark_bits=1000000000
+// BM_LegacyRank和BM_Rank对比旧的4块间隔rank表和rank9交错布局
+
+#include <stdlib.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "app/qzap/common/base/benchmark.h"
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/glog/logging.h"
+#include "thirdparty/gtest/gtest.h"
+#include "retrieval/fuzzy/wavelet/bit_array.h"
+
+DEFINE_uint64(bit_array_benchmark_bits, 1000000000, "benchmark位数组长度");
+
+using namespace wat_array;
+
+static uint64_t Random64() {
+  return (uint64_t(rand()) << 62) ^ (uint64_t(rand()) << 31) ^ uint64_t(rand());
+}
+
+static void BuildRandom(uint64_t length, int percent, BitArray* ba,
+                        std::vector<bool>* bits) {
+  ba->Init(length);
+  bits->assign(length, false);
+  for (uint64_t i = 0; i < length; ++i) {
+    if (rand() % 100 < percent) {
+      ba->SetBit(1, i);
+      (*bits)[i] = true;
+    }
+  }
+  ba->Build();
+}
+
+static void CheckBitArray(const BitArray& ba, const std::vector<bool>& bits) {
+  uint64_t ones = 0;
+  std::vector<uint64_t> positions;
+  std::vector<uint64_t> expected;
+  for (uint64_t i = 0; i <= bits.size(); ++i) {
+    ASSERT_EQ(ones, ba.Rank(1, i)) << i;
+    ASSERT_EQ(i - ones, ba.Rank(0, i)) << i;
+    positions.push_back(i);
+    expected.push_back(ones);
+    if (i == bits.size()) break;
+    ASSERT_EQ(bits[i] ? 1u : 0u, ba.Lookup(i));
+    if (bits[i]) {
+      ++ones;
+      ASSERT_EQ(i, ba.Select(1, ones)) << ones;
+    } else {
+      ASSERT_EQ(i, ba.Select(0, i + 1 - ones)) << i;
+    }
+  }
+  EXPECT_EQ(ones, ba.one_num());
+  EXPECT_EQ(NOTFOUND, ba.Select(1, ones + 1));
+
+  std::vector<uint64_t> ranks(positions.size());
+  ba.RankBatch(1, positions.data(), positions.size(), ranks.data());
+  EXPECT_EQ(expected, ranks);
+  ba.RankBatch(0, positions.data(), positions.size(), ranks.data());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    ASSERT_EQ(positions[i] - expected[i], ranks[i]);
+  }
+}
+
+TEST(BitArrayTest, RankSelect) {
+  srand(1);
+  uint64_t lengths[] = {1, 63, 64, 511, 512, 513, 4096, 10000};
+  int percents[] = {0, 3, 50, 97, 100};
+  for (auto length : lengths) {
+    for (auto percent : percents) {
+      BitArray ba;
+      std::vector<bool> bits;
+      BuildRandom(length, percent, &ba, &bits);
+      CheckBitArray(ba, bits);
+    }
+  }
+}
+
+TEST(BitArrayTest, SelectInBlock) {
+  srand(2);
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t x = Random64();
+    uint64_t rank = 0;
+    for (uint64_t pos = 0; pos < 64; ++pos) {
+      if ((x >> pos) & 1) {
+        ++rank;
+        ASSERT_EQ(pos, BitArray::SelectInBlock(x, rank));
+      }
+    }
+  }
+}
+
+TEST(BitArrayTest, SaveAndMap) {
+  srand(3);
+  BitArray ba;
+  std::vector<bool> bits;
+  BuildRandom(5000, 30, &ba, &bits);
+
+  std::ostringstream os;
+  ba.SaveMapped(os);
+  std::string data = os.str();
+  BitArray mapped;
+  EXPECT_EQ(data.size(), mapped.Map(data.data(), data.size()));
+  EXPECT_TRUE(mapped.mapped());
+  CheckBitArray(mapped, bits);
+  EXPECT_EQ(0u, mapped.Map(data.data(), data.size() - 1));
+
+  std::stringstream ss;
+  ba.Save(ss);
+  BitArray loaded;
+  // Load后不需要再Build
+  loaded.Load(ss);
+  CheckBitArray(loaded, bits);
+}
+
+// 旧布局: 位块单独存放, 每4个块一个累计rank
+class LegacyBitArray {
+ public:
+  explicit LegacyBitArray(const BitArray& ba) {
+    uint64_t block_num = (ba.length() + 63) / 64;
+    blocks_.resize(block_num);
+    for (uint64_t i = 0; i < ba.length(); ++i) {
+      blocks_[i / 64] |= ba.Lookup(i) << (i % 64);
+    }
+    uint64_t one_num = 0;
+    ranks_.resize(block_num / 4 + 1);
+    for (uint64_t i = 0; i < block_num; ++i) {
+      if (i % 4 == 0) ranks_[i / 4] = one_num;
+      one_num += BitArray::PopCount(blocks_[i]);
+    }
+    ranks_.back() = one_num;
+  }
+
+  uint64_t Rank(uint64_t pos) const {
+    uint64_t block_ind = pos / 64;
+    uint64_t table_ind = block_ind / 4;
+    uint64_t rank = ranks_[table_ind];
+    for (uint64_t i = table_ind * 4; i < block_ind; ++i) {
+      rank += BitArray::PopCount(blocks_[i]);
+    }
+    if (block_ind < blocks_.size()) {
+      rank += BitArray::PopCountMask(blocks_[block_ind], pos % 64);
+    }
+    return rank;
+  }
+
+ private:
+  std::vector<uint64_t> blocks_;
+  std::vector<uint64_t> ranks_;
+};
+
+static const BitArray& BenchmarkBitArray() {
+  static BitArray* ba = NULL;
+  if (ba == NULL) {
+    ba = new BitArray(FLAGS_bit_array_benchmark_bits);
+    for (uint64_t i = 0; i < ba->length(); i += 1 + Random64() % 4) {
+      ba->SetBit(1, i);
+    }
+    ba->Build();
+  }
+  return *ba;
+}
+
+static std::vector<uint64_t> BenchmarkPositions(int iters) {
+  std::vector<uint64_t> positions(iters);
+  uint64_t length = BenchmarkBitArray().length();
+  for (int i = 0; i < iters; ++i) {
+    positions[i] = Random64() % length;
+  }
+  return positions;
+}
+
+static void BM_LegacyRank(int iters) {
+  StopBenchmarkTiming();
+  static LegacyBitArray* legacy = new LegacyBitArray(BenchmarkBitArray());
+  std::vector<uint64_t> positions = BenchmarkPositions(iters);
+  uint64_t sum = 0;
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    sum += legacy->Rank(positions[i]);
+  }
+  CHECK_GT(sum + 1, 0u);
+}
+BENCHMARK(BM_LegacyRank);
+
+static void BM_Rank(int iters) {
+  StopBenchmarkTiming();
+  const BitArray& ba = BenchmarkBitArray();
+  std::vector<uint64_t> positions = BenchmarkPositions(iters);
+  uint64_t sum = 0;
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    sum += ba.Rank(1, positions[i]);
+  }
+  CHECK_GT(sum + 1, 0u);
+}
+BENCHMARK(BM_Rank);
+
+static void BM_RankBatch(int iters) {
+  StopBenchmarkTiming();
+  const BitArray& ba = BenchmarkBitArray();
+  std::vector<uint64_t> positions = BenchmarkPositions(iters);
+  std::vector<uint64_t> ranks(iters);
+  StartBenchmarkTiming();
+  ba.RankBatch(1, positions.data(), positions.size(), ranks.data());
+}
+BENCHMARK(BM_RankBatch);
+
+static void BM_Select(int iters) {
+  StopBenchmarkTiming();
+  const BitArray& ba = BenchmarkBitArray();
+  std::vector<uint64_t> ranks = BenchmarkPositions(iters);
+  uint64_t sum = 0;
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; ++i) {
+    sum += ba.Select(1, 1 + ranks[i] % ba.one_num());
+  }
+  CHECK_GT(sum + 1, 0u);
+}
+BENCHMARK(BM_Select);
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  RunSpecifiedBenchmarks();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,218 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "retrieval/fuzzy/wavelet/num_field.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/glog/logging.h"
+#include "common/base/string/algorithm.h"
+
+DEFINE_string(num_field_buckets, "",
+              "数值字段的分桶方式, 如\"2:linear:0.01,3:log:1.1,4:quantile:1024\", "
+              "未配置的字段按宽度1等宽分桶");
+
+namespace gdt {
+namespace wavelet {
+
+static const uint64_t kMaxBucket = std::numeric_limits<uint64_t>::max();
+
+NumField::NumField()
+    : field_id_(0), scheme_(BUCKET_LINEAR), param_(1),
+      mapped_values_(NULL), value_num_(0) {
+}
+
+void NumField::Init(uint64_t field_id, BucketScheme scheme, double param) {
+  field_id_ = field_id;
+  scheme_ = scheme;
+  param_ = param;
+  cuts_.clear();
+  value_storage_.clear();
+  mapped_values_ = NULL;
+  value_num_ = 0;
+}
+
+void NumField::Add(uint64_t docid, double value) {
+  if (value_storage_.size() <= docid) {
+    value_storage_.resize(docid + 1, std::numeric_limits<double>::quiet_NaN());
+  }
+  value_storage_[docid] = value;
+  value_num_ = value_storage_.size();
+}
+
+void NumField::Finish() {
+  if (scheme_ != BUCKET_QUANTILE) return;
+  std::vector<double> values;
+  for (double value : value_storage_) {
+    if (value == value) values.push_back(value);
+  }
+  std::sort(values.begin(), values.end());
+  cuts_.clear();
+  uint64_t bucket_num = std::max(param_, 1.0);
+  for (uint64_t i = 1; i < bucket_num; ++i) {
+    uint64_t pos = values.size() * i / bucket_num;
+    if (pos == 0 || pos >= values.size()) continue;
+    // 相同的值落在同一个桶
+    if (cuts_.empty() || values[pos] > cuts_.back()) {
+      cuts_.push_back(values[pos]);
+    }
+  }
+}
+
+uint64_t NumField::Bucket(double value) const {
+  double bucket = 0;
+  switch (scheme_) {
+    case BUCKET_LINEAR:
+      // 负值都在第0个桶, 由原始值过滤保证正确
+      bucket = value > 0 ? floor(value / param_) : 0;
+      break;
+    case BUCKET_LOG:
+      bucket = value >= 1 ? 1 + floor(log(value) / log(param_)) : 0;
+      break;
+    case BUCKET_QUANTILE:
+      return std::upper_bound(cuts_.begin(), cuts_.end(), value) - cuts_.begin();
+  }
+  return bucket < static_cast<double>(kMaxBucket) ? uint64_t(bucket) : kMaxBucket;
+}
+
+bool NumField::BucketRange(double lower, double upper,
+                           std::pair<uint64_t, uint64_t>* buckets) const {
+  if (!(lower <= upper)) return false;
+  buckets->first = Bucket(lower);
+  buckets->second = Bucket(upper);
+  return true;
+}
+
+void NumField::Save(std::ostream& os) const {
+  auto write = [&](uint64_t value) {
+    os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  write(field_id_);
+  write(scheme_);
+  os.write(reinterpret_cast<const char*>(&param_), sizeof(param_));
+  write(cuts_.size());
+  write(value_num_);
+  os.write(reinterpret_cast<const char*>(cuts_.data()), sizeof(double) * cuts_.size());
+  os.write(reinterpret_cast<const char*>(values()), sizeof(double) * value_num_);
+}
+
+uint64_t NumField::Map(const char* data, uint64_t size) {
+  static const uint64_t kHeaderSize = 5 * sizeof(uint64_t);
+  if (size < kHeaderSize) return 0;
+  const uint64_t* header = reinterpret_cast<const uint64_t*>(data);
+  if (header[1] > BUCKET_QUANTILE) return 0;
+  uint64_t cut_num = header[3];
+  uint64_t value_num = header[4];
+  if (cut_num > (size - kHeaderSize) / sizeof(double) ||
+      value_num > (size - kHeaderSize) / sizeof(double) - cut_num) {
+    return 0;
+  }
+  double param = 0;
+  memcpy(&param, &header[2], sizeof(param));
+  Init(header[0], BucketScheme(header[1]), param);
+  const double* cuts = reinterpret_cast<const double*>(data + kHeaderSize);
+  cuts_.assign(cuts, cuts + cut_num);
+  mapped_values_ = cuts + cut_num;
+  value_num_ = value_num;
+  return kHeaderSize + sizeof(double) * (cut_num + value_num);
+}
+
+bool NumFieldTable::ParseConfig(
+    const std::string& config,
+    std::vector<std::pair<uint64_t, std::pair<BucketScheme, double> > >* fields) {
+  std::vector<std::string> items;
+  SplitString(config, ",", &items);
+  for (auto& item : items) {
+    std::vector<std::string> parts;
+    SplitString(item, ":", &parts);
+    if (parts.size() != 3) return false;
+    char* end = NULL;
+    uint64_t field_id = strtoull(parts[0].c_str(), &end, 10);
+    if (*end != '\0') return false;
+    double param = strtod(parts[2].c_str(), &end);
+    if (*end != '\0' || !(param > 0)) return false;
+    BucketScheme scheme;
+    if (parts[1] == "linear") {
+      scheme = BUCKET_LINEAR;
+    } else if (parts[1] == "log") {
+      if (param <= 1) return false;
+      scheme = BUCKET_LOG;
+    } else if (parts[1] == "quantile") {
+      scheme = BUCKET_QUANTILE;
+    } else {
+      return false;
+    }
+    fields->push_back(std::make_pair(field_id, std::make_pair(scheme, param)));
+  }
+  return true;
+}
+
+NumField* NumFieldTable::Get(uint64_t field_id) {
+  auto iter = std::lower_bound(
+      fields_.begin(), fields_.end(), field_id,
+      [](const NumField& field, uint64_t id) { return field.field_id() < id; });
+  if (iter != fields_.end() && iter->field_id() == field_id) {
+    return &*iter;
+  }
+  BucketScheme scheme = BUCKET_LINEAR;
+  double param = 1;
+  std::vector<std::pair<uint64_t, std::pair<BucketScheme, double> > > configs;
+  if (!ParseConfig(FLAGS_num_field_buckets, &configs)) {
+    LOG(ERROR) << "Invalid --num_field_buckets: " << FLAGS_num_field_buckets;
+  }
+  for (auto& config : configs) {
+    if (config.first == field_id) {
+      scheme = config.second.first;
+      param = config.second.second;
+    }
+  }
+  iter = fields_.insert(iter, NumField());
+  iter->Init(field_id, scheme, param);
+  return &*iter;
+}
+
+const NumField* NumFieldTable::Find(uint64_t field_id) const {
+  auto iter = std::lower_bound(
+      fields_.begin(), fields_.end(), field_id,
+      [](const NumField& field, uint64_t id) { return field.field_id() < id; });
+  return (iter != fields_.end() && iter->field_id() == field_id) ? &*iter : NULL;
+}
+
+void NumFieldTable::Finish() {
+  for (auto& field : fields_) {
+    field.Finish();
+  }
+}
+
+void NumFieldTable::Save(std::ostream& os) const {
+  uint64_t field_num = fields_.size();
+  os.write(reinterpret_cast<const char*>(&field_num), sizeof(field_num));
+  for (auto& field : fields_) {
+    field.Save(os);
+  }
+}
+
+uint64_t NumFieldTable::Map(const char* data, uint64_t size) {
+  fields_.clear();
+  if (size < sizeof(uint64_t)) return 0;
+  uint64_t field_num = *reinterpret_cast<const uint64_t*>(data);
+  uint64_t offset = sizeof(uint64_t);
+  for (uint64_t i = 0; i < field_num; ++i) {
+    NumField field;
+    uint64_t used = field.Map(data + offset, size - offset);
+    if (used == 0) {
+      fields_.clear();
+      return 0;
+    }
+    fields_.push_back(field);
+    offset += used;
+  }
+  return offset;
+}
+
+}  // namespace wavelet
+}  // namespace gdt
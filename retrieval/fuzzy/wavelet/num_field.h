@@ -0,0 +1,128 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#ifndef CREATIVE_wavelet_CANDIDATE_SIMILARITY_NUM_FIELD_H_
+#define CREATIVE_wavelet_CANDIDATE_SIMILARITY_NUM_FIELD_H_
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gdt {
+namespace wavelet {
+
+// 数值字段的分桶方式
+enum BucketScheme {
+  // 等宽, 参数为桶宽
+  BUCKET_LINEAR = 0,
+  // 对数, 参数为相邻边界的比值, 小于1的值都在第0个桶
+  BUCKET_LOG = 1,
+  // 分位数, 参数为桶数, 边界在构建时从数据学习
+  BUCKET_QUANTILE = 2,
+};
+
+// 一个数值字段: 值 -> 桶的映射, 以及按文档位置存放的原始值列
+// 桶号随值单调不减, 范围检索先转换为桶区间, 两端的桶再按原始值精确过滤
+class NumField {
+ public:
+  NumField();
+
+  void Init(uint64_t field_id, BucketScheme scheme, double param);
+
+  // 构建时加入文档的原始值
+  void Add(uint64_t docid, double value);
+
+  // 所有值加入后调用, 分位数分桶在这里确定边界
+  void Finish();
+
+  uint64_t Bucket(double value) const;
+
+  // 值落在[lower, upper]的文档所在的桶区间, 不存在时返回false
+  bool BucketRange(double lower, double upper,
+                   std::pair<uint64_t, uint64_t>* buckets) const;
+
+  // 文档的原始值落在[lower, upper], 没有值的文档返回false
+  bool Contains(uint64_t docid, double lower, double upper) const {
+    if (docid >= value_num_) return false;
+    double value = values()[docid];
+    // 没有值的位置为NaN, 比较总是false
+    return value >= lower && value <= upper;
+  }
+
+  bool HasValue(uint64_t docid) const {
+    return docid < value_num_ && values()[docid] == values()[docid];
+  }
+
+  double value(uint64_t docid) const { return values()[docid]; }
+
+  uint64_t field_id() const { return field_id_; }
+
+  // 格式: field_id, scheme, param, cut_num, value_num, cut_num * double,
+  //       value_num * double
+  void Save(std::ostream& os) const;
+
+  // 引用data处的原始值列, 返回使用的字节数, 失败返回0
+  uint64_t Map(const char* data, uint64_t size);
+
+ private:
+  const double* values() const {
+    return mapped_values_ != NULL ? mapped_values_ : value_storage_.data();
+  }
+
+  uint64_t field_id_;
+  BucketScheme scheme_;
+  double param_;
+  // 分位数分桶的边界, 桶i为[cuts[i-1], cuts[i])
+  std::vector<double> cuts_;
+  std::vector<double> value_storage_;
+  // 载入时引用映射的内存
+  const double* mapped_values_;
+  uint64_t value_num_;
+};
+
+// 检索中一个字段的范围条件, 按原始值精确判断
+struct NumRange {
+  const NumField* field;
+  double lower;
+  double upper;
+
+  bool Contains(uint64_t docid) const {
+    return field->Contains(docid, lower, upper);
+  }
+};
+
+// 所有数值字段, 分桶方式由--num_field_buckets配置, 未配置的字段按宽度1等宽分桶
+class NumFieldTable {
+ public:
+  // 按配置创建字段, 已存在时直接返回
+  NumField* Get(uint64_t field_id);
+
+  // 字段不存在时返回NULL
+  const NumField* Find(uint64_t field_id) const;
+
+  // 所有字段Finish
+  void Finish();
+
+  void Save(std::ostream& os) const;
+
+  uint64_t Map(const char* data, uint64_t size);
+
+  void Clear() { fields_.clear(); }
+
+  size_t field_num() const { return fields_.size(); }
+
+  // 解析配置, 格式为"field_id:linear|log|quantile:param", 多个字段用逗号分隔
+  static bool ParseConfig(const std::string& config,
+                          std::vector<std::pair<uint64_t, std::pair<BucketScheme, double> > >* fields);
+
+ private:
+  // 按field_id有序
+  std::vector<NumField> fields_;
+};
+
+}  // namespace wavelet
+}  // namespace gdt
+
+#endif  // CREATIVE_wavelet_CANDIDATE_SIMILARITY_NUM_FIELD_H_
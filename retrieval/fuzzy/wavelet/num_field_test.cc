@@ -0,0 +1,128 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+
+#include <math.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/gtest/gtest.h"
+#include "retrieval/fuzzy/wavelet/num_field.h"
+
+DECLARE_string(num_field_buckets);
+
+using namespace gdt::wavelet;
+
+TEST(NumFieldTest, Linear) {
+  NumField field;
+  field.Init(1, BUCKET_LINEAR, 0.5);
+  EXPECT_EQ(0u, field.Bucket(-3));
+  EXPECT_EQ(0u, field.Bucket(0.49));
+  EXPECT_EQ(1u, field.Bucket(0.5));
+  EXPECT_EQ(19u, field.Bucket(9.99));
+  EXPECT_EQ(18u, field.Bucket(9.01));
+  std::pair<uint64_t, uint64_t> buckets;
+  ASSERT_TRUE(field.BucketRange(-INFINITY, INFINITY, &buckets));
+  EXPECT_EQ(0u, buckets.first);
+  EXPECT_EQ(UINT64_MAX, buckets.second);
+  EXPECT_FALSE(field.BucketRange(2, 1, &buckets));
+}
+
+TEST(NumFieldTest, Log) {
+  NumField field;
+  field.Init(1, BUCKET_LOG, 10);
+  EXPECT_EQ(0u, field.Bucket(0.5));
+  EXPECT_EQ(1u, field.Bucket(1));
+  EXPECT_EQ(1u, field.Bucket(9.99));
+  EXPECT_EQ(2u, field.Bucket(10.5));
+  EXPECT_EQ(4u, field.Bucket(5000));
+}
+
+TEST(NumFieldTest, Quantile) {
+  NumField field;
+  field.Init(1, BUCKET_QUANTILE, 4);
+  for (int i = 0; i < 100; ++i) {
+    field.Add(i, i < 50 ? 1 : i);
+  }
+  field.Finish();
+  // 一半的值相同, 落在同一个桶
+  EXPECT_EQ(0u, field.Bucket(0));
+  EXPECT_EQ(1u, field.Bucket(1));
+  EXPECT_EQ(1u, field.Bucket(49));
+  EXPECT_EQ(2u, field.Bucket(50));
+  EXPECT_EQ(3u, field.Bucket(75));
+  EXPECT_EQ(3u, field.Bucket(1000));
+  for (int i = 1; i < 100; ++i) {
+    EXPECT_LE(field.Bucket(i - 1), field.Bucket(i));
+  }
+}
+
+TEST(NumFieldTest, Contains) {
+  NumField field;
+  field.Init(1, BUCKET_LINEAR, 1);
+  field.Add(0, 9.01);
+  field.Add(2, 9.99);
+  EXPECT_EQ(field.Bucket(9.01), field.Bucket(9.99));
+  EXPECT_TRUE(field.Contains(0, 9, 9.5));
+  EXPECT_FALSE(field.Contains(2, 9, 9.5));
+  // 没有值的文档
+  EXPECT_FALSE(field.HasValue(1));
+  EXPECT_FALSE(field.Contains(1, -INFINITY, INFINITY));
+  EXPECT_FALSE(field.Contains(3, -INFINITY, INFINITY));
+}
+
+TEST(NumFieldTest, ParseConfig) {
+  std::vector<std::pair<uint64_t, std::pair<BucketScheme, double> > > fields;
+  ASSERT_TRUE(NumFieldTable::ParseConfig("2:linear:0.01,3:log:1.1,4:quantile:1024", &fields));
+  ASSERT_EQ(3u, fields.size());
+  EXPECT_EQ(2u, fields[0].first);
+  EXPECT_EQ(BUCKET_LINEAR, fields[0].second.first);
+  EXPECT_DOUBLE_EQ(0.01, fields[0].second.second);
+  EXPECT_EQ(BUCKET_LOG, fields[1].second.first);
+  EXPECT_EQ(BUCKET_QUANTILE, fields[2].second.first);
+  EXPECT_DOUBLE_EQ(1024, fields[2].second.second);
+
+  fields.clear();
+  EXPECT_TRUE(NumFieldTable::ParseConfig("", &fields));
+  EXPECT_TRUE(fields.empty());
+  EXPECT_FALSE(NumFieldTable::ParseConfig("2:linear", &fields));
+  EXPECT_FALSE(NumFieldTable::ParseConfig("2:cubic:1", &fields));
+  EXPECT_FALSE(NumFieldTable::ParseConfig("2:log:1", &fields));
+  EXPECT_FALSE(NumFieldTable::ParseConfig("x:linear:1", &fields));
+  EXPECT_FALSE(NumFieldTable::ParseConfig("2:linear:0", &fields));
+}
+
+TEST(NumFieldTableTest, SaveAndMap) {
+  FLAGS_num_field_buckets = "3:quantile:2";
+  NumFieldTable table;
+  for (int i = 0; i < 10; ++i) {
+    table.Get(3)->Add(i, i * 1.5);
+  }
+  table.Get(1)->Add(5, 2.5);
+  table.Finish();
+  FLAGS_num_field_buckets = "";
+  EXPECT_EQ(2u, table.field_num());
+  EXPECT_TRUE(table.Find(2) == NULL);
+  EXPECT_EQ(1u, table.Find(3)->Bucket(7.5));
+  EXPECT_EQ(0u, table.Find(3)->Bucket(6));
+
+  std::ostringstream oss;
+  table.Save(oss);
+  std::string data = oss.str();
+  NumFieldTable mapped;
+  EXPECT_EQ(data.size(), mapped.Map(data.data(), data.size()));
+  EXPECT_EQ(0u, mapped.Map(data.data(), data.size() - 8));
+  EXPECT_EQ(data.size(), mapped.Map(data.data(), data.size()));
+  ASSERT_EQ(2u, mapped.field_num());
+  const NumField* field = mapped.Find(3);
+  ASSERT_TRUE(field != NULL);
+  EXPECT_EQ(1u, field->Bucket(7.5));
+  EXPECT_EQ(0u, field->Bucket(6));
+  EXPECT_DOUBLE_EQ(13.5, field->value(9));
+  field = mapped.Find(1);
+  ASSERT_TRUE(field != NULL);
+  EXPECT_FALSE(field->HasValue(4));
+  EXPECT_TRUE(field->Contains(5, 2.5, 2.5));
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#include "retrieval/fuzzy/wavelet/offset_table.h"
+
+#include <algorithm>
+
+namespace gdt {
+namespace wavelet {
+
+static_assert(sizeof(FieldOffset) == 5 * sizeof(uint64_t), "FieldOffset is mapped");
+static_assert(sizeof(TokenOffset) == 3 * sizeof(uint64_t), "TokenOffset is mapped");
+
+OffsetTable::OffsetTable()
+    : fields_(NULL), tokens_(NULL), field_num_(0), token_num_(0) {
+}
+
+void OffsetTable::Build(std::vector<PostingEntry>* entries,
+                        std::vector<uint64_t>* posting) {
+  Clear();
+  std::sort(entries->begin(), entries->end());
+  posting->clear();
+  posting->reserve(entries->size());
+  for (size_t i = 0; i < entries->size(); ++i) {
+    const PostingEntry& entry = (*entries)[i];
+    if (field_storage_.empty() || field_storage_.back().field_id != entry.field_id) {
+      FieldOffset field = {entry.field_id, i, i, 0, entry.field_type};
+      field_storage_.push_back(field);
+    }
+    FieldOffset& field = field_storage_.back();
+    if (field.token_num == 0 || token_storage_.back().token_id != entry.token_id) {
+      TokenOffset token = {entry.token_id, i, i};
+      token_storage_.push_back(token);
+      ++field.token_num;
+    }
+    posting->push_back(entry.docid);
+    field.end = i + 1;
+    token_storage_.back().end = i + 1;
+  }
+  Bind();
+}
+
+const FieldOffset* OffsetTable::FindField(uint64_t field_id) const {
+  const FieldOffset* end = fields_ + field_num_;
+  const FieldOffset* iter = std::lower_bound(
+      fields_, end, field_id,
+      [](const FieldOffset& field, uint64_t id) { return field.field_id < id; });
+  return (iter != end && iter->field_id == field_id) ? iter : NULL;
+}
+
+const TokenOffset* OffsetTable::FindToken(
+    const FieldOffset& field, uint64_t token_id) const {
+  const TokenOffset* begin = tokens_ + token_begins_[&field - fields_];
+  const TokenOffset* end = begin + field.token_num;
+  const TokenOffset* iter = std::lower_bound(
+      begin, end, token_id,
+      [](const TokenOffset& token, uint64_t id) { return token.token_id < id; });
+  return (iter != end && iter->token_id == token_id) ? iter : NULL;
+}
+
+std::pair<const TokenOffset*, const TokenOffset*> OffsetTable::FindTokens(
+    const FieldOffset& field, uint64_t lower, uint64_t upper) const {
+  const TokenOffset* begin = tokens_ + token_begins_[&field - fields_];
+  const TokenOffset* end = begin + field.token_num;
+  const TokenOffset* lower_iter = std::lower_bound(
+      begin, end, lower,
+      [](const TokenOffset& token, uint64_t id) { return token.token_id < id; });
+  const TokenOffset* upper_iter = std::upper_bound(
+      lower_iter, end, upper,
+      [](uint64_t id, const TokenOffset& token) { return id < token.token_id; });
+  return std::make_pair(lower_iter, upper_iter);
+}
+
+std::pair<uint64_t, uint64_t> OffsetTable::FindRange(
+    const FieldOffset& field, uint64_t lower, uint64_t upper) const {
+  auto tokens = FindTokens(field, lower, upper);
+  const TokenOffset* end = tokens_ + token_begins_[&field - fields_] + field.token_num;
+  // 同一字段的倒排是连续的, 下一个词项的起点就是区间终点
+  uint64_t range_begin = tokens.first != end ? tokens.first->begin : field.end;
+  uint64_t range_end = tokens.second != end ? tokens.second->begin : field.end;
+  return std::make_pair(range_begin, std::max(range_begin, range_end));
+}
+
+void OffsetTable::Save(std::ostream& os) const {
+  os.write(reinterpret_cast<const char*>(&field_num_), sizeof(field_num_));
+  os.write(reinterpret_cast<const char*>(fields_), sizeof(FieldOffset) * field_num_);
+  os.write(reinterpret_cast<const char*>(tokens_), sizeof(TokenOffset) * token_num_);
+}
+
+uint64_t OffsetTable::Map(const char* data, uint64_t size) {
+  Clear();
+  if (size < sizeof(uint64_t)) return 0;
+  uint64_t field_num = *reinterpret_cast<const uint64_t*>(data);
+  uint64_t offset = sizeof(uint64_t);
+  if (field_num > (size - offset) / sizeof(FieldOffset)) return 0;
+  const FieldOffset* fields = reinterpret_cast<const FieldOffset*>(data + offset);
+  offset += sizeof(FieldOffset) * field_num;
+  uint64_t token_num = 0;
+  for (uint64_t i = 0; i < field_num; ++i) {
+    token_num += fields[i].token_num;
+  }
+  if (token_num > (size - offset) / sizeof(TokenOffset)) return 0;
+  fields_ = fields;
+  tokens_ = reinterpret_cast<const TokenOffset*>(data + offset);
+  field_num_ = field_num;
+  token_num_ = token_num;
+  IndexTokens();
+  return offset + sizeof(TokenOffset) * token_num;
+}
+
+void OffsetTable::Clear() {
+  std::vector<FieldOffset>().swap(field_storage_);
+  std::vector<TokenOffset>().swap(token_storage_);
+  std::vector<uint64_t>().swap(token_begins_);
+  fields_ = NULL;
+  tokens_ = NULL;
+  field_num_ = 0;
+  token_num_ = 0;
+}
+
+void OffsetTable::Bind() {
+  fields_ = field_storage_.data();
+  tokens_ = token_storage_.data();
+  field_num_ = field_storage_.size();
+  token_num_ = token_storage_.size();
+  IndexTokens();
+}
+
+void OffsetTable::IndexTokens() {
+  token_begins_.resize(field_num_);
+  for (uint64_t i = 0, begin = 0; i < field_num_; begin += fields_[i].token_num, ++i) {
+    token_begins_[i] = begin;
+  }
+}
+
+}  // namespace wavelet
+}  // namespace gdt
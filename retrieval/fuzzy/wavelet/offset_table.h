@@ -0,0 +1,111 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+#ifndef CREATIVE_wavelet_CANDIDATE_SIMILARITY_OFFSET_TABLE_H_
+#define CREATIVE_wavelet_CANDIDATE_SIMILARITY_OFFSET_TABLE_H_
+
+#include <stdint.h>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace gdt {
+namespace wavelet {
+
+// 构建时的一条倒排记录
+struct PostingEntry {
+  uint64_t field_id;
+  uint64_t token_id;
+  uint64_t docid;
+  // FieldType, 同一字段必须相同
+  uint64_t field_type;
+};
+
+inline bool operator<(const PostingEntry& a, const PostingEntry& b) {
+  if (a.field_id != b.field_id) return a.field_id < b.field_id;
+  if (a.token_id != b.token_id) return a.token_id < b.token_id;
+  return a.docid < b.docid;
+}
+
+// 字段在倒排中的区间, token_num为该字段的词项数
+struct FieldOffset {
+  uint64_t field_id;
+  uint64_t begin;
+  uint64_t end;
+  uint64_t token_num;
+  uint64_t field_type;
+};
+
+// 词项在倒排中的区间
+struct TokenOffset {
+  uint64_t token_id;
+  uint64_t begin;
+  uint64_t end;
+};
+
+// 字段/词项 -> 倒排区间的只读表
+// 字段表和词项表都是按ID排序的连续数组, 查询为二分查找,
+// 既可以自己持有内存, 也可以直接引用mmap的索引文件
+class OffsetTable {
+ public:
+  OffsetTable();
+
+  // 对(field, token, docid)排序后一次性构建, 输出按同样顺序排列的倒排
+  void Build(std::vector<PostingEntry>* entries, std::vector<uint64_t>* posting);
+
+  // 字段不存在时返回NULL
+  const FieldOffset* FindField(uint64_t field_id) const;
+
+  // 词项不存在时返回NULL
+  const TokenOffset* FindToken(const FieldOffset& field, uint64_t token_id) const;
+
+  // 字段的第index个词项, 用于遍历
+  const TokenOffset& token(const FieldOffset& field, uint64_t index) const {
+    return tokens_[token_begins_[&field - fields_] + index];
+  }
+
+  const FieldOffset& field(uint64_t index) const { return fields_[index]; }
+
+  // 词项在整个词项表中的下标, 可以用来索引按词项存放的附加数据
+  uint64_t token_index(const TokenOffset& token) const { return &token - tokens_; }
+
+  // 字段内词项ID落在[lower, upper]的词项
+  std::pair<const TokenOffset*, const TokenOffset*> FindTokens(
+      const FieldOffset& field, uint64_t lower, uint64_t upper) const;
+
+  // 字段内词项ID落在[lower, upper]的倒排区间
+  std::pair<uint64_t, uint64_t> FindRange(
+      const FieldOffset& field, uint64_t lower, uint64_t upper) const;
+
+  // 格式: field_num, field_num * FieldOffset, sum(token_num) * TokenOffset
+  void Save(std::ostream& os) const;
+
+  // 引用data处的表, 返回使用的字节数, 失败返回0
+  uint64_t Map(const char* data, uint64_t size);
+
+  void Clear();
+
+  uint64_t field_num() const { return field_num_; }
+
+  uint64_t token_num() const { return token_num_; }
+
+ private:
+  // 引用自己持有的内存
+  void Bind();
+
+  void IndexTokens();
+
+  std::vector<FieldOffset> field_storage_;
+  std::vector<TokenOffset> token_storage_;
+  // 每个字段在词项表中的起始下标
+  std::vector<uint64_t> token_begins_;
+  const FieldOffset* fields_;
+  const TokenOffset* tokens_;
+  uint64_t field_num_;
+  uint64_t token_num_;
+};
+
+}  // namespace wavelet
+}  // namespace gdt
+
+#endif  // CREATIVE_wavelet_CANDIDATE_SIMILARITY_OFFSET_TABLE_H_
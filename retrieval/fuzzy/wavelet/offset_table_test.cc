@@ -0,0 +1,69 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "thirdparty/gtest/gtest.h"
+#include "retrieval/fuzzy/wavelet/offset_table.h"
+
+using namespace gdt::wavelet;
+
+static void BuildTable(OffsetTable* table, std::vector<uint64_t>* posting) {
+  // 乱序输入, 构建时排序
+  std::vector<PostingEntry> entries = {
+    {2, 30, 1, 2}, {1, 5, 2, 1}, {1, 3, 0, 1}, {2, 10, 0, 2},
+    {1, 5, 0, 1}, {2, 30, 3, 2}, {1, 3, 1, 1}, {2, 20, 2, 2},
+  };
+  table->Build(&entries, posting);
+}
+
+static void CheckTable(const OffsetTable& table) {
+  EXPECT_EQ(2u, table.field_num());
+  EXPECT_EQ(5u, table.token_num());
+  EXPECT_TRUE(table.FindField(3) == NULL);
+
+  const FieldOffset* field = table.FindField(1);
+  ASSERT_TRUE(field != NULL);
+  EXPECT_EQ(0u, field->begin);
+  EXPECT_EQ(4u, field->end);
+  EXPECT_EQ(1u, field->field_type);
+  EXPECT_EQ(5u, table.token(*field, 1).token_id);
+  const TokenOffset* token = table.FindToken(*field, 5);
+  ASSERT_TRUE(token != NULL);
+  EXPECT_EQ(2u, token->begin);
+  EXPECT_EQ(4u, token->end);
+  EXPECT_TRUE(table.FindToken(*field, 4) == NULL);
+
+  field = table.FindField(2);
+  ASSERT_TRUE(field != NULL);
+  EXPECT_EQ(std::make_pair(4ul, 8ul), table.FindRange(*field, 0, 100));
+  EXPECT_EQ(std::make_pair(5ul, 8ul), table.FindRange(*field, 11, 30));
+  EXPECT_EQ(std::make_pair(4ul, 6ul), table.FindRange(*field, 10, 25));
+  EXPECT_EQ(std::make_pair(8ul, 8ul), table.FindRange(*field, 31, 40));
+  EXPECT_EQ(std::make_pair(5ul, 5ul), table.FindRange(*field, 11, 19));
+}
+
+TEST(OffsetTableTest, Build) {
+  OffsetTable table;
+  std::vector<uint64_t> posting;
+  BuildTable(&table, &posting);
+  EXPECT_EQ(std::vector<uint64_t>({0, 1, 0, 2, 0, 2, 1, 3}), posting);
+  CheckTable(table);
+}
+
+TEST(OffsetTableTest, SaveAndMap) {
+  OffsetTable table;
+  std::vector<uint64_t> posting;
+  BuildTable(&table, &posting);
+  std::ostringstream os;
+  table.Save(os);
+  std::string data = os.str();
+
+  OffsetTable mapped;
+  EXPECT_EQ(data.size(), mapped.Map(data.data(), data.size()));
+  CheckTable(mapped);
+  EXPECT_EQ(0u, mapped.Map(data.data(), data.size() - 1));
+}
@@ -2,12 +2,18 @@
 // Author: Wang Qian<cernwang@tencent.com>
 
 #include <math.h>
-#include <map>
 #include <vector>
 #include <algorithm>
+#include <limits>
 #include <utility>
 #include <string>
+#include <map>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
 #include "thirdparty/gflags/gflags.h"
 #include "thirdparty/glog/logging.h"
 #include "app/qzap/common/base/scoped_ptr.h"
@@ -25,16 +31,49 @@
 #include "framework/common/base_functor.h"
 #include "retrieval/fuzzy/wavelet/similarity_retrievaler.h"
 
+DEFINE_int32(retrieval_batch_thread_num, 0,
+             "批量检索的线程数, 0表示在调用线程中逐个检索");
+
 namespace gdt {
 namespace wavelet {
 
+REGISTER_RETRIEVALER(SimilarityRetrievaler);
+
+// 索引文件格式, 全部为8字节对齐的uint64:
+//   magic, field_num
+//   field_num * (field_id, begin, end, token_num, field_type)
+//   sum(token_num) * (token_id, begin, end)
+//   document_num, document_num * document_id
+//   数值字段表, 见NumFieldTable::Save
+//   wavelet matrix
+static const uint64_t kIndexMagic = 0x3430584449564157LLU;  // "WAVIDX04"
+
 bool SimilarityRetrievaler::Build(const std::vector<Document>& documents) {
+  size_t entry_num = entries_.size();
+  for (auto& document : documents) {
+    for (auto& field : document.field()) {
+      entry_num += field.field_type() == TYPE_ID ? field.id_size() : 1;
+    }
+  }
+  entries_.reserve(entry_num);
   std::for_each(documents.begin(), documents.end(),
                 std::bind(&SimilarityRetrievaler::BuildDocument, this, std::placeholders::_1));
-  return BuildWavletTree(invert_index_);
+  // 分位数分桶要看到所有值, 最后再把数值字段的原始值换成桶号
+  num_fields_.Finish();
+  for (auto& entry : entries_) {
+    if (entry.field_type == TYPE_NUM) {
+      const NumField* num_field = num_fields_.Find(entry.field_id);
+      entry.token_id = num_field->Bucket(num_field->value(entry.docid));
+    }
+  }
+  return BuildWavletTree();
 }
 
 bool SimilarityRetrievaler::BuildDocument(const Document& document) {
+  if (document_ids_.size() <= document.index()) {
+    document_ids_.resize(document.index() + 1, 0);
+  }
+  document_ids_[document.index()] = document.id();
   std::for_each(document.field().begin(), document.field().end(),
                 std::bind(&SimilarityRetrievaler::BuildFiled, this, std::placeholders::_1, document.index()));
   return true;
@@ -55,50 +94,235 @@ bool SimilarityRetrievaler::BuildFiled(const Field& field, uint64_t docid) {
 bool SimilarityRetrievaler::BuildIdFiled(const Field& field, uint64_t docid) {
   std::for_each(field.id().begin(), field.id().end(), 
                 [&] (uint64_t id) {
-                  invert_index_[field.field_id()][id].push_back(docid);
+                  entries_.push_back({field.field_id(), id, docid, TYPE_ID});
                 });
   return true;
 }
 
 bool SimilarityRetrievaler::BuildNumFiled(const Field& field, uint64_t docid) {
-  // TODO(cernwang) 间隔改成可配置的
-  uint64_t id = uint64_t(field.num());
-  invert_index_[field.field_id()][id].push_back(docid);
+  num_fields_.Get(field.field_id())->Add(docid, field.num());
+  // 桶号在所有文档加入后确定
+  entries_.push_back({field.field_id(), 0, docid, TYPE_NUM});
+  return true;
+}
+
+// 一批检索共用的查找结果, 不存在的字段和词项记为NULL
+struct SimilarityRetrievaler::LookupCache {
+  std::unordered_map<uint64_t, const FieldOffset*> fields;
+  // (field_id, token_id) -> 词项
+  std::map<std::pair<uint64_t, uint64_t>, const TokenOffset*> tokens;
+  // (field_id, 起始桶, 结束桶) -> 倒排区间
+  std::map<std::tuple<uint64_t, uint64_t, uint64_t>, std::pair<uint64_t, uint64_t> > ranges;
+};
+
+// 批量检索中的一个query
+struct SimilarityRetrievaler::BatchItem {
+  QueryPattern query_pattern;
+  std::vector<NumRange> ranges;
+  uint32_t top_k;
+  std::vector<Result>* results;
+  char succeed;
+};
+
+SimilarityRetrievaler::~SimilarityRetrievaler() {
+  if (batch_pool_) {
+    batch_pool_->Stop();
+  }
+}
+
+bool SimilarityRetrievaler::Init() {
+  if (!batch_pool_ && FLAGS_retrieval_batch_thread_num > 0) {
+    batch_pool_ = ThreadPool::Create("SimilarityRetrievaler", FLAGS_retrieval_batch_thread_num);
+    batch_pool_->Start();
+  }
   return true;
 }
 
 bool SimilarityRetrievaler::Retrieval(
     const Query& query, std::vector<Result>* results) {
   QueryPattern query_pattern;
-  for (auto field_query : query.field_query()) {
-    auto iter = feature_offset_.find(field_query.field_id());
-    CHECK(iter != feature_offset_.end());
-    std::pair<FieldPattern, double> field_pattern_thres;
-    CHECK(BuildFieldPattern(iter->second, field_query, &field_pattern_thres));
-    query_pattern.push_back(field_pattern_thres);
+  std::vector<NumRange> ranges;
+  CHECK(BuildQueryPattern(query, NULL, &query_pattern, &ranges));
+  return RetrievalPattern(&query_pattern, ranges, query.top_k(), results);
+}
+
+bool SimilarityRetrievaler::RetrievalBatch(
+    const std::vector<Query>& queries, std::vector<std::vector<Result> >* results) {
+  results->assign(queries.size(), std::vector<Result>());
+  // 相同的query只检索一次, 结果最后拷贝
+  std::unordered_map<std::string, size_t> unique_queries;
+  std::vector<size_t> sources(queries.size());
+  std::vector<BatchItem> items;
+  LookupCache cache;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    auto inserted = unique_queries.insert(
+        std::make_pair(queries[i].SerializeAsString(), i));
+    sources[i] = inserted.first->second;
+    if (!inserted.second) continue;
+    items.push_back(BatchItem());
+    BatchItem& item = items.back();
+    CHECK(BuildQueryPattern(queries[i], &cache, &item.query_pattern, &item.ranges));
+    item.top_k = queries[i].top_k();
+    item.results = &(*results)[i];
+    item.succeed = false;
+  }
+  // 当前线程也参与遍历
+  size_t task_num = batch_pool_ ? std::min<size_t>(items.size(), batch_pool_->size() + 1) : 1;
+  if (task_num > 1) {
+    CountBlocker blocker(task_num - 1);
+    for (size_t task = 1; task < task_num; ++task) {
+      if (!batch_pool_->PushTask(NewCallback(this, &SimilarityRetrievaler::RetrievalTask,
+                                             &items, task, task_num, &blocker))) {
+        // 线程池已停止时在当前线程完成这一份, 否则这些query没有结果
+        RetrievalTask(&items, task, task_num, &blocker);
+      }
+    }
+    RetrievalTask(&items, 0, task_num, NULL);
+    blocker.Wait();
+  } else {
+    RetrievalTask(&items, 0, 1, NULL);
+  }
+  for (auto& item : items) {
+    CHECK(item.succeed);
+  }
+  for (size_t i = 0; i < queries.size(); ++i) {
+    if (sources[i] != i) {
+      (*results)[i] = (*results)[sources[i]];
+    }
+  }
+  return true;
+}
+
+void SimilarityRetrievaler::RetrievalTask(std::vector<BatchItem>* items, size_t begin,
+                                          size_t step, CountBlocker* blocker) const {
+  for (size_t i = begin; i < items->size(); i += step) {
+    BatchItem& item = (*items)[i];
+    item.succeed = RetrievalPattern(&item.query_pattern, item.ranges, item.top_k, item.results);
+  }
+  if (blocker != NULL) {
+    blocker->Dec(1);
+  }
+}
+
+bool SimilarityRetrievaler::RetrievalPattern(
+    QueryPattern* query_pattern, const std::vector<NumRange>& ranges,
+    uint32_t top_k, std::vector<Result>* results) const {
+  if (top_k > 0) {
+    std::vector<std::pair<uint64_t, double> > doc_scores;
+    // 过滤会去掉两端桶中的文档, 不够top_k个时加倍重取
+    for (size_t k = top_k; ; k *= 2) {
+      // 检索会改写阈值, 每次用一份拷贝
+      QueryPattern pattern = *query_pattern;
+      std::vector<std::pair<uint64_t, double> > candidates;
+      CHECK(wavelet_tree_.Retrieval(pattern, k, &candidates));
+      doc_scores.clear();
+      for (auto& doc_score : candidates) {
+        if (Contains(ranges, doc_score.first)) {
+          doc_scores.push_back(doc_score);
+        }
+      }
+      if (doc_scores.size() >= top_k || candidates.size() < k) break;
+    }
+    if (doc_scores.size() > top_k) {
+      doc_scores.resize(top_k);
+    }
+    results->reserve(results->size() + doc_scores.size());
+    for (auto& doc_score : doc_scores) {
+      Result result;
+      result.set_index(doc_score.first);
+      if (doc_score.first < document_ids_.size()) {
+        result.set_document_id(document_ids_[doc_score.first]);
+      }
+      result.set_score(doc_score.second);
+      results->push_back(std::move(result));
+    }
+    return true;
   }
   std::vector<uint64_t> doc_index;
-  CHECK(wavelet_tree_.Retrieval(query_pattern, &doc_index));
+  CHECK(wavelet_tree_.Retrieval(*query_pattern, &doc_index));
   std::for_each(doc_index.begin(), doc_index.end(),
                 [&](uint64_t index) {
+                  if (!Contains(ranges, index)) return;
                   Result result;
                   result.set_index(index);
+                  if (index < document_ids_.size()) {
+                    result.set_document_id(document_ids_[index]);
+                  }
                   results->push_back(std::move(result));
                 });
   return true;
 }
 
+bool SimilarityRetrievaler::BuildQueryPattern(
+    const Query& query, LookupCache* cache,
+    QueryPattern* query_pattern, std::vector<NumRange>* ranges) const {
+  for (auto& field_query : query.field_query()) {
+    const FieldOffset* field_offset = FindField(field_query.field_id(), cache);
+    CHECK(field_offset != NULL);
+    std::pair<FieldPattern, double> field_pattern_thres;
+    CHECK(BuildFieldPattern(*field_offset, field_query, cache, &field_pattern_thres, ranges));
+    query_pattern->push_back(field_pattern_thres);
+  }
+  return true;
+}
+
+const FieldOffset* SimilarityRetrievaler::FindField(uint64_t field_id,
+                                                    LookupCache* cache) const {
+  if (cache == NULL) {
+    return offset_table_.FindField(field_id);
+  }
+  auto iter = cache->fields.find(field_id);
+  if (iter == cache->fields.end()) {
+    iter = cache->fields.insert(std::make_pair(field_id, offset_table_.FindField(field_id))).first;
+  }
+  return iter->second;
+}
+
+const TokenOffset* SimilarityRetrievaler::FindToken(const FieldOffset& field_offset,
+                                                    uint64_t token_id,
+                                                    LookupCache* cache) const {
+  if (cache == NULL) {
+    return offset_table_.FindToken(field_offset, token_id);
+  }
+  auto key = std::make_pair(field_offset.field_id, token_id);
+  auto iter = cache->tokens.find(key);
+  if (iter == cache->tokens.end()) {
+    iter = cache->tokens.insert(
+        std::make_pair(key, offset_table_.FindToken(field_offset, token_id))).first;
+  }
+  return iter->second;
+}
+
+std::pair<uint64_t, uint64_t> SimilarityRetrievaler::FindRange(
+    const FieldOffset& field_offset, const std::pair<uint64_t, uint64_t>& buckets,
+    LookupCache* cache) const {
+  if (cache == NULL) {
+    return offset_table_.FindRange(field_offset, buckets.first, buckets.second);
+  }
+  auto key = std::make_tuple(field_offset.field_id, buckets.first, buckets.second);
+  auto iter = cache->ranges.find(key);
+  if (iter == cache->ranges.end()) {
+    iter = cache->ranges.insert(std::make_pair(
+        key, offset_table_.FindRange(field_offset, buckets.first, buckets.second))).first;
+  }
+  return iter->second;
+}
+
 bool SimilarityRetrievaler::BuildFieldPattern(
     const FieldOffset& field_offset,
     const FieldQuery& field_query,
-    std::pair<FieldPattern, double>* field_pattern_thres) {
+    LookupCache* cache,
+    std::pair<FieldPattern, double>* field_pattern_thres,
+    std::vector<NumRange>* ranges) const {
   switch (field_query.field_query_type()) {
     case FIELD_QUERY_ID:
       field_pattern_thres->second = field_query.id_query().thres();
-      return BuildIdFieldPattern(field_offset, field_query.id_query(), &(field_pattern_thres->first));
+      return BuildIdFieldPattern(field_offset, field_query.id_query(), cache,
+                                 &(field_pattern_thres->first));
     case FIELD_QUERY_RANGE:
       field_pattern_thres->second = 1;
-      return BuildRangeFieldPattern(field_offset, field_query.range_query(), &(field_pattern_thres->first));
+      return BuildRangeFieldPattern(field_offset, field_query.range_query(), cache,
+                                    &(field_pattern_thres->first), ranges);
     default:
       break;
   }
@@ -108,12 +332,13 @@ bool SimilarityRetrievaler::BuildFieldPattern(
 bool SimilarityRetrievaler::BuildIdFieldPattern(
     const FieldOffset& field_offset,
     const IdQuery& id_query,
-    FieldPattern* field_pattern) {
-  auto& field_offset_map = field_offset.field_offset_map;
+    LookupCache* cache,
+    FieldPattern* field_pattern) const {
+  field_pattern->reserve(id_query.token_size());
   for (auto& token: id_query.token()) {
-    auto iter = field_offset_map.find(token.id()); 
-    CHECK_CONTINUE(iter != field_offset_map.end());
-    field_pattern->push_back(std::make_tuple(iter->second.first, iter->second.second, token.weight()));
+    const TokenOffset* token_offset = FindToken(field_offset, token.id(), cache);
+    CHECK_CONTINUE(token_offset != NULL);
+    field_pattern->push_back(std::make_tuple(token_offset->begin, token_offset->end, token.weight()));
   }
   return true;
 }
@@ -121,42 +346,155 @@ bool SimilarityRetrievaler::BuildIdFieldPattern(
 bool SimilarityRetrievaler::BuildRangeFieldPattern(
     const FieldOffset& field_offset,
     const RangeQuery& range_query,
-    FieldPattern* field_pattern) {
-  auto& field_offset_map = field_offset.field_offset_map;
-  auto lower_iter = field_offset_map.lower_bound(range_query.lower_bound());
-  auto upper_iter = field_offset_map.upper_bound(range_query.upper_bound());
-  uint64_t begin = (lower_iter != field_offset_map.begin() && range_query.has_lower_bound()) ? lower_iter->second.first : field_offset.begin;
-  uint64_t end = (upper_iter != field_offset_map.end() && range_query.has_upper_bound()) ? upper_iter->second.second : field_offset.end;
-  field_pattern->push_back(std::make_tuple(begin, end, 1));
+    LookupCache* cache,
+    FieldPattern* field_pattern,
+    std::vector<NumRange>* ranges) const {
+  const NumField* num_field = num_fields_.Find(field_offset.field_id);
+  CHECK_LOG(num_field != NULL, field_offset.field_id);
+  NumRange num_range = {num_field, -std::numeric_limits<double>::infinity(),
+                        std::numeric_limits<double>::infinity()};
+  if (range_query.has_lower_bound()) {
+    num_range.lower = range_query.lower_bound();
+  }
+  if (range_query.has_upper_bound()) {
+    num_range.upper = range_query.upper_bound();
+  }
+  // 桶号随值单调, 中间的桶全部满足, 两端的桶检索后按原始值过滤
+  std::pair<uint64_t, uint64_t> buckets;
+  if (!num_field->BucketRange(num_range.lower, num_range.upper, &buckets)) {
+    field_pattern->push_back(std::make_tuple(field_offset.begin, field_offset.begin, 1));
+    return true;
+  }
+  auto range = FindRange(field_offset, buckets, cache);
+  field_pattern->push_back(std::make_tuple(range.first, range.second, 1));
+  ranges->push_back(num_range);
   return true;
 }
 
+bool SimilarityRetrievaler::Contains(const std::vector<NumRange>& ranges,
+                                     uint64_t index) const {
+  for (auto& range : ranges) {
+    if (!range.Contains(index)) return false;
+  }
+  return true;
+}
 
-bool SimilarityRetrievaler::BuildWavletTree(const InvertIndex& invert_index) {
+bool SimilarityRetrievaler::BuildWavletTree() {
   std::vector<uint64_t> posting;
-  for (auto field_invert_index : invert_index) {
-    FieldOffset field_offset;
-    field_offset.begin = posting.size();
-    BuildFieldOffset(field_invert_index.second, field_offset.field_offset_map, posting);
-    field_offset.end = posting.size();
-    feature_offset_[field_invert_index.first] = std::move(field_offset);
-  }
+  offset_table_.Build(&entries_, &posting);
+  std::vector<PostingEntry>().swap(entries_);
   wavelet_tree_.Init(posting);
   return true;
 }
 
-bool SimilarityRetrievaler::BuildFieldOffset(
-    const FieldInvertIndex& field_invert_index,
-    FieldOffsetMap& field_offset_map,
-    std::vector<uint64_t>& posting) {
-  for (auto field_docs : field_invert_index) {
-    field_offset_map[field_docs.first].first = posting.size();
-    std::copy(field_docs.second.begin(), field_docs.second.end(), std::back_inserter(posting));
-    field_offset_map[field_docs.first].second = posting.size();
+bool SimilarityRetrievaler::FieldIds(std::vector<uint64_t>* field_ids) const {
+  field_ids->clear();
+  for (uint64_t i = 0; i < offset_table_.field_num(); ++i) {
+    field_ids->push_back(offset_table_.field(i).field_id);
   }
   return true;
 }
 
+bool SimilarityRetrievaler::Dump(std::vector<Document>* documents) const {
+  std::vector<Document> dumped(document_ids_.size());
+  for (size_t i = 0; i < dumped.size(); ++i) {
+    dumped[i].set_index(i);
+    dumped[i].set_id(document_ids_[i]);
+  }
+  for (uint64_t i = 0; i < offset_table_.field_num(); ++i) {
+    const FieldOffset& field_offset = offset_table_.field(i);
+    const NumField* num_field = num_fields_.Find(field_offset.field_id);
+    std::vector<Field*> fields(dumped.size(), NULL);
+    for (uint64_t j = 0; j < field_offset.token_num; ++j) {
+      const TokenOffset& token_offset = offset_table_.token(field_offset, j);
+      for (uint64_t pos = token_offset.begin; pos < token_offset.end; ++pos) {
+        uint64_t index = wavelet_tree_.Lookup(pos);
+        CHECK_LOG(index < dumped.size(), index);
+        Field*& field = fields[index];
+        if (field == NULL) {
+          field = dumped[index].add_field();
+          field->set_field_id(field_offset.field_id);
+          field->set_field_type(FieldType(field_offset.field_type));
+        }
+        if (field->field_type() == TYPE_NUM) {
+          CHECK_LOG(num_field != NULL, field_offset.field_id);
+          field->set_num(num_field->value(index));
+        } else {
+          field->add_id(token_offset.token_id);
+        }
+      }
+    }
+  }
+  documents->clear();
+  documents->reserve(dumped.size());
+  for (auto& document : dumped) {
+    // 跳过没有用到的索引位置
+    if (document.id() != 0 || document.field_size() > 0) {
+      documents->push_back(std::move(document));
+    }
+  }
+  return true;
+}
+
+bool SimilarityRetrievaler::Save(const std::string& filename) const {
+  std::ofstream ofs(filename.c_str(), std::ios::binary | std::ios::trunc);
+  CHECK_LOG(ofs.good(), filename);
+  auto write = [&](uint64_t value) {
+    ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  write(kIndexMagic);
+  offset_table_.Save(ofs);
+  write(document_ids_.size());
+  ofs.write(reinterpret_cast<const char*>(document_ids_.data()),
+            sizeof(uint64_t) * document_ids_.size());
+  num_fields_.Save(ofs);
+  wavelet_tree_.SaveMapped(ofs);
+  ofs.close();
+  CHECK_LOG(!ofs.fail(), filename);
+  return true;
+}
+
+bool SimilarityRetrievaler::Load(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_LOG(fd >= 0, filename);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    LOG(ERROR) << "Empty index file: " << filename;
+    return false;
+  }
+  void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK_LOG(ptr != MAP_FAILED, filename);
+  wavelet_tree_.Clear();
+  offset_table_.Clear();
+  entries_.clear();
+  document_ids_.clear();
+  num_fields_.Clear();
+  index_mmap_.reset(new ScopedMMap(ptr, st.st_size));
+
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(index_mmap_->ptr());
+  uint64_t word_num = index_mmap_->size() / sizeof(uint64_t);
+  CHECK_LOG(word_num >= 1 && words[0] == kIndexMagic, filename);
+  uint64_t used = offset_table_.Map(index_mmap_->ptr() + sizeof(uint64_t),
+                                    index_mmap_->size() - sizeof(uint64_t));
+  CHECK_LOG(used > 0, filename);
+  uint64_t pos = 1 + used / sizeof(uint64_t);
+  CHECK_LOG(word_num > pos && word_num >= pos + 1 + words[pos], filename);
+  document_ids_.assign(words + pos + 1, words + pos + 1 + words[pos]);
+  pos += 1 + words[pos];
+  used = num_fields_.Map(index_mmap_->ptr() + pos * sizeof(uint64_t),
+                         index_mmap_->size() - pos * sizeof(uint64_t));
+  CHECK_LOG(used > 0 && used % sizeof(uint64_t) == 0, filename);
+  pos += used / sizeof(uint64_t);
+  used = wavelet_tree_.Map(index_mmap_->ptr() + pos * sizeof(uint64_t),
+                                    index_mmap_->size() - pos * sizeof(uint64_t));
+  CHECK_LOG(used > 0, filename);
+  LOG(INFO) << "Load index " << filename << " fields:" << offset_table_.field_num()
+            << " tokens:" << offset_table_.token_num()
+            << " postings:" << wavelet_tree_.length();
+  return true;
+}
 
 }  // namespace wavelet
 }  // namespace gdt
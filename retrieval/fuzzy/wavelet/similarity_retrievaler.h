@@ -7,11 +7,17 @@
 #include <string>
 #include <iostream>
 #include <fstream>
-#include <map>
 #include <vector>
 #include <utility>
 #include <tuple>
+#include "app/qzap/common/base/scoped_ptr.h"
+#include "app/qzap/common/thread/count_blocker.h"
+#include "common/base/scoped_mmap.h"
+#include "common/base/shared_ptr.h"
+#include "common/system/concurrency/threadpool.h"
 #include "retrieval/base/retrievaler.h"
+#include "retrieval/fuzzy/wavelet/num_field.h"
+#include "retrieval/fuzzy/wavelet/offset_table.h"
 #include "retrieval/fuzzy/wavelet/wavelet_tree.h"
 #include "retrieval/proto/document.pb.h"
 #include "retrieval/proto/query.pb.h"
@@ -19,28 +25,37 @@
 namespace gdt {
 namespace wavelet {
 
-typedef std::map<uint64_t, std::pair<uint64_t, uint64_t> > FieldOffsetMap;
-
-struct FieldOffset {
-  uint64_t begin;
-  uint64_t end;
-  FieldOffsetMap field_offset_map;
-};
-
-// TODO(cernwang) 这边设计的有问题， 都用typedef后续有新需求变化会有很大改动
-typedef std::map<uint64_t, FieldOffset> OffsetMap;
 typedef std::vector<std::tuple<size_t, size_t, double> > FieldPattern;
 typedef std::vector<std::pair<FieldPattern, double> > QueryPattern;
-typedef std::map<uint64_t, std::vector<uint64_t> > FieldInvertIndex;
-typedef std::map<uint64_t, FieldInvertIndex> InvertIndex;
 
 // 类余弦检索
 class SimilarityRetrievaler : public Retrievaler {
  public:
+  ~SimilarityRetrievaler();
+  // --retrieval_batch_thread_num大于0时创建批量检索的线程池
+  bool Init();
   bool Build(const std::vector<Document>& documents);
   bool Retrieval(const Query& query, std::vector<Result>* results);
+  // 批量检索: 字段/词项/范围只查找一次, 相同的query只检索一次,
+  // 各query的遍历分给线程池和调用线程并行执行
+  bool RetrievalBatch(const std::vector<Query>& queries,
+                      std::vector<std::vector<Result> >* results);
+  // 保存为可以直接mmap的索引文件
+  bool Save(const std::string& filename) const;
+  // mmap索引文件, 位图直接引用映射的内存, 不再重建
+  bool Load(const std::string& filename);
+  bool DocumentIds(std::vector<uint64_t>* document_ids) const {
+    *document_ids = document_ids_;
+    return true;
+  }
+  bool FieldIds(std::vector<uint64_t>* field_ids) const;
+  // 从倒排还原文档, 数值字段从原始值列还原
+  bool Dump(std::vector<Document>* documents) const;
 
  private:
+  struct LookupCache;
+  struct BatchItem;
+
   bool BuildDocument(const Document& document);
 
   bool BuildFiled(const Field& field, uint64_t docid);
@@ -49,37 +64,73 @@ class SimilarityRetrievaler : public Retrievaler {
   
   bool BuildNumFiled(const Field& field, uint64_t docid);
 
+  // cache为NULL时直接查找offset_table_
+  bool BuildQueryPattern(
+      const Query& query,
+      LookupCache* cache,
+      QueryPattern* query_pattern,
+      std::vector<NumRange>* ranges) const;
+
   bool BuildFieldPattern(
       const FieldOffset& field_offset,
       const FieldQuery& field_query,
-      std::pair<FieldPattern, double>* field_pattern_thres);  
+      LookupCache* cache,
+      std::pair<FieldPattern, double>* field_pattern_thres,
+      std::vector<NumRange>* ranges) const;
 
   bool BuildIdFieldPattern(
       const FieldOffset& field_offset,
       const IdQuery& id_query,
-      FieldPattern* patterns);
+      LookupCache* cache,
+      FieldPattern* patterns) const;
 
   bool BuildRangeFieldPattern(
       const FieldOffset& field_offset,
       const RangeQuery& range_query,
-      FieldPattern* patterns);
+      LookupCache* cache,
+      FieldPattern* patterns,
+      std::vector<NumRange>* ranges) const;
+
+  const FieldOffset* FindField(uint64_t field_id, LookupCache* cache) const;
 
-  bool BuildWavletTree(const InvertIndex& invert_index);
+  const TokenOffset* FindToken(const FieldOffset& field_offset, uint64_t token_id,
+                               LookupCache* cache) const;
 
-  bool BuildFieldOffset(
-      const FieldInvertIndex& field_invert_index,
-      FieldOffsetMap& field_offset_map,
-      std::vector<uint64_t>& posting);
+  std::pair<uint64_t, uint64_t> FindRange(const FieldOffset& field_offset,
+                                          const std::pair<uint64_t, uint64_t>& buckets,
+                                          LookupCache* cache) const;
+
+  // 在小波树上遍历并过滤, query_pattern可能被改写
+  bool RetrievalPattern(
+      QueryPattern* query_pattern,
+      const std::vector<NumRange>& ranges,
+      uint32_t top_k,
+      std::vector<Result>* results) const;
+
+  // 检索items中下标为begin, begin + step, ...的query
+  void RetrievalTask(std::vector<BatchItem>* items, size_t begin, size_t step,
+                     CountBlocker* blocker) const;
+
+  // 按数值字段的原始值过滤, 去掉两端桶中不在范围内的文档
+  bool Contains(const std::vector<NumRange>& ranges, uint64_t index) const;
+
+  bool BuildWavletTree();
 
  private:
   WaveletTree wavelet_tree_;
-  OffsetMap feature_offset_;
-  InvertIndex invert_index_;
+  // 字段/词项 -> 倒排区间
+  OffsetTable offset_table_;
+  // 构建时的(field, token, docid), 建完即释放
+  std::vector<PostingEntry> entries_;
+  // 文档索引到文档ID
+  std::vector<uint64_t> document_ids_;
+  // 数值字段的分桶和原始值
+  NumFieldTable num_fields_;
+  // 索引文件的映射, wavelet_tree_的位图直接引用这块内存
+  scoped_ptr<ScopedMMap> index_mmap_;
+  std::tr1::shared_ptr<ThreadPool> batch_pool_;
 };
 
-REGISTER_RETRIEVALER(SimilarityRetrievaler);
-
-
 }  // namespace wavelet
 }  // namespace gdt
 
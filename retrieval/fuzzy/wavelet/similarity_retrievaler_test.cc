@@ -0,0 +1,192 @@
+// Copyright (c) 2014, Tencent Inc.
+// All rights reserved.
+// Author: Wang Qian <cernwang@tencent.com>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "thirdparty/gflags/gflags.h"
+#include "thirdparty/gtest/gtest.h"
+#include "thirdparty/glog/logging.h"
+#include "retrieval/fuzzy/wavelet/similarity_retrievaler.h"
+
+DECLARE_int32(retrieval_batch_thread_num);
+
+using namespace gdt::wavelet;
+
+static void AddDocument(uint64_t index, const std::vector<uint64_t>& ids,
+                        double price, std::vector<Document>* documents) {
+  Document document;
+  document.set_index(index);
+  document.set_id(index + 1000);
+  Field* field = document.add_field();
+  field->set_field_type(TYPE_ID);
+  field->set_field_id(1);
+  for (auto id : ids) {
+    field->add_id(id);
+  }
+  field = document.add_field();
+  field->set_field_type(TYPE_NUM);
+  field->set_field_id(2);
+  field->set_num(price);
+  documents->push_back(document);
+}
+
+static void BuildDocuments(std::vector<Document>* documents) {
+  AddDocument(0, {1, 2, 3}, 10, documents);
+  AddDocument(1, {2, 3}, 20, documents);
+  AddDocument(2, {3, 4}, 30, documents);
+  AddDocument(3, {1, 4}, 40, documents);
+}
+
+static Query IdQuery(double thres) {
+  Query query;
+  FieldQuery* field_query = query.add_field_query();
+  field_query->set_field_id(1);
+  field_query->set_field_query_type(FIELD_QUERY_ID);
+  field_query->mutable_id_query()->set_thres(thres);
+  for (uint64_t id = 1; id <= 3; ++id) {
+    Token* token = field_query->mutable_id_query()->add_token();
+    token->set_id(id);
+    token->set_weight(1);
+  }
+  return query;
+}
+
+static std::vector<uint64_t> Indexes(const std::vector<Result>& results) {
+  std::vector<uint64_t> indexes;
+  for (auto& result : results) {
+    indexes.push_back(result.index());
+  }
+  std::sort(indexes.begin(), indexes.end());
+  return indexes;
+}
+
+TEST(SimilarityRetrievalerTest, Retrieval) {
+  std::vector<Document> documents;
+  BuildDocuments(&documents);
+  SimilarityRetrievaler retrievaler;
+  ASSERT_TRUE(retrievaler.Build(documents));
+  std::vector<Result> results;
+  ASSERT_TRUE(retrievaler.Retrieval(IdQuery(2), &results));
+  EXPECT_EQ(std::vector<uint64_t>({0, 1}), Indexes(results));
+}
+
+TEST(SimilarityRetrievalerTest, TopK) {
+  std::vector<Document> documents;
+  BuildDocuments(&documents);
+  SimilarityRetrievaler retrievaler;
+  ASSERT_TRUE(retrievaler.Build(documents));
+  Query query = IdQuery(1);
+  query.set_top_k(1);
+  std::vector<Result> results;
+  ASSERT_TRUE(retrievaler.Retrieval(query, &results));
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ(0u, results[0].index());
+  EXPECT_EQ(1000u, results[0].document_id());
+  EXPECT_DOUBLE_EQ(3, results[0].score());
+}
+
+TEST(SimilarityRetrievalerTest, RangeRetrieval) {
+  std::vector<Document> documents;
+  BuildDocuments(&documents);
+  SimilarityRetrievaler retrievaler;
+  ASSERT_TRUE(retrievaler.Build(documents));
+  Query query;
+  FieldQuery* field_query = query.add_field_query();
+  field_query->set_field_id(2);
+  field_query->set_field_query_type(FIELD_QUERY_RANGE);
+  field_query->mutable_range_query()->set_lower_bound(15);
+  field_query->mutable_range_query()->set_upper_bound(30);
+  std::vector<Result> results;
+  ASSERT_TRUE(retrievaler.Retrieval(query, &results));
+  EXPECT_EQ(std::vector<uint64_t>({1, 2}), Indexes(results));
+
+  field_query->mutable_range_query()->clear_upper_bound();
+  results.clear();
+  ASSERT_TRUE(retrievaler.Retrieval(query, &results));
+  EXPECT_EQ(std::vector<uint64_t>({1, 2, 3}), Indexes(results));
+}
+
+TEST(SimilarityRetrievalerTest, SaveAndLoad) {
+  std::vector<Document> documents;
+  BuildDocuments(&documents);
+  SimilarityRetrievaler retrievaler;
+  ASSERT_TRUE(retrievaler.Build(documents));
+  ASSERT_TRUE(retrievaler.Save("similarity_retrievaler_test.index"));
+
+  SimilarityRetrievaler loaded;
+  ASSERT_TRUE(loaded.Load("similarity_retrievaler_test.index"));
+  for (double thres = 0; thres <= 3; thres += 1) {
+    std::vector<Result> expected, results;
+    ASSERT_TRUE(retrievaler.Retrieval(IdQuery(thres), &expected));
+    ASSERT_TRUE(loaded.Retrieval(IdQuery(thres), &results));
+    EXPECT_EQ(Indexes(expected), Indexes(results));
+    for (auto& result : results) {
+      EXPECT_EQ(result.index() + 1000, result.document_id());
+    }
+  }
+  EXPECT_FALSE(loaded.Load("not_exist.index"));
+}
+
+TEST(SimilarityRetrievalerTest, Dump) {
+  std::vector<Document> documents;
+  BuildDocuments(&documents);
+  SimilarityRetrievaler retrievaler;
+  ASSERT_TRUE(retrievaler.Build(documents));
+  std::vector<Document> dumped;
+  ASSERT_TRUE(retrievaler.Dump(&dumped));
+  ASSERT_EQ(documents.size(), dumped.size());
+  for (size_t i = 0; i < documents.size(); ++i) {
+    EXPECT_EQ(documents[i].DebugString(), dumped[i].DebugString());
+  }
+
+  // 导出的文档可以重建出相同的索引
+  SimilarityRetrievaler rebuilt;
+  ASSERT_TRUE(rebuilt.Build(dumped));
+  for (double thres = 0; thres <= 3; thres += 1) {
+    std::vector<Result> expected, results;
+    ASSERT_TRUE(retrievaler.Retrieval(IdQuery(thres), &expected));
+    ASSERT_TRUE(rebuilt.Retrieval(IdQuery(thres), &results));
+    EXPECT_EQ(Indexes(expected), Indexes(results));
+  }
+}
+
+// 批量检索与逐个检索的结果一致, 包括重复的query
+TEST(SimilarityRetrievalerTest, RetrievalBatch) {
+  std::vector<Document> documents;
+  BuildDocuments(&documents);
+  std::vector<Query> queries;
+  for (double thres = 0; thres <= 3; thres += 1) {
+    queries.push_back(IdQuery(thres));
+    queries.back().set_top_k(2);
+    queries.push_back(IdQuery(thres));
+  }
+  Query range_query = IdQuery(1);
+  FieldQuery* field_query = range_query.add_field_query();
+  field_query->set_field_id(2);
+  field_query->set_field_query_type(FIELD_QUERY_RANGE);
+  field_query->mutable_range_query()->set_lower_bound(15);
+  queries.push_back(range_query);
+  queries.push_back(IdQuery(1));
+
+  for (int thread_num = 0; thread_num <= 3; thread_num += 3) {
+    FLAGS_retrieval_batch_thread_num = thread_num;
+    SimilarityRetrievaler retrievaler;
+    ASSERT_TRUE(retrievaler.Init());
+    ASSERT_TRUE(retrievaler.Build(documents));
+    std::vector<std::vector<Result> > results;
+    ASSERT_TRUE(retrievaler.RetrievalBatch(queries, &results));
+    ASSERT_EQ(queries.size(), results.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+      std::vector<Result> expected;
+      ASSERT_TRUE(retrievaler.Retrieval(queries[i], &expected));
+      ASSERT_EQ(expected.size(), results[i].size()) << i;
+      for (size_t j = 0; j < expected.size(); ++j) {
+        EXPECT_EQ(expected[j].DebugString(), results[i][j].DebugString());
+      }
+    }
+  }
+  FLAGS_retrieval_batch_thread_num = 0;
+}
@@ -424,4 +424,54 @@ void WaveletMatrix::Load(istream& is) {
   SetBitReverseTable();
 }
 
+void WaveletMatrix::SaveMapped(ostream& os) const {
+  os.write((const char*)(&alphabet_num_), sizeof(alphabet_num_));
+  os.write((const char*)(&length_), sizeof(length_));
+  for (size_t i = 0; i < bit_arrays_.size(); ++i) {
+    bit_arrays_[i].SaveMapped(os);
+  }
+  for (size_t i = 0; i < bit_arrays_.size(); ++i) {
+    os.write((const char*)(&node_begin_pos_[i][0]),
+             sizeof(uint64_t) * node_begin_pos_[i].size());
+  }
+}
+
+uint64_t WaveletMatrix::Map(const char* data, uint64_t size) {
+  Clear();
+  uint64_t offset = 2 * sizeof(uint64_t);
+  if (size < offset) return 0;
+  const uint64_t* header = reinterpret_cast<const uint64_t*>(data);
+  alphabet_num_ = header[0];
+  alphabet_bit_num_ = Log2(alphabet_num_);
+  length_ = header[1];
+
+  bit_arrays_.resize(alphabet_bit_num_);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i) {
+    uint64_t used = bit_arrays_[i].Map(data + offset, size - offset);
+    if (used == 0) {
+      Clear();
+      return 0;
+    }
+    offset += used;
+  }
+
+  node_begin_pos_.resize(bit_arrays_.size());
+  for (size_t i = 0; i < bit_arrays_.size(); ++i) {
+    uint64_t num = (1 << (i + 1)) + 1;
+    if (size - offset < sizeof(uint64_t) * num) {
+      Clear();
+      return 0;
+    }
+    const uint64_t* begin = reinterpret_cast<const uint64_t*>(data + offset);
+    node_begin_pos_[i].assign(begin, begin + num);
+    offset += sizeof(uint64_t) * num;
+  }
+  zero_counts_.resize(bit_arrays_.size());
+  for (size_t i = 0; i < bit_arrays_.size(); ++i) {
+    zero_counts_[i] = node_begin_pos_[i][1 << i];
+  }
+  SetBitReverseTable();
+  return offset;
+}
+
 }
@@ -223,6 +223,20 @@ class WaveletMatrix {
    */
   void Load(std::istream& is);
 
+  /**
+   * Save the current status as 8-byte aligned words which can be mapped
+   * @param os The output stream where the data is saved
+   */
+  void SaveMapped(std::ostream& os) const;
+
+  /**
+   * Refer to the bit arrays saved by SaveMapped without copying them
+   * @param data The beginning of the saved words, must outlive the matrix
+   * @param size The number of available bytes
+   * @return The number of bytes consumed, or 0 if the data is truncated
+   */
+  uint64_t Map(const char* data, uint64_t size);
+
 
  protected:
   uint64_t GetAlphabetNum(const std::vector<uint64_t>& array) const;
@@ -1,6 +1,8 @@
 // Copyright (c) 2014, Tencent Inc.
 // Author: Wang Qian<cernwang@tencent.com>
 
+#include <algorithm>
+#include <queue>
 #include <utility>
 #include <vector>
 #include "retrieval/fuzzy/wavelet/wavelet_tree.h"
@@ -10,105 +12,239 @@ namespace wavelet {
 
 bool WaveletTree::Retrieval(
   QueryPattern& query_pattern,
-  std::vector<uint64_t>* results) {
-  double sum = 0;
-  for (auto field : query_pattern) {
-    FieldPattern& field_pattern = field.first;
-    double& thres = field.second;
-    for (int i = 0; i < field_pattern.size(); i++) {
-      sum += std::get<2>( field_pattern[i]);
+  std::vector<uint64_t>* results) const {
+  if (!PrepareThres(query_pattern)) {
+    return true;
+  }
+  RetrievalScratch scratch;
+  InitScratch(query_pattern, &scratch);
+  // 显式栈深度优先, 先0后1, 结果按文档升序
+  while (!scratch.nodes.empty()) {
+    RetrievalNode node = scratch.nodes.back();
+    scratch.nodes.pop_back();
+    if (node.level == this->alphabet_bit_num_) {
+      if (Satisfied(node, scratch)) {
+        results->push_back(node.symbol);
+      }
+      continue;
+    }
+    // 栈上的分支数据都在当前分支之下
+    Truncate(node.range_end, node.field_pos + scratch.field_num, &scratch);
+    bool has_zeros = true, has_ones = true;
+    RetrievalNode zero_node, one_node;
+    SplitLevel(node, &scratch, &zero_node, has_zeros, &one_node, has_ones);
+    if (has_ones) {
+      scratch.nodes.push_back(one_node);
     }
-    if (thres > sum) {
-      return true;
+    if (has_zeros) {
+      scratch.nodes.push_back(zero_node);
     }
-    thres = sum - thres;  
   }
-
-  return RetrievalEachLevel(query_pattern, 0, 0, results);
+  return true;
 }
 
-bool WaveletTree::RetrievalEachLevel(
-  const QueryPattern& query_pattern,
-  size_t level,
-  uint64_t symbol,
-  std::vector<uint64_t>* results) {
-  if (level == this->alphabet_bit_num_) {
-    results->push_back(symbol);
+bool WaveletTree::Retrieval(
+  QueryPattern& query_pattern,
+  size_t top_k,
+  std::vector<std::pair<uint64_t, double> >* results) const {
+  if (top_k == 0 || !PrepareThres(query_pattern)) {
     return true;
   }
-
-  const wat_array::BitArray& ba = bit_arrays_[level];
-  bool has_zeros = true, has_ones = true;
-  size_t zero_count = zero_counts_[level];
-  QueryPattern zero_query;
-  QueryPattern one_query;
-  for (auto field : query_pattern) {
-    const FieldPattern& field_pattern = field.first;
-    double thres = field.second;
-    std::pair<FieldPattern, double> zero_result;
-    std::pair<FieldPattern, double> one_result;
-    SatisfyCondition(field_pattern, thres, ba, zero_count,
-                     &zero_result, &one_result, has_zeros, has_ones);
-    if (has_zeros) {
-      zero_query.push_back(zero_result);
+  RetrievalScratch scratch;
+  InitScratch(query_pattern, &scratch);
+  std::priority_queue<Branch> branches;
+  branches.push({scratch.nodes[0].bound, false, 0});
+  while (!branches.empty() && results->size() < top_k) {
+    Branch branch = branches.top();
+    branches.pop();
+    RetrievalNode node = scratch.nodes[branch.node];
+    // 叶子的精确得分不低于所有剩余分支的上界
+    if (branch.leaf) {
+      results->push_back(std::make_pair(node.symbol, node.score));
+      continue;
     }
-    if (has_ones) {
-      one_query.push_back(one_result);
+    if (node.level == this->alphabet_bit_num_) {
+      // 叶子上剩余的区间都包含该文档
+      if (Satisfied(node, scratch)) {
+        branches.push({node.score, true, branch.node});
+      }
+      continue;
+    }
+    bool has_zeros = true, has_ones = true;
+    RetrievalNode zero_node, one_node;
+    SplitLevel(node, &scratch, &zero_node, has_zeros, &one_node, has_ones);
+    // 一个词项都没命中的分支不算召回
+    if (has_zeros && zero_node.range_pos < zero_node.range_end) {
+      branches.push({zero_node.bound, false, scratch.nodes.size()});
+      scratch.nodes.push_back(zero_node);
     }
-    if (!has_zeros && !has_ones) {
-      break;
+    if (has_ones && one_node.range_pos < one_node.range_end) {
+      branches.push({one_node.bound, false, scratch.nodes.size()});
+      scratch.nodes.push_back(one_node);
     }
   }
+  return true;
+}
 
-  if (has_zeros) {
-    RetrievalEachLevel(zero_query, level + 1, symbol, results);
-  }
-  if (has_ones) {
-    RetrievalEachLevel(one_query, level + 1,
-                       symbol | (uint64_t)1 << (this->alphabet_bit_num_ - level - 1), results);
+bool WaveletTree::PrepareThres(QueryPattern& query_pattern) const {
+  for (auto& field : query_pattern) {
+    FieldPattern& field_pattern = field.first;
+    double& thres = field.second;
+    double sum = 0;
+    // 只命中正权重词项的文档得分最高, 有负权重时高于带符号的和
+    double positive_sum = 0;
+    for (size_t i = 0; i < field_pattern.size(); i++) {
+      double weight = std::get<2>(field_pattern[i]);
+      sum += weight;
+      positive_sum += std::max(weight, 0.0);
+    }
+    if (thres > positive_sum) {
+      return false;
+    }
+    // 允许丢失的权重, 有负权重时可以为负, 丢掉负权重词项后回升
+    thres = sum - thres;
   }
   return true;
 }
 
-void WaveletTree::SatisfyCondition(const FieldPattern& patterns, double thres,
-                                   const wat_array::BitArray& ba, size_t zero_count,
-                                   std::pair<FieldPattern, double>* zero_result,
-                                   std::pair<FieldPattern, double>* one_result,
-                                   bool& has_zeros,  bool& has_ones) {
-  FieldPattern& zero_ranges = zero_result->first;
-  FieldPattern& one_ranges = one_result->first;
-  zero_ranges.reserve(patterns.size());
-  one_ranges.reserve(patterns.size());
-  double& zero_thres = zero_result->second;
-  double& one_thres = one_result->second;
-  zero_thres = thres;
-  one_thres = thres;
-  for (auto it = patterns.begin(); it != patterns.end(); ++it) {
-    size_t rank_start = ba.Rank(1, std::get<0>(*it));
-    size_t rank_end = ba.Rank(1,  std::get<1>(*it));
-    if (has_zeros) {
-      if (std::get<0>(*it) - rank_start < std::get<1>(*it) - rank_end) {
-        zero_ranges.push_back(std::make_tuple(std::get<0>(*it) - rank_start,  std::get<1>(*it) - rank_end,  std::get<2>(*it)));
-      } else {
-        zero_thres -= std::get<2>(*it);
-        if (zero_thres < 0) {
-          if (!has_ones) return;
-          has_zeros = false;
-        }
+void WaveletTree::InitScratch(const QueryPattern& query_pattern,
+                              RetrievalScratch* scratch) const {
+  size_t range_num = 0;
+  for (auto& field : query_pattern) {
+    range_num += field.first.size();
+  }
+  // 深度优先时同时存活的分支不超过 2 * 层数
+  size_t reserve_num = range_num * (2 * this->alphabet_bit_num_ + 1);
+  scratch->begin.reserve(reserve_num);
+  scratch->end.reserve(reserve_num);
+  scratch->weight.reserve(reserve_num);
+  scratch->rank_begin.reserve(range_num);
+  scratch->rank_end.reserve(range_num);
+  scratch->field_num = query_pattern.size();
+  scratch->range_num.reserve(scratch->field_num * (2 * this->alphabet_bit_num_ + 1));
+  scratch->thres.reserve(scratch->field_num * (2 * this->alphabet_bit_num_ + 1));
+  scratch->negative.reserve(scratch->field_num * (2 * this->alphabet_bit_num_ + 1));
+
+  RetrievalNode root = {0, 0, 0, 0, 0, 0, 0};
+  for (auto& field : query_pattern) {
+    for (auto& pattern : field.first) {
+      double weight = std::get<2>(pattern);
+      scratch->begin.push_back(std::get<0>(pattern));
+      scratch->end.push_back(std::get<1>(pattern));
+      scratch->weight.push_back(weight);
+      root.score += weight;
+      if (weight > 0) {
+        root.bound += weight;
       }
     }
-    if (has_ones) {
-      if (rank_start < rank_end) {
-        one_ranges.push_back(std::make_tuple(rank_start + zero_count, rank_end + zero_count, std::get<2>(*it)));
+    scratch->range_num.push_back(field.first.size());
+    scratch->thres.push_back(field.second);
+  }
+  root.range_end = scratch->begin.size();
+  for (auto& field : query_pattern) {
+    double negative = 0;
+    for (auto& pattern : field.first) {
+      negative -= std::min(std::get<2>(pattern), 0.0);
+    }
+    scratch->negative.push_back(negative);
+  }
+  scratch->nodes.push_back(root);
+}
+
+void WaveletTree::SplitLevel(
+  const RetrievalNode& node,
+  RetrievalScratch* scratch,
+  RetrievalNode* zero_node, bool& has_zeros,
+  RetrievalNode* one_node, bool& has_ones) const {
+  const wat_array::BitArray& ba = bit_arrays_[node.level];
+  size_t range_num = node.range_end - node.range_pos;
+  scratch->rank_begin.resize(range_num);
+  scratch->rank_end.resize(range_num);
+  const uint64_t* begin = scratch->begin.data() + node.range_pos;
+  const uint64_t* end = scratch->end.data() + node.range_pos;
+  ba.RankBatch(1, begin, range_num, scratch->rank_begin.data());
+  ba.RankBatch(1, end, range_num, scratch->rank_end.data());
+  size_t zero_count = zero_counts_[node.level];
+  has_ones = AppendChild(node, 1, zero_count, scratch, one_node);
+  has_zeros = AppendChild(node, 0, zero_count, scratch, zero_node);
+}
+
+bool WaveletTree::AppendChild(
+  const RetrievalNode& node,
+  uint64_t bit,
+  size_t zero_count,
+  RetrievalScratch* scratch,
+  RetrievalNode* child) const {
+  child->level = node.level + 1;
+  child->symbol = bit ? node.symbol | (uint64_t)1 << (this->alphabet_bit_num_ - node.level - 1)
+                      : node.symbol;
+  child->field_pos = scratch->range_num.size();
+  child->range_pos = scratch->begin.size();
+  child->bound = 0;
+  child->score = 0;
+  size_t i = node.range_pos;
+  for (size_t field = 0; field < scratch->field_num; ++field) {
+    double thres = scratch->thres[node.field_pos + field];
+    double parent_negative = scratch->negative[node.field_pos + field];
+    double negative = 0;
+    uint64_t range_num = 0;
+    for (size_t field_end = i + scratch->range_num[node.field_pos + field];
+         i < field_end; ++i) {
+      uint64_t rank_begin = scratch->rank_begin[i - node.range_pos];
+      uint64_t rank_end = scratch->rank_end[i - node.range_pos];
+      uint64_t begin = bit ? rank_begin + zero_count : scratch->begin[i] - rank_begin;
+      uint64_t end = bit ? rank_end + zero_count : scratch->end[i] - rank_end;
+      double weight = scratch->weight[i];
+      if (begin < end) {
+        scratch->begin.push_back(begin);
+        scratch->end.push_back(end);
+        scratch->weight.push_back(weight);
+        ++range_num;
+        child->score += weight;
+        if (weight > 0) {
+          child->bound += weight;
+        } else {
+          negative -= weight;
+        }
       } else {
-        one_thres -= std::get<2>(*it);
-        if (one_thres < 0) {
-          if (!has_zeros) return;
-          has_ones = false;
+        thres -= weight;
+        // 之后最多再丢失父分支剩余的负权重
+        if (thres + parent_negative < 0) {
+          Truncate(child->range_pos, child->field_pos, scratch);
+          return false;
         }
       }
     }
+    if (thres + negative < 0) {
+      Truncate(child->range_pos, child->field_pos, scratch);
+      return false;
+    }
+    scratch->range_num.push_back(range_num);
+    scratch->thres.push_back(thres);
+    scratch->negative.push_back(negative);
   }
+  child->range_end = scratch->begin.size();
+  return true;
+}
+
+bool WaveletTree::Satisfied(const RetrievalNode& node,
+                            const RetrievalScratch& scratch) const {
+  for (size_t field = 0; field < scratch.field_num; ++field) {
+    if (scratch.thres[node.field_pos + field] < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void WaveletTree::Truncate(size_t range_size, size_t field_size,
+                           RetrievalScratch* scratch) const {
+  scratch->begin.resize(range_size);
+  scratch->end.resize(range_size);
+  scratch->weight.resize(range_size);
+  scratch->range_num.resize(field_size);
+  scratch->thres.resize(field_size);
+  scratch->negative.resize(field_size);
 }
 
 }  // namespace wavelet
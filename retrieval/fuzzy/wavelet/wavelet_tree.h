@@ -15,26 +15,96 @@ typedef std::vector<std::pair<FieldPattern, double> > QueryPattern;
 namespace gdt {
 namespace wavelet {
 
+// 检索中的一个分支, 数据存放在RetrievalScratch中
+struct RetrievalNode {
+  size_t level;
+  uint64_t symbol;
+  // 各字段的区间数和剩余可丢失权重的起始下标
+  size_t field_pos;
+  // 区间的起止下标
+  size_t range_pos;
+  size_t range_end;
+  // 剩余区间的正权重和, 即得分上界
+  double bound;
+  // 剩余区间的权重和, 叶子上即为精确得分
+  double score;
+};
+
+// 一次检索复用的临时空间, 区间按列存放, 便于批量求rank
+// 各分支的数据依次追加, 深度优先时按栈回收
+struct RetrievalScratch {
+  std::vector<uint64_t> begin;
+  std::vector<uint64_t> end;
+  std::vector<double> weight;
+  std::vector<uint64_t> range_num;
+  std::vector<double> thres;
+  // 剩余区间中负权重的绝对值和, 丢失负权重会增加可丢失权重
+  std::vector<double> negative;
+  std::vector<uint64_t> rank_begin;
+  std::vector<uint64_t> rank_end;
+  std::vector<RetrievalNode> nodes;
+  size_t field_num;
+};
+
 class WaveletTree: public wavelet_matrix::WaveletMatrix {
  public:
-  // 带权检索
+  // 带权检索, 会改写query_pattern中的阈值, 可以被多个线程同时调用
+  bool Retrieval(
+      QueryPattern& query_pattern,
+      std::vector<uint64_t>* results) const;
+
+  // 带权top_k检索, 按得分从高到低返回(文档, 得分)
+  // 得分为命中词项的权重和, 按分支得分上界做最优优先搜索,
+  // 上界进不了top_k的分支不会被展开
   bool Retrieval(
       QueryPattern& query_pattern,
-      std::vector<uint64_t>* results);
+      size_t top_k,
+      std::vector<std::pair<uint64_t, double> >* results) const;
 
  private:
-  bool RetrievalEachLevel(
-      const QueryPattern& query_pattern,
-      size_t level,
-      uint64_t symbol,
-      std::vector<uint64_t>* results);
-
-  void SatisfyCondition(
-      const FieldPattern& patterns, double thres,
-      const wat_array::BitArray& ba, size_t zero_count,
-      std::pair<FieldPattern, double>* zero_result,
-      std::pair<FieldPattern, double>* one_result,
-      bool& has_zeros, bool& has_ones);
+  // top_k检索中待展开的分支
+  struct Branch {
+    // 得分上界, 叶子时为精确得分
+    double bound;
+    bool leaf;
+    // 在scratch.nodes中的下标
+    size_t node;
+
+    bool operator<(const Branch& other) const {
+      if (bound != other.bound) return bound < other.bound;
+      return !leaf && other.leaf;
+    }
+  };
+
+  // 把阈值转换为允许丢失的权重, 无解时返回false
+  bool PrepareThres(QueryPattern& query_pattern) const;
+
+  // 把检索模式拷贝到scratch中作为根分支
+  void InitScratch(const QueryPattern& query_pattern,
+                   RetrievalScratch* scratch) const;
+
+  // 把一层的分支拆成0/1两个子分支, 1分支的数据先于0分支追加
+  void SplitLevel(
+      const RetrievalNode& node,
+      RetrievalScratch* scratch,
+      RetrievalNode* zero_node, bool& has_zeros,
+      RetrievalNode* one_node, bool& has_ones) const;
+
+  // 叶子上每个字段都满足阈值
+  bool Satisfied(const RetrievalNode& node,
+                 const RetrievalScratch& scratch) const;
+
+  // 丢弃range_size/field_size之后的数据, 空间留给后续分支复用
+  void Truncate(size_t range_size, size_t field_size,
+                RetrievalScratch* scratch) const;
+
+  // 追加一个子分支, 不可能再满足阈值时回退并返回false
+  bool AppendChild(
+      const RetrievalNode& node,
+      uint64_t bit,
+      size_t zero_count,
+      RetrievalScratch* scratch,
+      RetrievalNode* child) const;
 };
 
 }  // namespace wavelet
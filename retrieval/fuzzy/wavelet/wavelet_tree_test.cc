@@ -5,6 +5,8 @@
 // All rights reserved.
 // Author: Wang Qian <cernwang@tencent.com>
 
+#include <stdlib.h>
+#include <algorithm>
 #include <string>
 #include <map>
 #include <utility>
@@ -23,3 +25,126 @@ TEST(WaveletTreeTest, LookUp) {
   WaveletTree wavelet_tree;
   wavelet_tree.Init(array);
 }
+
+
+// 词项0覆盖[0, 4), 词项1覆盖[4, 8), 词项2覆盖[8, 10)
+static QueryPattern TokenPattern(double thres) {
+  FieldPattern field_pattern;
+  field_pattern.push_back(std::make_tuple(0, 4, 1.0));
+  field_pattern.push_back(std::make_tuple(4, 8, 2.0));
+  field_pattern.push_back(std::make_tuple(8, 10, 0.5));
+  return QueryPattern(1, std::make_pair(field_pattern, thres));
+}
+
+TEST(WaveletTreeTest, TopK) {
+  uint64_t temp[10] = {0,1,2,3,4,5,6,3,3,9};
+  std::vector<uint64_t> array(temp, temp+10);
+  WaveletTree wavelet_tree;
+  wavelet_tree.Init(array);
+
+  std::vector<std::pair<uint64_t, double> > results;
+  QueryPattern query_pattern = TokenPattern(0);
+  ASSERT_TRUE(wavelet_tree.Retrieval(query_pattern, 4, &results));
+  ASSERT_EQ(4u, results.size());
+  EXPECT_EQ(3u, results[0].first);
+  EXPECT_DOUBLE_EQ(3.5, results[0].second);
+  std::vector<uint64_t> docs;
+  for (size_t i = 1; i < results.size(); ++i) {
+    EXPECT_DOUBLE_EQ(2, results[i].second);
+    docs.push_back(results[i].first);
+  }
+  std::sort(docs.begin(), docs.end());
+  EXPECT_EQ(std::vector<uint64_t>({4, 5, 6}), docs);
+
+  results.clear();
+  query_pattern = TokenPattern(1.5);
+  ASSERT_TRUE(wavelet_tree.Retrieval(query_pattern, 100, &results));
+  EXPECT_EQ(4u, results.size());
+
+  results.clear();
+  query_pattern = TokenPattern(0);
+  ASSERT_TRUE(wavelet_tree.Retrieval(query_pattern, 100, &results));
+  EXPECT_EQ(8u, results.size());
+  EXPECT_DOUBLE_EQ(0.5, results.back().second);
+}
+
+TEST(WaveletTreeTest, TopKMatchesThreshold) {
+  srand(1);
+  std::vector<uint64_t> array;
+  for (size_t i = 0; i < 2000; ++i) {
+    array.push_back(rand() % 300);
+  }
+  WaveletTree wavelet_tree;
+  wavelet_tree.Init(array);
+
+  FieldPattern field_pattern;
+  for (size_t begin = 0; begin < array.size(); begin += 100) {
+    field_pattern.push_back(std::make_tuple(begin, begin + 100, double(rand() % 5) - 1));
+  }
+  // 暴力计算每个文档的得分
+  std::map<uint64_t, double> scores;
+  for (auto& pattern : field_pattern) {
+    std::map<uint64_t, bool> hit;
+    for (size_t i = std::get<0>(pattern); i < std::get<1>(pattern); ++i) {
+      hit[array[i]] = true;
+    }
+    for (auto& doc : hit) {
+      scores[doc.first] += std::get<2>(pattern);
+    }
+  }
+  std::vector<double> expected;
+  std::vector<uint64_t> expected_docs;
+  for (auto& score : scores) {
+    if (score.second >= 3) {
+      expected.push_back(score.second);
+      expected_docs.push_back(score.first);
+    }
+  }
+  std::vector<uint64_t> docs;
+  QueryPattern thres_pattern(1, std::make_pair(field_pattern, 3.0));
+  ASSERT_TRUE(wavelet_tree.Retrieval(thres_pattern, &docs));
+  EXPECT_EQ(expected_docs, docs);
+
+  std::sort(expected.rbegin(), expected.rend());
+  expected.resize(std::min<size_t>(expected.size(), 20));
+  ASSERT_FALSE(expected.empty());
+
+  std::vector<std::pair<uint64_t, double> > results;
+  QueryPattern query_pattern(1, std::make_pair(field_pattern, 3.0));
+  ASSERT_TRUE(wavelet_tree.Retrieval(query_pattern, 20, &results));
+  ASSERT_EQ(expected.size(), results.size());
+  for (size_t i = 0; i < results.size(); ++i) {
+    EXPECT_DOUBLE_EQ(expected[i], results[i].second);
+    EXPECT_DOUBLE_EQ(scores[results[i].first], results[i].second);
+  }
+}
+
+TEST(WaveletTreeTest, NegativeWeight) {
+  uint64_t temp[10] = {0,1,2,3,4,5,6,3,3,9};
+  std::vector<uint64_t> array(temp, temp+10);
+  WaveletTree wavelet_tree;
+  wavelet_tree.Init(array);
+
+  // 带符号的和为1, 低于阈值, 但只命中词项0的文档得分为2
+  FieldPattern field_pattern;
+  field_pattern.push_back(std::make_tuple(0, 4, 2.0));
+  field_pattern.push_back(std::make_tuple(4, 8, -1.0));
+  QueryPattern thres_pattern(1, std::make_pair(field_pattern, 1.5));
+  std::vector<uint64_t> docs;
+  ASSERT_TRUE(wavelet_tree.Retrieval(thres_pattern, &docs));
+  EXPECT_EQ(std::vector<uint64_t>({0, 1, 2}), docs);
+
+  std::vector<std::pair<uint64_t, double> > results;
+  QueryPattern query_pattern(1, std::make_pair(field_pattern, 1.5));
+  ASSERT_TRUE(wavelet_tree.Retrieval(query_pattern, 10, &results));
+  ASSERT_EQ(3u, results.size());
+  for (size_t i = 0; i < results.size(); ++i) {
+    EXPECT_DOUBLE_EQ(2, results[i].second);
+  }
+
+  // 阈值高于正权重之和时没有结果
+  results.clear();
+  query_pattern = QueryPattern(1, std::make_pair(field_pattern, 2.5));
+  ASSERT_TRUE(wavelet_tree.Retrieval(query_pattern, 10, &results));
+  EXPECT_TRUE(results.empty());
+}
\ No newline at end of file
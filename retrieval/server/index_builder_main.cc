@@ -0,0 +1,51 @@
+// Copyright (c) 2014, Tencent Inc.
+// Author: Wang Qian<cernwang@tencent.com>
+
+// 离线构建检索索引, 输出的索引文件供retrieval_server直接mmap载入
+
+#include <string>
+#include <vector>
+#include "thirdparty/glog/logging.h"
+#include "thirdparty/gflags/gflags.h"
+#include "app/qzap/common/base/scoped_ptr.h"
+#include "data_storer/kv/leveldb/proto_kv.h"
+#include "retrieval/base/retrievaler.h"
+
+DEFINE_string(retrievaler, "SimilarityRetrievaler",
+              "检索器名称: SimilarityRetrievaler(小波树), PostingRetrievaler(压缩倒排链), "
+              "ShardedRetrievaler, IncrementalRetrievaler, 建索引和服务需一致");
+DEFINE_string(document_db, "../data/document", "文档leveldb路径");
+DEFINE_string(index_file, "../data/retrieval.index", "输出的索引文件");
+
+using namespace gdt;
+
+int main(int argc, char** argv) {
+  ::google::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  ProtoKV<Document, &Document::id> document_kv;
+  if (!document_kv.Open(FLAGS_document_db)) {
+    LOG(ERROR) << "Open document db failed " << FLAGS_document_db;
+    return 1;
+  }
+  std::vector<Document> documents;
+  if (!document_kv.Load(&documents)) {
+    LOG(ERROR) << "Load documents failed " << FLAGS_document_db;
+    return 1;
+  }
+  scoped_ptr<Retrievaler> retrievaler(CREATE_RETRIEVALER(FLAGS_retrievaler));
+  if (!retrievaler || !retrievaler->Init()) {
+    LOG(ERROR) << "Unknown retrievaler " << FLAGS_retrievaler;
+    return 1;
+  }
+  if (!retrievaler->Build(documents)) {
+    LOG(ERROR) << "Build index failed";
+    return 1;
+  }
+  if (!retrievaler->Save(FLAGS_index_file)) {
+    LOG(ERROR) << "Save index failed " << FLAGS_index_file;
+    return 1;
+  }
+  LOG(INFO) << "Build " << documents.size() << " documents to "
+            << FLAGS_index_file;
+  return 0;
+}
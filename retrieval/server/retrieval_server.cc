@@ -39,7 +39,17 @@
 #include "thirdparty/gflags/gflags.h" 
 #include "retrieval/proto/retrieval_service.pb.h"
 #include "retrieval/proto/retrieval_service.grpc.pb.h"
-#include "retrieval/fuzzy/wavelet/similarity_retrievaler.h"
+#include "app/qzap/common/base/scoped_ptr.h"
+#include "common/system/concurrency/thread.h"
+#include "common/system/concurrency/this_thread.h"
+#include "retrieval/base/retrievaler.h"
+
+DEFINE_string(retrievaler, "SimilarityRetrievaler",
+              "检索器名称: SimilarityRetrievaler(小波树), PostingRetrievaler(压缩倒排链), "
+              "ShardedRetrievaler, IncrementalRetrievaler, 建索引和服务需一致");
+DEFINE_string(index_file, "../data/retrieval.index", "预先构建的索引文件");
+DEFINE_int32(compact_interval_seconds, 60, "检查是否需要合并增量的间隔, 0不合并");
+DEFINE_int32(compact_min_updates, 10000, "累计多少次更新后合并增量到基础索引");
 
 using namespace gdt;
 using grpc::Server;
@@ -47,22 +57,109 @@ using grpc::ServerBuilder;
 using grpc::ServerContext;
 using grpc::Status;
 
+enum RetrievalErrorCode {
+  kRetrievalSuccess = 0,
+  kRetrievalFailed = 1,
+};
+
 // Logic and data behind the server's behavior.
 class RetrievalServiceImpl final: public ::RetrievalService::Service {
  public:
-  //
+  // 创建检索器并载入索引
   bool Init() {
-    return retrievaler->Init();
+    retrievaler_.reset(CREATE_RETRIEVALER(FLAGS_retrievaler));
+    if (!retrievaler_) {
+      LOG(ERROR) << "Unknown retrievaler " << FLAGS_retrievaler;
+      return false;
+    }
+    if (!retrievaler_->Init() || !retrievaler_->Load(FLAGS_index_file)) {
+      LOG(ERROR) << "Load index failed " << FLAGS_index_file;
+      return false;
+    }
+    update_num_ = 0;
+    if (FLAGS_compact_interval_seconds > 0) {
+      compact_thread_.reset(new Thread(
+          "compact", NewCallback(this, &RetrievalServiceImpl::CompactLoop)));
+      compact_thread_->Start();
+    }
+    return true;
   }
-  //
+  // 检索
   Status Process(ServerContext* context, const RetrievalRequest* request,
                  RetrievalResponse* response) {
-    return Status::CANCELLED;
+    std::vector<Result> results;
+    if (!retrievaler_->Retrieval(request->query(), &results)) {
+      response->set_error_code(kRetrievalFailed);
+      return Status::OK;
+    }
+    response->mutable_result()->Reserve(results.size());
+    for (auto& result : results) {
+      response->add_result()->Swap(&result);
+    }
+    response->set_error_code(kRetrievalSuccess);
+    return Status::OK;
+  }
+  // 批量检索
+  Status BatchProcess(ServerContext* context, const BatchRetrievalRequest* request,
+                      BatchRetrievalResponse* response) {
+    std::vector<Query> queries(request->query().begin(), request->query().end());
+    std::vector<std::vector<Result> > results;
+    if (!retrievaler_->RetrievalBatch(queries, &results)) {
+      response->set_error_code(kRetrievalFailed);
+      return Status::OK;
+    }
+    response->mutable_response()->Reserve(results.size());
+    for (auto& query_results : results) {
+      RetrievalResponse* query_response = response->add_response();
+      query_response->mutable_result()->Reserve(query_results.size());
+      for (auto& result : query_results) {
+        query_response->add_result()->Swap(&result);
+      }
+      query_response->set_error_code(kRetrievalSuccess);
+    }
+    response->set_error_code(kRetrievalSuccess);
+    return Status::OK;
+  }
+  // 增量更新
+  Status Update(ServerContext* context, const UpdateRequest* request,
+                UpdateResponse* response) {
+    int64_t missing_num = 0;
+    for (auto& document : request->document()) {
+      if (!retrievaler_->Update(document)) {
+        response->set_error_code(kRetrievalFailed);
+        return Status::OK;
+      }
+    }
+    for (auto document_id : request->deleted_id()) {
+      if (!retrievaler_->Delete(document_id)) {
+        ++missing_num;
+      }
+    }
+    __sync_fetch_and_add(&update_num_,
+                         request->document_size() + request->deleted_id_size());
+    response->set_missing_num(missing_num);
+    response->set_error_code(kRetrievalSuccess);
+    return Status::OK;
   }
 
  private:
-  Retrievaler* retrievaler;
+  // 定期把增量合并到基础索引, 合并期间检索和更新不受影响
+  void CompactLoop() {
+    while (true) {
+      ThisThread::Sleep(FLAGS_compact_interval_seconds * 1000LL);
+      int64_t update_num = update_num_;
+      if (update_num < FLAGS_compact_min_updates) continue;
+      if (retrievaler_->Compact()) {
+        __sync_fetch_and_sub(&update_num_, update_num);
+      }
+    }
+  }
 
+  // 检索器, 可以被多个线程同时使用
+  scoped_ptr<Retrievaler> retrievaler_;
+  // 上次合并后的更新次数
+  int64_t update_num_;
+  scoped_ptr<Thread> compact_thread_;
 };
 
 bool RunServer() {